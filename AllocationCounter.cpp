@@ -0,0 +1,75 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // Relaxed: the count only needs to be exact once the counted work has been joined
+    std::atomic<uint64_t> sAllocationCount(0);
+
+    void* allocate(size_t size)
+    {
+        sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        void* pMemory = std::malloc(size > 0 ? size : 1);
+        if (!pMemory) throw std::bad_alloc();
+        return pMemory;
+    }
+}
+
+uint64_t AllocationCounter::getCount()
+{
+    return sAllocationCount.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete(void* pMemory, const std::nothrow_t&) noexcept
+{
+    std::free(pMemory);
+}
+
+void operator delete[](void* pMemory, const std::nothrow_t&) noexcept
+{
+    std::free(pMemory);
+}
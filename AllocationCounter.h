@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts calls to the global operator new of the whole executable, Falcor included, by replacing it in AllocationCounter.cpp.
+// Allocations that bypass it (malloc, aligned new, driver heaps) aren't counted.
+namespace AllocationCounter
+{
+    // Allocations since startup, from every thread. Take the difference of two calls to count a span of work.
+    uint64_t getCount();
+}
@@ -0,0 +1,75 @@
+#include "AsyncLoader.h"
+
+AsyncLoader::SharedPtr AsyncLoader::create()
+{
+    SharedPtr pLoader = SharedPtr(new AsyncLoader());
+    pLoader->mThread = std::thread(&AsyncLoader::workerLoop, pLoader.get());
+    return pLoader;
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    // The running job completes, queued jobs and unfinished batches are dropped
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+    }
+    mWakeCondition.notify_all();
+    mThread.join();
+}
+
+void AsyncLoader::enqueue(Job job)
+{
+    mPendingJobs++;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mWakeCondition.notify_one();
+}
+
+void AsyncLoader::publish(Batch batch)
+{
+    // Counted before the job finishes, so isIdle() never sees a gap between a job and its batches
+    mPendingBatches++;
+    while (!mBatches.push(std::move(batch)))
+    {
+        if (mShutdown) return;
+        std::this_thread::yield();
+    }
+}
+
+uint32_t AsyncLoader::runBatches(double budgetMs)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    uint32_t calls = 0;
+    while (mCurrentBatch || mBatches.pop(mCurrentBatch))
+    {
+        calls++;
+        if (mCurrentBatch())
+        {
+            mCurrentBatch = nullptr;
+            mPendingBatches--;
+        }
+        if (CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) >= budgetMs) break;
+    }
+    return calls;
+}
+
+void AsyncLoader::workerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeCondition.wait(lock, [this] { return mShutdown || !mJobs.empty(); });
+            if (mShutdown) return;
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        job();
+        mPendingJobs--;
+    }
+}
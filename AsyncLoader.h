@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Falcor.h"
+#include "SpscQueue.h"
+#include <condition_variable>
+#include <deque>
+
+using namespace Falcor;
+
+// Runs loading jobs in order on a dedicated thread. Jobs do the CPU work and hand anything that needs the GPU back to the
+// render thread as batches, through a lock-free queue. The render thread runs batches between frames within a time budget,
+// so frames keep rendering while content streams in.
+class AsyncLoader
+{
+public:
+    using SharedPtr = std::shared_ptr<AsyncLoader>;
+    using Job = std::function<void()>;
+    using Batch = std::function<bool()>;    // Returns false to be called again, which spreads long GPU work over several frames
+
+    static SharedPtr create();
+    ~AsyncLoader();
+
+    // Render thread. Queues a job for the loader thread.
+    void enqueue(Job job);
+
+    // Loader thread. Hands a batch to the render thread, waits while the queue is full.
+    void publish(Batch batch);
+
+    // Render thread. Runs published batches in order until none are left or budgetMs has passed. Returns the number of batch calls.
+    uint32_t runBatches(double budgetMs);
+
+    // No job queued or running and no batch left
+    bool isIdle() const { return mPendingJobs.load() == 0 && mPendingBatches.load() == 0; }
+
+private:
+    AsyncLoader() = default;
+    void workerLoop();
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mWakeCondition;
+    std::deque<Job> mJobs;                      // Guarded by mMutex
+    std::atomic<bool> mShutdown{ false };
+
+    SpscQueue<Batch> mBatches{ 64 };
+    Batch mCurrentBatch;                        // Render thread, a batch that asked to be called again
+    std::atomic<uint32_t> mPendingJobs{ 0 };    // Queued and running
+    std::atomic<uint32_t> mPendingBatches{ 0 }; // Published and not finished
+};
@@ -0,0 +1,214 @@
+#include "BenchmarkRunner.h"
+#include "Benchmarks.h"
+
+namespace
+{
+    const char* kPhaseNames[] = { "prepare", "bind", "submit" };
+
+    // Nearest-rank percentile of sorted values
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        const size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+    double mean(const std::vector<double>& values)
+    {
+        double sum = 0;
+        for (double value : values) sum += value;
+        return values.empty() ? 0 : sum / values.size();
+    }
+
+    bool parseCount(const char* pArg, uint32_t& count)
+    {
+        char* pEnd = nullptr;
+        const unsigned long value = std::strtoul(pArg, &pEnd, 10);
+        if (pEnd == pArg || *pEnd != '\0' || value == 0) return false;
+        count = (uint32_t)value;
+        return true;
+    }
+}
+
+bool BenchmarkRunner::parseCommandLine(int argc, char** argv, Options& options)
+{
+    bool enabled = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "-benchmark")
+        {
+            enabled = true;
+        }
+        else if (arg == "-scene" && hasValue)
+        {
+            options.scenePath = argv[++i];
+        }
+        else if (arg == "-warmup" && hasValue)
+        {
+            if (!parseCount(argv[++i], options.warmupFrames)) logWarning("Invalid -warmup frame count " + std::string(argv[i]));
+        }
+        else if (arg == "-frames" && hasValue)
+        {
+            if (!parseCount(argv[++i], options.measuredFrames)) logWarning("Invalid -frames frame count " + std::string(argv[i]));
+        }
+        else if (arg == "-output" && hasValue)
+        {
+            options.outputPrefix = argv[++i];
+        }
+        else if (arg == "-capture" && hasValue)
+        {
+            options.capturePath = argv[++i];
+        }
+        else if (arg == "-replay" && hasValue)
+        {
+            options.replayPath = argv[++i];
+        }
+        else if (arg == "-repeat" && hasValue)
+        {
+            if (!parseCount(argv[++i], options.replayRepeatCount)) logWarning("Invalid -repeat count " + std::string(argv[i]));
+        }
+        else
+        {
+            logWarning("Unknown command line argument " + arg);
+        }
+    }
+    return enabled;
+}
+
+BenchmarkRunner::SharedPtr BenchmarkRunner::create(const Options& options, const std::vector<std::string>& modeNames)
+{
+    return SharedPtr(new BenchmarkRunner(options, modeNames));
+}
+
+BenchmarkRunner::BenchmarkRunner(const Options& options, const std::vector<std::string>& modeNames)
+    : mOptions(options)
+    , mModeNames(modeNames)
+    , mSamples(modeNames.size())
+{
+    for (auto& samples : mSamples)
+    {
+        samples.reserve(options.measuredFrames);
+    }
+}
+
+void BenchmarkRunner::updateCamera(Camera* pCamera, const glm::vec3& center, float radius) const
+{
+    // One full orbit over warmup + measured frames, starting at the interactive default view
+    const float t = (float)mFrameInMode / (float)(mOptions.warmupFrames + mOptions.measuredFrames);
+    const float angle = glm::radians(135.0f) + t * glm::radians(360.0f);
+    const float distance = radius * 1.13f;
+
+    pCamera->setPosition(center + glm::vec3(std::cos(angle) * distance, 0.5f * radius, std::sin(angle) * distance));
+    pCamera->setTarget(center);
+}
+
+void BenchmarkRunner::beginFrame()
+{
+    mFrameStart = CpuTimer::getCurrentTimePoint();
+}
+
+void BenchmarkRunner::endFrame(const FrameSample& sample)
+{
+    assert(!isFinished());
+
+    if (mFrameInMode >= mOptions.warmupFrames)
+    {
+        FrameSample recorded = sample;
+        recorded.cpuFrameMs = CpuTimer::calcDuration(mFrameStart, CpuTimer::getCurrentTimePoint());
+        recorded.frameIntervalMs = mHasPrevFrame ? CpuTimer::calcDuration(mPrevFrameStart, mFrameStart) : 0;
+        mSamples[mModeIndex].push_back(recorded);
+    }
+
+    mPrevFrameStart = mFrameStart;
+    mHasPrevFrame = true;
+
+    if (++mFrameInMode == mOptions.warmupFrames + mOptions.measuredFrames)
+    {
+        logInfo("Benchmarked render mode " + mModeNames[mModeIndex]);
+        mFrameInMode = 0;
+        mModeIndex++;
+    }
+}
+
+bool BenchmarkRunner::writeResults() const
+{
+    std::vector<Benchmarks::Row> summary;
+    std::vector<Benchmarks::Row> frames;
+
+    for (size_t mode = 0; mode < mModeNames.size(); ++mode)
+    {
+        const auto& samples = mSamples[mode];
+
+        std::vector<double> cpuFrameMs, frameIntervalMs, draws, drawCalls, triangles, baseTriangles, heapAllocations, submitNsPerDraw;
+        std::vector<double> phaseMs[(uint32_t)Phase::Count];
+        for (const auto& sample : samples)
+        {
+            cpuFrameMs.push_back(sample.cpuFrameMs);
+            frameIntervalMs.push_back(sample.frameIntervalMs);
+            draws.push_back(sample.draws);
+            drawCalls.push_back(sample.drawCalls);
+            triangles.push_back((double)sample.triangles);
+            baseTriangles.push_back((double)sample.baseTriangles);
+            heapAllocations.push_back((double)sample.heapAllocations);
+            submitNsPerDraw.push_back(sample.phaseMs[(uint32_t)Phase::Submit] * 1e6 / std::max(1u, sample.draws));
+            for (uint32_t phase = 0; phase < (uint32_t)Phase::Count; ++phase)
+            {
+                phaseMs[phase].push_back(sample.phaseMs[phase]);
+            }
+
+            Benchmarks::Row frame;
+            frame.name = mModeNames[mode];
+            frame.values = {
+                { "cpuFrameMs", sample.cpuFrameMs },
+                { "frameIntervalMs", sample.frameIntervalMs },
+                { "prepareMs", sample.phaseMs[(uint32_t)Phase::Prepare] },
+                { "bindMs", sample.phaseMs[(uint32_t)Phase::Bind] },
+                { "submitMs", sample.phaseMs[(uint32_t)Phase::Submit] },
+                { "draws", sample.draws },
+                { "drawCalls", sample.drawCalls },
+                { "triangles", (double)sample.triangles },
+                { "baseTriangles", (double)sample.baseTriangles },
+                { "heapAllocations", (double)sample.heapAllocations } };
+            frames.push_back(frame);
+        }
+
+        Benchmarks::Row row;
+        row.name = mModeNames[mode];
+        row.values.push_back({ "frames", (double)samples.size() });
+        row.values.push_back({ "cpuFrameMeanMs", mean(cpuFrameMs) });
+        row.values.push_back({ "frameIntervalMeanMs", mean(frameIntervalMs) });
+
+        std::sort(cpuFrameMs.begin(), cpuFrameMs.end());
+        std::sort(frameIntervalMs.begin(), frameIntervalMs.end());
+        for (double p : { 50.0, 90.0, 95.0, 99.0 })
+        {
+            const std::string suffix = "P" + std::to_string((int)p) + "Ms";
+            row.values.push_back({ "cpuFrame" + suffix, percentile(cpuFrameMs, p) });
+            row.values.push_back({ "frameInterval" + suffix, percentile(frameIntervalMs, p) });
+        }
+        row.values.push_back({ "cpuFrameMaxMs", cpuFrameMs.empty() ? 0 : cpuFrameMs.back() });
+        row.values.push_back({ "frameIntervalMaxMs", frameIntervalMs.empty() ? 0 : frameIntervalMs.back() });
+
+        for (uint32_t phase = 0; phase < (uint32_t)Phase::Count; ++phase)
+        {
+            row.values.push_back({ std::string(kPhaseNames[phase]) + "MeanMs", mean(phaseMs[phase]) });
+        }
+        row.values.push_back({ "draws", mean(draws) });
+        row.values.push_back({ "drawCalls", mean(drawCalls) });
+        row.values.push_back({ "triangles", mean(triangles) });
+        row.values.push_back({ "baseTriangles", mean(baseTriangles) });
+        row.values.push_back({ "heapAllocationsPerFrame", mean(heapAllocations) });
+        row.values.push_back({ "submitNsPerDraw", mean(submitNsPerDraw) });
+
+        logInfo(row.name + ": " + std::to_string(mean(cpuFrameMs)) + " ms CPU per frame");
+        summary.push_back(row);
+    }
+
+    const bool json = Benchmarks::writeJson(mOptions.outputPrefix + ".json", summary);
+    const bool csv = Benchmarks::writeCsv(mOptions.outputPrefix + ".csv", summary);
+    const bool frameCsv = Benchmarks::writeCsv(mOptions.outputPrefix + "Frames.csv", frames);
+    return json && csv && frameCsv;
+}
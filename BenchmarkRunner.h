@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Unattended benchmark of the render modes. Every mode renders warmup frames followed by measured frames along the
+// same scripted camera path, then the per-mode statistics are written as JSON and CSV.
+class BenchmarkRunner
+{
+public:
+    using SharedPtr = std::shared_ptr<BenchmarkRunner>;
+
+    enum class Phase : uint32_t
+    {
+        Prepare,    // Draw list updates, culling, draw packet building and sorting
+        Bind,       // Per-frame and persistent resource binding
+        Submit,     // Draw calls, including the per-draw state the render context applies with them
+        Count
+    };
+
+    struct Options
+    {
+        std::string scenePath;
+        uint32_t warmupFrames = 60;
+        uint32_t measuredFrames = 300;
+        std::string outputPrefix = "RenderModeBenchmark";
+        std::string capturePath;    // Command trace of every benchmark frame, see CommandCapture
+        std::string replayPath;     // Command trace to replay against the null backend instead of running the app
+        uint32_t replayRepeatCount = 10;
+    };
+
+    struct FrameSample
+    {
+        double cpuFrameMs = 0;      // Time spent between beginFrame() and endFrame()
+        double frameIntervalMs = 0; // Time since the previous frame began, includes present and waiting for the GPU
+        double phaseMs[(uint32_t)Phase::Count] = {};
+        uint32_t draws = 0;         // Objects drawn
+        uint32_t drawCalls = 0;     // API draw calls, a multi-draw counts once
+        uint64_t triangles = 0;     // Submitted after LOD selection, only counted by the multi-draw mode
+        uint64_t baseTriangles = 0; // The same draws at full detail
+        uint64_t heapAllocations = 0;   // Global operator new calls from every thread during the frame, see AllocationCounter
+    };
+
+    // Recognizes -benchmark [-scene <path>] [-warmup <frames>] [-frames <frames>] [-output <prefix>] [-capture <trace>], and
+    // -replay <trace> [-repeat <count>] [-output <prefix>]. The scene path can also describe a generated scene, see StressScene::kPathPrefix.
+    // Returns false if -benchmark isn't on the command line.
+    static bool parseCommandLine(int argc, char** argv, Options& options);
+
+    static SharedPtr create(const Options& options, const std::vector<std::string>& modeNames);
+
+    bool isFinished() const { return mModeIndex >= (uint32_t)mModeNames.size(); }
+    uint32_t getModeIndex() const { return mModeIndex; }
+    uint32_t getFrameInMode() const { return mFrameInMode; }
+
+    // Orbit around the scene. Depends only on the frame index within the mode, so every mode sees the same views.
+    void updateCamera(Camera* pCamera, const glm::vec3& center, float radius) const;
+
+    void beginFrame();
+
+    // Records the phase times and draw counts of the frame (frame times are filled in here) and advances to the
+    // next frame, possibly of the next mode
+    void endFrame(const FrameSample& sample);
+
+    // Writes <prefix>.json, <prefix>.csv with one row per mode, and <prefix>Frames.csv with every measured frame
+    bool writeResults() const;
+
+private:
+    BenchmarkRunner(const Options& options, const std::vector<std::string>& modeNames);
+
+    Options mOptions;
+    std::vector<std::string> mModeNames;
+    std::vector<std::vector<FrameSample>> mSamples; // Per mode
+
+    uint32_t mModeIndex = 0;
+    uint32_t mFrameInMode = 0;
+    CpuTimer::TimePoint mFrameStart;
+    CpuTimer::TimePoint mPrevFrameStart;
+    bool mHasPrevFrame = false;
+};
@@ -0,0 +1,1444 @@
+#include "Benchmarks.h"
+#include "FrustumCuller.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
+#include "Skinner.h"
+#include "RenderStats.h"
+#include "VertexQuantization.h"
+#include <cfloat>
+#include <random>
+
+namespace
+{
+    double elapsedMs(const CpuTimer::TimePoint& start)
+    {
+        return CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    }
+
+    // Repeats the measurement until it takes long enough to be stable and returns the time of one run
+    template<typename Func>
+    double measureMs(Func func, double minTotalMs = 100.0)
+    {
+        uint32_t runs = 0;
+        auto start = CpuTimer::getCurrentTimePoint();
+        double totalMs = 0;
+        do
+        {
+            func();
+            runs++;
+            totalMs = elapsedMs(start);
+        } while (totalMs < minTotalMs);
+        return totalMs / runs;
+    }
+
+    float maxAbsDifference(const glm::vec3& a, const glm::vec3& b)
+    {
+        const glm::vec3 difference = glm::abs(a - b);
+        return std::max(difference.x, std::max(difference.y, difference.z));
+    }
+
+    // Octahedral 16-bit snorm stays below 0.004 degrees, the bound leaves room for the decode's float precision
+    const double kMaxDirectionErrorDegrees = 0.01;
+
+    // In double and through atan2, acos of a float dot product can't resolve angles this small
+    double angleDegrees(const glm::vec3& a, const glm::vec3& b)
+    {
+        const double cx = (double)a.y * b.z - (double)a.z * b.y;
+        const double cy = (double)a.z * b.x - (double)a.x * b.z;
+        const double cz = (double)a.x * b.y - (double)a.y * b.x;
+        const double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+        return std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot) * 180.0 / 3.14159265358979;
+    }
+
+    // Keeps the replayed commands as flat values, to compare a replay with what was recorded
+    class ListBackend : public CommandTrace::Backend
+    {
+    public:
+        std::vector<uint64_t> values;
+
+        void beginFrame(uint32_t mode) override { values.insert(values.end(), { 0, mode }); }
+        void setGraphicsState(uint32_t stateID) override { values.insert(values.end(), { 1, stateID }); }
+        void setGraphicsVars(uint32_t varsID) override { values.insert(values.end(), { 2, varsID }); }
+        void setVao(uint32_t vaoID) override { values.insert(values.end(), { 3, vaoID }); }
+        void setMaterial(uint32_t materialID) override { values.insert(values.end(), { 4, materialID }); }
+        void pushConstants(uint32_t size, const void* pData) override
+        {
+            values.insert(values.end(), { 5, size });
+            for (uint32_t i = 0; i < size / 4; ++i) values.push_back(((const uint32_t*)pData)[i]);
+        }
+        void drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) override { values.insert(values.end(), { 6, indexCount, startIndex, (uint64_t)(int64_t)baseVertex }); }
+        void multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount) override { values.insert(values.end(), { 7, bufferID, offset, drawCount, stride, instanceCount }); }
+    };
+
+    // Issues the same commands to a CommandTrace or a backend, with the values the encoding has to get right
+    template<typename Target>
+    void issueSyntheticCommands(Target& target)
+    {
+        const uint32_t pushes[][2] = { { 0, 0 }, { 1, 7 }, { 0, UINT32_MAX }, { 1000000, 3 } };
+        target.beginFrame(0);
+        target.setVao(2);
+        target.setMaterial(300);
+        target.setGraphicsState(0);
+        target.setGraphicsVars(1);
+        for (const auto& push : pushes)
+        {
+            target.pushConstants(sizeof(push), push);
+            target.drawIndexed(36, 12, -5);
+        }
+        target.multiDrawIndexedIndirect(4, 1ull << 40, 100000, 20, 3000000);
+    }
+
+    template<typename T>
+    bool sameContents(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+}
+
+namespace Benchmarks
+{
+    bool writeCsv(const std::string& filename, const std::vector<Row>& rows)
+    {
+        std::ofstream file(filename);
+        if (!file.is_open())
+        {
+            logWarning("Can't open benchmark output file " + filename);
+            return false;
+        }
+
+        if (!rows.empty())
+        {
+            file << "name";
+            for (const auto& value : rows[0].values) file << "," << value.first;
+            file << "\n";
+        }
+
+        for (const auto& row : rows)
+        {
+            file << row.name;
+            for (const auto& value : row.values) file << "," << value.second;
+            file << "\n";
+        }
+        return true;
+    }
+
+    bool writeJson(const std::string& filename, const std::vector<Row>& rows)
+    {
+        std::ofstream file(filename);
+        if (!file.is_open())
+        {
+            logWarning("Can't open benchmark output file " + filename);
+            return false;
+        }
+
+        auto quote = [](const std::string& str)
+        {
+            std::string quoted = "\"";
+            for (char c : str)
+            {
+                if (c == '"' || c == '\\') quoted += '\\';
+                quoted += c;
+            }
+            return quoted + "\"";
+        };
+
+        file << "[\n";
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            file << "    { \"name\": " << quote(rows[i].name);
+            for (const auto& value : rows[i].values) file << ", " << quote(value.first) << ": " << value.second;
+            file << (i + 1 < rows.size() ? " },\n" : " }\n");
+        }
+        file << "]\n";
+        return true;
+    }
+
+    std::vector<Row> drawListBuild(const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, uint32_t repeatCount, uint32_t maxThreadCount, DrawConstantsLayout layout)
+    {
+        std::vector<Row> rows;
+        DrawList::SharedPtr pReference;
+        double serialMs = 0;
+
+        // Powers of two, then the full pool
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t threadCount = 1; threadCount < maxThreadCount; threadCount *= 2) threadCounts.push_back(threadCount);
+        threadCounts.push_back(maxThreadCount);
+
+        for (uint32_t threadCount : threadCounts)
+        {
+            ThreadPool::SharedPtr pPool = ThreadPool::create(threadCount);
+
+            auto start = CpuTimer::getCurrentTimePoint();
+            DrawList::SharedPtr pDrawList = DrawList::create(pScene, pProgram, repeatCount, pPool.get(), layout);
+            const double constantsMs = elapsedMs(start);
+            pDrawList->buildMultiDrawData(pPool.get());
+            const double totalMs = elapsedMs(start);
+
+            bool identical = true;
+            if (!pReference)
+            {
+                pReference = pDrawList;
+                serialMs = totalMs;
+            }
+            else
+            {
+                identical = sameContents(pDrawList->getConstants(), pReference->getConstants()) && sameContents(pDrawList->getDrawArgs(), pReference->getDrawArgs()) &&
+                    sameContents(pDrawList->getCompactConstants(), pReference->getCompactConstants()) && sameContents(pDrawList->getPrevTransforms(), pReference->getPrevTransforms());
+                if (!identical)
+                {
+                    logWarning("Draw list built with " + std::to_string(threadCount) + " threads differs from the serial build");
+                }
+            }
+
+            Row row;
+            row.name = "DrawListBuild_" + std::to_string(threadCount) + "T";
+            row.values = {
+                { "threads", threadCount },
+                { "draws", pDrawList->getDrawCount() },
+                { "constantsBytes", (double)pDrawList->getGpuConstantsSize() },
+                { "geometryBytes", (double)(pDrawList->getGeometryPool()->getVertexDataSize() + pDrawList->getGeometryPool()->getIndexDataSize()) },
+                { "constantsMs", constantsMs },
+                { "totalMs", totalMs },
+                { "speedup", serialMs / totalMs },
+                { "identical", identical ? 1.0 : 0.0 } };
+            logInfo(row.name + ": " + std::to_string(totalMs) + " ms for " + std::to_string(pDrawList->getDrawCount()) + " draws");
+            rows.push_back(row);
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> geometryOptimization(const std::vector<Mesh::SharedPtr>& meshes, uint32_t maxThreadCount)
+    {
+        const std::vector<std::pair<std::string, GeometryPool::Flags>> configs = {
+            { "None", GeometryPool::Flags::None },
+            { "VertexCache", GeometryPool::Flags::OptimizeVertexCache },
+            { "VertexCacheShortIndices", GeometryPool::Flags::OptimizeVertexCache | GeometryPool::Flags::ShortIndices },
+            { "VertexCacheShortIndicesLods", GeometryPool::Flags::OptimizeVertexCache | GeometryPool::Flags::ShortIndices | GeometryPool::Flags::GenerateLods } };
+
+        ThreadPool::SharedPtr pPool = ThreadPool::create(maxThreadCount);
+
+        std::vector<Row> rows;
+        for (const auto& config : configs)
+        {
+            auto start = CpuTimer::getCurrentTimePoint();
+            GeometryPool::SharedPtr pGeometry = GeometryPool::create(meshes, nullptr, config.second);
+            const double serialMs = elapsedMs(start);
+
+            start = CpuTimer::getCurrentTimePoint();
+            GeometryPool::SharedPtr pParallelGeometry = GeometryPool::create(meshes, pPool.get(), config.second);
+            const double parallelMs = elapsedMs(start);
+
+            GeometryPool::SharedPtr pRepeatGeometry = GeometryPool::create(meshes, nullptr, config.second);
+            const bool reproducible = pGeometry->getContentHash() == pRepeatGeometry->getContentHash() && pGeometry->getContentHash() == pParallelGeometry->getContentHash();
+            if (!reproducible)
+            {
+                logWarning("Geometry pool build with " + config.first + " isn't reproducible");
+            }
+
+            const GeometryPool::OptimizeStats& stats = pGeometry->getOptimizeStats();
+
+            Row row;
+            row.name = "GeometryPool_" + config.first;
+            row.values = {
+                { "meshes", (double)meshes.size() },
+                { "acmrBefore", stats.before.getACMR() },
+                { "acmrAfter", stats.after.getACMR() },
+                { "atvrBefore", stats.before.getATVR() },
+                { "atvrAfter", stats.after.getATVR() },
+                { "vertexBytes", (double)pGeometry->getVertexDataSize() },
+                { "indexBytes", (double)pGeometry->getIndexDataSize() },
+                { "shortIndices", pGeometry->getIndexFormat() == ResourceFormat::R16Uint ? 1.0 : 0.0 },
+                { "serialMs", serialMs },
+                { "parallelMs", parallelMs },
+                { "reproducible", reproducible ? 1.0 : 0.0 } };
+
+            // Triangles of each detail level relative to full detail, 1 without LODs
+            const GeometryPool::LodStats& lodStats = pGeometry->getLodStats();
+            for (uint32_t level = 1; level < GeometryPool::kMaxLods; ++level)
+            {
+                const std::string prefix = "lod" + std::to_string(level);
+                row.values.push_back({ prefix + "Meshes", lodStats.levels[level] });
+                row.values.push_back({ prefix + "TriangleRatio", lodStats.indices[0] ? (double)lodStats.indices[level] / lodStats.indices[0] : 1.0 });
+            }
+            logInfo(row.name + ": ACMR " + std::to_string(stats.before.getACMR()) + " -> " + std::to_string(stats.after.getACMR()));
+            rows.push_back(row);
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> vertexQuantization(const std::vector<Mesh::SharedPtr>& meshes)
+    {
+        const GeometryPool::Flags flags = GeometryPool::Flags::OptimizeVertexCache | GeometryPool::Flags::KeepCpuData;
+        auto start = CpuTimer::getCurrentTimePoint();
+        GeometryPool::SharedPtr pFullPool = GeometryPool::create(meshes, nullptr, flags);
+        const double fullMs = elapsedMs(start);
+
+        start = CpuTimer::getCurrentTimePoint();
+        GeometryPool::SharedPtr pQuantizedPool = GeometryPool::create(meshes, nullptr, flags | GeometryPool::Flags::QuantizeVertices);
+        const double quantizedMs = elapsedMs(start);
+
+        if (!pQuantizedPool->isQuantized())
+        {
+            logWarning("Vertex quantization benchmark skipped, the geometry pool keeps fp32 vertices for these meshes");
+            return {};
+        }
+
+        // Quantization happens after the vertices are reordered, so vertex v is the same vertex in both pools
+        const uint32_t vertexCount = pFullPool->getVertexCount();
+        std::vector<uint32_t> vertexMeshes(vertexCount);
+        for (uint32_t m = 0; m < pQuantizedPool->getMeshCount(); ++m)
+        {
+            const GeometryPool::MeshRange& range = pQuantizedPool->getMeshRange(m);
+            std::fill(vertexMeshes.begin() + range.baseVertex, vertexMeshes.begin() + range.baseVertex + range.vertexCount, m);
+        }
+
+        const auto& fullLayout = pFullPool->getVao()->getVertexLayout();
+        const auto& quantizedLayout = pQuantizedPool->getVao()->getVertexLayout();
+        const auto& fullStreams = pFullPool->getCpuVertexStreams();
+        const auto& quantizedStreams = pQuantizedPool->getCpuVertexStreams();
+
+        std::vector<Row> rows;
+        double worstRatio = 0;
+        for (uint32_t i = 0; i < (uint32_t)fullStreams.size(); ++i)
+        {
+            const auto& fullBuffer = fullLayout->getBufferLayout(i);
+            const auto& quantizedBuffer = quantizedLayout->getBufferLayout(i);
+            for (uint32_t element = 0; element < quantizedBuffer->getElementCount(); ++element)
+            {
+                const ResourceFormat format = quantizedBuffer->getElementFormat(element);
+                const uint32_t fullSize = getFormatBytesPerBlock(fullBuffer->getElementFormat(element)) * fullBuffer->getElementArraySize(element);
+
+                // Each sample's error is relative to its own bound, the row reports the largest bound of the element
+                double maxError = 0, maxBound = 0, maxRatio = 0;
+                auto addSample = [&](double error, double bound)
+                {
+                    maxError = std::max(maxError, error);
+                    maxBound = std::max(maxBound, bound);
+                    maxRatio = std::max(maxRatio, bound > 0 ? error / bound : (error > 0 ? DBL_MAX : 0.0));
+                };
+
+                for (uint32_t v = 0; v < vertexCount; ++v)
+                {
+                    const uint8_t* pFull = fullStreams[i].data() + (size_t)v * fullBuffer->getStride() + fullBuffer->getElementOffset(element);
+                    const uint8_t* pQuantized = quantizedStreams[i].data() + (size_t)v * quantizedBuffer->getStride() + quantizedBuffer->getElementOffset(element);
+                    float full[3];
+                    memcpy(full, pFull, std::min(fullSize, (uint32_t)sizeof(full)));
+
+                    if (format == ResourceFormat::RGBA16Unorm)
+                    {
+                        // Half a unorm step of the mesh's bounds, plus the rounding of the float multiply-add
+                        const GeometryPool::MeshRange& range = pQuantizedPool->getMeshRange(vertexMeshes[v]);
+                        uint16_t encoded[4];
+                        memcpy(encoded, pQuantized, sizeof(encoded));
+                        const glm::vec3 decoded = VertexQuantization::decodePosition(encoded, range.positionScale, range.positionOffset);
+                        for (int axis = 0; axis < 3; ++axis)
+                        {
+                            const double slack = 4.0 * FLT_EPSILON * (std::abs(range.positionOffset[axis]) + range.positionScale[axis]);
+                            addSample(std::abs(decoded[axis] - full[axis]), 0.5 * range.positionScale[axis] / 65535.0 + slack);
+                        }
+                    }
+                    else if (format == ResourceFormat::RG16Snorm)
+                    {
+                        const glm::vec3 direction(full[0], full[1], full[2]);
+                        if (glm::dot(direction, direction) == 0) continue;
+                        int16_t encoded[2];
+                        memcpy(encoded, pQuantized, sizeof(encoded));
+                        addSample(angleDegrees(glm::normalize(direction), VertexQuantization::decodeOctahedral(encoded)), kMaxDirectionErrorDegrees);
+                    }
+                    else if (format == ResourceFormat::RG16Float)
+                    {
+                        // Half a half-float ulp, values past the half range fail
+                        uint16_t encoded[2];
+                        memcpy(encoded, pQuantized, sizeof(encoded));
+                        for (int c = 0; c < 2; ++c)
+                        {
+                            addSample(std::abs((double)VertexQuantization::decodeHalf(encoded[c]) - full[c]), std::max(std::abs(full[c]) * std::ldexp(1.0, -11), std::ldexp(1.0, -25)));
+                        }
+                    }
+                    else
+                    {
+                        addSample(memcmp(pFull, pQuantized, fullSize) == 0 ? 0.0 : 1.0, 0.0);
+                    }
+                }
+
+                const uint32_t quantizedSize = getFormatBytesPerBlock(format) * quantizedBuffer->getElementArraySize(element);
+                worstRatio = std::max(worstRatio, maxRatio);
+
+                Row row;
+                row.name = "VertexQuantization_" + quantizedBuffer->getElementName(element);
+                row.values = {
+                    { "vertices", (double)vertexCount },
+                    { "bytesPerVertexFp32", (double)fullSize },
+                    { "bytesPerVertexQuantized", (double)quantizedSize },
+                    { "bytesPerVertexSaved", (double)fullSize - quantizedSize },
+                    { "maxError", maxError },
+                    { "errorBound", maxBound },
+                    { "maxErrorRatio", maxRatio },
+                    { "withinBound", maxRatio <= 1.0 ? 1.0 : 0.0 },
+                    { "buildMs", 0.0 } };
+                if (maxRatio > 1.0)
+                {
+                    logWarning(row.name + " error " + std::to_string(maxError) + " exceeds its bound");
+                }
+                rows.push_back(row);
+            }
+        }
+
+        const double fullBytes = (double)pFullPool->getVertexDataSize() / std::max(1u, vertexCount);
+        const double quantizedBytes = (double)pQuantizedPool->getVertexDataSize() / std::max(1u, vertexCount);
+
+        Row total;
+        total.name = "VertexQuantization_Total";
+        total.values = {
+            { "vertices", (double)vertexCount },
+            { "bytesPerVertexFp32", fullBytes },
+            { "bytesPerVertexQuantized", quantizedBytes },
+            { "bytesPerVertexSaved", fullBytes - quantizedBytes },
+            { "maxError", 0.0 },
+            { "errorBound", 0.0 },
+            { "maxErrorRatio", worstRatio },
+            { "withinBound", worstRatio <= 1.0 ? 1.0 : 0.0 },
+            { "buildMs", quantizedMs - fullMs } };
+        logInfo(total.name + ": " + std::to_string(fullBytes) + " -> " + std::to_string(quantizedBytes) + " bytes/vertex, worst error " + std::to_string(worstRatio) + " of the bound");
+        rows.push_back(total);
+        return rows;
+    }
+
+    std::vector<Row> drawConstantsLayout(uint32_t drawCount)
+    {
+        std::mt19937 rng(drawCount);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+        std::uniform_real_distribution<float> scale(0.1f, 10.0f);
+
+        std::vector<DrawConstants> constants(drawCount);
+        for (uint32_t i = 0; i < drawCount; ++i)
+        {
+            glm::mat4 worldMat = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng), position(rng)));
+            worldMat = glm::rotate(worldMat, angle(rng), glm::normalize(glm::vec3(position(rng), position(rng), position(rng))));
+            worldMat = glm::scale(worldMat, glm::vec3(scale(rng), scale(rng), scale(rng)));
+
+            DrawConstants& drawConstants = constants[i];
+            drawConstants.worldMat = worldMat;
+            drawConstants.prevWorldMat = worldMat;
+            drawConstants.worldInvTransposeMat = transpose(inverse(glm::mat3(worldMat)));
+            drawConstants.drawID = i;
+            drawConstants.meshID = i;
+            drawConstants.materialID = 0;
+            drawConstants.geometryID = 0;
+        }
+
+        // Emulate the shader and compare against the stored inverse transpose, relative to the largest element
+        std::vector<CompactDrawConstants> packed(drawCount);
+        const double packMs = measureMs([&]
+        {
+            for (uint32_t i = 0; i < drawCount; ++i) packed[i] = CompactDrawConstants::fromFull(constants[i], CompactDrawConstants::kInvalidIndex);
+        });
+
+        float maxNormalError = 0;
+        bool exactWorld = true;
+        for (uint32_t i = 0; i < drawCount; ++i)
+        {
+            const AffineTransform& world = packed[i].world;
+            exactWorld = exactWorld && world.toMat4() == constants[i].worldMat;
+
+            const glm::vec3 a0(world.rows[0]), a1(world.rows[1]), a2(world.rows[2]);
+            const glm::vec3 cofactors[3] = { glm::cross(a1, a2), glm::cross(a2, a0), glm::cross(a0, a1) };
+            const float invDet = 1.0f / glm::dot(a0, cofactors[0]);
+
+            const glm::mat3x4& reference = constants[i].worldInvTransposeMat;
+            float maxElement = 0, maxError = 0;
+            for (int row = 0; row < 3; ++row)
+            {
+                for (int column = 0; column < 3; ++column)
+                {
+                    maxElement = std::max(maxElement, std::abs(reference[column][row]));
+                    maxError = std::max(maxError, std::abs(reference[column][row] - cofactors[row][column] * invDet));
+                }
+            }
+            maxNormalError = std::max(maxNormalError, maxError / maxElement);
+        }
+        if (!exactWorld) logWarning("Compact draw constants don't reproduce the world matrices exactly");
+
+        std::vector<Row> rows;
+        for (double movingFraction : { 0.0, 0.01, 0.1, 1.0 })
+        {
+            const double movingDraws = std::floor(drawCount * movingFraction);
+            const double fullBytes = (double)drawCount * sizeof(DrawConstants);
+            const double fullUploadBytes = movingDraws * sizeof(DrawConstants);
+
+            // Compact: moving draws additionally own a previous transform slot, which is uploaded along with their constants
+            const double compactBytes = drawCount * sizeof(CompactDrawConstants) + movingDraws * sizeof(AffineTransform);
+            const double compactUploadBytes = movingDraws * (sizeof(CompactDrawConstants) + sizeof(AffineTransform));
+
+            const std::string suffix = "_" + std::to_string((int)(movingFraction * 100)) + "PctMoving";
+            for (bool compact : { false, true })
+            {
+                Row row;
+                row.name = (compact ? "DrawConstantsCompact" : "DrawConstantsFull") + suffix;
+                row.values = {
+                    { "draws", drawCount },
+                    { "movingDraws", movingDraws },
+                    { "bytesPerDraw", (compact ? compactBytes : fullBytes) / drawCount },
+                    { "gpuMB", (compact ? compactBytes : fullBytes) / (1024.0 * 1024.0) },
+                    { "frameUploadMB", (compact ? compactUploadBytes : fullUploadBytes) / (1024.0 * 1024.0) },
+                    { "savedGpuMB", compact ? (fullBytes - compactBytes) / (1024.0 * 1024.0) : 0.0 },
+                    { "savedFrameUploadMB", compact ? (fullUploadBytes - compactUploadBytes) / (1024.0 * 1024.0) : 0.0 },
+                    { "packNsPerDraw", compact ? packMs * 1e6 / drawCount : 0.0 },
+                    { "maxRelativeNormalError", compact ? maxNormalError : 0.0 },
+                    { "exactWorld", (compact ? exactWorld : true) ? 1.0 : 0.0 } };
+                logInfo(row.name + ": " + std::to_string((compact ? compactBytes : fullBytes) / drawCount) + " bytes/draw");
+                rows.push_back(row);
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> frustumCulling(const std::vector<uint32_t>& drawCounts)
+    {
+        const glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+        const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+        const Frustum frustum = Frustum::fromViewProj(proj * view);
+
+        std::vector<Row> rows;
+        for (uint32_t drawCount : drawCounts)
+        {
+            // Boxes scattered around the camera, so roughly a sixth of them survive
+            std::mt19937 rng(drawCount);
+            std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+            std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+            FrustumCuller::SharedPtr pCuller = FrustumCuller::create();
+            pCuller->resize(drawCount);
+            for (uint32_t i = 0; i < drawCount; ++i)
+            {
+                BoundingBox box;
+                box.center = glm::vec3(position(rng), position(rng), position(rng));
+                box.extent = glm::vec3(size(rng), size(rng), size(rng));
+                pCuller->setBounds(i, box);
+            }
+
+            std::vector<uint32_t> reference(drawCount);
+            const uint32_t referenceCount = pCuller->cull(frustum, reference.data(), FrustumCuller::Kernel::Scalar);
+
+            for (auto kernel : { FrustumCuller::Kernel::Scalar, FrustumCuller::Kernel::SSE, FrustumCuller::Kernel::AVX })
+            {
+                if (!FrustumCuller::isKernelSupported(kernel)) continue;
+
+                std::vector<uint32_t> visible(drawCount);
+                uint32_t visibleCount = 0;
+                const double ms = measureMs([&] { visibleCount = pCuller->cull(frustum, visible.data(), kernel); });
+
+                const bool matches = visibleCount == referenceCount && std::equal(reference.begin(), reference.begin() + referenceCount, visible.begin());
+                if (!matches)
+                {
+                    logWarning(std::string("Frustum culling kernel ") + FrustumCuller::getKernelName(kernel) + " differs from the scalar reference");
+                }
+
+                Row row;
+                row.name = std::string("FrustumCull_") + FrustumCuller::getKernelName(kernel) + "_" + std::to_string(drawCount);
+                row.values = {
+                    { "draws", drawCount },
+                    { "visible", visibleCount },
+                    { "nsPerDraw", ms * 1e6 / drawCount },
+                    { "matchesScalar", matches ? 1.0 : 0.0 } };
+                logInfo(row.name + ": " + std::to_string(ms * 1e6 / drawCount) + " ns/draw");
+                rows.push_back(row);
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> instanceBvh(const std::vector<uint32_t>& drawCounts)
+    {
+        const glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+        const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+        const Frustum frustum = Frustum::fromViewProj(proj * view);
+        const glm::vec3 sphereCenter(0.0f, 0.0f, -100.0f);
+        const float sphereRadius = 100.0f;
+
+        std::vector<Row> rows;
+        for (uint32_t drawCount : drawCounts)
+        {
+            // The same scattered boxes as the frustum culling benchmark
+            std::mt19937 rng(drawCount);
+            std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+            std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+            std::vector<BoundingBox> bounds(drawCount);
+            FrustumCuller::SharedPtr pCuller = FrustumCuller::create();
+            pCuller->resize(drawCount);
+            for (uint32_t i = 0; i < drawCount; ++i)
+            {
+                bounds[i].center = glm::vec3(position(rng), position(rng), position(rng));
+                bounds[i].extent = glm::vec3(size(rng), size(rng), size(rng));
+                pCuller->setBounds(i, bounds[i]);
+            }
+
+            InstanceBvh::SharedPtr pBvh = InstanceBvh::create();
+            pBvh->build(bounds);
+
+            // Flat loops, with the fastest culling kernel for the frustum
+            std::vector<uint32_t> flatFrustum(drawCount), flatSphere(drawCount);
+            uint32_t flatFrustumCount = 0, flatSphereCount = 0;
+            const double flatFrustumMs = measureMs([&] { flatFrustumCount = pCuller->cull(frustum, flatFrustum.data()); });
+            const double flatSphereMs = measureMs([&]
+            {
+                flatSphereCount = 0;
+                for (uint32_t i = 0; i < drawCount; ++i)
+                {
+                    if (InstanceBvh::intersectsSphere(bounds[i].center, bounds[i].extent, sphereCenter, sphereRadius)) flatSphere[flatSphereCount++] = i;
+                }
+            });
+
+            std::vector<uint32_t> bvhFrustum(drawCount), bvhSphere(drawCount);
+            uint32_t bvhFrustumCount = 0, bvhSphereCount = 0;
+            const double bvhFrustumMs = measureMs([&] { bvhFrustumCount = pBvh->queryFrustum(frustum, bvhFrustum.data()); });
+            const double bvhSphereMs = measureMs([&] { bvhSphereCount = pBvh->querySphere(sphereCenter, sphereRadius, bvhSphere.data()); });
+
+            // A tenth of the draws move each frame: the flat loop only stores their bounds, the hierarchy also refits
+            std::vector<BoundingBox> moved;
+            for (uint32_t i = 0; i < drawCount; i += 10)
+            {
+                BoundingBox box = bounds[i];
+                box.center += glm::vec3(1.0f, 0.0f, -1.0f);
+                moved.push_back(box);
+            }
+            const double flatUpdateMs = measureMs([&]
+            {
+                for (uint32_t i = 0; i < (uint32_t)moved.size(); ++i) pCuller->setBounds(i * 10, moved[i]);
+            });
+            const double bvhUpdateMs = measureMs([&]
+            {
+                for (uint32_t i = 0; i < (uint32_t)moved.size(); ++i) pBvh->setBounds(i * 10, moved[i]);
+                pBvh->refit();
+            });
+
+            // After the move both see the same boxes again
+            flatFrustumCount = pCuller->cull(frustum, flatFrustum.data());
+            bvhFrustumCount = pBvh->queryFrustum(frustum, bvhFrustum.data());
+            std::sort(bvhFrustum.begin(), bvhFrustum.begin() + bvhFrustumCount);
+            std::sort(bvhSphere.begin(), bvhSphere.begin() + bvhSphereCount);
+            const bool matches = flatFrustumCount == bvhFrustumCount && std::equal(flatFrustum.begin(), flatFrustum.begin() + flatFrustumCount, bvhFrustum.begin()) &&
+                flatSphereCount == bvhSphereCount && std::equal(flatSphere.begin(), flatSphere.begin() + flatSphereCount, bvhSphere.begin());
+            if (!matches)
+            {
+                logWarning("Instance BVH queries differ from the flat loops with " + std::to_string(drawCount) + " draws");
+            }
+
+            const InstanceBvh::Stats& stats = pBvh->getStats();
+            Row row;
+            row.name = "InstanceBvh_" + std::to_string(drawCount);
+            row.values = {
+                { "draws", drawCount },
+                { "nodes", stats.nodes },
+                { "depth", stats.depth },
+                { "buildMs", stats.buildMs },
+                { "frustumVisible", flatFrustumCount },
+                { "flatFrustumMs", flatFrustumMs },
+                { "bvhFrustumMs", bvhFrustumMs },
+                { "sphereVisible", flatSphereCount },
+                { "flatSphereMs", flatSphereMs },
+                { "bvhSphereMs", bvhSphereMs },
+                { "flatUpdateMs", flatUpdateMs },
+                { "bvhUpdateMs", bvhUpdateMs },
+                { "matchesFlat", matches ? 1.0 : 0.0 } };
+            logInfo(row.name + ": frustum " + std::to_string(flatFrustumMs) + " -> " + std::to_string(bvhFrustumMs) + " ms, refit " + std::to_string(bvhUpdateMs) + " ms");
+            rows.push_back(row);
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> occlusionCulling(uint32_t boxCount, uint32_t maxThreadCount)
+    {
+        const glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+        const float aspect = 16.0f / 9.0f;
+        const float tanHalfFov = std::tan(glm::radians(30.0f));
+        const glm::mat4 viewProj = glm::perspective(glm::radians(60.0f), aspect, 0.1f, 500.0f) * view;
+
+        // Unit wall in the xy plane split into 8x8 quads, so that it has interior edges like a real mesh
+        const uint32_t kWallCells = 8;
+        std::vector<glm::vec3> wallPositions;
+        std::vector<uint32_t> wallIndices;
+        for (uint32_t y = 0; y <= kWallCells; ++y)
+        {
+            for (uint32_t x = 0; x <= kWallCells; ++x) wallPositions.push_back(glm::vec3(2.0f * x / kWallCells - 1.0f, 2.0f * y / kWallCells - 1.0f, 0.0f));
+        }
+        for (uint32_t y = 0; y < kWallCells; ++y)
+        {
+            for (uint32_t x = 0; x < kWallCells; ++x)
+            {
+                const uint32_t corner = y * (kWallCells + 1) + x;
+                wallIndices.insert(wallIndices.end(), { corner, corner + 1, corner + kWallCells + 2, corner, corner + kWallCells + 2, corner + kWallCells + 1 });
+            }
+        }
+
+        OcclusionCuller::SharedPtr pCuller = OcclusionCuller::create();
+        const uint32_t wallMesh = pCuller->addMesh(wallPositions, wallIndices);
+        auto wallTransform = [](const glm::vec3& center, float halfSize) { return glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(halfSize)); };
+
+        std::vector<OcclusionCuller::Kernel> kernels;
+        for (auto kernel : { OcclusionCuller::Kernel::Scalar, OcclusionCuller::Kernel::AVX2 })
+        {
+            if (OcclusionCuller::isKernelSupported(kernel)) kernels.push_back(kernel);
+        }
+
+        // Known cases behind a 20x20 wall 20 units away: covered and farther, nearer, peeking past the edge, and intersecting the wall
+        struct KnownCase
+        {
+            BoundingBox box;
+            bool visible;
+        };
+        const KnownCase knownCases[] = {
+            { { glm::vec3(0, 0, -40), glm::vec3(1) }, false },
+            { { glm::vec3(0, 0, -10), glm::vec3(1) }, true },
+            { { glm::vec3(21, 0, -40), glm::vec3(2) }, true },
+            { { glm::vec3(0, 0, -20), glm::vec3(1) }, true } };
+
+        pCuller->beginFrame(viewProj);
+        pCuller->addOccluder(wallMesh, wallTransform(glm::vec3(0, 0, -20), 10.0f));
+        pCuller->rasterize();
+        uint32_t passed = 0;
+        for (const auto& knownCase : knownCases)
+        {
+            bool correct = true;
+            for (auto kernel : kernels) correct = correct && pCuller->testBox(knownCase.box, kernel) == knownCase.visible;
+            if (correct) passed++;
+        }
+        if (passed != arraysize(knownCases)) logWarning("Occlusion culling got " + std::to_string(arraysize(knownCases) - passed) + " known cases wrong");
+
+        std::vector<Row> rows;
+        Row knownRow;
+        knownRow.name = "OcclusionCull_KnownCases";
+        knownRow.values = { { "cases", (double)arraysize(knownCases) }, { "passed", passed } };
+        rows.push_back(knownRow);
+
+        // Boxes spread through the view between 25 and 300 units, bounds stored like the draw list's
+        std::mt19937 rng(boxCount);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> depth(25.0f, 300.0f);
+        std::uniform_real_distribution<float> size(0.5f, 3.0f);
+        FrustumCuller::SharedPtr pBounds = FrustumCuller::create();
+        pBounds->resize(boxCount);
+        std::vector<uint32_t> allBoxes(boxCount);
+        for (uint32_t i = 0; i < boxCount; ++i)
+        {
+            const float distance = depth(rng);
+            BoundingBox box;
+            box.center = glm::vec3(unit(rng) * distance * tanHalfFov * aspect, unit(rng) * distance * tanHalfFov, -distance);
+            box.extent = glm::vec3(size(rng), size(rng), size(rng));
+            pBounds->setBounds(i, box);
+            allBoxes[i] = i;
+        }
+
+        std::vector<uint32_t> threadCounts = { 1 };
+        if (maxThreadCount > 1) threadCounts.push_back(maxThreadCount);
+
+        for (uint32_t occluderCount : { 4u, 16u, 64u })
+        {
+            // Walls between 15 and 60 units, large enough that more of them hide most of the boxes
+            std::vector<glm::mat4> walls;
+            std::uniform_real_distribution<float> wallDepth(15.0f, 60.0f);
+            std::uniform_real_distribution<float> wallSize(3.0f, 10.0f);
+            for (uint32_t i = 0; i < occluderCount; ++i)
+            {
+                const float distance = wallDepth(rng);
+                const glm::vec3 center(unit(rng) * distance * tanHalfFov * aspect, unit(rng) * distance * tanHalfFov, -distance);
+                walls.push_back(wallTransform(center, wallSize(rng)));
+            }
+
+            std::vector<float> referenceDepth;
+            std::vector<uint32_t> referenceVisible;
+            for (uint32_t threadCount : threadCounts)
+            {
+                ThreadPool::SharedPtr pPool = ThreadPool::create(threadCount);
+                for (auto kernel : kernels)
+                {
+                    const double rasterMs = measureMs([&]
+                    {
+                        pCuller->beginFrame(viewProj);
+                        for (const auto& wall : walls) pCuller->addOccluder(wallMesh, wall);
+                        pCuller->rasterize(pPool.get(), kernel);
+                    });
+                    const OcclusionCuller::Stats stats = pCuller->getStats();
+
+                    std::vector<uint32_t> visible;
+                    uint32_t visibleCount = 0;
+                    const double testMs = measureMs([&]
+                    {
+                        visible = allBoxes;
+                        visibleCount = pCuller->cull(*pBounds, visible.data(), boxCount, pPool.get(), kernel);
+                    });
+                    visible.resize(visibleCount);
+
+                    // The first run, scalar on one thread, is the reference
+                    if (referenceDepth.empty())
+                    {
+                        referenceDepth = pCuller->getDepth();
+                        referenceVisible = visible;
+                    }
+                    const bool matches = sameContents(referenceDepth, pCuller->getDepth()) && visible == referenceVisible;
+                    if (!matches)
+                    {
+                        logWarning(std::string("Occlusion culling with ") + OcclusionCuller::getKernelName(kernel) + " on " + std::to_string(threadCount) + " threads differs from the scalar reference");
+                    }
+
+                    const uint32_t occluded = boxCount - visibleCount;
+                    Row row;
+                    row.name = std::string("OcclusionCull_") + OcclusionCuller::getKernelName(kernel) + "_" + std::to_string(occluderCount) + "Occluders_" + std::to_string(threadCount) + "T";
+                    row.values = {
+                        { "occluders", occluderCount },
+                        { "occluderTriangles", stats.occluderTriangles },
+                        { "binnedTriangles", stats.binnedTriangles },
+                        { "threads", threadCount },
+                        { "boxes", boxCount },
+                        { "occluded", occluded },
+                        { "occludedRatio", (double)occluded / boxCount },
+                        { "rasterMs", rasterMs },
+                        { "testMs", testMs },
+                        { "nsPerBox", testMs * 1e6 / boxCount },
+                        { "matchesScalar", matches ? 1.0 : 0.0 } };
+                    logInfo(row.name + ": " + std::to_string(100.0 * occluded / boxCount) + "% occluded, raster " + std::to_string(rasterMs) + " ms, test " + std::to_string(testMs * 1e6 / boxCount) + " ns/box");
+                    rows.push_back(row);
+                }
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> lightClustering(const std::vector<uint32_t>& lightCounts, uint32_t maxThreadCount)
+    {
+        const float aspect = 16.0f / 9.0f;
+        const float tanHalfFov = std::tan(glm::radians(30.0f));
+        LightClusters::View view;
+        view.viewMat = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+        view.projMat = glm::perspective(glm::radians(60.0f), aspect, 0.1f, 500.0f);
+        view.nearZ = 0.1f;
+        view.farZ = 500.0f;
+
+        std::vector<LightClusters::Kernel> kernels;
+        for (auto kernel : { LightClusters::Kernel::Scalar, LightClusters::Kernel::AVX })
+        {
+            if (LightClusters::isKernelSupported(kernel)) kernels.push_back(kernel);
+        }
+
+        LightClusters::SharedPtr pClusters = LightClusters::create();
+        auto clusterHasLight = [&](uint32_t cluster, uint32_t light)
+        {
+            const LightClusters::ClusterRange& range = pClusters->getClusterRanges()[cluster];
+            const auto& indices = pClusters->getLightIndices();
+            return std::find(indices.begin() + range.offset, indices.begin() + range.offset + range.count, light) != indices.begin() + range.offset + range.count;
+        };
+
+        // Known cases: a small light 50 units ahead, one around the camera, one behind it and one past the far plane
+        const std::vector<LightClusters::Light> knownLights = {
+            { glm::vec3(0, 0, -50), 1.0f },
+            { glm::vec3(0, 0, 0), 5.0f },
+            { glm::vec3(0, 0, 20), 5.0f },
+            { glm::vec3(0, 0, -600), 10.0f } };
+        uint32_t passed = 0;
+        for (auto kernel : kernels)
+        {
+            pClusters->build(view, knownLights, nullptr, kernel);
+            bool farLightsListed = false;
+            for (uint32_t cluster = 0; cluster < LightClusters::kClusterCount; ++cluster)
+            {
+                farLightsListed = farLightsListed || clusterHasLight(cluster, 2) || clusterHasLight(cluster, 3);
+            }
+            if (clusterHasLight(pClusters->findCluster(glm::vec3(0, 0, -50)), 0)) passed++;
+            if (!clusterHasLight(pClusters->findCluster(glm::vec3(0, 0, -60)), 0)) passed++;
+            if (clusterHasLight(pClusters->findCluster(glm::vec3(0, 0, -1)), 1) && clusterHasLight(pClusters->findCluster(glm::vec3(0.05f, 0.02f, -0.2f)), 1)) passed++;
+            if (!farLightsListed) passed++;
+        }
+        const uint32_t knownCaseCount = 4 * (uint32_t)kernels.size();
+        if (passed != knownCaseCount) logWarning("Light clustering got " + std::to_string(knownCaseCount - passed) + " known cases wrong");
+
+        std::vector<Row> rows;
+        Row knownRow;
+        knownRow.name = "LightClusters_KnownCases";
+        knownRow.values = { { "cases", knownCaseCount }, { "passed", passed } };
+        rows.push_back(knownRow);
+
+        std::vector<uint32_t> threadCounts = { 1 };
+        if (maxThreadCount > 1) threadCounts.push_back(maxThreadCount);
+
+        for (uint32_t lightCount : lightCounts)
+        {
+            // Lights spread a little past the view in every direction, so some are culled, some straddle the near plane
+            std::mt19937 rng(lightCount);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            std::uniform_real_distribution<float> depth(-10.0f, 400.0f);
+            std::uniform_real_distribution<float> radius(1.0f, 20.0f);
+            std::vector<LightClusters::Light> lights(lightCount);
+            for (auto& light : lights)
+            {
+                const float distance = depth(rng);
+                const float spread = 1.2f * std::max(std::abs(distance), 1.0f);
+                light.position = glm::vec3(unit(rng) * spread * tanHalfFov * aspect, unit(rng) * spread * tanHalfFov, -distance);
+                light.radius = radius(rng);
+            }
+
+            std::vector<LightClusters::ClusterRange> referenceRanges;
+            std::vector<uint32_t> referenceIndices;
+            uint32_t falseAssignments = 0;
+            uint32_t missedLights = 0;
+            for (uint32_t threadCount : threadCounts)
+            {
+                ThreadPool::SharedPtr pPool = ThreadPool::create(threadCount);
+                for (auto kernel : kernels)
+                {
+                    const double binMs = measureMs([&] { pClusters->build(view, lights, pPool.get(), kernel); });
+                    const LightClusters::Stats stats = pClusters->getStats();
+                    const auto& ranges = pClusters->getClusterRanges();
+                    const auto& indices = pClusters->getLightIndices();
+
+                    // The first run, scalar on one thread, is the reference, checked against the light spheres directly
+                    if (referenceIndices.empty())
+                    {
+                        referenceRanges = ranges;
+                        referenceIndices = indices;
+
+                        std::vector<glm::vec3> viewPositions(lightCount);
+                        for (uint32_t i = 0; i < lightCount; ++i) viewPositions[i] = glm::vec3(view.viewMat * glm::vec4(lights[i].position, 1.0f));
+
+                        for (uint32_t cluster = 0; cluster < LightClusters::kClusterCount; ++cluster)
+                        {
+                            const BoundingBox bounds = pClusters->getClusterBounds(cluster);
+                            for (uint32_t i = ranges[cluster].offset; i < ranges[cluster].offset + ranges[cluster].count; ++i)
+                            {
+                                const glm::vec3& center = viewPositions[indices[i]];
+                                const glm::vec3 offset = glm::max(glm::max(bounds.getMinPos() - center, center - bounds.getMaxPos()), glm::vec3(0.0f));
+                                if (glm::dot(offset, offset) > lights[indices[i]].radius * lights[indices[i]].radius) falseAssignments++;
+                            }
+                        }
+
+                        // Points strictly inside a sphere, so that rounding at the sphere's surface doesn't count as a miss
+                        const uint32_t kSamplePoints = 4096;
+                        std::uniform_real_distribution<float> logDepth(std::log(view.nearZ), std::log(view.farZ));
+                        for (uint32_t sample = 0; sample < kSamplePoints; ++sample)
+                        {
+                            const float distance = std::exp(logDepth(rng));
+                            const glm::vec3 point(unit(rng) * distance * tanHalfFov * aspect, unit(rng) * distance * tanHalfFov, -distance);
+                            const uint32_t cluster = pClusters->findCluster(point);
+                            for (uint32_t i = 0; i < lightCount; ++i)
+                            {
+                                const glm::vec3 offset = point - viewPositions[i];
+                                if (glm::dot(offset, offset) <= 0.999f * lights[i].radius * lights[i].radius && !clusterHasLight(cluster, i)) missedLights++;
+                            }
+                        }
+
+                        if (falseAssignments > 0 || missedLights > 0)
+                        {
+                            logWarning("Light clustering of " + std::to_string(lightCount) + " lights has " + std::to_string(falseAssignments) + " false assignments and missed " + std::to_string(missedLights) + " lights");
+                        }
+                    }
+
+                    const bool matches = sameContents(referenceIndices, indices) && sameContents(referenceRanges, ranges);
+                    if (!matches)
+                    {
+                        logWarning(std::string("Light clustering with ") + LightClusters::getKernelName(kernel) + " on " + std::to_string(threadCount) + " threads differs from the scalar reference");
+                    }
+
+                    Row row;
+                    row.name = std::string("LightClusters_") + LightClusters::getKernelName(kernel) + "_" + std::to_string(lightCount) + "Lights_" + std::to_string(threadCount) + "T";
+                    row.values = {
+                        { "lights", lightCount },
+                        { "threads", threadCount },
+                        { "visibleLights", stats.visibleLights },
+                        { "assignments", stats.assignments },
+                        { "occupiedClusters", stats.occupiedClusters },
+                        { "avgLightsPerCluster", (double)stats.assignments / LightClusters::kClusterCount },
+                        { "avgLightsPerOccupiedCluster", (double)stats.assignments / std::max(1u, stats.occupiedClusters) },
+                        { "maxClusterLights", stats.maxClusterLights },
+                        { "binMs", binMs },
+                        { "nsPerLight", binMs * 1e6 / lightCount },
+                        { "falseAssignments", falseAssignments },
+                        { "missedLights", missedLights },
+                        { "matchesScalar", matches ? 1.0 : 0.0 } };
+                    logInfo(row.name + ": " + std::to_string(binMs) + " ms, " + std::to_string((double)stats.assignments / std::max(1u, stats.occupiedClusters)) + " lights per occupied cluster, max " + std::to_string(stats.maxClusterLights));
+                    rows.push_back(row);
+                }
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> descriptorTable(const GraphicsProgram::SharedPtr& pProgram, const DescriptorTable::SharedPtr& pSourceTable)
+    {
+        std::vector<Texture::SharedPtr> sourceTextures;
+        for (uint32_t slot = 0; slot < pSourceTable->getSlotCount(); ++slot)
+        {
+            if (pSourceTable->getTexture(slot)) sourceTextures.push_back(pSourceTable->getTexture(slot));
+        }
+        if (sourceTextures.empty()) return {};
+
+        const uint32_t capacity = pSourceTable->getCapacity();
+        const std::string arrayName = "gBindlessTextures";
+        std::vector<Texture::SharedPtr> textures(capacity);
+        for (uint32_t slot = 0; slot < capacity; ++slot) textures[slot] = sourceTextures[slot % sourceTextures.size()];
+
+        GraphicsVars::SharedPtr pVars = GraphicsVars::create(pProgram->getReflector());
+        const double byNameMs = measureMs([&]
+        {
+            for (uint32_t slot = 0; slot < capacity; ++slot) pVars->setTexture(arrayName + "[" + std::to_string(slot) + "]", textures[slot]);
+        });
+
+        DescriptorTable::SharedPtr pTable;
+        const double fullMs = measureMs([&]
+        {
+            pTable = DescriptorTable::create(arrayName, capacity);
+            for (const auto& pTexture : textures) pTable->add(pTexture);
+            pTable->bind(pVars);
+        });
+
+        // Replaced slots come back from the free list, so the table stays the same size
+        const uint32_t replacedCount = std::max(1u, capacity / 100);
+        uint32_t incrementalSlotsWritten = 0;
+        const double incrementalMs = measureMs([&]
+        {
+            for (uint32_t i = 0; i < replacedCount; ++i) pTable->remove(i * 100 % capacity);
+            for (uint32_t i = 0; i < replacedCount; ++i) pTable->add(textures[i * 100 % capacity]);
+            incrementalSlotsWritten = pTable->bind(pVars).slotsWritten;
+        });
+
+        ParameterBlock* pBlock = pVars->getDefaultBlock().get();
+        const ParameterBlock::BindLocation location = pBlock->getReflection()->getResourceBinding(arrayName);
+        bool matches = pTable->getSlotCount() == capacity;
+        for (uint32_t slot = 0; slot < pTable->getSlotCount() && matches; ++slot)
+        {
+            matches = pBlock->getSrv(location, slot) == pTable->getTexture(slot)->getSRV();
+        }
+        if (!matches) logWarning("Descriptor table bindings don't match its textures");
+
+        std::vector<Row> rows;
+        struct Variant
+        {
+            const char* name;
+            double ms;
+            uint32_t slotsWritten;
+        };
+        const Variant variants[] = { { "ByName", byNameMs, capacity }, { "TableFull", fullMs, capacity }, { "TableIncremental", incrementalMs, incrementalSlotsWritten } };
+        for (const Variant& variant : variants)
+        {
+            Row row;
+            row.name = std::string("TextureBind_") + variant.name + "_" + std::to_string(capacity);
+            row.values = {
+                { "slots", capacity },
+                { "slotsWritten", variant.slotsWritten },
+                { "ms", variant.ms },
+                { "nsPerSlotWritten", variant.ms * 1e6 / std::max(1u, variant.slotsWritten) },
+                { "matches", matches ? 1.0 : 0.0 } };
+            logInfo(row.name + ": " + std::to_string(variant.ms) + " ms");
+            rows.push_back(row);
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> drawRecording(const Scene::SharedPtr& pScene, uint32_t repeatCount, uint32_t maxThreadCount, const DrawRecorder::View& view)
+    {
+        DrawQueue::SharedPtr pQueue = DrawQueue::create();
+        DrawRecorder::SharedPtr pRecorder = DrawRecorder::create();
+        pRecorder->setSceneDraws(pScene, repeatCount, 0, pQueue.get());
+        const uint32_t drawCount = pRecorder->getSceneDrawCount();
+
+        std::vector<DrawConstants> constants(drawCount);
+        std::vector<DrawPacket> referencePackets;
+        std::vector<DrawConstants> referenceConstants;
+        double serialMs = 0;
+
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t threadCount = 1; threadCount < maxThreadCount; threadCount *= 2) threadCounts.push_back(threadCount);
+        threadCounts.push_back(maxThreadCount);
+
+        std::vector<Row> rows;
+        for (uint32_t threadCount : threadCounts)
+        {
+            ThreadPool::SharedPtr pPool = ThreadPool::create(threadCount);
+            const double ms = measureMs([&]
+            {
+                pQueue->clear();
+                pRecorder->recordScene(pPool.get(), view, constants.data(), 0, pQueue.get());
+            });
+
+            // Culled draws leave their constants untouched, so only the visible ones are compared
+            bool identical = true;
+            if (threadCount == 1)
+            {
+                referencePackets = pQueue->getPackets();
+                referenceConstants = constants;
+                serialMs = ms;
+            }
+            else
+            {
+                identical = sameContents(pQueue->getPackets(), referencePackets);
+                for (size_t i = 0; i < referencePackets.size() && identical; ++i)
+                {
+                    const uint32_t drawID = referencePackets[i].drawID;
+                    identical = memcmp(&constants[drawID], &referenceConstants[drawID], sizeof(DrawConstants)) == 0;
+                }
+                if (!identical)
+                {
+                    logWarning("Draws recorded with " + std::to_string(threadCount) + " threads differ from the serial recording");
+                }
+            }
+
+            Row row;
+            row.name = "DrawRecording_" + std::to_string(threadCount) + "T";
+            row.values = {
+                { "threads", threadCount },
+                { "draws", drawCount },
+                { "visibleDraws", (double)pQueue->getPackets().size() },
+                { "ms", ms },
+                { "drawsPerMs", drawCount / ms },
+                { "speedup", serialMs / ms },
+                { "identical", identical ? 1.0 : 0.0 } };
+            logInfo(row.name + ": " + std::to_string(drawCount / ms) + " draws/ms");
+            rows.push_back(row);
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> skinning(uint32_t vertexCount, uint32_t maxThreadCount)
+    {
+        // Odd-sized meshes so that tasks end mid pair for the two-vertex kernel
+        const uint32_t kBoneCount = 64;
+        const uint32_t kVerticesPerMesh = 5001;
+        const float kMaxError = 1e-4f;
+
+        std::mt19937 rng(vertexCount);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_int_distribution<uint32_t> bone(0, kBoneCount - 1);
+
+        std::vector<glm::mat4> boneMatrices(kBoneCount);
+        std::vector<glm::mat3x4> boneNormalMatrices(kBoneCount);
+        for (uint32_t b = 0; b < kBoneCount; ++b)
+        {
+            const glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 2.0f, 0.0f));
+            boneMatrices[b] = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng), unit(rng), unit(rng))) * glm::rotate(glm::mat4(1.0f), unit(rng) * 3.0f, axis);
+            boneNormalMatrices[b] = transpose(inverse(glm::mat3(boneMatrices[b])));
+        }
+
+        std::vector<glm::vec3> positions(vertexCount);
+        std::vector<glm::vec3> normals(vertexCount);
+        std::vector<Skinner::Influence> influences(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            positions[v] = 10.0f * glm::vec3(unit(rng), unit(rng), unit(rng));
+            normals[v] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+
+            // One to four bones
+            Skinner::Influence& influence = influences[v];
+            glm::vec4 weights(0.0f);
+            const uint32_t used = 1 + v % 4;
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                influence.bones[i] = (uint16_t)bone(rng);
+                weights[i] = i < used ? 0.1f + std::abs(unit(rng)) : 0.0f;
+            }
+            influence.weights = weights / (weights.x + weights.y + weights.z + weights.w);
+        }
+
+        // Separate outputs per kernel, compared against the scalar kernel's
+        std::vector<glm::vec3> referencePositions(vertexCount), referenceNormals(vertexCount);
+        std::vector<glm::vec3> skinnedPositions(vertexCount), skinnedNormals(vertexCount);
+        auto createSkinner = [&](std::vector<glm::vec3>& outPositions, std::vector<glm::vec3>& outNormals)
+        {
+            Skinner::SharedPtr pSkinner = Skinner::create();
+            for (uint32_t first = 0; first < vertexCount; first += kVerticesPerMesh)
+            {
+                Skinner::Job job;
+                job.pPositions = &positions[first];
+                job.pNormals = &normals[first];
+                job.pInfluences = &influences[first];
+                job.vertexCount = std::min(kVerticesPerMesh, vertexCount - first);
+                job.pBoneMatrices = boneMatrices.data();
+                job.pBoneNormalMatrices = boneNormalMatrices.data();
+                job.pOutPositions = (uint8_t*)&outPositions[first];
+                job.pOutNormals = (uint8_t*)&outNormals[first];
+                pSkinner->addJob(job);
+            }
+            return pSkinner;
+        };
+
+        Skinner::SharedPtr pReference = createSkinner(referencePositions, referenceNormals);
+        pReference->run(nullptr, Skinner::Kernel::Scalar);
+
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t threadCount = 1; threadCount < maxThreadCount; threadCount *= 2) threadCounts.push_back(threadCount);
+        threadCounts.push_back(maxThreadCount);
+
+        std::vector<Row> rows;
+        for (auto kernel : { Skinner::Kernel::Scalar, Skinner::Kernel::SSE, Skinner::Kernel::AVX2 })
+        {
+            if (!Skinner::isKernelSupported(kernel)) continue;
+
+            Skinner::SharedPtr pSkinner = createSkinner(skinnedPositions, skinnedNormals);
+            double serialMs = 0;
+            for (uint32_t threadCount : threadCounts)
+            {
+                ThreadPool::SharedPtr pPool = ThreadPool::create(threadCount);
+                std::fill(skinnedPositions.begin(), skinnedPositions.end(), glm::vec3(0.0f));
+                const double ms = measureMs([&] { pSkinner->run(pPool.get(), kernel); });
+                if (threadCount == 1) serialMs = ms;
+
+                float maxError = 0;
+                for (uint32_t v = 0; v < vertexCount; ++v)
+                {
+                    maxError = std::max(maxError, maxAbsDifference(skinnedPositions[v], referencePositions[v]));
+                    maxError = std::max(maxError, maxAbsDifference(skinnedNormals[v], referenceNormals[v]));
+                }
+                for (uint32_t job = 0; job < pSkinner->getJobCount(); ++job)
+                {
+                    const BoundingBox& bounds = pSkinner->getBounds(job);
+                    const BoundingBox& referenceBounds = pReference->getBounds(job);
+                    maxError = std::max(maxError, maxAbsDifference(bounds.center, referenceBounds.center));
+                    maxError = std::max(maxError, maxAbsDifference(bounds.extent, referenceBounds.extent));
+                }
+                const bool matches = maxError <= kMaxError;
+                if (!matches)
+                {
+                    logWarning(std::string("Skinning kernel ") + Skinner::getKernelName(kernel) + " differs from the scalar reference by " + std::to_string(maxError));
+                }
+
+                Row row;
+                row.name = std::string("Skinning_") + Skinner::getKernelName(kernel) + "_" + std::to_string(threadCount) + "T";
+                row.values = {
+                    { "threads", threadCount },
+                    { "vertices", vertexCount },
+                    { "ms", ms },
+                    { "verticesPerMs", vertexCount / ms },
+                    { "verticesPerMsPerCore", vertexCount / ms / threadCount },
+                    { "speedup", serialMs / ms },
+                    { "maxError", maxError },
+                    { "matchesScalar", matches ? 1.0 : 0.0 } };
+                logInfo(row.name + ": " + std::to_string(vertexCount / ms) + " vertices/ms, " + std::to_string(vertexCount / ms / threadCount) + " per core");
+                rows.push_back(row);
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> uploadRing(const std::vector<uint32_t>& drawCounts)
+    {
+        std::vector<Row> rows;
+        for (uint32_t drawCount : drawCounts)
+        {
+            DrawConstants constants = {};
+            constants.worldMat = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+            constants.prevWorldMat = constants.worldMat;
+            constants.worldInvTransposeMat = transpose(inverse(glm::mat3(constants.worldMat)));
+            const double frameBytes = (double)drawCount * sizeof(DrawConstants);
+
+            UploadRing::SharedPtr pRing = UploadRing::create(1024 * 1024);
+            uint32_t warmupGrows = 0;
+            auto writeRingFrame = [&]()
+            {
+                pRing->beginFrame();
+                for (uint32_t i = 0; i < drawCount; ++i)
+                {
+                    UploadRing::Allocation allocation;
+                    constants.drawID = i;
+                    *pRing->allocate<DrawConstants>(1, allocation) = constants;
+                }
+                return pRing->getFrameStats().grows;
+            };
+            for (uint32_t frame = 0; frame < UploadRing::kFramesInFlight * 2; ++frame) warmupGrows += writeRingFrame();
+
+            uint32_t steadyGrows = 0;
+            const double ringMs = measureMs([&] { steadyGrows += writeRingFrame(); });
+            const UploadRing::FrameStats ringStats = pRing->getFrameStats();
+            if (steadyGrows > 0) logWarning("Upload ring kept growing after warming up");
+
+            // Baseline: every draw's constants in their own short-lived heap allocation
+            std::vector<std::unique_ptr<DrawConstants>> heapConstants(drawCount);
+            const double heapMs = measureMs([&]
+            {
+                for (uint32_t i = 0; i < drawCount; ++i)
+                {
+                    constants.drawID = i;
+                    heapConstants[i] = std::make_unique<DrawConstants>(constants);
+                }
+            });
+
+            for (bool ring : { true, false })
+            {
+                const double ms = ring ? ringMs : heapMs;
+                Row row;
+                row.name = std::string(ring ? "UploadRing_" : "HeapAlloc_") + std::to_string(drawCount);
+                row.values = {
+                    { "allocationsPerFrame", ring ? ringStats.allocations : drawCount },
+                    { "bytesPerFrame", frameBytes },
+                    { "paddingBytesPerFrame", ring ? (double)ringStats.paddingBytes : 0.0 },
+                    { "nsPerAllocation", ms * 1e6 / drawCount },
+                    { "GBPerSecond", frameBytes / (ms * 1e6) },
+                    { "warmupGrows", ring ? warmupGrows : 0 },
+                    { "steadyGrows", ring ? steadyGrows : 0 },
+                    { "capacityMB", ring ? pRing->getCapacity() / (1024.0 * 1024.0) : 0.0 } };
+                logInfo(row.name + ": " + std::to_string(frameBytes / (ms * 1e6)) + " GB/s");
+                rows.push_back(row);
+            }
+        }
+
+        return rows;
+    }
+
+    std::vector<Row> renderStats(uint32_t maxThreadCount)
+    {
+        // Shaped like the app's registry: a few dozen counters, about as many adds and spans per frame as RecordRenderStats and EndPhase make
+        const uint32_t kCounterCount = 26;
+        const uint32_t kAddsPerFrame = 16;
+        const uint32_t kSpansPerFrame = 6;
+        const uint32_t kAddCount = 1000000;
+        const uint32_t kCaptureFrames = 1000;
+        const double kFrameMs = 1000.0 / 60.0;
+
+        RenderStats::SharedPtr pStats = RenderStats::create();
+        for (uint32_t i = 0; i < kCounterCount; ++i)
+        {
+            pStats->registerCounter("counter" + std::to_string(i), i % 4 == 0 ? RenderStats::Unit::Ms : RenderStats::Unit::Count);
+        }
+
+        const double addMs = measureMs([&]
+        {
+            for (uint32_t i = 0; i < kAddCount; ++i) pStats->add(i % kCounterCount, 1);
+        });
+        pStats->endFrame();
+
+        // Every thread counting into the same counters, the totals have to add up
+        ThreadPool::SharedPtr pPool = ThreadPool::create(maxThreadCount);
+        const double contendedMs = measureMs([&]
+        {
+            pPool->parallelFor(kAddCount, 4096, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; ++i) pStats->add(i % 2, 1);
+            });
+        });
+        pStats->endFrame();
+        pPool->parallelFor(kAddCount, 4096, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i) pStats->add(i % 2, 1);
+        });
+        pStats->endFrame();
+        const bool totalsMatch = pStats->getSummary(1).last == kAddCount / 2 && pStats->getSummary(0).last == kAddCount / 2 * 1e-6;
+        if (!totalsMatch) logWarning("Render stats lost counts under contention");
+
+        const CpuTimer::TimePoint spanStart = CpuTimer::getCurrentTimePoint();
+        const double spanMs = measureMs([&]
+        {
+            for (uint32_t i = 0; i < 1000; ++i) pStats->addSpan(i % kCounterCount, spanStart, spanStart);
+        });
+        const double endFrameMs = measureMs([&] { pStats->endFrame(); });
+
+        auto countFrame = [&]()
+        {
+            for (uint32_t i = 0; i < kAddsPerFrame; ++i) pStats->add(i, i);
+            for (uint32_t i = 0; i < kSpansPerFrame; ++i) pStats->addSpan(kAddsPerFrame + i, spanStart, CpuTimer::getCurrentTimePoint());
+            pStats->endFrame();
+        };
+        const double frameMs = measureMs(countFrame);
+
+        // Capturing also appends the spans and the frame's totals. The last frame writes the capture and isn't timed.
+        pStats->beginCapture(kCaptureFrames, "RenderStatsBenchmark");
+        auto captureStart = CpuTimer::getCurrentTimePoint();
+        for (uint32_t frame = 0; frame + 1 < kCaptureFrames; ++frame) countFrame();
+        const double captureFrameMs = elapsedMs(captureStart) / (kCaptureFrames - 1);
+        countFrame();
+        const double reportMs = measureMs([&] { pStats->getReport(); });
+
+        Row row;
+        row.name = "RenderStats_" + std::to_string(kCounterCount);
+        row.values = {
+            { "counters", kCounterCount },
+            { "nsPerAdd", addMs * 1e6 / kAddCount },
+            { "nsPerContendedAdd", contendedMs * 1e6 / kAddCount },
+            { "threads", pPool->getThreadCount() },
+            { "nsPerSpan", spanMs * 1e6 / 1000 },
+            { "usPerEndFrame", endFrameMs * 1e3 },
+            { "usPerFrame", frameMs * 1e3 },
+            { "usPerCapturedFrame", captureFrameMs * 1e3 },
+            { "frameOverheadPercent", frameMs / kFrameMs * 100 },
+            { "capturedFrameOverheadPercent", captureFrameMs / kFrameMs * 100 },
+            { "usPerGuiReport", reportMs * 1e3 },
+            { "totalsMatch", totalsMatch ? 1.0 : 0.0 } };
+        logInfo(row.name + ": " + std::to_string(frameMs * 1e3) + " us/frame, " + std::to_string(frameMs / kFrameMs * 100) + "% of a 60 Hz frame");
+        return { row };
+    }
+
+    std::vector<Row> commandReplay(const CommandTrace::SharedPtr& pTrace, uint32_t repeatCount)
+    {
+        // Known case: the synthetic commands issued to the list backend directly and replayed from a trace must match
+        {
+            CommandTrace::SharedPtr pSynthetic = CommandTrace::create({ "Synthetic" });
+            ListBackend expected, replayed;
+            issueSyntheticCommands(*pSynthetic);
+            issueSyntheticCommands(expected);
+            if (!pSynthetic->replay(replayed) || replayed.values != expected.values) logWarning("Command replay: the synthetic trace doesn't decode to what was recorded");
+        }
+
+        std::vector<NullBackend::ModeStats> firstStats;
+        double totalMs = 0;
+        for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+        {
+            NullBackend backend;
+            auto start = CpuTimer::getCurrentTimePoint();
+            const bool complete = pTrace->replay(backend);
+            backend.finish();
+            totalMs += elapsedMs(start);
+
+            if (!complete) logWarning("Command replay: the trace is truncated or holds an unknown command");
+            if (repeat == 0)
+            {
+                firstStats = backend.getModeStats();
+                continue;
+            }
+
+            const auto& stats = backend.getModeStats();
+            bool same = stats.size() == firstStats.size();
+            for (size_t mode = 0; same && mode < stats.size(); ++mode)
+            {
+                same = stats[mode].hash == firstStats[mode].hash && stats[mode].commands == firstStats[mode].commands;
+            }
+            if (!same) logWarning("Command replay: replay " + std::to_string(repeat) + " differs from the first");
+        }
+        logInfo("Replayed " + std::to_string(pTrace->getFrameCount()) + " frames " + std::to_string(repeatCount) + " times in " + std::to_string(totalMs) + " ms");
+
+        // Times are from the modes' frames in the first replay, the counts are the same in every replay
+        std::vector<Row> rows;
+        const auto& modeNames = pTrace->getModeNames();
+        for (size_t mode = 0; mode < firstStats.size(); ++mode)
+        {
+            const NullBackend::ModeStats& stats = firstStats[mode];
+            if (stats.frames == 0) continue;
+            if (stats.invalidDraws > 0) logWarning("Command replay: " + std::to_string(stats.invalidDraws) + " draws without a state, vars or VAO bound");
+
+            const double frames = stats.frames;
+            Row row;
+            row.name = mode < modeNames.size() ? modeNames[mode] : "Mode" + std::to_string(mode);
+            row.values = {
+                { "frames", frames },
+                { "commandsPerFrame", stats.commands / frames },
+                { "drawsPerFrame", stats.draws / frames },
+                { "drawCallsPerFrame", stats.drawCalls / frames },
+                { "stateBindsPerFrame", stats.stateBinds / frames },
+                { "vaoChangesPerFrame", stats.vaoChanges / frames },
+                { "materialChangesPerFrame", stats.materialChanges / frames },
+                { "pushConstantBytesPerFrame", stats.pushConstantBytes / frames },
+                { "replayNsPerCommand", stats.replayMs * 1e6 / std::max<uint64_t>(1, stats.commands) },
+                { "replayNsPerDrawCall", stats.replayMs * 1e6 / std::max<uint64_t>(1, stats.drawCalls) },
+                { "hash", (double)(uint32_t)stats.hash } };
+            logInfo(row.name + ": " + std::to_string(stats.commands / frames) + " commands per frame");
+            rows.push_back(row);
+        }
+        return rows;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Falcor.h"
+#include "DrawList.h"
+#include "DrawRecorder.h"
+#include "CommandTrace.h"
+
+using namespace Falcor;
+
+// CPU-side benchmarks of the rendering subsystems. Results are logged and written as CSV next to the executable.
+namespace Benchmarks
+{
+    struct Row
+    {
+        std::string name;
+        std::vector<std::pair<std::string, double>> values;
+    };
+
+    // Writes rows as CSV. The header comes from the value names of the first row.
+    bool writeCsv(const std::string& filename, const std::vector<Row>& rows);
+
+    // Writes rows as a JSON array with one object per row
+    bool writeJson(const std::string& filename, const std::vector<Row>& rows);
+
+    // Builds the full draw list (constants and multi-draw geometry) with 1..N threads and checks that the output
+    // matches the single-threaded build
+    std::vector<Row> drawListBuild(const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, uint32_t repeatCount, uint32_t maxThreadCount, DrawConstantsLayout layout);
+
+    // Builds the geometry pool without optimization, with vertex cache optimization, with 16-bit indices on top and with LODs.
+    // Reports ACMR/ATVR before and after and the triangles per LOD, and checks that repeated and multithreaded builds produce
+    // bit-identical geometry.
+    std::vector<Row> geometryOptimization(const std::vector<Mesh::SharedPtr>& meshes, uint32_t maxThreadCount);
+
+    // Builds the geometry pool with fp32 and with quantized vertices and decodes the quantized streams the way the input assembler
+    // and BindlessVS.slang do. Reports bytes/vertex saved per element and in total, and checks each element's largest error against
+    // the fp32 pool: half a 16-bit step of the mesh's bounds for positions, 0.01 degrees for directions, half an ulp for half texture
+    // coordinates, exact for the copied elements. buildMs is the extra build time of quantizing.
+    std::vector<Row> vertexQuantization(const std::vector<Mesh::SharedPtr>& meshes);
+
+    // Packs random draws into the full and compact draw constant layouts and reports bytes/draw, GPU memory and per-frame upload
+    // for several fractions of moving draws. The compact normal matrix, derived from cofactors as in BindlessVS.slang, is checked
+    // against the full layout's inverse transpose.
+    std::vector<Row> drawConstantsLayout(uint32_t drawCount);
+
+    // Culls random boxes with every supported kernel and reports ns/draw. Each kernel's output is checked against the scalar reference.
+    std::vector<Row> frustumCulling(const std::vector<uint32_t>& drawCounts);
+
+    // Queries random boxes with a frustum and a sphere through the instance BVH and through flat loops, and reports the query times,
+    // the build time and the cost of moving a tenth of the boxes (storing the bounds, plus the refit for the BVH). Checks that the BVH
+    // finds the same boxes.
+    std::vector<Row> instanceBvh(const std::vector<uint32_t>& drawCounts);
+
+    // Rasterizes growing numbers of walls as occluders and tests random boxes behind them with every supported kernel on one and
+    // N threads, and reports the occluded ratio against the rasterization and test cost. Checks a few known cases (a box behind a
+    // wall is occluded, one in front, one peeking past the edge and one crossing the wall are not) and that every kernel and thread
+    // count produces the scalar reference's depth buffer and visible boxes.
+    std::vector<Row> occlusionCulling(uint32_t boxCount, uint32_t maxThreadCount);
+
+    // Bins random point lights into the clusters of a view with every supported kernel on one and N threads, and reports the binning
+    // time and lights per cluster. Checks a few known cases (a light in front of the camera, one around it, one behind it and one past
+    // the far plane), that no cluster lists a light that misses its bounds, that random points in the view find every light reaching
+    // them in their cluster's list, and that every kernel and thread count produces the scalar reference's lists.
+    std::vector<Row> lightClustering(const std::vector<uint32_t>& lightCounts, uint32_t maxThreadCount);
+
+    // Skins random vertices with four influences from a random skeleton with every supported kernel on 1..N threads, and reports
+    // vertices/ms, vertices/ms per core and the speedup over one thread. Checks positions, normals and bounds against the scalar kernel.
+    std::vector<Row> skinning(uint32_t vertexCount, uint32_t maxThreadCount);
+
+    // Writes a frame of per-draw constants through the upload ring and through a heap allocation per draw, and reports
+    // allocations/frame, ns/allocation and write bandwidth. The ring starts small, the rows report how often it grew while
+    // warming up and checks that it stays put once it holds kFramesInFlight frames.
+    std::vector<Row> uploadRing(const std::vector<uint32_t>& drawCounts);
+
+    // Records the explicit mode's scene draws with 1..N threads and reports draws/ms and the speedup over one thread. Checks that
+    // the packets and draw constants match the single-threaded recording.
+    std::vector<Row> drawRecording(const Scene::SharedPtr& pScene, uint32_t repeatCount, uint32_t maxThreadCount, const DrawRecorder::View& view);
+
+    // Counts into a render stats registry shaped like the app's, from one thread and from every pool thread into the same counters,
+    // and reports ns/add, ns/span and the cost of a frame's counting and endFrame() against a 60 Hz frame, with and without a
+    // capture running. Checks that contended counts all arrive.
+    std::vector<Row> renderStats(uint32_t maxThreadCount);
+
+    // Fills the program's bindless texture array to capacity with the table's textures and binds it by name per slot, through a
+    // fresh descriptor table, and incrementally after replacing 1% of the slots. Checks the table's bindings against the textures.
+    std::vector<Row> descriptorTable(const GraphicsProgram::SharedPtr& pProgram, const DescriptorTable::SharedPtr& pSourceTable);
+
+    // Replays the trace against the null backend repeatCount times and reports per mode the commands, draws, state changes and push
+    // constant bytes per frame, the replay cost per command and draw, and the hash of the mode's commands. Checks that a synthetic
+    // trace with edge values (negative base vertex, decreasing push constants, 64-bit offsets) decodes to what was recorded, that
+    // every replay of the trace produces the same commands, and that no draw is issued without a state, vars and VAO bound.
+    std::vector<Row> commandReplay(const CommandTrace::SharedPtr& pTrace, uint32_t repeatCount);
+}
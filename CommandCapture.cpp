@@ -0,0 +1,85 @@
+#include "CommandCapture.h"
+
+CommandCapture::SharedPtr CommandCapture::create()
+{
+    return SharedPtr(new CommandCapture());
+}
+
+void CommandCapture::beginCapture(uint32_t frameCount, const std::string& path, const std::vector<std::string>& modeNames)
+{
+    if (mFramesLeft > 0 || frameCount == 0) return;
+
+    mpTrace = CommandTrace::create(modeNames);
+    mObjectIDs.clear();
+    mPath = path;
+    mFramesLeft = frameCount;
+}
+
+void CommandCapture::beginFrame(uint32_t mode)
+{
+    mInFrame = mFramesLeft > 0;
+    if (mInFrame) mpTrace->beginFrame(mode);
+}
+
+void CommandCapture::endFrame()
+{
+    // A capture begun during a frame starts with the next one
+    if (!mInFrame) return;
+    mInFrame = false;
+
+    if (--mFramesLeft == 0)
+    {
+        if (mpTrace->writeFile(mPath))
+        {
+            logInfo("Wrote command trace " + mPath + ": " + std::to_string(mpTrace->getFrameCount()) + " frames, " + std::to_string(mpTrace->getSize() / 1024) + " KB");
+        }
+        mpTrace = nullptr;
+        mObjectIDs = {};
+    }
+}
+
+uint32_t CommandCapture::getObjectID(const void* pObject)
+{
+    auto it = mObjectIDs.find(pObject);
+    if (it != mObjectIDs.end()) return it->second;
+
+    const uint32_t id = (uint32_t)mObjectIDs.size();
+    mObjectIDs[pObject] = id;
+    return id;
+}
+
+void CommandCapture::setGraphicsState(RenderContext* pContext, const GraphicsState::SharedPtr& pState)
+{
+    if (mInFrame) mpTrace->setGraphicsState(getObjectID(pState.get()));
+    pContext->setGraphicsState(pState);
+}
+
+void CommandCapture::setGraphicsVars(RenderContext* pContext, const GraphicsVars::SharedPtr& pVars)
+{
+    if (mInFrame) mpTrace->setGraphicsVars(getObjectID(pVars.get()));
+    pContext->setGraphicsVars(pVars);
+}
+
+void CommandCapture::pushConstants(RenderContext* pContext, const GraphicsVars::SharedPtr& pVars, uint32_t size, const void* pData)
+{
+    if (mInFrame) mpTrace->pushConstants(size, pData);
+    pContext->pushConstants(pVars, size, pData);
+}
+
+void CommandCapture::drawIndexed(RenderContext* pContext, uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+    if (mInFrame) mpTrace->drawIndexed(indexCount, startIndex, baseVertex);
+    pContext->drawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void CommandCapture::multiDrawIndexedIndirect(RenderContext* pContext, const Buffer* pArgBuffer, uint64_t offset, uint32_t drawCount, const DrawIndexedArguments* pArgs)
+{
+    const uint32_t stride = sizeof(DrawIndexedArguments);
+    if (mInFrame)
+    {
+        uint64_t instanceCount = 0;
+        for (uint32_t i = 0; i < drawCount; ++i) instanceCount += pArgs[i].instanceCount;
+        mpTrace->multiDrawIndexedIndirect(getObjectID(pArgBuffer), offset, drawCount, stride, instanceCount);
+    }
+    pContext->multiDrawIndexedIndirect(pArgBuffer, offset, drawCount, stride);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Falcor.h"
+#include "CommandTrace.h"
+
+using namespace Falcor;
+
+// Forwards the render paths' RenderContext calls and, while capturing, records them to a CommandTrace. The VAO and material
+// changes the render context applies with the next draw are recorded too. Outside of a capture a call costs one branch.
+// The draws Falcor's SceneRenderer makes in the stock mode don't go through it and aren't recorded.
+class CommandCapture
+{
+public:
+    using SharedPtr = std::shared_ptr<CommandCapture>;
+
+    static SharedPtr create();
+
+    // Records the next frameCount frames, then writes the trace to path. Frames are tagged with an index into modeNames.
+    void beginCapture(uint32_t frameCount, const std::string& path, const std::vector<std::string>& modeNames);
+    bool isCapturing() const { return mFramesLeft > 0; }
+
+    void beginFrame(uint32_t mode);
+    void endFrame();
+
+    void setGraphicsState(RenderContext* pContext, const GraphicsState::SharedPtr& pState);
+    void setGraphicsVars(RenderContext* pContext, const GraphicsVars::SharedPtr& pVars);
+    void pushConstants(RenderContext* pContext, const GraphicsVars::SharedPtr& pVars, uint32_t size, const void* pData);
+    void drawIndexed(RenderContext* pContext, uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+    // pArgs is the CPU copy of the drawCount args in pArgBuffer, their instance counts are recorded with the draw
+    void multiDrawIndexedIndirect(RenderContext* pContext, const Buffer* pArgBuffer, uint64_t offset, uint32_t drawCount, const DrawIndexedArguments* pArgs);
+
+    // State changes made on the bound state and vars between draws, record only
+    void recordVao(const Vao* pVao) { if (mInFrame) mpTrace->setVao(getObjectID(pVao)); }
+    void recordMaterial(const Material* pMaterial) { if (mInFrame) mpTrace->setMaterial(getObjectID(pMaterial)); }
+
+private:
+    CommandCapture() = default;
+
+    // IDs in order of first use, shared by all object types. Only valid during one capture.
+    uint32_t getObjectID(const void* pObject);
+
+    CommandTrace::SharedPtr mpTrace;
+    std::unordered_map<const void*, uint32_t> mObjectIDs;
+    std::string mPath;
+    uint32_t mFramesLeft = 0;
+    bool mInFrame = false;
+};
@@ -0,0 +1,344 @@
+#include "CommandTrace.h"
+#include "MappedFile.h"
+#include <fstream>
+
+namespace
+{
+    const char kMagic[8] = { 'H', 'P', 'R', 'T', 'R', 'A', 'C', 'E' };
+
+    uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+    int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+    // Reads the stream front to back, failing once it runs past the end
+    struct Reader
+    {
+        const uint8_t* pData;
+        size_t size;
+        size_t offset;
+        bool failed;
+
+        uint64_t readVarint()
+        {
+            uint64_t value = 0;
+            for (uint32_t shift = 0; shift < 64; shift += 7)
+            {
+                if (offset >= size)
+                {
+                    failed = true;
+                    return 0;
+                }
+                const uint8_t byte = pData[offset++];
+                value |= (uint64_t)(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) return value;
+            }
+            failed = true;
+            return 0;
+        }
+
+        uint32_t readUint() { return (uint32_t)readVarint(); }
+    };
+}
+
+CommandTrace::SharedPtr CommandTrace::create(const std::vector<std::string>& modeNames)
+{
+    SharedPtr pTrace = SharedPtr(new CommandTrace());
+    pTrace->mModeNames = modeNames;
+    return pTrace;
+}
+
+CommandTrace::SharedPtr CommandTrace::readFile(const std::string& path)
+{
+    MappedFile::SharedPtr pFile = MappedFile::open(path);
+    if (!pFile || pFile->getSize() < sizeof(Header))
+    {
+        logWarning("Can't read command trace " + path);
+        return nullptr;
+    }
+
+    Header header;
+    memcpy(&header, pFile->getData(), sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || sizeof(Header) + header.modeNamesSize + header.size != pFile->getSize())
+    {
+        logWarning("Command trace " + path + " is from another version or truncated");
+        return nullptr;
+    }
+
+    SharedPtr pTrace = SharedPtr(new CommandTrace());
+    pTrace->mFrameCount = header.frameCount;
+
+    const char* pNames = (const char*)pFile->getData() + sizeof(Header);
+    const char* pNamesEnd = pNames + header.modeNamesSize;
+    for (uint32_t mode = 0; mode < header.modeCount && pNames < pNamesEnd; ++mode)
+    {
+        pTrace->mModeNames.push_back(std::string(pNames, strnlen(pNames, pNamesEnd - pNames)));
+        pNames += pTrace->mModeNames.back().size() + 1;
+    }
+
+    pTrace->mData.assign((const uint8_t*)pNamesEnd, pFile->getData() + pFile->getSize());
+    return pTrace;
+}
+
+bool CommandTrace::writeFile(const std::string& path) const
+{
+    std::string names;
+    for (const auto& name : mModeNames) names.append(name.c_str(), name.size() + 1);
+
+    Header header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.frameCount = mFrameCount;
+    header.modeCount = (uint32_t)mModeNames.size();
+    header.modeNamesSize = (uint32_t)names.size();
+    header.size = mData.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        logWarning("Can't write command trace " + path);
+        return false;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write(names.data(), names.size());
+    file.write((const char*)mData.data(), mData.size());
+    if (!file.good())
+    {
+        logWarning("Failed writing command trace " + path);
+        return false;
+    }
+    return true;
+}
+
+void CommandTrace::writeVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        mData.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    mData.push_back((uint8_t)value);
+}
+
+void CommandTrace::writeCommand(Command command, uint32_t value)
+{
+    mData.push_back((uint8_t)command);
+    writeVarint(value);
+}
+
+void CommandTrace::beginFrame(uint32_t mode)
+{
+    writeCommand(Command::BeginFrame, mode);
+    mFrameCount++;
+}
+
+void CommandTrace::pushConstants(uint32_t size, const void* pData)
+{
+    assert(size % 4 == 0 && size <= kMaxPushConstantsSize);
+    mData.push_back((uint8_t)Command::PushConstants);
+    writeVarint(size);
+
+    const uint32_t* pWords = (const uint32_t*)pData;
+    for (uint32_t i = 0; i < size / 4; ++i)
+    {
+        writeVarint(zigzag((int64_t)pWords[i] - (int64_t)mPushConstants[i]));
+        mPushConstants[i] = pWords[i];
+    }
+}
+
+void CommandTrace::drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+    mData.push_back((uint8_t)Command::DrawIndexed);
+    writeVarint(indexCount);
+    writeVarint(startIndex);
+    writeVarint(zigzag(baseVertex));
+}
+
+void CommandTrace::multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount)
+{
+    mData.push_back((uint8_t)Command::MultiDrawIndexedIndirect);
+    writeVarint(bufferID);
+    writeVarint(offset);
+    writeVarint(drawCount);
+    writeVarint(stride);
+    writeVarint(instanceCount);
+}
+
+bool CommandTrace::replay(Backend& backend) const
+{
+    Reader reader = { mData.data(), mData.size(), 0, false };
+    uint32_t pushConstants[kMaxPushConstantsSize / 4] = {};
+
+    while (reader.offset < reader.size)
+    {
+        const Command command = (Command)reader.pData[reader.offset++];
+        switch (command)
+        {
+        case Command::BeginFrame:
+        {
+            // Backends size their per-mode state by the mode, so one the trace has no name for is malformed
+            const uint32_t mode = reader.readUint();
+            if (!reader.failed && mode >= mModeNames.size()) return false;
+            if (!reader.failed) backend.beginFrame(mode);
+            break;
+        }
+        case Command::SetGraphicsState:
+        {
+            const uint32_t stateID = reader.readUint();
+            if (!reader.failed) backend.setGraphicsState(stateID);
+            break;
+        }
+        case Command::SetGraphicsVars:
+        {
+            const uint32_t varsID = reader.readUint();
+            if (!reader.failed) backend.setGraphicsVars(varsID);
+            break;
+        }
+        case Command::SetVao:
+        {
+            const uint32_t vaoID = reader.readUint();
+            if (!reader.failed) backend.setVao(vaoID);
+            break;
+        }
+        case Command::SetMaterial:
+        {
+            const uint32_t materialID = reader.readUint();
+            if (!reader.failed) backend.setMaterial(materialID);
+            break;
+        }
+        case Command::PushConstants:
+        {
+            const uint32_t size = reader.readUint();
+            if (size % 4 != 0 || size > kMaxPushConstantsSize) return false;
+            for (uint32_t i = 0; i < size / 4; ++i)
+            {
+                pushConstants[i] = (uint32_t)((int64_t)pushConstants[i] + unzigzag(reader.readVarint()));
+            }
+            if (!reader.failed) backend.pushConstants(size, pushConstants);
+            break;
+        }
+        case Command::DrawIndexed:
+        {
+            const uint32_t indexCount = reader.readUint();
+            const uint32_t startIndex = reader.readUint();
+            const int32_t baseVertex = (int32_t)unzigzag(reader.readVarint());
+            if (!reader.failed) backend.drawIndexed(indexCount, startIndex, baseVertex);
+            break;
+        }
+        case Command::MultiDrawIndexedIndirect:
+        {
+            const uint32_t bufferID = reader.readUint();
+            const uint64_t offset = reader.readVarint();
+            const uint32_t drawCount = reader.readUint();
+            const uint32_t stride = reader.readUint();
+            const uint64_t instanceCount = reader.readVarint();
+            if (!reader.failed) backend.multiDrawIndexedIndirect(bufferID, offset, drawCount, stride, instanceCount);
+            break;
+        }
+        default:
+            return false;
+        }
+        if (reader.failed) return false;
+    }
+    return true;
+}
+
+NullBackend::ModeStats& NullBackend::getMode()
+{
+    // Commands recorded before the first frame count for mode 0
+    if (mMode >= mModeStats.size()) mModeStats.resize(mMode + 1);
+    return mModeStats[mMode];
+}
+
+void NullBackend::hashValues(CommandTrace::Command command, const uint64_t* pValues, uint32_t count)
+{
+    ModeStats& mode = getMode();
+    mode.commands++;
+    mode.hash = hashBytes(mode.hash, &command, sizeof(command));
+    mode.hash = hashBytes(mode.hash, pValues, count * sizeof(uint64_t));
+}
+
+void NullBackend::checkDraw()
+{
+    if (mState == kUnbound || mVars == kUnbound || mVao == kUnbound) getMode().invalidDraws++;
+}
+
+void NullBackend::finish()
+{
+    if (!mInFrame) return;
+    getMode().replayMs += CpuTimer::calcDuration(mFrameStart, CpuTimer::getCurrentTimePoint());
+    mInFrame = false;
+}
+
+void NullBackend::beginFrame(uint32_t mode)
+{
+    finish();
+    mMode = mode;
+    mInFrame = true;
+    mFrameStart = CpuTimer::getCurrentTimePoint();
+
+    // Every render path binds its state again each frame, a draw relying on the previous frame's bindings is flagged
+    mState = kUnbound;
+    mVars = kUnbound;
+    mVao = kUnbound;
+
+    const uint64_t values[] = { mode };
+    hashValues(CommandTrace::Command::BeginFrame, values, 1);
+    getMode().frames++;
+}
+
+void NullBackend::setGraphicsState(uint32_t stateID)
+{
+    mState = stateID;
+    const uint64_t values[] = { stateID };
+    hashValues(CommandTrace::Command::SetGraphicsState, values, 1);
+    getMode().stateBinds++;
+}
+
+void NullBackend::setGraphicsVars(uint32_t varsID)
+{
+    mVars = varsID;
+    const uint64_t values[] = { varsID };
+    hashValues(CommandTrace::Command::SetGraphicsVars, values, 1);
+    getMode().stateBinds++;
+}
+
+void NullBackend::setVao(uint32_t vaoID)
+{
+    mVao = vaoID;
+    const uint64_t values[] = { vaoID };
+    hashValues(CommandTrace::Command::SetVao, values, 1);
+    getMode().vaoChanges++;
+}
+
+void NullBackend::setMaterial(uint32_t materialID)
+{
+    const uint64_t values[] = { materialID };
+    hashValues(CommandTrace::Command::SetMaterial, values, 1);
+    getMode().materialChanges++;
+}
+
+void NullBackend::pushConstants(uint32_t size, const void* pData)
+{
+    const uint32_t* pWords = (const uint32_t*)pData;
+    uint64_t values[CommandTrace::kMaxPushConstantsSize / 4];
+    for (uint32_t i = 0; i < size / 4; ++i) values[i] = pWords[i];
+    hashValues(CommandTrace::Command::PushConstants, values, size / 4);
+    getMode().pushConstantBytes += size;
+}
+
+void NullBackend::drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+    checkDraw();
+    const uint64_t values[] = { indexCount, startIndex, (uint64_t)(int64_t)baseVertex };
+    hashValues(CommandTrace::Command::DrawIndexed, values, 3);
+    getMode().draws++;
+    getMode().drawCalls++;
+}
+
+void NullBackend::multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount)
+{
+    checkDraw();
+    const uint64_t values[] = { bufferID, offset, drawCount, stride, instanceCount };
+    hashValues(CommandTrace::Command::MultiDrawIndexedIndirect, values, 5);
+    getMode().draws += instanceCount;
+    getMode().drawCalls++;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Hash.h"
+
+using namespace Falcor;
+
+// Compact binary stream of the commands frames issued through the RenderContext, written by CommandCapture and replayed against
+// a Backend without a device. Objects are referenced by IDs in order of first use, so a trace only depends on what was drawn and
+// in which order, not on where the objects were allocated. Integers are stored as LEB128 varints, push constants as the difference
+// to the previous push of the same word, which makes consecutive draw IDs a byte each.
+class CommandTrace
+{
+public:
+    using SharedPtr = std::shared_ptr<CommandTrace>;
+
+    static const uint32_t kVersion = 2;
+
+    enum class Command : uint8_t
+    {
+        BeginFrame,                 // mode, an index into the mode names
+        SetGraphicsState,           // stateID
+        SetGraphicsVars,            // varsID
+        SetVao,                     // vaoID, set on the bound state between draws
+        SetMaterial,                // materialID, set on the bound vars between draws
+        PushConstants,              // size, then a zigzag delta per 32-bit word
+        DrawIndexed,                // indexCount, startIndex, zigzag baseVertex
+        MultiDrawIndexedIndirect,   // bufferID, offset, drawCount, stride, instanceCount summed over the args
+        Count
+    };
+
+    // Receives the commands of replay() in the order they were recorded
+    class Backend
+    {
+    public:
+        virtual ~Backend() = default;
+        virtual void beginFrame(uint32_t mode) = 0;
+        virtual void setGraphicsState(uint32_t stateID) = 0;
+        virtual void setGraphicsVars(uint32_t varsID) = 0;
+        virtual void setVao(uint32_t vaoID) = 0;
+        virtual void setMaterial(uint32_t materialID) = 0;
+        virtual void pushConstants(uint32_t size, const void* pData) = 0;
+        virtual void drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) = 0;
+        virtual void multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount) = 0;
+    };
+
+    // Frames are tagged with a mode, e.g. the render mode or the benchmark configuration. The names are stored with the trace.
+    static SharedPtr create(const std::vector<std::string>& modeNames);
+
+    // Returns nullptr if the file can't be read or is a trace of another version
+    static SharedPtr readFile(const std::string& path);
+    bool writeFile(const std::string& path) const;
+
+    void beginFrame(uint32_t mode);
+    void setGraphicsState(uint32_t stateID) { writeCommand(Command::SetGraphicsState, stateID); }
+    void setGraphicsVars(uint32_t varsID) { writeCommand(Command::SetGraphicsVars, varsID); }
+    void setVao(uint32_t vaoID) { writeCommand(Command::SetVao, vaoID); }
+    void setMaterial(uint32_t materialID) { writeCommand(Command::SetMaterial, materialID); }
+    void pushConstants(uint32_t size, const void* pData);       // size is a multiple of 4, at most kMaxPushConstantsSize
+    void drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+    void multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount);
+
+    // Decodes the commands in order. Returns false at the first truncated or unknown command, or a frame of a mode without a name,
+    // after replaying the ones before it.
+    bool replay(Backend& backend) const;
+
+    const std::vector<std::string>& getModeNames() const { return mModeNames; }
+    uint32_t getFrameCount() const { return mFrameCount; }
+    size_t getSize() const { return mData.size(); }
+
+    static const uint32_t kMaxPushConstantsSize = 128;
+
+private:
+    CommandTrace() = default;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t frameCount;
+        uint32_t modeCount;
+        uint32_t modeNamesSize;     // Null-terminated names following the header
+        uint64_t size;              // Of the command stream following the names
+    };
+
+    void writeCommand(Command command, uint32_t value);
+    void writeVarint(uint64_t value);
+
+    std::vector<std::string> mModeNames;
+    std::vector<uint8_t> mData;
+    uint32_t mFrameCount = 0;
+    uint32_t mPushConstants[kMaxPushConstantsSize / 4] = {};    // Last pushed words, the reference of the deltas
+};
+
+// Replay backend that only tracks the bound state. Counts the commands per mode, times their decoding and hashes them, so
+// two replays of the same trace, or traces of two builds along the same camera path, can be compared. Flags draws issued without a
+// state, vars or VAO bound.
+class NullBackend : public CommandTrace::Backend
+{
+public:
+    struct ModeStats
+    {
+        uint32_t frames = 0;
+        uint64_t commands = 0;
+        uint64_t draws = 0;                 // Objects drawn, an indirect draw counts the instances of its args
+        uint64_t drawCalls = 0;
+        uint64_t stateBinds = 0;            // setGraphicsState and setGraphicsVars
+        uint64_t vaoChanges = 0;
+        uint64_t materialChanges = 0;
+        uint64_t pushConstantBytes = 0;
+        uint64_t invalidDraws = 0;
+        uint64_t hash = kHashSeed;
+        double replayMs = 0;                // Frames of this mode, from their beginFrame to the next one
+    };
+
+    // Closes the timing of the last frame
+    void finish();
+
+    // Indexed by the trace's modes
+    const std::vector<ModeStats>& getModeStats() const { return mModeStats; }
+
+    void beginFrame(uint32_t mode) override;
+    void setGraphicsState(uint32_t stateID) override;
+    void setGraphicsVars(uint32_t varsID) override;
+    void setVao(uint32_t vaoID) override;
+    void setMaterial(uint32_t materialID) override;
+    void pushConstants(uint32_t size, const void* pData) override;
+    void drawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) override;
+    void multiDrawIndexedIndirect(uint32_t bufferID, uint64_t offset, uint32_t drawCount, uint32_t stride, uint64_t instanceCount) override;
+
+private:
+    static const uint32_t kUnbound = UINT32_MAX;
+
+    ModeStats& getMode();
+    void hashValues(CommandTrace::Command command, const uint64_t* pValues, uint32_t count);
+    void checkDraw();
+
+    std::vector<ModeStats> mModeStats;
+    uint32_t mMode = 0;
+    bool mInFrame = false;
+    CpuTimer::TimePoint mFrameStart;
+
+    uint32_t mState = kUnbound;
+    uint32_t mVars = kUnbound;
+    uint32_t mVao = kUnbound;
+};
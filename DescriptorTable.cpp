@@ -0,0 +1,96 @@
+#include "DescriptorTable.h"
+
+DescriptorTable::SharedPtr DescriptorTable::create(const std::string& arrayName, uint32_t capacity)
+{
+    SharedPtr pTable = SharedPtr(new DescriptorTable());
+    pTable->mArrayName = arrayName;
+    pTable->mCapacity = capacity;
+    return pTable;
+}
+
+uint32_t DescriptorTable::add(const Texture::SharedPtr& pTexture)
+{
+    uint32_t slot;
+    if (!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else if (mTextures.size() < mCapacity)
+    {
+        slot = (uint32_t)mTextures.size();
+        mTextures.push_back(nullptr);
+        mSlotDirty.push_back(false);
+    }
+    else
+    {
+        return kInvalidSlot;
+    }
+
+    set(slot, pTexture);
+    return slot;
+}
+
+void DescriptorTable::remove(uint32_t slot)
+{
+    assert(slot < mTextures.size());
+    set(slot, nullptr);
+    mFreeSlots.push_back(slot);
+}
+
+void DescriptorTable::set(uint32_t slot, const Texture::SharedPtr& pTexture)
+{
+    assert(slot < mTextures.size());
+    if (mTextures[slot] == pTexture) return;
+    mTextures[slot] = pTexture;
+    markDirty(slot);
+}
+
+void DescriptorTable::markDirty(uint32_t slot)
+{
+    if (mSlotDirty[slot]) return;
+    mSlotDirty[slot] = true;
+    mDirtySlots.push_back(slot);
+}
+
+DescriptorTable::BindStats DescriptorTable::bind(const GraphicsVars::SharedPtr& pVars)
+{
+    BindStats stats;
+    ParameterBlock* pBlock = pVars->getDefaultBlock().get();
+
+    auto writeSlot = [&](uint32_t slot)
+    {
+        const Texture::SharedPtr& pTexture = mTextures[slot];
+        pBlock->setSrv(mBindLocation, slot, pTexture ? pTexture->getSRV() : nullptr);
+        stats.slotsWritten++;
+    };
+
+    if (mpBoundVars.lock() != pVars)
+    {
+        mBindLocation = pBlock->getReflection()->getResourceBinding(mArrayName);
+        if (mBindLocation.setIndex == ProgramReflection::kInvalidLocation)
+        {
+            logWarning("Bindless array " + mArrayName + " not found in the program");
+            mLastBindStats = stats;
+            return stats;
+        }
+        mpBoundVars = pVars;
+        stats.resolved = true;
+
+        // Fresh vars start out with every slot null
+        for (uint32_t slot = 0; slot < (uint32_t)mTextures.size(); ++slot)
+        {
+            if (mTextures[slot]) writeSlot(slot);
+        }
+    }
+    else
+    {
+        for (uint32_t slot : mDirtySlots) writeSlot(slot);
+    }
+
+    for (uint32_t slot : mDirtySlots) mSlotDirty[slot] = false;
+    mDirtySlots.clear();
+
+    mLastBindStats = stats;
+    return stats;
+}
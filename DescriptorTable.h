@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// CPU side of a bindless texture array, such as gBindlessTextures. Slots are stable: freed slots go on a free list and are
+// handed out again by later adds. The array's binding is resolved from reflection once per vars object, after that binding
+// only writes the slots that changed since the last bind, straight to the bind location instead of by name.
+class DescriptorTable
+{
+public:
+    using SharedPtr = std::shared_ptr<DescriptorTable>;
+
+    static const uint32_t kInvalidSlot = ~0u;
+
+    struct BindStats
+    {
+        uint32_t slotsWritten = 0;
+        bool resolved = false;          // The vars were new to the table, so the binding was looked up and every slot written
+    };
+
+    // capacity must not exceed the size of the shader array
+    static SharedPtr create(const std::string& arrayName, uint32_t capacity);
+
+    // Returns the slot holding the texture, which may be null, or kInvalidSlot if the table is full
+    uint32_t add(const Texture::SharedPtr& pTexture);
+
+    // Binds null to the slot and makes it available to add()
+    void remove(uint32_t slot);
+
+    void set(uint32_t slot, const Texture::SharedPtr& pTexture);
+
+    // Writes the slots into the array in the vars' default parameter block. Falcor rebuilds the descriptor set once when
+    // the vars are next bound, however many slots were written.
+    BindStats bind(const GraphicsVars::SharedPtr& pVars);
+
+    const Texture::SharedPtr& getTexture(uint32_t slot) const { return mTextures[slot]; }
+    uint32_t getSlotCount() const { return (uint32_t)mTextures.size(); }                           // Including free slots
+    uint32_t getUsedSlotCount() const { return (uint32_t)(mTextures.size() - mFreeSlots.size()); }
+    uint32_t getCapacity() const { return mCapacity; }
+    const BindStats& getLastBindStats() const { return mLastBindStats; }
+
+private:
+    DescriptorTable() = default;
+    void markDirty(uint32_t slot);
+
+    std::string mArrayName;
+    uint32_t mCapacity = 0;
+    std::vector<Texture::SharedPtr> mTextures;      // Indexed by slot
+    std::vector<uint32_t> mFreeSlots;
+    std::vector<uint32_t> mDirtySlots;              // Changed since the last bind
+    std::vector<bool> mSlotDirty;
+
+    // Vars the table was last bound to, expired when they are destroyed
+    std::weak_ptr<GraphicsVars> mpBoundVars;
+    ParameterBlock::BindLocation mBindLocation;
+    BindStats mLastBindStats;
+};
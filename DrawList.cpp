@@ -0,0 +1,1162 @@
+#include "DrawList.h"
+
+namespace
+{
+    // Dirty ranges separated by at most this many clean draws are uploaded together
+    const uint32_t kMergeGapDraws = 16;
+
+    // Upper bound of updateData calls per frame. Beyond this, the smallest gaps are bridged.
+    const size_t kMaxUploadRanges = 8;
+
+    // Draws per parallel build task
+    const uint32_t kBuildGrainSize = 1024;
+
+    // Smallest previous transforms buffer, so that a few moving draws don't cause repeated reallocation
+    const uint32_t kMinPrevTransforms = 256;
+
+    // Draws whose bounding sphere covers less than this radius over distance are too small to be worth rasterizing as occluders
+    const float kMinOccluderSize = 0.05f;
+
+    glm::mat3x4 computeInvTranspose(const glm::mat4& worldMat)
+    {
+        return transpose(inverse(glm::mat3(worldMat)));
+    }
+
+    // Everything that changes the packed output besides the scene
+    struct PackOptions
+    {
+        uint32_t repeatCount;
+        uint32_t layout;
+        uint32_t geometryFlags;
+        uint32_t drawConstantsSize;
+        uint32_t compactConstantsSize;
+        uint32_t materialDataSize;
+    };
+
+    template<typename T>
+    DrawListPack::SectionData makeSection(DrawListPack::Section section, const std::vector<T>& data)
+    {
+        return { section, data.data(), data.size() * sizeof(T) };
+    }
+}
+
+AffineTransform AffineTransform::fromMat4(const glm::mat4& mat)
+{
+    AffineTransform transform;
+    for (int row = 0; row < 3; ++row)
+    {
+        transform.rows[row] = glm::vec4(mat[0][row], mat[1][row], mat[2][row], mat[3][row]);
+    }
+    return transform;
+}
+
+glm::mat4 AffineTransform::toMat4() const
+{
+    glm::mat4 mat(1.0f);
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            mat[column][row] = rows[row][column];
+        }
+    }
+    return mat;
+}
+
+CompactDrawConstants CompactDrawConstants::fromFull(const DrawConstants& drawConstants, uint32_t prevTransformIndex)
+{
+    CompactDrawConstants packed;
+    packed.world = AffineTransform::fromMat4(drawConstants.worldMat);
+    packed.geometryID = drawConstants.geometryID;
+    packed.materialID = drawConstants.materialID;
+    packed.flags = drawConstants.prevWorldMat == drawConstants.worldMat ? kStaticFlag : 0;
+    packed.prevTransformIndex = prevTransformIndex;
+    return packed;
+}
+
+DrawList::SharedPtr DrawList::create(const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, uint32_t repeatCount, ThreadPool* pPool, DrawConstantsLayout layout, bool deferUpload)
+{
+    SharedPtr pDrawList = SharedPtr(new DrawList());
+    pDrawList->mpScene = pScene;
+    pDrawList->mpProgram = pProgram;
+    pDrawList->mRepeatCount = repeatCount;
+    pDrawList->mLayout = layout;
+    pDrawList->mpMaterialTable = MaterialTable::create();
+    pDrawList->mpCuller = FrustumCuller::create();
+
+    // Counting pass over a single copy of the scene. Every repeat produces the same draw sequence.
+    std::vector<Mesh::SharedPtr> sceneMeshes;
+    std::vector<Model::SharedPtr> sceneModels;
+    std::vector<glm::mat4> sceneMeshTransforms;
+    std::vector<uint32_t> sceneInstanceIndices;
+    std::vector<uint32_t> sceneMaterialIDs;
+
+    auto& instances = pDrawList->mInstances;
+    for (uint32_t modelID = 0; modelID < pScene->getModelCount(); ++modelID)
+    {
+        const auto& model = pScene->getModel(modelID);
+        for (uint32_t modelInstanceID = 0; modelInstanceID < pScene->getModelInstanceCount(modelID); ++modelInstanceID)
+        {
+            for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
+            {
+                const auto& mesh = model->getMesh(meshID);
+                for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
+                {
+                    const auto& meshInstance = model->getMeshInstance(meshID, meshInstanceID);
+
+                    // Skinned vertices already include the mesh's place in the model through the bone hierarchy
+                    sceneMeshes.push_back(mesh);
+                    sceneModels.push_back(model);
+                    sceneMeshTransforms.push_back(mesh->hasBones() ? glm::mat4(1.0f) : meshInstance->getTransformMatrix());
+                    sceneInstanceIndices.push_back((uint32_t)instances.size());
+                    sceneMaterialIDs.push_back(pDrawList->mpMaterialTable->addMaterial(mesh->getMaterial()));
+                }
+            }
+
+            TrackedInstance instance;
+            instance.pInstance = pScene->getModelInstance(modelID, modelInstanceID);
+            instance.worldMat = instance.pInstance->getTransformMatrix();
+            instance.prevWorldMat = instance.pInstance->getPrevTransformMatrix();
+            instances.push_back(std::move(instance));
+        }
+    }
+
+    const uint32_t drawsPerRepeat = (uint32_t)sceneMeshes.size();
+    const uint32_t drawCount = drawsPerRepeat * repeatCount;
+
+    // Group draws by mesh so that all instances of a mesh occupy consecutive drawIDs and can be issued as a single instanced draw.
+    // Within a group, every scene draw owns repeatCount consecutive slots.
+    auto& groups = pDrawList->mMeshGroups;
+    std::unordered_map<const Mesh*, uint32_t> groupLookup;
+    std::vector<uint32_t> sceneGroups(drawsPerRepeat);
+    for (uint32_t sceneDrawID = 0; sceneDrawID < drawsPerRepeat; ++sceneDrawID)
+    {
+        const auto& mesh = sceneMeshes[sceneDrawID];
+        auto it = groupLookup.find(mesh.get());
+        if (it == groupLookup.end())
+        {
+            it = groupLookup.emplace(mesh.get(), (uint32_t)groups.size()).first;
+            groups.push_back({ mesh, sceneModels[sceneDrawID], 0, 0 });
+        }
+        sceneGroups[sceneDrawID] = it->second;
+        groups[it->second].drawCount += repeatCount;
+    }
+
+    uint32_t firstDraw = 0;
+    for (auto& group : groups)
+    {
+        group.firstDraw = firstDraw;
+        firstDraw += group.drawCount;
+    }
+
+    std::vector<uint32_t> groupCursors(groups.size(), 0);
+    std::vector<uint32_t> sceneDrawBases(drawsPerRepeat);
+    for (uint32_t sceneDrawID = 0; sceneDrawID < drawsPerRepeat; ++sceneDrawID)
+    {
+        const uint32_t group = sceneGroups[sceneDrawID];
+        sceneDrawBases[sceneDrawID] = groups[group].firstDraw + groupCursors[group];
+        groupCursors[group] += repeatCount;
+
+        // Consecutive mesh instances of the same mesh within a model instance extend the previous range
+        auto& drawRanges = instances[sceneInstanceIndices[sceneDrawID]].drawRanges;
+        if (!drawRanges.empty() && drawRanges.back().first + drawRanges.back().count == sceneDrawBases[sceneDrawID])
+        {
+            drawRanges.back().count += repeatCount;
+        }
+        else
+        {
+            drawRanges.push_back({ sceneDrawBases[sceneDrawID], repeatCount });
+        }
+    }
+
+    // Fill pass, each draw writes only its own slot
+    pDrawList->mMeshes.resize(drawCount);
+    pDrawList->mMeshTransforms.resize(drawCount);
+    pDrawList->mConstants.resize(drawCount);
+    pDrawList->mpCuller->resize(drawCount);
+
+    const bool compact = layout == DrawConstantsLayout::Compact;
+    if (compact)
+    {
+        CompactDrawConstants initial = {};
+        initial.prevTransformIndex = CompactDrawConstants::kInvalidIndex;
+        pDrawList->mCompactConstants.resize(drawCount, initial);
+    }
+
+    parallelFor(pPool, drawCount, kBuildGrainSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const uint32_t sceneDrawID = i / repeatCount;
+            const uint32_t drawID = sceneDrawBases[sceneDrawID] + i % repeatCount;
+            pDrawList->mMeshes[drawID] = sceneMeshes[sceneDrawID];
+            pDrawList->mMeshTransforms[drawID] = sceneMeshTransforms[sceneDrawID];
+
+            DrawConstants& drawConstants = pDrawList->mConstants[drawID];
+            drawConstants.drawID = drawID;
+            drawConstants.meshID = sceneMeshes[sceneDrawID]->getId();
+            drawConstants.materialID = sceneMaterialIDs[sceneDrawID];
+            drawConstants.geometryID = sceneGroups[sceneDrawID];
+            pDrawList->updateTransforms(drawID, instances[sceneInstanceIndices[sceneDrawID]]);
+            pDrawList->updateBounds(drawID);
+
+            // No draw has a previous transform slot yet, so packing doesn't touch shared state
+            if (compact) pDrawList->packCompact(drawID);
+        }
+    });
+
+    if (compact)
+    {
+        // Slots in drawID order, independent of the thread count
+        for (uint32_t drawID = 0; drawID < drawCount; ++drawID)
+        {
+            const CompactDrawConstants& packed = pDrawList->mCompactConstants[drawID];
+            if (!(packed.flags & CompactDrawConstants::kStaticFlag)) pDrawList->assignPrevTransform(drawID);
+        }
+    }
+
+    if (!deferUpload) pDrawList->uploadConstants();
+    return pDrawList;
+}
+
+void DrawList::uploadConstants()
+{
+    if (mDrawConstantsBuffer || mConstants.empty()) return;
+
+    // setBlob() only fills the buffer's CPU shadow, which the next bind uploads whole. The initial contents go up right away, so
+    // the shadow is clean and the ranges update() writes with updateData() are the only later copies.
+    if (mLayout == DrawConstantsLayout::Compact)
+    {
+        mDrawConstantsBuffer = StructuredBuffer::create(mpProgram, "gDrawConstants", mCompactConstants.size());
+        mDrawConstantsBuffer->setBlob(mCompactConstants.data(), 0, sizeof(CompactDrawConstants) * mCompactConstants.size());
+        uploadPrevTransforms(0, (uint32_t)mPrevTransforms.size());
+    }
+    else
+    {
+        mDrawConstantsBuffer = StructuredBuffer::create(mpProgram, "gDrawConstants", mConstants.size());
+        mDrawConstantsBuffer->setBlob(mConstants.data(), 0, sizeof(DrawConstants) * mConstants.size());
+    }
+    mDrawConstantsBuffer->uploadToGPU();
+}
+
+uint64_t DrawList::computePackKey(const std::string& scenePath, const Scene::SharedPtr& pScene, uint32_t repeatCount, DrawConstantsLayout layout, GeometryPool::Flags geometryFlags)
+{
+    // Keeping CPU copies doesn't change the data
+    PackOptions options = {};
+    options.repeatCount = repeatCount;
+    options.layout = (uint32_t)layout;
+    options.geometryFlags = (uint32_t)(geometryFlags & ~(GeometryPool::Flags::KeepCpuData | GeometryPool::Flags::KeepOccluders));
+    options.drawConstantsSize = sizeof(DrawConstants);
+    options.compactConstantsSize = sizeof(CompactDrawConstants);
+    options.materialDataSize = sizeof(BindlessMaterialData);
+    return DrawListPack::computeKey(scenePath, pScene, &options, sizeof(options));
+}
+
+DrawList::SharedPtr DrawList::createFromPack(const std::string& path, uint64_t key, const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, ThreadPool* pPool, bool deferUpload)
+{
+    DrawListPack::SharedPtr pPack = DrawListPack::open(path, key);
+    if (!pPack) return nullptr;
+
+    const DrawListPack::Info& info = pPack->getInfo();
+    const uint32_t drawCount = info.drawCount;
+    const bool compact = info.layout == (uint32_t)DrawConstantsLayout::Compact;
+
+    size_t constantCount, compactCount, prevCount, transformCount, groupCount, instanceCount, rangeCount, materialCount;
+    const DrawConstants* pConstants = pPack->getSection<DrawConstants>(DrawListPack::Section::Constants, constantCount);
+    const CompactDrawConstants* pCompact = pPack->getSection<CompactDrawConstants>(DrawListPack::Section::CompactConstants, compactCount);
+    const AffineTransform* pPrevTransforms = pPack->getSection<AffineTransform>(DrawListPack::Section::PrevTransforms, prevCount);
+    const glm::mat4* pMeshTransforms = pPack->getSection<glm::mat4>(DrawListPack::Section::MeshTransforms, transformCount);
+    const DrawListPack::PackedMeshGroup* pGroups = pPack->getSection<DrawListPack::PackedMeshGroup>(DrawListPack::Section::MeshGroups, groupCount);
+    const DrawListPack::PackedInstance* pInstances = pPack->getSection<DrawListPack::PackedInstance>(DrawListPack::Section::Instances, instanceCount);
+    const DrawListPack::PackedRange* pRanges = pPack->getSection<DrawListPack::PackedRange>(DrawListPack::Section::InstanceRanges, rangeCount);
+    const BindlessMaterialData* pMaterials = pPack->getSection<BindlessMaterialData>(DrawListPack::Section::Materials, materialCount);
+
+    if (drawCount == 0 || constantCount != drawCount || transformCount != drawCount || (compact && compactCount != drawCount) || groupCount == 0 || instanceCount == 0)
+    {
+        logWarning("Draw list pack " + path + " is incomplete, rebuilding");
+        return nullptr;
+    }
+
+    SharedPtr pDrawList = SharedPtr(new DrawList());
+    pDrawList->mpScene = pScene;
+    pDrawList->mpProgram = pProgram;
+    pDrawList->mRepeatCount = info.repeatCount;
+    pDrawList->mLayout = compact ? DrawConstantsLayout::Compact : DrawConstantsLayout::Full;
+    pDrawList->mpMaterialTable = MaterialTable::create();
+    pDrawList->mpCuller = FrustumCuller::create();
+
+    // Mesh groups and model instances reference the scene by index. Validate everything before trusting any drawID.
+    auto& groups = pDrawList->mMeshGroups;
+    pDrawList->mMeshes.resize(drawCount);
+    for (size_t i = 0; i < groupCount; ++i)
+    {
+        const DrawListPack::PackedMeshGroup& packed = pGroups[i];
+        if (packed.modelID >= pScene->getModelCount() || packed.meshID >= pScene->getModel(packed.modelID)->getMeshCount() || packed.firstDraw > drawCount || packed.drawCount > drawCount - packed.firstDraw)
+        {
+            logWarning("Draw list pack " + path + " doesn't match the scene, rebuilding");
+            return nullptr;
+        }
+
+        // mMeshes doubles as the coverage map, the groups must cover every drawID exactly once
+        const auto first = pDrawList->mMeshes.begin() + packed.firstDraw;
+        const auto last = first + packed.drawCount;
+        if (std::any_of(first, last, [](const Mesh::SharedPtr& pMesh) { return pMesh != nullptr; }))
+        {
+            logWarning("Draw list pack " + path + " has overlapping mesh groups, rebuilding");
+            return nullptr;
+        }
+
+        const Mesh::SharedPtr& pMesh = pScene->getModel(packed.modelID)->getMesh(packed.meshID);
+        groups.push_back({ pMesh, pScene->getModel(packed.modelID), packed.firstDraw, packed.drawCount });
+        std::fill(first, last, pMesh);
+    }
+    if (std::find(pDrawList->mMeshes.begin(), pDrawList->mMeshes.end(), nullptr) != pDrawList->mMeshes.end())
+    {
+        logWarning("Draw list pack " + path + " has draws outside of any mesh group, rebuilding");
+        return nullptr;
+    }
+
+    auto& instances = pDrawList->mInstances;
+    for (size_t i = 0; i < instanceCount; ++i)
+    {
+        const DrawListPack::PackedInstance& packed = pInstances[i];
+        if (packed.modelID >= pScene->getModelCount() || packed.modelInstanceID >= pScene->getModelInstanceCount(packed.modelID) || packed.firstRange > rangeCount || packed.rangeCount > rangeCount - packed.firstRange)
+        {
+            logWarning("Draw list pack " + path + " doesn't match the scene, rebuilding");
+            return nullptr;
+        }
+
+        TrackedInstance instance;
+        instance.pInstance = pScene->getModelInstance(packed.modelID, packed.modelInstanceID);
+        instance.worldMat = packed.worldMat;
+        instance.prevWorldMat = packed.prevWorldMat;
+        for (uint32_t r = packed.firstRange; r < packed.firstRange + packed.rangeCount; ++r)
+        {
+            if (pRanges[r].first > drawCount || pRanges[r].count > drawCount - pRanges[r].first)
+            {
+                logWarning("Draw list pack " + path + " doesn't match the scene, rebuilding");
+                return nullptr;
+            }
+            instance.drawRanges.push_back({ pRanges[r].first, pRanges[r].count });
+        }
+        instances.push_back(std::move(instance));
+    }
+
+    // The material table holds texture objects, so it's rebuilt from the scene in the same order as create(). The packed constants
+    // must describe the same table, otherwise the materialIDs in the draw constants are wrong.
+    for (uint32_t modelID = 0; modelID < pScene->getModelCount(); ++modelID)
+    {
+        const auto& model = pScene->getModel(modelID);
+        for (uint32_t modelInstanceID = 0; modelInstanceID < pScene->getModelInstanceCount(modelID); ++modelInstanceID)
+        {
+            for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
+            {
+                for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
+                {
+                    pDrawList->mpMaterialTable->addMaterial(model->getMesh(meshID)->getMaterial());
+                }
+            }
+        }
+    }
+
+    const auto& materialData = pDrawList->mpMaterialTable->getMaterialData();
+    if (materialCount != materialData.size() || memcmp(pMaterials, materialData.data(), materialCount * sizeof(BindlessMaterialData)) != 0)
+    {
+        logWarning("Draw list pack " + path + " has different materials than the scene, rebuilding");
+        return nullptr;
+    }
+
+    // The compact constants index the previous transforms, which packCompact() and updateConstants() write through
+    if (compact)
+    {
+        for (uint32_t drawID = 0; drawID < drawCount; ++drawID)
+        {
+            const uint32_t prevIndex = pCompact[drawID].prevTransformIndex;
+            if (prevIndex != CompactDrawConstants::kInvalidIndex && prevIndex >= prevCount)
+            {
+                logWarning("Draw list pack " + path + " has a previous transform index out of range, rebuilding");
+                return nullptr;
+            }
+        }
+    }
+
+    // Everything checks out, copy the CPU mirrors
+    pDrawList->mConstants.assign(pConstants, pConstants + drawCount);
+    pDrawList->mMeshTransforms.assign(pMeshTransforms, pMeshTransforms + drawCount);
+    pDrawList->mpCuller->resize(drawCount);
+    parallelFor(pPool, drawCount, kBuildGrainSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t drawID = begin; drawID < end; ++drawID)
+        {
+            pDrawList->updateBounds(drawID);
+        }
+    });
+
+    if (compact)
+    {
+        assert(compactCount == drawCount);
+        pDrawList->mCompactConstants.assign(pCompact, pCompact + drawCount);
+        pDrawList->mPrevTransforms.assign(pPrevTransforms, pPrevTransforms + prevCount);
+    }
+
+    pDrawList->mFromPack = true;
+    pDrawList->mpPack = pPack;
+    if (!deferUpload) pDrawList->uploadConstants();
+    return pDrawList;
+}
+
+bool DrawList::writePack(const std::string& path, uint64_t key) const
+{
+    if (!mpGeometryPool || mpGeometryPool->getCpuIndices().empty())
+    {
+        logWarning("Writing a draw list pack requires multi-draw data built with GeometryPool::Flags::KeepCpuData");
+        return false;
+    }
+
+    // The bind pose and influences aren't packed, scenes with skinned meshes build their geometry on every launch
+    if (mpSkinner)
+    {
+        logInfo("Not writing a draw list pack for a scene with skinned meshes");
+        return false;
+    }
+
+    const auto& vertexStreams = mpGeometryPool->getCpuVertexStreams();
+    if (vertexStreams.size() > DrawListPack::kMaxVertexStreams)
+    {
+        logWarning("Draw list pack supports at most " + std::to_string(DrawListPack::kMaxVertexStreams) + " vertex streams");
+        return false;
+    }
+
+    // Meshes are stored by model and mesh index
+    std::unordered_map<const Mesh*, std::pair<uint32_t, uint32_t>> meshLookup;
+    for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); ++modelID)
+    {
+        const auto& model = mpScene->getModel(modelID);
+        for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
+        {
+            meshLookup.emplace(model->getMesh(meshID).get(), std::make_pair(modelID, meshID));
+        }
+    }
+
+    std::vector<DrawListPack::PackedMeshGroup> groups;
+    for (const auto& group : mMeshGroups)
+    {
+        const auto& ids = meshLookup.at(group.pMesh.get());
+        groups.push_back({ ids.first, ids.second, group.firstDraw, group.drawCount });
+    }
+
+    // Model instances in the order create() tracks them
+    std::unordered_map<const Scene::ModelInstance*, std::pair<uint32_t, uint32_t>> instanceLookup;
+    for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); ++modelID)
+    {
+        for (uint32_t modelInstanceID = 0; modelInstanceID < mpScene->getModelInstanceCount(modelID); ++modelInstanceID)
+        {
+            instanceLookup.emplace(mpScene->getModelInstance(modelID, modelInstanceID).get(), std::make_pair(modelID, modelInstanceID));
+        }
+    }
+
+    std::vector<DrawListPack::PackedInstance> instances;
+    std::vector<DrawListPack::PackedRange> ranges;
+    for (const auto& instance : mInstances)
+    {
+        const auto& ids = instanceLookup.at(instance.pInstance.get());
+        DrawListPack::PackedInstance packed;
+        packed.worldMat = instance.worldMat;
+        packed.prevWorldMat = instance.prevWorldMat;
+        packed.modelID = ids.first;
+        packed.modelInstanceID = ids.second;
+        packed.firstRange = (uint32_t)ranges.size();
+        packed.rangeCount = (uint32_t)instance.drawRanges.size();
+        instances.push_back(packed);
+
+        for (const auto& range : instance.drawRanges)
+        {
+            ranges.push_back({ range.first, range.count });
+        }
+    }
+
+    std::vector<GeometryPool::MeshRange> meshRanges;
+    for (uint32_t i = 0; i < mpGeometryPool->getMeshCount(); ++i)
+    {
+        meshRanges.push_back(mpGeometryPool->getMeshRange(i));
+    }
+
+    DrawListPack::Info info;
+    info.key = key;
+    info.geometryHash = mpGeometryPool->getContentHash();
+    info.drawCount = getDrawCount();
+    info.repeatCount = mRepeatCount;
+    info.layout = (uint32_t)mLayout;
+    info.vertexStreamCount = (uint32_t)vertexStreams.size();
+    info.shortIndices = mpGeometryPool->getIndexFormat() == ResourceFormat::R16Uint ? 1 : 0;
+    info.quantizedVertices = mpGeometryPool->isQuantized() ? 1 : 0;
+    info.optimizeBefore = mpGeometryPool->getOptimizeStats().before;
+    info.optimizeAfter = mpGeometryPool->getOptimizeStats().after;
+
+    std::vector<DrawListPack::SectionData> sections =
+    {
+        makeSection(DrawListPack::Section::Constants, mConstants),
+        makeSection(DrawListPack::Section::CompactConstants, mCompactConstants),
+        makeSection(DrawListPack::Section::PrevTransforms, mPrevTransforms),
+        makeSection(DrawListPack::Section::MeshTransforms, mMeshTransforms),
+        makeSection(DrawListPack::Section::MeshGroups, groups),
+        makeSection(DrawListPack::Section::Instances, instances),
+        makeSection(DrawListPack::Section::InstanceRanges, ranges),
+        makeSection(DrawListPack::Section::Materials, mpMaterialTable->getMaterialData()),
+        makeSection(DrawListPack::Section::MeshRanges, meshRanges),
+        makeSection(DrawListPack::Section::DrawArgs, mDrawArgs),
+        makeSection(DrawListPack::Section::Indices, mpGeometryPool->getCpuIndices()),
+    };
+    for (uint32_t i = 0; i < (uint32_t)vertexStreams.size(); ++i)
+    {
+        sections.push_back(makeSection((DrawListPack::Section)((uint32_t)DrawListPack::Section::VertexStreams + i), vertexStreams[i]));
+    }
+
+    return DrawListPack::write(path, info, sections);
+}
+
+void DrawList::updateTransforms(uint32_t drawID, const TrackedInstance& instance)
+{
+    const glm::mat4& meshMat = mMeshTransforms[drawID];
+
+    DrawConstants& drawConstants = mConstants[drawID];
+    drawConstants.worldMat = instance.worldMat * meshMat;
+    drawConstants.prevWorldMat = instance.prevWorldMat * meshMat;
+    drawConstants.worldInvTransposeMat = computeInvTranspose(drawConstants.worldMat);
+}
+
+void DrawList::packCompact(uint32_t drawID)
+{
+    const DrawConstants& drawConstants = mConstants[drawID];
+    CompactDrawConstants& packed = mCompactConstants[drawID];
+    packed = CompactDrawConstants::fromFull(drawConstants, packed.prevTransformIndex);
+
+    // Static draws keep their slot, the shader just doesn't read it
+    if (!(packed.flags & CompactDrawConstants::kStaticFlag) && packed.prevTransformIndex != CompactDrawConstants::kInvalidIndex)
+    {
+        mPrevTransforms[packed.prevTransformIndex] = AffineTransform::fromMat4(drawConstants.prevWorldMat);
+        mDirtyPrevBegin = mDirtyPrevBegin == mDirtyPrevEnd ? packed.prevTransformIndex : std::min(mDirtyPrevBegin, packed.prevTransformIndex);
+        mDirtyPrevEnd = std::max(mDirtyPrevEnd, packed.prevTransformIndex + 1);
+    }
+}
+
+void DrawList::assignPrevTransform(uint32_t drawID)
+{
+    CompactDrawConstants& packed = mCompactConstants[drawID];
+    assert(packed.prevTransformIndex == CompactDrawConstants::kInvalidIndex);
+
+    packed.prevTransformIndex = (uint32_t)mPrevTransforms.size();
+    mPrevTransforms.push_back(AffineTransform::fromMat4(mConstants[drawID].prevWorldMat));
+    mDirtyPrevBegin = mDirtyPrevBegin == mDirtyPrevEnd ? packed.prevTransformIndex : std::min(mDirtyPrevBegin, packed.prevTransformIndex);
+    mDirtyPrevEnd = packed.prevTransformIndex + 1;
+}
+
+void DrawList::uploadPrevTransforms(uint32_t first, uint32_t count)
+{
+    // Grow geometrically. A new buffer needs every slot.
+    const uint32_t slotCount = (uint32_t)mPrevTransforms.size();
+    const size_t stride = sizeof(AffineTransform);
+    if (!mPrevTransformsBuffer || slotCount > mPrevTransformsCapacity)
+    {
+        mPrevTransformsCapacity = std::max(kMinPrevTransforms, slotCount * 2);
+        mPrevTransformsBuffer = StructuredBuffer::create(mpProgram, "gPrevWorldTransforms", mPrevTransformsCapacity);
+        if (slotCount > 0) mPrevTransformsBuffer->setBlob(mPrevTransforms.data(), 0, slotCount * stride);
+        mPrevTransformsBuffer->uploadToGPU();
+        mUploadStats.uploadedBytes += mPrevTransformsCapacity * stride;
+        mUploadStats.uploadCalls++;
+        return;
+    }
+
+    if (count == 0) return;
+
+    // Past the initial upload the shadow is left stale, see uploadConstants()
+    mPrevTransformsBuffer->updateData(&mPrevTransforms[first], first * stride, count * stride);
+    mUploadStats.uploadedBytes += count * stride;
+    mUploadStats.uploadCalls++;
+}
+
+size_t DrawList::getGpuConstantsSize() const
+{
+    if (mLayout == DrawConstantsLayout::Compact)
+    {
+        return mCompactConstants.size() * sizeof(CompactDrawConstants) + mPrevTransforms.size() * sizeof(AffineTransform);
+    }
+    return mConstants.size() * sizeof(DrawConstants);
+}
+
+void DrawList::updateBounds(uint32_t drawID)
+{
+    const BoundingBox box = mMeshes[drawID]->getBoundingBox().transform(mConstants[drawID].worldMat);
+    mpCuller->setBounds(drawID, box);
+    if (mpBvh) mpBvh->setBounds(drawID, box);
+}
+
+const DrawList::UploadStats& DrawList::update()
+{
+    mUploadStats = {};
+    mDirtyRanges.clear();
+    mDirtyPrevBegin = 0;
+    mDirtyPrevEnd = 0;
+
+    const bool compact = mLayout == DrawConstantsLayout::Compact;
+
+    for (auto& instance : mInstances)
+    {
+        const glm::mat4& worldMat = instance.pInstance->getTransformMatrix();
+
+        // An instance that stopped moving still needs one more upload so that prev catches up with current
+        const bool moved = worldMat != instance.worldMat;
+        const bool settling = instance.prevWorldMat != instance.worldMat;
+        if (!moved && !settling) continue;
+
+        instance.prevWorldMat = instance.worldMat;
+        instance.worldMat = worldMat;
+
+        for (const auto& range : instance.drawRanges)
+        {
+            for (uint32_t drawID = range.first; drawID < range.first + range.count; ++drawID)
+            {
+                updateTransforms(drawID, instance);
+                updateBounds(drawID);
+
+                if (compact)
+                {
+                    packCompact(drawID);
+                    const CompactDrawConstants& packed = mCompactConstants[drawID];
+                    if (!(packed.flags & CompactDrawConstants::kStaticFlag) && packed.prevTransformIndex == CompactDrawConstants::kInvalidIndex)
+                    {
+                        assignPrevTransform(drawID);
+                    }
+                }
+            }
+            mDirtyRanges.push_back(range);
+            mUploadStats.dirtyDraws += range.count;
+        }
+        mUploadStats.dirtyInstances++;
+    }
+
+    if (!mDirtyRanges.empty())
+    {
+        uploadDirtyRanges();
+    }
+
+    if (compact && mDirtyPrevEnd > mDirtyPrevBegin)
+    {
+        uploadPrevTransforms(mDirtyPrevBegin, mDirtyPrevEnd - mDirtyPrevBegin);
+    }
+
+    return mUploadStats;
+}
+
+void DrawList::uploadDirtyRanges()
+{
+    std::sort(mDirtyRanges.begin(), mDirtyRanges.end(), [](const DrawRange& a, const DrawRange& b) { return a.first < b.first; });
+
+    // Merge ranges that touch or are separated by a small gap
+    std::vector<DrawRange> merged;
+    merged.reserve(mDirtyRanges.size());
+    merged.push_back(mDirtyRanges[0]);
+    for (size_t i = 1; i < mDirtyRanges.size(); ++i)
+    {
+        DrawRange& last = merged.back();
+        const DrawRange& range = mDirtyRanges[i];
+        const uint32_t lastEnd = last.first + last.count;
+        if (range.first <= lastEnd + kMergeGapDraws)
+        {
+            last.count = std::max(lastEnd, range.first + range.count) - last.first;
+        }
+        else
+        {
+            merged.push_back(range);
+        }
+    }
+
+    // Still too many calls: bridge the smallest gaps until we are within budget
+    if (merged.size() > kMaxUploadRanges)
+    {
+        std::vector<uint32_t> gapOrder(merged.size() - 1);
+        for (uint32_t i = 0; i < (uint32_t)gapOrder.size(); ++i) gapOrder[i] = i;
+
+        auto gapAfter = [&](uint32_t i) { return merged[i + 1].first - (merged[i].first + merged[i].count); };
+        const size_t bridgeCount = merged.size() - kMaxUploadRanges;
+        std::nth_element(gapOrder.begin(), gapOrder.begin() + bridgeCount, gapOrder.end(), [&](uint32_t a, uint32_t b) { return gapAfter(a) < gapAfter(b); });
+
+        std::vector<bool> bridged(merged.size() - 1, false);
+        for (size_t i = 0; i < bridgeCount; ++i) bridged[gapOrder[i]] = true;
+
+        std::vector<DrawRange> bridgedRanges;
+        bridgedRanges.reserve(kMaxUploadRanges);
+        bridgedRanges.push_back(merged[0]);
+        for (size_t i = 1; i < merged.size(); ++i)
+        {
+            if (bridged[i - 1])
+            {
+                DrawRange& last = bridgedRanges.back();
+                last.count = merged[i].first + merged[i].count - last.first;
+            }
+            else
+            {
+                bridgedRanges.push_back(merged[i]);
+            }
+        }
+        merged.swap(bridgedRanges);
+    }
+
+    const bool compact = mLayout == DrawConstantsLayout::Compact;
+    const size_t stride = compact ? sizeof(CompactDrawConstants) : sizeof(DrawConstants);
+    for (const auto& range : merged)
+    {
+        const void* pData = compact ? (const void*)&mCompactConstants[range.first] : (const void*)&mConstants[range.first];
+        mDrawConstantsBuffer->updateData(pData, range.first * stride, range.count * stride);
+        mUploadStats.uploadedDraws += range.count;
+        mUploadStats.uploadCalls++;
+        mUploadStats.uploadedBytes += range.count * stride;
+    }
+}
+
+void DrawList::buildMultiDrawData(ThreadPool* pPool, GeometryPool::Flags geometryFlags)
+{
+    if (mpGeometryPool || mConstants.empty()) return;
+
+    // The pack isn't needed once its geometry is uploaded
+    const bool loaded = mpPack && loadPackedGeometry(geometryFlags);
+    mpPack = nullptr;
+    if (loaded)
+    {
+        createMultiDrawResources();
+        return;
+    }
+    mFromPack = false;
+
+    setGeometryPool(GeometryPool::create(getGroupMeshes(), pPool, geometryFlags));
+}
+
+std::vector<Mesh::SharedPtr> DrawList::getGroupMeshes() const
+{
+    std::vector<Mesh::SharedPtr> meshes;
+    for (const auto& group : mMeshGroups)
+    {
+        meshes.push_back(group.pMesh);
+    }
+    return meshes;
+}
+
+void DrawList::setGeometryPool(const GeometryPool::SharedPtr& pGeometryPool)
+{
+    assert(!mpGeometryPool && pGeometryPool->getMeshCount() == mMeshGroups.size());
+    mpGeometryPool = pGeometryPool;
+    mpPack = nullptr;
+
+    // One instanced draw per mesh. gl_InstanceID (startInstanceLocation + instance) is the drawID.
+    mDrawArgs.resize(mMeshGroups.size());
+    for (uint32_t groupIndex = 0; groupIndex < (uint32_t)mMeshGroups.size(); ++groupIndex)
+    {
+        const MeshGroup& group = mMeshGroups[groupIndex];
+        const GeometryPool::MeshRange& range = mpGeometryPool->getMeshRange(groupIndex);
+
+        DrawIndexedArguments args = {};
+        args.indexCountPerInstance = range.lods[0].indexCount;
+        args.startIndexLocation = range.lods[0].startIndex;
+        args.baseVertexLocation = range.baseVertex;
+        args.instanceCount = group.drawCount;
+        args.startInstanceLocation = group.firstDraw;
+        mDrawArgs[groupIndex] = args;
+    }
+
+    createMultiDrawResources();
+}
+
+bool DrawList::loadPackedGeometry(GeometryPool::Flags geometryFlags)
+{
+    const DrawListPack::Info& info = mpPack->getInfo();
+
+    size_t rangeCount, argCount;
+    const GeometryPool::MeshRange* pMeshRanges = mpPack->getSection<GeometryPool::MeshRange>(DrawListPack::Section::MeshRanges, rangeCount);
+    const DrawIndexedArguments* pDrawArgs = mpPack->getSection<DrawIndexedArguments>(DrawListPack::Section::DrawArgs, argCount);
+    if (rangeCount != mMeshGroups.size() || argCount != mMeshGroups.size() || info.vertexStreamCount > DrawListPack::kMaxVertexStreams)
+    {
+        logWarning("Draw list pack has no usable geometry, rebuilding it");
+        return false;
+    }
+
+    GeometryPool::DataRange indices;
+    indices.pData = mpPack->getSectionData(DrawListPack::Section::Indices, indices.size);
+
+    std::vector<GeometryPool::DataRange> vertexStreams(info.vertexStreamCount);
+    for (uint32_t i = 0; i < info.vertexStreamCount; ++i)
+    {
+        vertexStreams[i].pData = mpPack->getSectionData((DrawListPack::Section)((uint32_t)DrawListPack::Section::VertexStreams + i), vertexStreams[i].size);
+    }
+
+    const auto& protoVao = mMeshGroups[0].pMesh->getVao();
+    if (!indices.pData || vertexStreams.size() != protoVao->getVertexBuffersCount())
+    {
+        logWarning("Draw list pack has no usable geometry, rebuilding it");
+        return false;
+    }
+
+    GeometryPool::OptimizeStats optimizeStats;
+    optimizeStats.before = info.optimizeBefore;
+    optimizeStats.after = info.optimizeAfter;
+
+    std::vector<GeometryPool::MeshRange> meshRanges(pMeshRanges, pMeshRanges + rangeCount);
+    const ResourceFormat indexFormat = info.shortIndices ? ResourceFormat::R16Uint : ResourceFormat::R32Uint;
+    const GeometryPool::Flags quantizeFlags = info.quantizedVertices ? GeometryPool::Flags::QuantizeVertices : GeometryPool::Flags::None;
+    mpGeometryPool = GeometryPool::createFromData(protoVao, meshRanges, vertexStreams, indices, indexFormat, optimizeStats, (geometryFlags & GeometryPool::Flags::KeepOccluders) | quantizeFlags);
+
+    // The hash covers every byte that was uploaded, so a corrupted pack is caught here rather than on screen
+    if (mpGeometryPool->getContentHash() != info.geometryHash)
+    {
+        logWarning("Draw list pack geometry is corrupted, rebuilding it");
+        mpGeometryPool = nullptr;
+        return false;
+    }
+
+    mDrawArgs.assign(pDrawArgs, pDrawArgs + argCount);
+    return true;
+}
+
+void DrawList::createMultiDrawResources()
+{
+    mIndirectArgBuffer = Buffer::create(getDrawCount() * sizeof(DrawIndexedArguments), Resource::BindFlags::IndirectArg, Buffer::CpuAccess::Write, nullptr);
+    mIndirectArgBuffer->updateData(mDrawArgs.data(), 0, mDrawArgs.size() * sizeof(DrawIndexedArguments));
+    mpIndirectArgs = mIndirectArgBuffer.get();
+    mIndirectArgCount = (uint32_t)mDrawArgs.size();
+
+    mpMaterialTable->createMaterialBuffer(mpProgram);
+    mProtoMaterial = mpScene->getModel(0)->getMesh(0)->getMaterial();
+
+    // Relative errors scale with the world bounds of each draw, whatever its transform
+    mLodErrors.assign(mMeshGroups.size() * GeometryPool::kMaxLods, 0.0f);
+    for (uint32_t groupIndex = 0; groupIndex < (uint32_t)mMeshGroups.size(); ++groupIndex)
+    {
+        const GeometryPool::MeshRange& range = mpGeometryPool->getMeshRange(groupIndex);
+        const float radius = glm::length(mMeshGroups[groupIndex].pMesh->getBoundingBox().extent);
+        for (uint32_t level = 0; level < range.lodCount; ++level)
+        {
+            mLodErrors[groupIndex * GeometryPool::kMaxLods + level] = radius > 0 ? range.lods[level].error / radius : 0.0f;
+        }
+    }
+    setUnculledStats();
+    createSkinningJobs();
+    createOcclusionCuller();
+}
+
+void DrawList::createSkinningJobs()
+{
+    const auto& skinnedMeshes = mpGeometryPool->getSkinnedMeshes();
+    if (skinnedMeshes.empty()) return;
+
+    // Each job writes its mesh's range of the pool's skinned region. Bone matrices are looked up again on every skin().
+    mpSkinner = Skinner::create();
+    const GeometryPool::SkinnedElement positions = mpGeometryPool->getSkinnedPositions();
+    const GeometryPool::SkinnedElement normals = mpGeometryPool->getSkinnedNormals();
+    for (const auto& skinnedMesh : skinnedMeshes)
+    {
+        const uint32_t vertexOffset = mpGeometryPool->getMeshRange(skinnedMesh.meshIndex).baseVertex - mpGeometryPool->getSkinnedBaseVertex();
+
+        Skinner::Job job;
+        job.pPositions = skinnedMesh.positions.data();
+        job.pNormals = normals.pData && !skinnedMesh.normals.empty() ? skinnedMesh.normals.data() : nullptr;
+        job.pInfluences = skinnedMesh.influences.data();
+        job.vertexCount = (uint32_t)skinnedMesh.positions.size();
+        job.pOutPositions = positions.pData + (size_t)vertexOffset * positions.stride;
+        job.outPositionStride = positions.stride;
+        job.pOutNormals = job.pNormals ? normals.pData + (size_t)vertexOffset * normals.stride : nullptr;
+        job.outNormalStride = normals.stride;
+        mpSkinner->addJob(job);
+
+        // Pool meshes are the mesh groups in order
+        mSkinnedGroups.push_back(skinnedMesh.meshIndex);
+
+#ifdef _DEBUG
+        const uint32_t boneCount = mMeshGroups[skinnedMesh.meshIndex].pModel->getBoneCount();
+        for (const auto& influence : skinnedMesh.influences)
+        {
+            for (uint32_t i = 0; i < 4; ++i) assert(influence.bones[i] < boneCount || influence.weights[i] == 0);
+        }
+#endif
+    }
+    logInfo("Skinning " + std::to_string(mpGeometryPool->getSkinnedVertexCount()) + " vertices of " + std::to_string(skinnedMeshes.size()) + " meshes per frame");
+}
+
+void DrawList::createOcclusionCuller()
+{
+    const auto& occluderMeshes = mpGeometryPool->getOccluderMeshes();
+    mGroupOccluders.assign(mMeshGroups.size(), ~0u);
+    if (occluderMeshes.empty()) return;
+
+    // Pool meshes are the mesh groups in order
+    mpOcclusionCuller = OcclusionCuller::create();
+    for (const auto& occluderMesh : occluderMeshes)
+    {
+        mGroupOccluders[occluderMesh.meshIndex] = mpOcclusionCuller->addMesh(occluderMesh.positions, occluderMesh.indices);
+    }
+    logInfo(std::to_string(occluderMeshes.size()) + " of " + std::to_string(mMeshGroups.size()) + " meshes can occlude");
+}
+
+void DrawList::skin(ThreadPool* pPool, Skinner::Kernel kernel)
+{
+    if (!mpSkinner) return;
+
+    for (uint32_t jobIndex = 0; jobIndex < mpSkinner->getJobCount(); ++jobIndex)
+    {
+        const Model* pModel = mMeshGroups[mSkinnedGroups[jobIndex]].pModel.get();
+        Skinner::Job& job = mpSkinner->getJob(jobIndex);
+        job.pBoneMatrices = pModel->getBoneMatrices();
+        job.pBoneNormalMatrices = pModel->getBoneInvTransposeMatrices();
+    }
+
+    mpSkinner->run(pPool, kernel);
+    mpGeometryPool->uploadSkinnedVertices();
+
+    // The mesh's bounds don't cover the animation, every draw takes the skinned bounds through its model instance's transform
+    for (uint32_t jobIndex = 0; jobIndex < mpSkinner->getJobCount(); ++jobIndex)
+    {
+        const MeshGroup& group = mMeshGroups[mSkinnedGroups[jobIndex]];
+        const BoundingBox& skinnedBounds = mpSkinner->getBounds(jobIndex);
+        for (uint32_t drawID = group.firstDraw; drawID < group.firstDraw + group.drawCount; ++drawID)
+        {
+            const BoundingBox box = skinnedBounds.transform(mConstants[drawID].worldMat);
+            mpCuller->setBounds(drawID, box);
+            if (mpBvh) mpBvh->setBounds(drawID, box);
+        }
+    }
+}
+
+DrawList::LodSettings DrawList::LodSettings::fromCamera(const Camera* pCamera, uint32_t viewportHeight, float maxPixelError)
+{
+    LodSettings lod;
+    lod.cameraPos = pCamera->getPosition();
+    lod.projScale = 0.5f * (float)viewportHeight * pCamera->getProjMatrix()[1][1];
+    lod.maxPixelError = maxPixelError;
+    return lod;
+}
+
+uint32_t DrawList::selectLod(uint32_t groupIndex, uint32_t drawID, const LodSettings& lod) const
+{
+    const GeometryPool::MeshRange& range = mpGeometryPool->getMeshRange(groupIndex);
+    if (range.lodCount == 1) return 0;
+
+    // Distance to the nearest point of the bounding sphere, full detail when the camera is inside it
+    const glm::vec4 sphere = mpCuller->getBoundingSphere(drawID);
+    const float distance = glm::length(glm::vec3(sphere) - lod.cameraPos) - sphere.w;
+    if (distance <= 0) return 0;
+
+    // Errors grow with the level, so the first level that is too coarse ends the search
+    const float pixelsPerError = sphere.w * lod.projScale / distance;
+    const float* pErrors = &mLodErrors[groupIndex * GeometryPool::kMaxLods];
+    uint32_t level = 0;
+    while (level + 1 < range.lodCount && pErrors[level + 1] * pixelsPerError <= lod.maxPixelError) level++;
+    return level;
+}
+
+const DrawList::CullStats& DrawList::cull(const Frustum& frustum, FrustumCuller::Kernel kernel, UploadRing* pUploadRing, const LodSettings* pLod, const OcclusionSettings* pOcclusion)
+{
+    assert(mpGeometryPool);
+    auto start = CpuTimer::getCurrentTimePoint();
+
+    mVisibleDraws.resize(getDrawCount());
+    uint32_t visibleCount;
+    if (mpBvh)
+    {
+        // Draws come out in hierarchy order, merging runs needs them ascending
+        mpBvh->refit();
+        visibleCount = mpBvh->queryFrustum(frustum, mVisibleDraws.data());
+        std::sort(mVisibleDraws.begin(), mVisibleDraws.begin() + visibleCount);
+    }
+    else
+    {
+        visibleCount = mpCuller->cull(frustum, mVisibleDraws.data(), kernel);
+    }
+
+#ifdef _DEBUG
+    // Validate the SIMD kernels and the hierarchy against the scalar reference
+    std::vector<uint32_t> reference(getDrawCount());
+    assert(mpCuller->cull(frustum, reference.data(), FrustumCuller::Kernel::Scalar) == visibleCount);
+    assert(std::equal(reference.begin(), reference.begin() + visibleCount, mVisibleDraws.begin()));
+#endif
+
+    const bool occlusion = pOcclusion && mpOcclusionCuller;
+    const uint32_t frustumVisibleCount = visibleCount;
+    if (occlusion) visibleCount = cullOccluded(visibleCount, *pOcclusion);
+
+    writeDrawArgs(visibleCount, pLod, pUploadRing);
+    mCullStats.hierarchy = mpBvh != nullptr;
+    if (occlusion)
+    {
+        const OcclusionCuller::Stats& occlusionStats = mpOcclusionCuller->getStats();
+        mCullStats.occluders = occlusionStats.occluders;
+        mCullStats.occluderTriangles = occlusionStats.occluderTriangles;
+        mCullStats.occludedDraws = frustumVisibleCount - visibleCount;
+        mCullStats.occlusionMs = occlusionStats.rasterMs + occlusionStats.testMs;
+    }
+    mCullStats.cullMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    return mCullStats;
+}
+
+DrawList::OcclusionSettings DrawList::OcclusionSettings::fromCamera(const Camera* pCamera, uint32_t maxOccluderTriangles, ThreadPool* pPool)
+{
+    OcclusionSettings occlusion;
+    occlusion.viewProj = pCamera->getViewProjMatrix();
+    occlusion.cameraPos = pCamera->getPosition();
+    occlusion.maxOccluderTriangles = maxOccluderTriangles;
+    occlusion.pPool = pPool;
+    occlusion.kernel = OcclusionCuller::Kernel::Best;
+    return occlusion;
+}
+
+uint32_t DrawList::cullOccluded(uint32_t visibleCount, const OcclusionSettings& occlusion)
+{
+    // Rank the visible draws that can occlude by how much of the view their bounds cover, the draws are ascending so groups follow in order
+    mOccluderCandidates.clear();
+    uint32_t groupIndex = 0;
+    for (uint32_t i = 0; i < visibleCount; ++i)
+    {
+        const uint32_t drawID = mVisibleDraws[i];
+        while (drawID >= mMeshGroups[groupIndex].firstDraw + mMeshGroups[groupIndex].drawCount) groupIndex++;
+        if (mGroupOccluders[groupIndex] == ~0u) continue;
+
+        const glm::vec4 sphere = mpCuller->getBoundingSphere(drawID);
+        const float distance = glm::length(glm::vec3(sphere) - occlusion.cameraPos);
+        const float size = distance > sphere.w ? sphere.w / distance : 1.0f;
+        if (size >= kMinOccluderSize) mOccluderCandidates.push_back({ size, drawID, mGroupOccluders[groupIndex] });
+    }
+
+    // Largest first, ties by drawID so that the selection doesn't depend on the sort
+    std::sort(mOccluderCandidates.begin(), mOccluderCandidates.end(), [](const OccluderCandidate& a, const OccluderCandidate& b)
+    {
+        return a.size != b.size ? a.size > b.size : a.drawID < b.drawID;
+    });
+
+    // Smaller candidates may still fit after a large one didn't
+    mpOcclusionCuller->beginFrame(occlusion.viewProj);
+    uint32_t triangles = 0;
+    for (const auto& candidate : mOccluderCandidates)
+    {
+        const uint32_t meshTriangles = mpOcclusionCuller->getMeshTriangleCount(candidate.occluderMesh);
+        if (triangles + meshTriangles > occlusion.maxOccluderTriangles) continue;
+
+        mpOcclusionCuller->addOccluder(candidate.occluderMesh, mConstants[candidate.drawID].worldMat);
+        triangles += meshTriangles;
+    }
+    mpOcclusionCuller->rasterize(occlusion.pPool, occlusion.kernel);
+
+    // Draws stay ascending, the occluders themselves always pass since their bounds enclose their own surface
+    return mpOcclusionCuller->cull(*mpCuller, mVisibleDraws.data(), visibleCount, occlusion.pPool, occlusion.kernel);
+}
+
+void DrawList::setCullHierarchy(bool enable)
+{
+    if (!enable)
+    {
+        mpBvh = nullptr;
+        return;
+    }
+    if (mpBvh) return;
+
+    std::vector<BoundingBox> bounds(getDrawCount());
+    for (uint32_t drawID = 0; drawID < getDrawCount(); ++drawID) bounds[drawID] = mpCuller->getBounds(drawID);
+    mpBvh = InstanceBvh::create();
+    mpBvh->build(bounds);
+    logInfo("Built the draw BVH in " + std::to_string(mpBvh->getStats().buildMs) + " ms, " + std::to_string(mpBvh->getStats().nodes) + " nodes");
+}
+
+const DrawList::CullStats& DrawList::selectLods(const LodSettings& lod, UploadRing* pUploadRing)
+{
+    assert(mpGeometryPool);
+    auto start = CpuTimer::getCurrentTimePoint();
+
+    mVisibleDraws.resize(getDrawCount());
+    for (uint32_t drawID = 0; drawID < getDrawCount(); ++drawID) mVisibleDraws[drawID] = drawID;
+
+    writeDrawArgs(getDrawCount(), &lod, pUploadRing);
+    mCullStats.cullMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    return mCullStats;
+}
+
+void DrawList::writeDrawArgs(uint32_t drawCount, const LodSettings* pLod, UploadRing* pUploadRing)
+{
+    mCullStats = {};
+
+    // Visible draws come out in ascending order, so runs of the same mesh and level can be merged into instanced args
+    mCulledArgs.clear();
+    uint32_t groupIndex = 0;
+    for (uint32_t i = 0; i < drawCount; ++i)
+    {
+        const uint32_t drawID = mVisibleDraws[i];
+        while (drawID >= mMeshGroups[groupIndex].firstDraw + mMeshGroups[groupIndex].drawCount) groupIndex++;
+
+        const GeometryPool::MeshRange& range = mpGeometryPool->getMeshRange(groupIndex);
+        const uint32_t level = pLod ? selectLod(groupIndex, drawID, *pLod) : 0;
+        const GeometryPool::LodRange& lodRange = range.lods[level];
+        mCullStats.lodDraws[level]++;
+        mCullStats.triangles += lodRange.indexCount / 3;
+        mCullStats.baseTriangles += range.lods[0].indexCount / 3;
+
+        if (!mCulledArgs.empty())
+        {
+            DrawIndexedArguments& last = mCulledArgs.back();
+            if (last.startIndexLocation == lodRange.startIndex && last.baseVertexLocation == (int32_t)range.baseVertex && last.startInstanceLocation + last.instanceCount == drawID)
+            {
+                last.instanceCount++;
+                continue;
+            }
+        }
+
+        DrawIndexedArguments args = mDrawArgs[groupIndex];
+        args.indexCountPerInstance = lodRange.indexCount;
+        args.startIndexLocation = lodRange.startIndex;
+        args.instanceCount = 1;
+        args.startInstanceLocation = drawID;
+        mCulledArgs.push_back(args);
+    }
+
+    mpIndirectArgs = mIndirectArgBuffer.get();
+    mIndirectArgOffset = 0;
+    if (!mCulledArgs.empty())
+    {
+        const size_t argsSize = mCulledArgs.size() * sizeof(DrawIndexedArguments);
+        if (pUploadRing)
+        {
+            UploadRing::Allocation allocation;
+            memcpy(pUploadRing->allocate<DrawIndexedArguments>((uint32_t)mCulledArgs.size(), allocation), mCulledArgs.data(), argsSize);
+            mpIndirectArgs = allocation.pBuffer;
+            mIndirectArgOffset = allocation.offset;
+        }
+        else
+        {
+            mIndirectArgBuffer->updateData(mCulledArgs.data(), 0, argsSize);
+        }
+    }
+    mIndirectArgCount = (uint32_t)mCulledArgs.size();
+    mCulled = true;
+
+    mCullStats.visibleDraws = drawCount;
+    mCullStats.argCount = mIndirectArgCount;
+}
+
+void DrawList::resetCulling()
+{
+    if (!mCulled) return;
+
+    mIndirectArgBuffer->updateData(mDrawArgs.data(), 0, mDrawArgs.size() * sizeof(DrawIndexedArguments));
+    mpIndirectArgs = mIndirectArgBuffer.get();
+    mIndirectArgOffset = 0;
+    mIndirectArgCount = (uint32_t)mDrawArgs.size();
+    mCulled = false;
+    setUnculledStats();
+}
+
+void DrawList::setUnculledStats()
+{
+    mCullStats = {};
+    mCullStats.visibleDraws = getDrawCount();
+    mCullStats.argCount = (uint32_t)mDrawArgs.size();
+    mCullStats.lodDraws[0] = getDrawCount();
+    for (const auto& args : mDrawArgs)
+    {
+        mCullStats.triangles += (uint64_t)args.indexCountPerInstance / 3 * args.instanceCount;
+    }
+    mCullStats.baseTriangles = mCullStats.triangles;
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+#include "MaterialTable.h"
+#include "GeometryPool.h"
+#include "FrustumCuller.h"
+#include "InstanceBvh.h"
+#include "OcclusionCuller.h"
+#include "Skinner.h"
+#include "DrawListPack.h"
+#include "UploadRing.h"
+
+using namespace Falcor;
+
+// CPU mirror of DrawConstants in BindlessVS.slang
+struct DrawConstants
+{
+    glm::mat4 worldMat;
+    glm::mat4 prevWorldMat;
+    glm::mat3x4 worldInvTransposeMat;
+    uint32_t drawID;
+    uint32_t meshID;
+    uint32_t materialID;    // Index into the bindless material table
+    uint32_t geometryID;    // Mesh group of the draw in the geometry pool, for its dequantization. Also pads to 16 byte alignment.
+};
+static_assert(sizeof(DrawConstants) == 192, "DrawConstants must match the structured buffer stride of BindlessVS.slang");
+
+// CPU mirror of AffineTransform in BindlessVS.slang: the top three rows of a column-vector affine matrix
+struct AffineTransform
+{
+    glm::vec4 rows[3];
+
+    static AffineTransform fromMat4(const glm::mat4& mat);
+    glm::mat4 toMat4() const;
+};
+
+// CPU mirror of DrawConstants in BindlessVS.slang with COMPACT_DRAW_CONSTANTS. 64 instead of 192 bytes: the normal matrix
+// is derived in the shader and the previous transform is only stored, in a separate buffer, for draws that moved.
+struct CompactDrawConstants
+{
+    static const uint32_t kStaticFlag = 0x1;
+    static const uint32_t kInvalidIndex = ~0u;
+
+    AffineTransform world;
+    uint32_t geometryID;
+    uint32_t materialID;
+    uint32_t flags;                 // kStaticFlag: prevWorldMat == worldMat, the shader aliases the world transform
+    uint32_t prevTransformIndex;    // Into the previous transforms buffer, kInvalidIndex until the draw first moves
+
+    static CompactDrawConstants fromFull(const DrawConstants& drawConstants, uint32_t prevTransformIndex);
+};
+static_assert(sizeof(CompactDrawConstants) == 64, "CompactDrawConstants must match the structured buffer stride of BindlessVS.slang");
+
+enum class DrawConstantsLayout
+{
+    Full,       // DrawConstants
+    Compact,    // CompactDrawConstants, requires the program to define COMPACT_DRAW_CONSTANTS
+};
+
+// Flattened, persistent list of every mesh instance in the scene, shared by the bindless render paths.
+// Draws are ordered by mesh, so each mesh's instances form a contiguous drawID range.
+// Draw constants are built once and afterwards only the draws whose model instance moved are re-uploaded.
+class DrawList
+{
+public:
+    using SharedPtr = std::shared_ptr<DrawList>;
+
+    // Draws of the same mesh, stored at consecutive drawIDs
+    struct MeshGroup
+    {
+        Mesh::SharedPtr pMesh;
+        Model::SharedPtr pModel;    // Owner of the bone matrices when the mesh is skinned
+        uint32_t firstDraw;
+        uint32_t drawCount;
+    };
+
+    struct UploadStats
+    {
+        uint32_t dirtyInstances = 0;
+        uint32_t dirtyDraws = 0;
+        uint32_t uploadedDraws = 0;    // Includes clean draws swallowed by range coalescing
+        uint32_t uploadCalls = 0;
+        uint64_t uploadedBytes = 0;
+    };
+
+    // Walks the scene repeatCount times and builds the draw constants buffer for the program's gDrawConstants.
+    // The scene is enumerated once to count draws, then the per-draw data is filled in parallel when a pool is given.
+    // The layout must match the program's variant of DrawConstants.
+    // With deferUpload, no GPU resources are created, so the call can run off the render thread. Call uploadConstants() on the render thread before use.
+    static SharedPtr create(const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, uint32_t repeatCount, ThreadPool* pPool = nullptr, DrawConstantsLayout layout = DrawConstantsLayout::Full, bool deferUpload = false);
+
+    // Key of the pack holding a draw list built from this scene with these options
+    static uint64_t computePackKey(const std::string& scenePath, const Scene::SharedPtr& pScene, uint32_t repeatCount, DrawConstantsLayout layout, GeometryPool::Flags geometryFlags);
+
+    // Restores a draw list written by writePack(). The scene must already be loaded, it provides the meshes, materials and model instances.
+    // Returns nullptr if the pack is missing, stale or doesn't match the scene, in which case the caller builds with create().
+    static SharedPtr createFromPack(const std::string& path, uint64_t key, const Scene::SharedPtr& pScene, const GraphicsProgram::SharedPtr& pProgram, ThreadPool* pPool = nullptr, bool deferUpload = false);
+
+    // Creates the draw constants buffer. No-op if already uploaded.
+    void uploadConstants();
+
+    // Writes the draw constants, merged geometry, indirect args and material data. Requires multi-draw data built with GeometryPool::Flags::KeepCpuData.
+    bool writePack(const std::string& path, uint64_t key) const;
+
+    // Builds the geometry pool, one instanced indirect draw per mesh group and the bindless material buffer used by the multi-draw path.
+    // No-op if already built. Offsets come from a serial counting pass, so the output is identical regardless of the thread count.
+    // A draw list restored from a pack uploads the packed geometry instead and ignores the flags other than KeepOccluders.
+    void buildMultiDrawData(ThreadPool* pPool = nullptr, GeometryPool::Flags geometryFlags = GeometryPool::Flags::None);
+
+    // Completes the multi-draw data with a geometry pool built elsewhere, e.g. with GeometryPool::createDeferred() from getGroupMeshes()
+    void setGeometryPool(const GeometryPool::SharedPtr& pGeometryPool);
+    std::vector<Mesh::SharedPtr> getGroupMeshes() const;
+
+    struct CullStats
+    {
+        uint32_t visibleDraws = 0;
+        uint32_t argCount = 0;
+        uint64_t triangles = 0;                             // Submitted by the current args
+        uint64_t baseTriangles = 0;                         // The same draws at full detail
+        uint32_t lodDraws[GeometryPool::kMaxLods] = {};    // Visible draws per detail level
+        bool hierarchy = false;                             // Culled through the BVH rather than the flat kernels
+        uint32_t occluders = 0;
+        uint32_t occluderTriangles = 0;
+        uint32_t occludedDraws = 0;                         // In the frustum but hidden behind the occluders
+        double occlusionMs = 0;                             // Rasterizing the occluders and testing the draws
+        double cullMs = 0;                                  // Including the BVH refit and occlusion culling
+    };
+
+    // Screen-space LOD selection: each draw uses the coarsest level whose error projects to at most maxPixelError pixels.
+    // Requires a geometry pool built with GeometryPool::Flags::GenerateLods, otherwise every draw stays at full detail.
+    struct LodSettings
+    {
+        glm::vec3 cameraPos;
+        float projScale;        // Pixels covered by one unit at distance one, viewport height * proj[1][1] / 2
+        float maxPixelError;
+
+        static LodSettings fromCamera(const Camera* pCamera, uint32_t viewportHeight, float maxPixelError);
+    };
+
+    // Software occlusion culling after the frustum test: the frustum-visible draws of meshes that can occlude are ranked by the
+    // angle their bounds cover, the largest are rasterized up to the triangle budget, then every visible draw's bounds are tested.
+    // Requires a geometry pool built with GeometryPool::Flags::KeepOccluders, otherwise nothing is occluded.
+    struct OcclusionSettings
+    {
+        glm::mat4 viewProj;
+        glm::vec3 cameraPos;
+        uint32_t maxOccluderTriangles;
+        ThreadPool* pPool;
+        OcclusionCuller::Kernel kernel;
+
+        static OcclusionSettings fromCamera(const Camera* pCamera, uint32_t maxOccluderTriangles, ThreadPool* pPool = nullptr);
+    };
+
+    // Picks up model instance transform changes and re-uploads the affected draw constants. Call after SceneRenderer::update().
+    const UploadStats& update();
+
+    // Culls every draw against the frustum and rewrites the indirect args with runs of consecutive visible draws of the same mesh
+    // and detail level. Levels are selected per draw when LOD settings are given, otherwise every draw is at full detail.
+    // Draws hidden behind others are dropped as well when occlusion settings are given.
+    // The args go to a fresh upload ring allocation when a ring is given, otherwise the indirect arg buffer is updated in place.
+    // Requires buildMultiDrawData().
+    const CullStats& cull(const Frustum& frustum, FrustumCuller::Kernel kernel = FrustumCuller::Kernel::Best, UploadRing* pUploadRing = nullptr, const LodSettings* pLod = nullptr, const OcclusionSettings* pOcclusion = nullptr);
+
+    // Culls through a BVH over the draw bounds instead of testing every draw, refit after update() moved draws.
+    // Builds the hierarchy on the first call that enables it. The visible draws are the same either way.
+    void setCullHierarchy(bool enable);
+    const InstanceBvh::SharedPtr& getCullHierarchy() const { return mpBvh; }
+
+    // Skins the meshes with bones into the geometry pool with their models' current bone matrices and updates the bounds of their draws.
+    // Skinned vertices are in model space and shared by every draw of the mesh, so those draws only apply their model instance's transform.
+    // Call every frame after update() and before cull(). No-op without skinned meshes.
+    void skin(ThreadPool* pPool = nullptr, Skinner::Kernel kernel = Skinner::Kernel::Best);
+    const Skinner::SharedPtr& getSkinner() const { return mpSkinner; }     // Null without skinned meshes
+
+    // Selects the detail level of every draw without culling, writing the args like cull()
+    const CullStats& selectLods(const LodSettings& lod, UploadRing* pUploadRing = nullptr);
+
+    // Restores the unculled indirect args, one instanced draw per mesh group at full detail
+    void resetCulling();
+
+    uint32_t getDrawCount() const { return (uint32_t)mConstants.size(); }
+    bool isFromPack() const { return mFromPack; }     // False again if the packed geometry turned out unusable
+    const std::vector<Mesh::SharedPtr>& getMeshes() const { return mMeshes; }
+    const std::vector<MeshGroup>& getMeshGroups() const { return mMeshGroups; }
+    const std::vector<DrawConstants>& getConstants() const { return mConstants; }                   // Full layout, kept on the CPU for either layout
+    const StructuredBuffer::SharedPtr& getConstantsBuffer() const { return mDrawConstantsBuffer; }
+
+    DrawConstantsLayout getLayout() const { return mLayout; }
+    const std::vector<CompactDrawConstants>& getCompactConstants() const { return mCompactConstants; }
+    const std::vector<AffineTransform>& getPrevTransforms() const { return mPrevTransforms; }
+    const StructuredBuffer::SharedPtr& getPrevTransformsBuffer() const { return mPrevTransformsBuffer; }    // Compact layout only, may be recreated by update()
+    size_t getGpuConstantsSize() const;
+
+    const GeometryPool::SharedPtr& getGeometryPool() const { return mpGeometryPool; }
+    const Vao::SharedPtr& getVao() const { return mpGeometryPool->getVao(); }
+    Buffer* getIndirectArgBuffer() const { return mpIndirectArgs; }                       // Valid until the upload ring's next frame
+    uint64_t getIndirectArgOffset() const { return mIndirectArgOffset; }
+    const std::vector<DrawIndexedArguments>& getDrawArgs() const { return mDrawArgs; }    // One entry per mesh group
+    uint32_t getIndirectArgCount() const { return mIndirectArgCount; }                  // Args currently in the indirect arg buffer
+    const DrawIndexedArguments* getIndirectArgData() const { return mCulled ? mCulledArgs.data() : mDrawArgs.data(); }    // CPU copy of them
+    const FrustumCuller::SharedPtr& getCuller() const { return mpCuller; }
+    const OcclusionCuller::SharedPtr& getOcclusionCuller() const { return mpOcclusionCuller; }     // Null without occluder meshes
+    const Material::SharedPtr& getProtoMaterial() const { return mProtoMaterial; }
+    const MaterialTable::SharedPtr& getMaterialTable() const { return mpMaterialTable; }
+    const UploadStats& getUploadStats() const { return mUploadStats; }
+    const CullStats& getCullStats() const { return mCullStats; }
+
+private:
+    DrawList() = default;
+
+    struct DrawRange
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct OccluderCandidate
+    {
+        float size;         // Bounding sphere radius over distance
+        uint32_t drawID;
+        uint32_t occluderMesh;
+    };
+
+    // Model instance whose world transform feeds a set of draws. One range per mesh instance, covering all scene repeats.
+    struct TrackedInstance
+    {
+        Scene::ModelInstance::SharedPtr pInstance;
+        glm::mat4 worldMat;
+        glm::mat4 prevWorldMat;
+        std::vector<DrawRange> drawRanges;
+    };
+
+    void updateTransforms(uint32_t drawID, const TrackedInstance& instance);
+    void packCompact(uint32_t drawID);
+    void assignPrevTransform(uint32_t drawID);
+    void uploadPrevTransforms(uint32_t first, uint32_t count);
+    void uploadDirtyRanges();
+    void updateBounds(uint32_t drawID);
+    bool loadPackedGeometry(GeometryPool::Flags geometryFlags);
+    void createMultiDrawResources();
+    void createSkinningJobs();
+    void createOcclusionCuller();
+    uint32_t cullOccluded(uint32_t visibleCount, const OcclusionSettings& occlusion);
+    void writeDrawArgs(uint32_t drawCount, const LodSettings* pLod, UploadRing* pUploadRing);
+    uint32_t selectLod(uint32_t groupIndex, uint32_t drawID, const LodSettings& lod) const;
+    void setUnculledStats();
+
+    Scene::SharedPtr mpScene;
+    GraphicsProgram::SharedPtr mpProgram;
+    uint32_t mRepeatCount = 1;
+    DrawConstantsLayout mLayout = DrawConstantsLayout::Full;
+    bool mFromPack = false;
+    DrawListPack::SharedPtr mpPack;                         // Kept mapped until buildMultiDrawData() uploads its geometry
+
+    std::vector<Mesh::SharedPtr> mMeshes;                   // Indexed by drawID
+    std::vector<MeshGroup> mMeshGroups;
+    std::vector<glm::mat4> mMeshTransforms;                 // Mesh instance transform relative to its model, indexed by drawID
+    std::vector<DrawConstants> mConstants;                  // CPU copy of the GPU draw constants
+    std::vector<TrackedInstance> mInstances;
+    std::vector<DrawRange> mDirtyRanges;
+    StructuredBuffer::SharedPtr mDrawConstantsBuffer;
+
+    std::vector<CompactDrawConstants> mCompactConstants;    // GPU layout of the draw constants in compact mode
+    std::vector<AffineTransform> mPrevTransforms;           // Slots are handed out when a draw first moves and never freed
+    StructuredBuffer::SharedPtr mPrevTransformsBuffer;
+    uint32_t mPrevTransformsCapacity = 0;
+    uint32_t mDirtyPrevBegin = 0;
+    uint32_t mDirtyPrevEnd = 0;
+
+    GeometryPool::SharedPtr mpGeometryPool;
+    Buffer::SharedPtr mIndirectArgBuffer;                   // Sized for one arg per draw, the worst case after culling
+    std::vector<DrawIndexedArguments> mDrawArgs;            // CPU copy of the unculled indirect args
+    uint32_t mIndirectArgCount = 0;
+    Buffer* mpIndirectArgs = nullptr;                       // Where the current args are, mIndirectArgBuffer or an upload ring
+    uint64_t mIndirectArgOffset = 0;
+
+    FrustumCuller::SharedPtr mpCuller;                      // World bounds indexed by drawID
+    InstanceBvh::SharedPtr mpBvh;                           // Over the same bounds, only while hierarchical culling is enabled
+    std::vector<uint32_t> mVisibleDraws;
+    std::vector<DrawIndexedArguments> mCulledArgs;
+    std::vector<float> mLodErrors;                          // Per mesh group and level, relative to the mesh's bounding radius
+    OcclusionCuller::SharedPtr mpOcclusionCuller;
+    std::vector<uint32_t> mGroupOccluders;                  // Occluder mesh per mesh group, ~0u for groups that don't occlude
+    std::vector<OccluderCandidate> mOccluderCandidates;     // Rebuilt by every occlusion cull
+    Skinner::SharedPtr mpSkinner;                           // One job per skinned mesh group
+    std::vector<uint32_t> mSkinnedGroups;                   // Mesh group of each skinning job
+    bool mCulled = false;
+    Material::SharedPtr mProtoMaterial;                     // The material instance used to provide material data uniform across the multi draw
+    MaterialTable::SharedPtr mpMaterialTable;               // Unique materials, indexed by DrawConstants::materialID
+
+    UploadStats mUploadStats;
+    CullStats mCullStats;
+};
@@ -0,0 +1,136 @@
+#include "DrawListPack.h"
+#include "Hash.h"
+
+namespace
+{
+    const char kMagic[8] = { 'D', 'R', 'W', 'L', 'P', 'A', 'C', 'K' };
+    const uint64_t kSectionAlignment = 16;
+
+    // Contents for the scene file, which is small, and size only for the model files, which aren't
+    uint64_t hashFile(uint64_t hash, const std::string& path, bool contents)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        const int64_t size = file.is_open() ? (int64_t)file.tellg() : -1;
+        hash = hashBytes(hash, path.data(), path.size());
+        hash = hashBytes(hash, &size, sizeof(size));
+
+        if (contents && size > 0)
+        {
+            std::vector<char> data((size_t)size);
+            file.seekg(0);
+            file.read(data.data(), size);
+            hash = hashBytes(hash, data.data(), data.size());
+        }
+        return hash;
+    }
+}
+
+uint64_t DrawListPack::computeKey(const std::string& scenePath, const Scene::SharedPtr& pScene, const void* pOptions, size_t optionsSize)
+{
+    const uint32_t version = kVersion;
+    uint64_t hash = hashBytes(kHashSeed, &version, sizeof(version));
+    hash = hashFile(hash, scenePath, true);
+    for (uint32_t modelID = 0; modelID < pScene->getModelCount(); ++modelID)
+    {
+        hash = hashFile(hash, pScene->getModel(modelID)->getFilename(), false);
+    }
+    return hashBytes(hash, pOptions, optionsSize);
+}
+
+DrawListPack::SharedPtr DrawListPack::open(const std::string& path, uint64_t key)
+{
+    MappedFile::SharedPtr pFile = MappedFile::open(path);
+    if (!pFile) return nullptr;
+
+    if (pFile->getSize() < sizeof(Header))
+    {
+        logWarning("Draw list pack " + path + " is truncated");
+        return nullptr;
+    }
+
+    const Header* pHeader = (const Header*)pFile->getData();
+    if (memcmp(pHeader->magic, kMagic, sizeof(kMagic)) != 0 || pHeader->version != kVersion || pHeader->sectionCount != (uint32_t)Section::Count)
+    {
+        logInfo("Draw list pack " + path + " is from another version, rebuilding");
+        return nullptr;
+    }
+    if (pHeader->info.key != key)
+    {
+        logInfo("Draw list pack " + path + " was built from a different scene or with different options, rebuilding");
+        return nullptr;
+    }
+
+    for (const auto& entry : pHeader->sections)
+    {
+        if (entry.offset > pFile->getSize() || entry.size > pFile->getSize() - entry.offset)
+        {
+            logWarning("Draw list pack " + path + " is truncated");
+            return nullptr;
+        }
+    }
+
+    SharedPtr pPack = SharedPtr(new DrawListPack());
+    pPack->mpFile = pFile;
+    pPack->mpHeader = pHeader;
+    pPack->mInfo = pHeader->info;
+    return pPack;
+}
+
+bool DrawListPack::write(const std::string& path, const Info& info, const std::vector<SectionData>& sections)
+{
+    Header header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.sectionCount = (uint32_t)Section::Count;
+    header.info = info;
+
+    // Lay out the sections after the header
+    uint64_t offset = sizeof(Header);
+    for (const auto& section : sections)
+    {
+        offset = (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+        header.sections[(uint32_t)section.section] = { offset, section.size };
+        offset += section.size;
+    }
+
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            logWarning("Can't write draw list pack " + tempPath);
+            return false;
+        }
+
+        file.write((const char*)&header, sizeof(header));
+        const char padding[kSectionAlignment] = {};
+        for (const auto& section : sections)
+        {
+            const uint64_t position = (uint64_t)file.tellp();
+            file.write(padding, header.sections[(uint32_t)section.section].offset - position);
+            file.write((const char*)section.pData, section.size);
+        }
+
+        if (!file.good())
+        {
+            logWarning("Failed writing draw list pack " + tempPath);
+            return false;
+        }
+    }
+
+    // rename() doesn't replace existing files on Windows
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        logWarning("Can't replace draw list pack " + path);
+        return false;
+    }
+    return true;
+}
+
+const uint8_t* DrawListPack::getSectionData(Section section, size_t& size) const
+{
+    const SectionEntry& entry = mpHeader->sections[(uint32_t)section];
+    size = (size_t)entry.size;
+    return entry.size > 0 ? mpFile->getData() + entry.offset : nullptr;
+}
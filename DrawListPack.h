@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Falcor.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+
+using namespace Falcor;
+
+// Versioned binary file holding a fully built draw list: draw constants, merged geometry, indirect args and material data.
+// Sections are stored raw and 16 byte aligned, so a memory-mapped pack can be uploaded without any parsing or copying.
+class DrawListPack
+{
+public:
+    using SharedPtr = std::shared_ptr<DrawListPack>;
+
+    // Bump whenever the layout of the header or of any section's elements changes
+    static const uint32_t kVersion = 3;
+    static const uint32_t kMaxVertexStreams = 8;
+
+    enum class Section : uint32_t
+    {
+        Constants,          // DrawConstants per draw
+        CompactConstants,   // CompactDrawConstants per draw, compact layout only
+        PrevTransforms,     // AffineTransform per previous transform slot, compact layout only
+        MeshTransforms,     // glm::mat4 per draw
+        MeshGroups,         // PackedMeshGroup per mesh group
+        Instances,          // PackedInstance per tracked model instance
+        InstanceRanges,     // PackedRange per draw range, referenced by the instances
+        Materials,          // BindlessMaterialData per unique material
+        MeshRanges,         // GeometryPool::MeshRange per mesh group
+        DrawArgs,           // DrawIndexedArguments per mesh group
+        Indices,            // 16 or 32-bit indices, see Info::shortIndices
+        VertexStreams,      // One section per vertex stream follows
+        Count = VertexStreams + kMaxVertexStreams
+    };
+
+    // Meshes and model instances are stored by scene index, the objects come from the loaded scene
+    struct PackedMeshGroup
+    {
+        uint32_t modelID;
+        uint32_t meshID;
+        uint32_t firstDraw;
+        uint32_t drawCount;
+    };
+
+    struct PackedRange
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct PackedInstance
+    {
+        glm::mat4 worldMat;
+        glm::mat4 prevWorldMat;
+        uint32_t modelID;
+        uint32_t modelInstanceID;
+        uint32_t firstRange;
+        uint32_t rangeCount;
+    };
+
+    struct Info
+    {
+        uint64_t key = 0;
+        uint64_t geometryHash = 0;
+        uint32_t drawCount = 0;
+        uint32_t repeatCount = 0;
+        uint32_t layout = 0;                // DrawConstantsLayout
+        uint32_t vertexStreamCount = 0;
+        uint32_t shortIndices = 0;
+        uint32_t quantizedVertices = 0;     // The vertex streams have GeometryPool's quantized layout
+        MeshOptimizer::CacheStats optimizeBefore;
+        MeshOptimizer::CacheStats optimizeAfter;
+    };
+
+    struct SectionData
+    {
+        Section section;
+        const void* pData;
+        size_t size;
+    };
+
+    // Hash of the scene file contents, the referenced model files' names and sizes, and the build options
+    static uint64_t computeKey(const std::string& scenePath, const Scene::SharedPtr& pScene, const void* pOptions, size_t optionsSize);
+
+    // Returns nullptr if the file is missing, truncated, from another version or built with a different key
+    static SharedPtr open(const std::string& path, uint64_t key);
+
+    // Writes to a temporary file that replaces the pack once complete, so an interrupted write never leaves a valid-looking pack
+    static bool write(const std::string& path, const Info& info, const std::vector<SectionData>& sections);
+
+    const Info& getInfo() const { return mInfo; }
+
+    // Returns nullptr with count 0 if the section is missing or isn't a whole number of elements
+    template<typename T>
+    const T* getSection(Section section, size_t& count) const
+    {
+        size_t size = 0;
+        const uint8_t* pData = getSectionData(section, size);
+        count = pData && size % sizeof(T) == 0 ? size / sizeof(T) : 0;
+        return count > 0 ? (const T*)pData : nullptr;
+    }
+
+    const uint8_t* getSectionData(Section section, size_t& size) const;
+
+private:
+    DrawListPack() = default;
+
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        Info info;
+        SectionEntry sections[(uint32_t)Section::Count];
+    };
+
+    MappedFile::SharedPtr mpFile;
+    const Header* mpHeader = nullptr;
+    Info mInfo;
+};
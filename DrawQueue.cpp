@@ -0,0 +1,96 @@
+#include "DrawQueue.h"
+
+namespace
+{
+    const uint32_t kVaoKeyBits = 16;
+    const uint32_t kMaterialKeyBits = 20;
+    const uint32_t kDepthBits = 20;
+}
+
+DrawQueue::SharedPtr DrawQueue::create()
+{
+    return SharedPtr(new DrawQueue());
+}
+
+uint32_t DrawQueue::getObjectKey(std::unordered_map<const void*, uint32_t>& keys, const void* pObject)
+{
+    auto it = keys.find(pObject);
+    if (it != keys.end()) return it->second;
+
+    const uint32_t key = (uint32_t)keys.size();
+    keys.emplace(pObject, key);
+    return key;
+}
+
+uint64_t DrawQueue::makeSortKey(uint32_t programVariant, uint32_t vaoKey, uint32_t materialKey, float depth)
+{
+    // Keys beyond the field width alias, which only costs some sorting quality
+    const uint64_t depthBucket = (uint64_t)glm::clamp(depth * (float)kDepthBucketCount, 0.0f, (float)(kDepthBucketCount - 1));
+
+    uint64_t key = programVariant & 0xff;
+    key = (key << kVaoKeyBits) | (vaoKey & ((1u << kVaoKeyBits) - 1));
+    key = (key << kMaterialKeyBits) | (materialKey & ((1u << kMaterialKeyBits) - 1));
+    key = (key << kDepthBits) | depthBucket;
+    return key;
+}
+
+void DrawQueue::record(ThreadPool* pPool, uint32_t count, uint32_t grainSize, const RecordFunc& func)
+{
+    if (count == 0) return;
+
+    // Without workers parallelFor() runs the whole range as the first chunk and leaves the others empty
+    const uint32_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (mChunks.size() < chunkCount) mChunks.resize(chunkCount);
+    for (uint32_t i = 0; i < chunkCount; ++i) mChunks[i].clear();
+
+    parallelFor(pPool, count, grainSize, [&](uint32_t begin, uint32_t end)
+    {
+        func(begin, end, mChunks[begin / grainSize]);
+    });
+
+    for (uint32_t i = 0; i < chunkCount; ++i)
+    {
+        mPackets.insert(mPackets.end(), mChunks[i].begin(), mChunks[i].end());
+    }
+}
+
+void DrawQueue::sort()
+{
+    const size_t count = mPackets.size();
+    if (count < 2) return;
+
+    mScratch.resize(count);
+    DrawPacket* pSrc = mPackets.data();
+    DrawPacket* pDst = mScratch.data();
+
+    for (uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        uint32_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            histogram[(pSrc[i].sortKey >> shift) & 0xff]++;
+        }
+
+        // All keys share this byte, the pass wouldn't change the order
+        if (histogram[(pSrc[0].sortKey >> shift) & 0xff] == count) continue;
+
+        uint32_t offset = 0;
+        for (uint32_t& bucket : histogram)
+        {
+            const uint32_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            pDst[histogram[(pSrc[i].sortKey >> shift) & 0xff]++] = pSrc[i];
+        }
+        std::swap(pSrc, pDst);
+    }
+
+    if (pSrc != mPackets.data())
+    {
+        mPackets.swap(mScratch);
+    }
+}
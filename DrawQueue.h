@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+
+using namespace Falcor;
+
+// One draw of the per-draw render paths. Holds raw pointers into the scene, which outlives the queue.
+struct DrawPacket
+{
+    uint64_t sortKey;
+    const Mesh* pMesh;
+    const Scene::ModelInstance* pModelInstance;     // Null for draws whose transforms live in the bindless draw constants
+    const Model::MeshInstance* pMeshInstance;
+    uint32_t drawID;
+    uint32_t drawRingSlot;                          // Upload ring slot of the draw constants, when they were written ahead of submission
+};
+
+// Per-frame list of draw packets, radix sorted by state so that consecutive draws share as much state as possible
+class DrawQueue
+{
+public:
+    using SharedPtr = std::shared_ptr<DrawQueue>;
+
+    // Sort key layout, most significant first: program variant (8 bits), VAO (16 bits), material (20 bits), depth bucket (20 bits)
+    static const uint32_t kDepthBucketCount = 1 << 20;
+
+    struct SubmitStats
+    {
+        uint32_t draws = 0;
+        uint32_t materialChanges = 0;
+        uint32_t vaoChanges = 0;
+        uint32_t stateChanges = 0;
+        uint32_t materialChangesAvoided = 0;
+        uint32_t vaoChangesAvoided = 0;
+        uint32_t stateChangesAvoided = 0;
+    };
+
+    static SharedPtr create();
+
+    void clear() { mPackets.clear(); }
+    void push(const DrawPacket& packet) { mPackets.push_back(packet); }
+
+    // Appends the packets recorded by func for [0, count), split into chunks of grainSize draws recorded in parallel.
+    // Each chunk records into its own list and the lists are appended in order, so the result matches a serial loop.
+    using RecordFunc = std::function<void(uint32_t begin, uint32_t end, std::vector<DrawPacket>& packets)>;
+    void record(ThreadPool* pPool, uint32_t count, uint32_t grainSize, const RecordFunc& func);
+
+    // Compact IDs for the key fields. Stable across frames, so the same object always sorts to the same place.
+    uint32_t getVaoKey(const Vao* pVao) { return getObjectKey(mVaoKeys, pVao); }
+    uint32_t getMaterialKey(const Material* pMaterial) { return getObjectKey(mMaterialKeys, pMaterial); }
+
+    // depth is normalized to [0, 1], 0 being the near plane, so that draws sort front to back within a state bucket
+    static uint64_t makeSortKey(uint32_t programVariant, uint32_t vaoKey, uint32_t materialKey, float depth);
+
+    // LSD radix sort on the 64-bit keys. Stable, so draws with equal keys keep their submission order.
+    void sort();
+
+    const std::vector<DrawPacket>& getPackets() const { return mPackets; }
+
+private:
+    DrawQueue() = default;
+    uint32_t getObjectKey(std::unordered_map<const void*, uint32_t>& keys, const void* pObject);
+
+    std::vector<DrawPacket> mPackets;
+    std::vector<DrawPacket> mScratch;
+    std::vector<std::vector<DrawPacket>> mChunks;   // Kept across frames for their capacity
+    std::unordered_map<const void*, uint32_t> mVaoKeys;
+    std::unordered_map<const void*, uint32_t> mMaterialKeys;
+};
@@ -0,0 +1,119 @@
+#include "DrawRecorder.h"
+
+DrawRecorder::SharedPtr DrawRecorder::create()
+{
+    return SharedPtr(new DrawRecorder());
+}
+
+void DrawRecorder::setSceneDraws(const Scene::SharedPtr& pScene, uint32_t repeatCount, uint32_t programVariant, DrawQueue* pQueue)
+{
+    mSceneDraws.clear();
+    mModelInstances.clear();
+    mMeshInstances.clear();
+    for (uint32_t repeat = 0; repeat < repeatCount; ++repeat)
+    {
+        for (uint32_t modelID = 0; modelID < pScene->getModelCount(); ++modelID)
+        {
+            const auto& model = pScene->getModel(modelID);
+            for (uint32_t modelInstanceID = 0; modelInstanceID < pScene->getModelInstanceCount(modelID); ++modelInstanceID)
+            {
+                const auto& modelInstance = pScene->getModelInstance(modelID, modelInstanceID);
+                if (repeat == 0) mModelInstances.push_back(modelInstance.get());
+                for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
+                {
+                    const auto& mesh = model->getMesh(meshID);
+                    const uint64_t stateKey = DrawQueue::makeSortKey(programVariant, pQueue->getVaoKey(mesh->getVao().get()), pQueue->getMaterialKey(mesh->getMaterial().get()), 0.0f);
+                    for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
+                    {
+                        const auto& meshInstance = model->getMeshInstance(meshID, meshInstanceID);
+                        if (repeat == 0 && modelInstanceID == 0) mMeshInstances.push_back(meshInstance.get());
+                        mSceneDraws.push_back({ mesh.get(), modelInstance.get(), meshInstance.get(), stateKey });
+                    }
+                }
+            }
+        }
+    }
+}
+
+void DrawRecorder::writeSceneConstants(const Mesh* pMesh, const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, uint32_t drawID, DrawConstants* pDst)
+{
+    assert(!pMesh->hasBones());
+    DrawConstants constants;
+    constants.worldMat = pModelInstance->getTransformMatrix() * pMeshInstance->getTransformMatrix();
+    constants.prevWorldMat = pModelInstance->getPrevTransformMatrix() * pMeshInstance->getTransformMatrix();
+    constants.worldInvTransposeMat = transpose(inverse(glm::mat3(constants.worldMat)));
+    constants.drawID = drawID;
+    constants.meshID = pMesh->getId();
+    constants.materialID = 0;
+    constants.geometryID = 0;
+    *pDst = constants;
+}
+
+void DrawRecorder::recordScene(ThreadPool* pPool, const View& view, DrawConstants* pConstants, uint32_t firstRingSlot, DrawQueue* pQueue) const
+{
+    for (const Scene::ModelInstance* pInstance : mModelInstances)
+    {
+        pInstance->getTransformMatrix();
+        pInstance->getPrevTransformMatrix();
+    }
+    for (const Model::MeshInstance* pInstance : mMeshInstances)
+    {
+        pInstance->getTransformMatrix();
+        pInstance->getBoundingBox();
+    }
+
+    pQueue->record(pPool, (uint32_t)mSceneDraws.size(), kDrawsPerChunk, [&](uint32_t begin, uint32_t end, std::vector<DrawPacket>& packets)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const SceneDraw& draw = mSceneDraws[i];
+            const BoundingBox box = draw.pMeshInstance->getBoundingBox().transform(draw.pModelInstance->getTransformMatrix());
+            if (view.cull && !view.frustum.intersects(box)) continue;
+
+            writeSceneConstants(draw.pMesh, draw.pModelInstance, draw.pMeshInstance, i, pConstants + i);
+
+            // The depth bucket takes the low bits, which are zero in the state key
+            DrawPacket packet;
+            packet.sortKey = draw.stateKey | DrawQueue::makeSortKey(0, 0, 0, glm::length(box.center - view.cameraPos) * view.depthScale);
+            packet.pMesh = draw.pMesh;
+            packet.pModelInstance = nullptr;
+            packet.pMeshInstance = nullptr;
+            packet.drawID = i;
+            packet.drawRingSlot = firstRingSlot + i * kRingSlotsPerDraw;
+            packets.push_back(packet);
+        }
+    });
+}
+
+void DrawRecorder::recordDrawList(ThreadPool* pPool, const View& view, const DrawList::SharedPtr& pDrawList, uint32_t programVariant, DrawQueue* pQueue)
+{
+    const auto& meshes = pDrawList->getMeshes();
+    if (mpDrawList.lock() != pDrawList)
+    {
+        mDrawListStateKeys.resize(meshes.size());
+        for (size_t drawID = 0; drawID < meshes.size(); ++drawID)
+        {
+            const Mesh* pMesh = meshes[drawID].get();
+            mDrawListStateKeys[drawID] = DrawQueue::makeSortKey(programVariant, pQueue->getVaoKey(pMesh->getVao().get()), pQueue->getMaterialKey(pMesh->getMaterial().get()), 0.0f);
+        }
+        mpDrawList = pDrawList;
+    }
+
+    const auto& constants = pDrawList->getConstants();
+    pQueue->record(pPool, pDrawList->getDrawCount(), kDrawsPerChunk, [&](uint32_t begin, uint32_t end, std::vector<DrawPacket>& packets)
+    {
+        for (uint32_t drawID = begin; drawID < end; ++drawID)
+        {
+            const glm::vec3 position = glm::vec3(constants[drawID].worldMat[3]);
+
+            DrawPacket packet;
+            packet.sortKey = mDrawListStateKeys[drawID] | DrawQueue::makeSortKey(0, 0, 0, glm::length(position - view.cameraPos) * view.depthScale);
+            packet.pMesh = meshes[drawID].get();
+            packet.pModelInstance = nullptr;
+            packet.pMeshInstance = nullptr;
+            packet.drawID = drawID;
+            packet.drawRingSlot = 0;
+            packets.push_back(packet);
+        }
+    });
+}
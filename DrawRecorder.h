@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Falcor.h"
+#include "DrawList.h"
+#include "DrawQueue.h"
+#include "ThreadPool.h"
+
+using namespace Falcor;
+
+// Records the per-draw CPU work of the per-draw render paths into a draw queue on the thread pool: culling, sort keys and the
+// draw constants of scene draws. Only submitting the recorded packets is left to the render thread.
+// The draws are flattened once with their sort key fields, so recording only reads shared data and needs no locks.
+class DrawRecorder
+{
+public:
+    using SharedPtr = std::shared_ptr<DrawRecorder>;
+
+    // Draws recorded per chunk, small enough to balance the threads, large enough to amortize taking a chunk
+    static const uint32_t kDrawsPerChunk = 256;
+
+    // Upload ring slots taken by one DrawConstants
+    static const uint32_t kRingSlotsPerDraw = sizeof(DrawConstants) / 16;
+
+    struct View
+    {
+        Frustum frustum;
+        glm::vec3 cameraPos;
+        float depthScale;       // 1 / far plane, normalizes the sort depth
+        bool cull;
+    };
+
+    static SharedPtr create();
+
+    // Flattens every mesh instance of the scene repeatCount times, in the order of the explicit traversal.
+    // Transforms are read when recording, so the scene may animate. Call again when the scene changes.
+    void setSceneDraws(const Scene::SharedPtr& pScene, uint32_t repeatCount, uint32_t programVariant, DrawQueue* pQueue);
+
+    // Appends a packet per visible scene draw and writes its constants to pConstants[draw]. Packets carry the constants' ring
+    // slot, firstRingSlot + draw * kRingSlotsPerDraw, and the draw index as drawID.
+    void recordScene(ThreadPool* pPool, const View& view, DrawConstants* pConstants, uint32_t firstRingSlot, DrawQueue* pQueue) const;
+
+    // Appends a packet per draw of the draw list, with drawID indexing its constants. Like the serial path, it doesn't cull.
+    // The draw list's state keys are looked up on the first record after it changes.
+    void recordDrawList(ThreadPool* pPool, const View& view, const DrawList::SharedPtr& pDrawList, uint32_t programVariant, DrawQueue* pQueue);
+
+    uint32_t getSceneDrawCount() const { return (uint32_t)mSceneDraws.size(); }
+
+    // Full draw constants of a scene draw, built locally and stored with one copy since pDst may be write-combined upload memory
+    static void writeSceneConstants(const Mesh* pMesh, const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, uint32_t drawID, DrawConstants* pDst);
+
+private:
+    DrawRecorder() = default;
+
+    struct SceneDraw
+    {
+        const Mesh* pMesh;
+        const Scene::ModelInstance* pModelInstance;
+        const Model::MeshInstance* pMeshInstance;
+        uint64_t stateKey;      // Sort key without the depth bucket
+    };
+
+    std::vector<SceneDraw> mSceneDraws;
+
+    // Unique instances of the scene draws. Falcor updates instance matrices lazily on first access, so the recorder
+    // touches them serially before reading them from several threads.
+    std::vector<const Scene::ModelInstance*> mModelInstances;
+    std::vector<const Model::MeshInstance*> mMeshInstances;
+
+    std::weak_ptr<DrawList> mpDrawList;         // Draw list the state keys were looked up for
+    std::vector<uint64_t> mDrawListStateKeys;   // Indexed by drawID
+};
@@ -0,0 +1,240 @@
+#include "FrustumCuller.h"
+#include "Simd.h"
+
+namespace
+{
+    // Box vs. plane: the box is outside if its center is further behind the plane than its projected extent.
+    // The SIMD kernels evaluate exactly the same expression in the same order, so all kernels agree bit for bit.
+    inline bool isInside(const glm::vec4& plane, float cx, float cy, float cz, float ex, float ey, float ez)
+    {
+        const float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+        const float r = std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez;
+        return d + r >= 0.0f;
+    }
+}
+
+Frustum Frustum::fromViewProj(const glm::mat4& viewProj)
+{
+    auto row = [&](int r) { return glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]); };
+
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0); // Left
+    frustum.planes[1] = row(3) - row(0); // Right
+    frustum.planes[2] = row(3) + row(1); // Bottom
+    frustum.planes[3] = row(3) - row(1); // Top
+    frustum.planes[4] = row(3) + row(2); // Near
+    frustum.planes[5] = row(3) - row(2); // Far
+
+    for (auto& plane : frustum.planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingBox& box) const
+{
+    for (const auto& plane : planes)
+    {
+        if (!isInside(plane, box.center.x, box.center.y, box.center.z, box.extent.x, box.extent.y, box.extent.z)) return false;
+    }
+    return true;
+}
+
+FrustumCuller::SharedPtr FrustumCuller::create()
+{
+    return SharedPtr(new FrustumCuller());
+}
+
+void FrustumCuller::resize(uint32_t count)
+{
+    for (auto* pArray : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ })
+    {
+        pArray->resize(count);
+    }
+}
+
+void FrustumCuller::setBounds(uint32_t index, const BoundingBox& box)
+{
+    mCenterX[index] = box.center.x;
+    mCenterY[index] = box.center.y;
+    mCenterZ[index] = box.center.z;
+    mExtentX[index] = box.extent.x;
+    mExtentY[index] = box.extent.y;
+    mExtentZ[index] = box.extent.z;
+}
+
+BoundingBox FrustumCuller::getBounds(uint32_t index) const
+{
+    BoundingBox box;
+    box.center = glm::vec3(mCenterX[index], mCenterY[index], mCenterZ[index]);
+    box.extent = glm::vec3(mExtentX[index], mExtentY[index], mExtentZ[index]);
+    return box;
+}
+
+glm::vec4 FrustumCuller::getBoundingSphere(uint32_t index) const
+{
+    const glm::vec3 extent(mExtentX[index], mExtentY[index], mExtentZ[index]);
+    return glm::vec4(mCenterX[index], mCenterY[index], mCenterZ[index], glm::length(extent));
+}
+
+bool FrustumCuller::isKernelSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::AVX:
+        return Simd::hasAVX();
+    default:
+        return true; // SSE2 is part of the x64 baseline
+    }
+}
+
+const char* FrustumCuller::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar: return "Scalar";
+    case Kernel::SSE: return "SSE";
+    case Kernel::AVX: return "AVX";
+    default: return "Best";
+    }
+}
+
+uint32_t FrustumCuller::cull(const Frustum& frustum, uint32_t* pVisible, Kernel kernel) const
+{
+    if (kernel == Kernel::Best)
+    {
+        kernel = Simd::hasAVX() ? Kernel::AVX : Kernel::SSE;
+    }
+
+    switch (kernel)
+    {
+    case Kernel::Scalar:
+        return cullScalar(frustum, 0, getCount(), pVisible);
+    case Kernel::SSE:
+        return cullSSE(frustum, pVisible);
+    case Kernel::AVX:
+        assert(Simd::hasAVX());
+        return cullAVX(frustum, pVisible);
+    default:
+        should_not_get_here();
+        return 0;
+    }
+}
+
+uint32_t FrustumCuller::cullScalar(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* pVisible) const
+{
+    uint32_t visibleCount = 0;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        bool inside = true;
+        for (uint32_t p = 0; p < 6 && inside; ++p)
+        {
+            inside = isInside(frustum.planes[p], mCenterX[i], mCenterY[i], mCenterZ[i], mExtentX[i], mExtentY[i], mExtentZ[i]);
+        }
+
+        if (inside)
+        {
+            pVisible[visibleCount++] = i;
+        }
+    }
+    return visibleCount;
+}
+
+uint32_t FrustumCuller::cullSSE(const Frustum& frustum, uint32_t* pVisible) const
+{
+    const uint32_t count = getCount();
+    const uint32_t simdEnd = count & ~3u;
+
+    __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        const glm::vec4& plane = frustum.planes[p];
+        nx[p] = _mm_set1_ps(plane.x);
+        ny[p] = _mm_set1_ps(plane.y);
+        nz[p] = _mm_set1_ps(plane.z);
+        nw[p] = _mm_set1_ps(plane.w);
+        ax[p] = _mm_set1_ps(std::abs(plane.x));
+        ay[p] = _mm_set1_ps(std::abs(plane.y));
+        az[p] = _mm_set1_ps(std::abs(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < simdEnd; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&mCenterX[i]);
+        const __m128 cy = _mm_loadu_ps(&mCenterY[i]);
+        const __m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+        const __m128 ex = _mm_loadu_ps(&mExtentX[i]);
+        const __m128 ey = _mm_loadu_ps(&mExtentY[i]);
+        const __m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)), nw[p]);
+            const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+        }
+
+        // Branchless compaction. visibleCount <= i, so the speculative writes stay within the output.
+        const uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            pVisible[visibleCount] = i + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+
+    return visibleCount + cullScalar(frustum, simdEnd, count, pVisible + visibleCount);
+}
+
+SIMD_TARGET_AVX uint32_t FrustumCuller::cullAVX(const Frustum& frustum, uint32_t* pVisible) const
+{
+    const uint32_t count = getCount();
+    const uint32_t simdEnd = count & ~7u;
+
+    __m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        const glm::vec4& plane = frustum.planes[p];
+        nx[p] = _mm256_set1_ps(plane.x);
+        ny[p] = _mm256_set1_ps(plane.y);
+        nz[p] = _mm256_set1_ps(plane.z);
+        nw[p] = _mm256_set1_ps(plane.w);
+        ax[p] = _mm256_set1_ps(std::abs(plane.x));
+        ay[p] = _mm256_set1_ps(std::abs(plane.y));
+        az[p] = _mm256_set1_ps(std::abs(plane.z));
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < simdEnd; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+        const __m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+        const __m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+        const __m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+        const __m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+        const __m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), nw[p]);
+            const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+        }
+
+        const uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+        for (uint32_t lane = 0; lane < 8; ++lane)
+        {
+            pVisible[visibleCount] = i + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+    _mm256_zeroupper();
+
+    return visibleCount + cullScalar(frustum, simdEnd, count, pVisible + visibleCount);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// World-space frustum as six inward-facing planes (xyz normal, w distance)
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // Extracts the planes from a view-projection matrix. The near plane is z >= -w, which is conservative for both depth conventions.
+    static Frustum fromViewProj(const glm::mat4& viewProj);
+
+    // Scalar test of a single box, used by the per-draw render paths
+    bool intersects(const BoundingBox& box) const;
+};
+
+// Axis-aligned bounds of many draws in structure-of-arrays form, culled against a frustum with SIMD kernels
+class FrustumCuller
+{
+public:
+    using SharedPtr = std::shared_ptr<FrustumCuller>;
+
+    enum class Kernel
+    {
+        Scalar,     // Reference implementation
+        SSE,        // 4 boxes per iteration
+        AVX,        // 8 boxes per iteration
+        Best,       // Widest kernel supported by the CPU
+    };
+
+    static SharedPtr create();
+
+    void resize(uint32_t count);
+    void setBounds(uint32_t index, const BoundingBox& box);
+    uint32_t getCount() const { return (uint32_t)mCenterX.size(); }
+
+    BoundingBox getBounds(uint32_t index) const;
+
+    // Sphere around the box, center in xyz and radius in w
+    glm::vec4 getBoundingSphere(uint32_t index) const;
+
+    // Writes the ascending indices of all boxes intersecting the frustum and returns how many there are.
+    // pVisible must hold getCount() entries. Every kernel produces the same output.
+    uint32_t cull(const Frustum& frustum, uint32_t* pVisible, Kernel kernel = Kernel::Best) const;
+
+    static bool isKernelSupported(Kernel kernel);
+    static const char* getKernelName(Kernel kernel);
+
+private:
+    FrustumCuller() = default;
+
+    uint32_t cullScalar(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* pVisible) const;
+    uint32_t cullSSE(const Frustum& frustum, uint32_t* pVisible) const;
+    uint32_t cullAVX(const Frustum& frustum, uint32_t* pVisible) const;
+
+    std::vector<float> mCenterX, mCenterY, mCenterZ;
+    std::vector<float> mExtentX, mExtentY, mExtentZ;
+};
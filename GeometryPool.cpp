@@ -0,0 +1,816 @@
+#include "GeometryPool.h"
+#include "Hash.h"
+#include "VertexQuantization.h"
+#include <cfloat>
+
+namespace
+{
+    const uint32_t kMaxShortIndexVertices = 1 << 16;
+
+    // LOD generation stops at meshes this small, and when simplifying stalls above this fraction of the previous level
+    const uint32_t kMinLodTriangles = 64;
+    const float kMinLodReduction = 0.8f;
+
+    // Levels may move the surface at most this fraction of the mesh radius, the screen-space selection decides where that is acceptable
+    const float kMaxLodErrorFraction = 0.1f;
+
+    void computeBounds(const uint8_t* pPositions, uint32_t stride, uint32_t vertexCount, glm::vec3& minPos, glm::vec3& maxPos)
+    {
+        minPos = glm::vec3(FLT_MAX);
+        maxPos = glm::vec3(-FLT_MAX);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            const float* p = (const float*)(pPositions + (size_t)v * stride);
+            const glm::vec3 position(p[0], p[1], p[2]);
+            minPos = glm::min(minPos, position);
+            maxPos = glm::max(maxPos, position);
+        }
+    }
+
+    float computeRadius(const uint8_t* pPositions, uint32_t stride, uint32_t vertexCount)
+    {
+        glm::vec3 minPos, maxPos;
+        computeBounds(pPositions, stride, vertexCount, minPos, maxPos);
+        return vertexCount > 0 ? 0.5f * glm::length(maxPos - minPos) : 0.0f;
+    }
+
+    uint32_t findStream(const Vao::SharedPtr& pVao, const std::string& elementName)
+    {
+        for (uint32_t i = 0; i < pVao->getVertexBuffersCount(); ++i)
+        {
+            if (pVao->getVertexLayout()->getBufferLayout(i)->getElementName(0) == elementName) return i;
+        }
+        return ~0u;
+    }
+
+    // RGB32Float position element of a layout, stream ~0u if there is none
+    void findPositionElement(const VertexLayout::SharedConstPtr& pLayout, uint32_t streamCount, uint32_t& stream, uint32_t& offset)
+    {
+        stream = ~0u;
+        for (uint32_t i = 0; i < streamCount && stream == ~0u; ++i)
+        {
+            const auto& bufferLayout = pLayout->getBufferLayout(i);
+            for (uint32_t element = 0; element < bufferLayout->getElementCount(); ++element)
+            {
+                if (bufferLayout->getElementName(element) == VERTEX_POSITION_NAME && bufferLayout->getElementFormat(element) == ResourceFormat::RGB32Float)
+                {
+                    stream = i;
+                    offset = bufferLayout->getElementOffset(element);
+                }
+            }
+        }
+    }
+
+    void readVec3s(const uint8_t* pData, uint32_t stride, uint32_t vertexCount, std::vector<glm::vec3>& output)
+    {
+        output.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            memcpy(&output[v], pData + (size_t)v * stride, sizeof(glm::vec3));
+        }
+    }
+
+    // Positions of a mesh's vertices as the vertex shader sees them, decoding quantized ones
+    void readPositions(const uint8_t* pData, uint32_t stride, const GeometryPool::MeshRange& range, bool quantized, std::vector<glm::vec3>& output)
+    {
+        pData += (size_t)range.baseVertex * stride;
+        if (!quantized)
+        {
+            readVec3s(pData, stride, range.vertexCount, output);
+            return;
+        }
+
+        output.resize(range.vertexCount);
+        for (uint32_t v = 0; v < range.vertexCount; ++v)
+        {
+            uint16_t quantizedPosition[4];
+            memcpy(quantizedPosition, pData + (size_t)v * stride, sizeof(quantizedPosition));
+            output[v] = VertexQuantization::decodePosition(quantizedPosition, range.positionScale, range.positionOffset);
+        }
+    }
+
+    enum class ElementEncoding
+    {
+        Copy,
+        Position,       // RGB32Float to RGBA16Unorm relative to the mesh's bounds
+        Direction,      // RGB32Float to octahedral RG16Snorm
+        TexCoord,       // RG32Float or RGB32Float to RG16Float, a third coordinate is dropped
+    };
+
+    struct QuantizedElement
+    {
+        ElementEncoding encoding;
+        uint32_t srcOffset;
+        uint32_t dstOffset;
+        uint32_t size;          // Of the source element
+    };
+
+    struct QuantizedStream
+    {
+        uint32_t stride;
+        std::vector<QuantizedElement> elements;
+    };
+
+    // Quantized version of an fp32 layout and how each element is converted. Elements stay in order and tightly packed like Falcor's layouts.
+    // Returns null if there is no RGB32Float position, without one there are no bounds to quantize against.
+    VertexLayout::SharedPtr createQuantizedLayout(const VertexLayout::SharedConstPtr& pLayout, uint32_t streamCount, std::vector<QuantizedStream>& streams)
+    {
+        VertexLayout::SharedPtr pQuantizedLayout = VertexLayout::create();
+        bool hasPosition = false;
+        streams.assign(streamCount, {});
+        for (uint32_t i = 0; i < streamCount; ++i)
+        {
+            const auto& bufferLayout = pLayout->getBufferLayout(i);
+            VertexBufferLayout::SharedPtr pQuantizedBuffer = VertexBufferLayout::create();
+            QuantizedStream& stream = streams[i];
+            stream.stride = 0;
+            for (uint32_t element = 0; element < bufferLayout->getElementCount(); ++element)
+            {
+                const std::string& name = bufferLayout->getElementName(element);
+                const ResourceFormat format = bufferLayout->getElementFormat(element);
+                const uint32_t arraySize = bufferLayout->getElementArraySize(element);
+
+                QuantizedElement quantized;
+                quantized.encoding = ElementEncoding::Copy;
+                quantized.srcOffset = bufferLayout->getElementOffset(element);
+                quantized.dstOffset = stream.stride;
+                quantized.size = getFormatBytesPerBlock(format) * arraySize;
+
+                ResourceFormat quantizedFormat = format;
+                if (arraySize == 1 && format == ResourceFormat::RGB32Float && name == VERTEX_POSITION_NAME)
+                {
+                    quantized.encoding = ElementEncoding::Position;
+                    quantizedFormat = ResourceFormat::RGBA16Unorm;
+                    hasPosition = true;
+                }
+                else if (arraySize == 1 && format == ResourceFormat::RGB32Float && (name == VERTEX_NORMAL_NAME || name == VERTEX_BITANGENT_NAME))
+                {
+                    quantized.encoding = ElementEncoding::Direction;
+                    quantizedFormat = ResourceFormat::RG16Snorm;
+                }
+                else if (arraySize == 1 && (format == ResourceFormat::RG32Float || format == ResourceFormat::RGB32Float) && name == VERTEX_TEXCOORD_NAME)
+                {
+                    quantized.encoding = ElementEncoding::TexCoord;
+                    quantizedFormat = ResourceFormat::RG16Float;
+                }
+
+                pQuantizedBuffer->addElement(name, quantized.dstOffset, quantizedFormat, arraySize, bufferLayout->getElementShaderLocation(element));
+                stream.stride += getFormatBytesPerBlock(quantizedFormat) * arraySize;
+                stream.elements.push_back(quantized);
+            }
+            pQuantizedLayout->addBufferLayout(i, pQuantizedBuffer);
+        }
+        return hasPosition ? pQuantizedLayout : nullptr;
+    }
+
+    void quantizeElement(const QuantizedElement& element, const uint8_t* pSrc, uint8_t* pDst, const GeometryPool::MeshRange& range)
+    {
+        pSrc += element.srcOffset;
+        pDst += element.dstOffset;
+        if (element.encoding == ElementEncoding::Copy)
+        {
+            memcpy(pDst, pSrc, element.size);
+            return;
+        }
+
+        float value[3];
+        memcpy(value, pSrc, element.encoding == ElementEncoding::TexCoord ? 2 * sizeof(float) : sizeof(value));
+        switch (element.encoding)
+        {
+        case ElementEncoding::Position:
+        {
+            uint16_t position[4];
+            VertexQuantization::encodePosition(glm::vec3(value[0], value[1], value[2]), range.positionScale, range.positionOffset, position);
+            memcpy(pDst, position, sizeof(position));
+            break;
+        }
+        case ElementEncoding::Direction:
+        {
+            int16_t direction[2];
+            VertexQuantization::encodeOctahedral(glm::vec3(value[0], value[1], value[2]), direction);
+            memcpy(pDst, direction, sizeof(direction));
+            break;
+        }
+        default:
+        {
+            const uint16_t texCoord[2] = { VertexQuantization::encodeHalf(value[0]), VertexQuantization::encodeHalf(value[1]) };
+            memcpy(pDst, texCoord, sizeof(texCoord));
+            break;
+        }
+        }
+    }
+}
+
+GeometryPool::SharedPtr GeometryPool::create(const std::vector<Mesh::SharedPtr>& meshes, ThreadPool* pPool, Flags flags)
+{
+    SharedPtr pGeometryPool = createDeferred(meshes, flags);
+    pGeometryPool->mapSources((uint32_t)meshes.size());
+    pGeometryPool->build(pPool);
+    pGeometryPool->upload();
+    return pGeometryPool;
+}
+
+GeometryPool::SharedPtr GeometryPool::createDeferred(const std::vector<Mesh::SharedPtr>& meshes, Flags flags)
+{
+    SharedPtr pGeometryPool = SharedPtr(new GeometryPool());
+    pGeometryPool->mSourceMeshes = meshes;
+    pGeometryPool->mFlags = flags;
+    if (meshes.empty()) return pGeometryPool;
+
+    // The layout comes from a static mesh when there is one, so that bone streams aren't merged
+    uint32_t protoIndex = 0;
+    while (protoIndex + 1 < (uint32_t)meshes.size() && meshes[protoIndex]->hasBones()) protoIndex++;
+    if (meshes[protoIndex]->hasBones()) protoIndex = 0;
+
+    const auto& protoVao = meshes[protoIndex]->getVao();
+    const uint32_t vertexStreamCount = protoVao->getVertexBuffersCount();
+    assert(protoVao->getIndexBufferFormat() == ResourceFormat::R32Uint);
+    pGeometryPool->mProtoVao = protoVao;
+
+    pGeometryPool->mVertexStrides.resize(vertexStreamCount);
+    pGeometryPool->mStreamNames.resize(vertexStreamCount);
+    for (uint32_t i = 0; i < vertexStreamCount; ++i)
+    {
+        const auto& bufferLayout = protoVao->getVertexLayout()->getBufferLayout(i);
+        pGeometryPool->mVertexStrides[i] = bufferLayout->getStride();
+        pGeometryPool->mStreamNames[i] = bufferLayout->getElementName(0);
+
+        for (uint32_t element = 0; element < bufferLayout->getElementCount(); ++element)
+        {
+            if (bufferLayout->getElementFormat(element) != ResourceFormat::RGB32Float) continue;
+
+            if (bufferLayout->getElementName(element) == VERTEX_POSITION_NAME)
+            {
+                pGeometryPool->mPositionStream = i;
+                pGeometryPool->mPositionOffset = bufferLayout->getElementOffset(element);
+            }
+            else if (bufferLayout->getElementName(element) == VERTEX_NORMAL_NAME)
+            {
+                pGeometryPool->mNormalStream = i;
+                pGeometryPool->mNormalOffset = bufferLayout->getElementOffset(element);
+            }
+        }
+    }
+
+    pGeometryPool->mSourceVertexData.resize(meshes.size());
+    pGeometryPool->mSourceStreams.resize(meshes.size());
+    pGeometryPool->mSourceBones.resize(meshes.size());
+    pGeometryPool->mSourceIndexData.resize(meshes.size());
+    pGeometryPool->mSkinIndices.resize(meshes.size(), ~0u);
+    pGeometryPool->mMeshRanges.resize(meshes.size());
+    return pGeometryPool;
+}
+
+bool GeometryPool::mapSources(uint32_t maxMeshes)
+{
+    if (mMappedMeshCount == mSourceMeshes.size()) return true;
+
+    // Counting pass: map each mesh once and assign its range, in mesh order so the offsets don't depend on the batch sizes
+    const uint32_t vertexStreamCount = (uint32_t)mVertexStrides.size();
+    const uint32_t end = std::min((uint32_t)mSourceMeshes.size(), mMappedMeshCount + maxMeshes);
+    for (uint32_t m = mMappedMeshCount; m < end; ++m)
+    {
+        const auto& pMesh = mSourceMeshes[m];
+        const auto& vao = pMesh->getVao();
+        assert(vao->getIndexBufferFormat() == ResourceFormat::R32Uint);
+        mSourceVertexData[m].assign(vao->getVertexBuffersCount(), nullptr);
+
+        MeshRange& range = mMeshRanges[m];
+        for (uint32_t i = 0; i < vertexStreamCount; ++i)
+        {
+            const uint32_t stream = findStream(vao, mStreamNames[i]);
+            assert(stream != ~0u && vao->getVertexLayout()->getBufferLayout(stream)->getStride() == mVertexStrides[i]);
+
+            const uint32_t vertexCount = (uint32_t)vao->getVertexBuffer(stream)->getSize() / mVertexStrides[i];
+            assert(i == 0 || vertexCount == range.vertexCount);
+            range.vertexCount = vertexCount;
+            mSourceStreams[m].push_back(stream);
+            mapSourceStream(m, stream);
+        }
+
+        // Meshes with bones are skinned when the pool has positions to rewrite, otherwise they stay in the bind pose
+        SourceBones& bones = mSourceBones[m];
+        if (pMesh->hasBones() && mPositionStream != ~0u)
+        {
+            bones.weightStream = findStream(vao, VERTEX_BONE_WEIGHT_NAME);
+            bones.idStream = findStream(vao, VERTEX_BONE_ID_NAME);
+        }
+        const bool skinned = bones.weightStream != ~0u && bones.idStream != ~0u;
+        if (skinned)
+        {
+            mapSourceStream(m, bones.weightStream);
+            mapSourceStream(m, bones.idStream);
+            mSkinIndices[m] = (uint32_t)mSkinnedMeshes.size();
+            mSkinnedMeshes.push_back({ m });
+        }
+        mSourceIndexData[m] = (const uint8_t*)vao->getIndexBuffer()->map(Buffer::MapType::Read);
+
+        // Coarser levels are generated by build() and stored after every mesh's full detail indices
+        range.lodCount = 1;
+        range.lods[0].indexCount = (uint32_t)vao->getIndexBuffer()->getSize() / sizeof(uint32_t);
+        range.lods[0].startIndex = mTotalIndexCount;
+        range.lods[0].error = 0;
+        mTotalIndexCount += range.lods[0].indexCount;
+
+        if (!skinned)
+        {
+            range.baseVertex = mTotalVertexCount;
+            mTotalVertexCount += range.vertexCount;
+        }
+    }
+
+    mMappedMeshCount = end;
+    if (mMappedMeshCount < mSourceMeshes.size()) return false;
+
+    // The skinned region follows every static vertex, so a frame's skinning is uploaded in one range per stream
+    mSkinnedBaseVertex = mTotalVertexCount;
+    for (const auto& skinnedMesh : mSkinnedMeshes)
+    {
+        MeshRange& range = mMeshRanges[skinnedMesh.meshIndex];
+        range.baseVertex = mTotalVertexCount;
+        mTotalVertexCount += range.vertexCount;
+    }
+    mSkinnedVertexCount = mTotalVertexCount - mSkinnedBaseVertex;
+    return true;
+}
+
+const uint8_t* GeometryPool::mapSourceStream(uint32_t meshIndex, uint32_t stream)
+{
+    const uint8_t*& pData = mSourceVertexData[meshIndex][stream];
+    if (!pData) pData = (const uint8_t*)mSourceMeshes[meshIndex]->getVao()->getVertexBuffer(stream)->map(Buffer::MapType::Read);
+    return pData;
+}
+
+void GeometryPool::build(ThreadPool* pPool)
+{
+    assert(mMappedMeshCount == mSourceMeshes.size());
+    if (mSourceMeshes.empty()) return;
+
+    const auto& protoVao = mSourceMeshes[0]->getVao();
+    const uint32_t vertexStreamCount = (uint32_t)mVertexStrides.size();
+    const bool triangleList = protoVao->getPrimitiveTopology() == Vao::Topology::TriangleList;
+    const bool optimize = (mFlags & Flags::OptimizeVertexCache) != Flags::None && triangleList;
+    const bool generateLods = (mFlags & Flags::GenerateLods) != Flags::None && triangleList && mPositionStream != ~0u;
+
+    // Fill pass, meshes copy into disjoint ranges
+    auto& vertexStreams = mCpuVertexStreams;
+    vertexStreams.resize(vertexStreamCount);
+    for (uint32_t i = 0; i < vertexStreamCount; ++i)
+    {
+        vertexStreams[i].resize((size_t)mTotalVertexCount * mVertexStrides[i]);
+        mVertexDataSize += vertexStreams[i].size();
+    }
+    std::vector<uint32_t> indices(mTotalIndexCount);
+    std::vector<OptimizeStats> meshStats(mSourceMeshes.size());
+    std::vector<std::vector<std::vector<uint32_t>>> meshLods(mSourceMeshes.size());     // Levels 1+ per mesh, placed after the parallel pass
+
+    parallelFor(pPool, (uint32_t)mSourceMeshes.size(), 1, [&](uint32_t begin, uint32_t end)
+    {
+        std::vector<uint32_t> remap;
+        for (uint32_t m = begin; m < end; ++m)
+        {
+            MeshRange& range = mMeshRanges[m];
+            const LodRange& lod0 = range.lods[0];
+            std::vector<const uint8_t*> vertexData(vertexStreamCount);
+            for (uint32_t i = 0; i < vertexStreamCount; ++i) vertexData[i] = mSourceVertexData[m][mSourceStreams[m][i]];
+            uint32_t* pMeshIndices = indices.data() + lod0.startIndex;
+            memcpy(pMeshIndices, mSourceIndexData[m], lod0.indexCount * sizeof(uint32_t));
+            meshStats[m].before = MeshOptimizer::analyzeVertexCache(pMeshIndices, lod0.indexCount, range.vertexCount);
+
+            // Skinned vertices keep their source order, it's the order of the bind pose and influences skinned every frame
+            const uint32_t skinIndex = mSkinIndices[m];
+            if (optimize && skinIndex != ~0u)
+            {
+                MeshOptimizer::optimizeVertexCache(pMeshIndices, lod0.indexCount, range.vertexCount);
+                MeshOptimizer::optimizeOverdraw(pMeshIndices, lod0.indexCount, vertexData[mPositionStream] + mPositionOffset, mVertexStrides[mPositionStream], range.vertexCount);
+                meshStats[m].after = MeshOptimizer::analyzeVertexCache(pMeshIndices, lod0.indexCount, range.vertexCount);
+            }
+
+            if (!optimize || skinIndex != ~0u)
+            {
+                if (!optimize) meshStats[m].after = meshStats[m].before;
+                for (uint32_t i = 0; i < vertexStreamCount; ++i)
+                {
+                    const size_t stride = mVertexStrides[i];
+                    memcpy(vertexStreams[i].data() + range.baseVertex * stride, vertexData[i], range.vertexCount * stride);
+                }
+            }
+            else
+            {
+                MeshOptimizer::optimizeVertexCache(pMeshIndices, lod0.indexCount, range.vertexCount);
+                if (mPositionStream != ~0u)
+                {
+                    MeshOptimizer::optimizeOverdraw(pMeshIndices, lod0.indexCount, vertexData[mPositionStream] + mPositionOffset, mVertexStrides[mPositionStream], range.vertexCount);
+                }
+                MeshOptimizer::optimizeVertexFetch(pMeshIndices, lod0.indexCount, range.vertexCount, remap);
+
+                meshStats[m].after = MeshOptimizer::analyzeVertexCache(pMeshIndices, lod0.indexCount, range.vertexCount);
+
+                // Scatter the vertices to their new slots
+                for (uint32_t i = 0; i < vertexStreamCount; ++i)
+                {
+                    const size_t stride = mVertexStrides[i];
+                    uint8_t* pDst = vertexStreams[i].data() + range.baseVertex * stride;
+                    for (uint32_t v = 0; v < range.vertexCount; ++v)
+                    {
+                        memcpy(pDst + remap[v] * stride, vertexData[i] + v * stride, stride);
+                    }
+                }
+            }
+
+            if (skinIndex != ~0u)
+            {
+                SkinnedMesh& skinnedMesh = mSkinnedMeshes[skinIndex];
+                readVec3s(vertexData[mPositionStream] + mPositionOffset, mVertexStrides[mPositionStream], range.vertexCount, skinnedMesh.positions);
+                if (mNormalStream != ~0u) readVec3s(vertexData[mNormalStream] + mNormalOffset, mVertexStrides[mNormalStream], range.vertexCount, skinnedMesh.normals);
+                readInfluences(m, skinnedMesh.influences);
+            }
+
+            if (!generateLods) continue;
+
+            // Every level is simplified from full detail, so its error is measured against the original surface.
+            // The levels index the mesh's vertices, only the index ranges differ.
+            const uint32_t positionStride = mVertexStrides[mPositionStream];
+            const uint8_t* pPositions = vertexStreams[mPositionStream].data() + range.baseVertex * positionStride + mPositionOffset;
+            const float maxError = kMaxLodErrorFraction * computeRadius(pPositions, positionStride, range.vertexCount);
+
+            uint32_t previousIndexCount = lod0.indexCount;
+            while (range.lodCount < kMaxLods)
+            {
+                const uint32_t targetIndexCount = previousIndexCount / 6 * 3;
+                if (targetIndexCount < kMinLodTriangles * 3) break;
+
+                std::vector<uint32_t> lodIndices;
+                const float error = MeshOptimizer::simplify(pMeshIndices, lod0.indexCount, pPositions, positionStride, range.vertexCount, targetIndexCount, maxError, lodIndices);
+                if (lodIndices.empty() || lodIndices.size() > previousIndexCount * kMinLodReduction) break;
+
+                if (optimize) MeshOptimizer::optimizeVertexCache(lodIndices.data(), (uint32_t)lodIndices.size(), range.vertexCount);
+
+                LodRange& lod = range.lods[range.lodCount++];
+                lod.indexCount = (uint32_t)lodIndices.size();
+                lod.error = error;
+                previousIndexCount = lod.indexCount;
+                meshLods[m].push_back(std::move(lodIndices));
+            }
+        }
+    });
+
+    // Coarser levels follow all full detail indices, in mesh order so the layout doesn't depend on the thread count
+    for (uint32_t m = 0; m < (uint32_t)mMeshRanges.size(); ++m)
+    {
+        MeshRange& range = mMeshRanges[m];
+        for (uint32_t level = 1; level < range.lodCount; ++level)
+        {
+            const auto& lodIndices = meshLods[m][level - 1];
+            range.lods[level].startIndex = (uint32_t)indices.size();
+            indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+        }
+    }
+    mTotalIndexCount = (uint32_t)indices.size();
+    updateLodStats();
+
+    // CPU copies of the skinned region of the streams rewritten every frame, other elements of those streams keep their values
+    for (uint32_t stream : { mPositionStream, mNormalStream })
+    {
+        if (mSkinnedMeshes.empty() || stream == ~0u || (!mSkinnedStreams.empty() && mSkinnedStreams[0].first == stream)) continue;
+
+        const size_t stride = mVertexStrides[stream];
+        const uint8_t* pRegion = vertexStreams[stream].data() + (size_t)mSkinnedBaseVertex * stride;
+        mSkinnedStreams.emplace_back(stream, std::vector<uint8_t>(pRegion, pRegion + (size_t)mSkinnedVertexCount * stride));
+    }
+
+    for (const auto& stats : meshStats)
+    {
+        mOptimizeStats.before += stats.before;
+        mOptimizeStats.after += stats.after;
+    }
+
+    // Indices are mesh-relative, the draws add baseVertexLocation, so 16 bits suffice when every mesh is small enough
+    bool shortIndices = (mFlags & Flags::ShortIndices) != Flags::None;
+    for (const auto& range : mMeshRanges)
+    {
+        shortIndices = shortIndices && range.vertexCount <= kMaxShortIndexVertices;
+    }
+
+    if (shortIndices)
+    {
+        std::vector<uint16_t> shortIndexData(indices.begin(), indices.end());
+        mIndexFormat = ResourceFormat::R16Uint;
+        mIndexDataSize = shortIndexData.size() * sizeof(uint16_t);
+        mCpuIndices.assign((const uint8_t*)shortIndexData.data(), (const uint8_t*)shortIndexData.data() + mIndexDataSize);
+    }
+    else
+    {
+        mIndexFormat = ResourceFormat::R32Uint;
+        mIndexDataSize = indices.size() * sizeof(uint32_t);
+        mCpuIndices.assign((const uint8_t*)indices.data(), (const uint8_t*)indices.data() + mIndexDataSize);
+    }
+
+    if ((mFlags & Flags::QuantizeVertices) != Flags::None && mPositionStream != ~0u)
+    {
+        quantizeVertices(pPool);
+    }
+
+    // After quantizing, so that occluders have the positions the GPU renders
+    if ((mFlags & Flags::KeepOccluders) != Flags::None && triangleList && mPositionStream != ~0u)
+    {
+        extractOccluders(vertexStreams[mPositionStream].data() + mPositionOffset, mVertexStrides[mPositionStream], { mCpuIndices.data(), mCpuIndices.size() });
+    }
+
+    if (generateLods)
+    {
+        std::string levels;
+        for (uint32_t level = 0; level < kMaxLods; ++level)
+        {
+            levels += (level > 0 ? ", " : "") + std::to_string(mLodStats.indices[level] / 3);
+        }
+        logInfo("Geometry pool LOD triangles " + levels);
+    }
+
+    if (optimize)
+    {
+        logInfo("Geometry pool ACMR " + std::to_string(mOptimizeStats.before.getACMR()) + " -> " + std::to_string(mOptimizeStats.after.getACMR()) +
+            ", ATVR " + std::to_string(mOptimizeStats.before.getATVR()) + " -> " + std::to_string(mOptimizeStats.after.getATVR()));
+    }
+}
+
+void GeometryPool::upload()
+{
+    if (mSourceMeshes.empty()) return;
+
+    for (uint32_t m = 0; m < mMappedMeshCount; ++m)
+    {
+        const auto& vao = mSourceMeshes[m]->getVao();
+        for (uint32_t stream = 0; stream < (uint32_t)mSourceVertexData[m].size(); ++stream)
+        {
+            if (mSourceVertexData[m][stream]) vao->getVertexBuffer(stream)->unmap();
+        }
+        vao->getIndexBuffer()->unmap();
+    }
+
+    std::vector<DataRange> streamRanges;
+    for (const auto& vertices : mCpuVertexStreams)
+    {
+        streamRanges.push_back({ vertices.data(), vertices.size() });
+    }
+    VertexLayout::SharedConstPtr pLayout = mProtoVao->getVertexLayout();
+    if (mQuantizedLayout) pLayout = mQuantizedLayout;
+    createVao(mProtoVao->getPrimitiveTopology(), pLayout, streamRanges, { mCpuIndices.data(), mCpuIndices.size() });
+    createPositionDequantBuffer();
+
+    mSourceMeshes.clear();
+    mProtoVao = nullptr;
+    mSourceVertexData.clear();
+    mSourceStreams.clear();
+    mSourceBones.clear();
+    mSourceIndexData.clear();
+    mMappedMeshCount = 0;
+
+    if ((mFlags & Flags::KeepCpuData) == Flags::None)
+    {
+        releaseCpuData();
+    }
+}
+
+GeometryPool::SharedPtr GeometryPool::createFromData(const Vao::SharedPtr& pProtoVao, const std::vector<MeshRange>& meshRanges, const std::vector<DataRange>& vertexStreams, DataRange indices, ResourceFormat indexFormat, const OptimizeStats& optimizeStats, Flags flags)
+{
+    SharedPtr pGeometryPool = SharedPtr(new GeometryPool());
+    pGeometryPool->mMeshRanges = meshRanges;
+    pGeometryPool->mIndexFormat = indexFormat;
+    pGeometryPool->mIndexDataSize = indices.size;
+    pGeometryPool->mOptimizeStats = optimizeStats;
+    pGeometryPool->updateLodStats();
+    for (const auto& stream : vertexStreams)
+    {
+        pGeometryPool->mVertexDataSize += stream.size;
+    }
+    for (const auto& range : meshRanges)
+    {
+        pGeometryPool->mTotalVertexCount = std::max(pGeometryPool->mTotalVertexCount, range.baseVertex + range.vertexCount);
+    }
+
+    // The quantized layout is derived from the prototype's, like build() derived it
+    VertexLayout::SharedConstPtr pLayout = pProtoVao->getVertexLayout();
+    uint32_t positionStream, positionOffset = 0;
+    findPositionElement(pLayout, (uint32_t)vertexStreams.size(), positionStream, positionOffset);
+    if ((flags & Flags::QuantizeVertices) != Flags::None)
+    {
+        std::vector<QuantizedStream> streams;
+        pGeometryPool->mQuantizedLayout = createQuantizedLayout(pLayout, (uint32_t)vertexStreams.size(), streams);
+        if (pGeometryPool->mQuantizedLayout)
+        {
+            pLayout = pGeometryPool->mQuantizedLayout;
+            for (const auto& element : streams[positionStream].elements)
+            {
+                if (element.encoding == ElementEncoding::Position) positionOffset = element.dstOffset;
+            }
+        }
+    }
+
+    pGeometryPool->createVao(pProtoVao->getPrimitiveTopology(), pLayout, vertexStreams, indices);
+    pGeometryPool->createPositionDequantBuffer();
+
+    if ((flags & Flags::KeepOccluders) != Flags::None && pProtoVao->getPrimitiveTopology() == Vao::Topology::TriangleList && positionStream != ~0u)
+    {
+        const uint32_t stride = pLayout->getBufferLayout(positionStream)->getStride();
+        pGeometryPool->extractOccluders((const uint8_t*)vertexStreams[positionStream].pData + positionOffset, stride, indices);
+    }
+    return pGeometryPool;
+}
+
+void GeometryPool::createVao(Vao::Topology topology, const VertexLayout::SharedConstPtr& pLayout, const std::vector<DataRange>& vertexStreams, DataRange indices)
+{
+    uint64_t hash = kHashSeed;
+    Vao::BufferVec vbs;
+    for (const auto& stream : vertexStreams)
+    {
+        hash = hashBytes(hash, stream.pData, stream.size);
+        vbs.push_back(Buffer::create(stream.size, Buffer::BindFlags::Vertex, Buffer::CpuAccess::None, stream.pData));
+    }
+    mContentHash = hashBytes(hash, indices.pData, indices.size);
+
+    auto ib = Buffer::create(indices.size, Buffer::BindFlags::Index, Buffer::CpuAccess::None, indices.pData);
+    mVao = Vao::create(topology, pLayout, vbs, ib, mIndexFormat);
+}
+
+void GeometryPool::createPositionDequantBuffer()
+{
+    if (!mQuantizedLayout) return;
+
+    std::vector<glm::vec4> dequant;
+    for (const auto& range : mMeshRanges)
+    {
+        dequant.push_back(glm::vec4(range.positionScale, 0.0f));
+        dequant.push_back(glm::vec4(range.positionOffset, 0.0f));
+    }
+    mPositionDequantBuffer = Buffer::create(dequant.size() * sizeof(glm::vec4), Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, dequant.data());
+}
+
+void GeometryPool::releaseCpuData()
+{
+    mCpuVertexStreams = {};
+    mCpuIndices = {};
+}
+
+void GeometryPool::updateLodStats()
+{
+    mLodStats = {};
+    for (const auto& range : mMeshRanges)
+    {
+        for (uint32_t level = 0; level < kMaxLods; ++level)
+        {
+            if (level < range.lodCount) mLodStats.levels[level]++;
+            mLodStats.indices[level] += range.lods[std::min(level, range.lodCount - 1)].indexCount;
+        }
+    }
+}
+
+void GeometryPool::extractOccluders(const uint8_t* pPositions, uint32_t positionStride, DataRange indices)
+{
+    // Skinned meshes move away from their bind pose, and coarser levels may pass outside the surface, so only full detail static meshes occlude
+    mOccluderMeshes.clear();
+    for (uint32_t m = 0; m < (uint32_t)mMeshRanges.size(); ++m)
+    {
+        const MeshRange& range = mMeshRanges[m];
+        const LodRange& lod0 = range.lods[0];
+        const bool skinned = m < mSkinIndices.size() && mSkinIndices[m] != ~0u;
+        if (skinned || lod0.indexCount == 0 || lod0.indexCount / 3 > kMaxOccluderTriangles) continue;
+
+        OccluderMesh occluder;
+        occluder.meshIndex = m;
+        readPositions(pPositions, positionStride, range, isQuantized(), occluder.positions);
+        occluder.indices.resize(lod0.indexCount);
+        for (uint32_t i = 0; i < lod0.indexCount; ++i)
+        {
+            const uint32_t index = lod0.startIndex + i;
+            occluder.indices[i] = mIndexFormat == ResourceFormat::R16Uint ? ((const uint16_t*)indices.pData)[index] : ((const uint32_t*)indices.pData)[index];
+        }
+        mOccluderMeshes.push_back(std::move(occluder));
+    }
+}
+
+void GeometryPool::quantizeVertices(ThreadPool* pPool)
+{
+    // Skinning rewrites fp32 positions and normals every frame, and posed meshes leave their bind pose bounds
+    if (!mSkinnedMeshes.empty())
+    {
+        logWarning("Geometry pool has skinned meshes, keeping fp32 vertices");
+        return;
+    }
+
+    const uint32_t vertexStreamCount = (uint32_t)mVertexStrides.size();
+    std::vector<QuantizedStream> streams;
+    mQuantizedLayout = createQuantizedLayout(mProtoVao->getVertexLayout(), vertexStreamCount, streams);
+    if (!mQuantizedLayout) return;
+
+    std::vector<std::vector<uint8_t>> quantizedStreams(vertexStreamCount);
+    for (uint32_t i = 0; i < vertexStreamCount; ++i)
+    {
+        quantizedStreams[i].resize((size_t)mTotalVertexCount * streams[i].stride);
+    }
+
+    // Meshes write disjoint ranges, each relative to its own bounds
+    parallelFor(pPool, (uint32_t)mMeshRanges.size(), 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t m = begin; m < end; ++m)
+        {
+            MeshRange& range = mMeshRanges[m];
+            const uint32_t positionStride = mVertexStrides[mPositionStream];
+            glm::vec3 minPos, maxPos;
+            computeBounds(mCpuVertexStreams[mPositionStream].data() + (size_t)range.baseVertex * positionStride + mPositionOffset, positionStride, range.vertexCount, minPos, maxPos);
+            range.positionOffset = range.vertexCount > 0 ? minPos : glm::vec3(0.0f);
+            range.positionScale = range.vertexCount > 0 ? maxPos - minPos : glm::vec3(0.0f);
+
+            for (uint32_t i = 0; i < vertexStreamCount; ++i)
+            {
+                const size_t srcStride = mVertexStrides[i];
+                const size_t dstStride = streams[i].stride;
+                const uint8_t* pSrc = mCpuVertexStreams[i].data() + range.baseVertex * srcStride;
+                uint8_t* pDst = quantizedStreams[i].data() + range.baseVertex * dstStride;
+                for (uint32_t v = 0; v < range.vertexCount; ++v)
+                {
+                    for (const auto& element : streams[i].elements)
+                    {
+                        quantizeElement(element, pSrc + v * srcStride, pDst + v * dstStride, range);
+                    }
+                }
+            }
+        }
+    });
+
+    // The CPU copy and the element offsets describe the quantized layout from here on
+    mVertexDataSize = 0;
+    for (uint32_t i = 0; i < vertexStreamCount; ++i)
+    {
+        mVertexStrides[i] = streams[i].stride;
+        mVertexDataSize += quantizedStreams[i].size();
+    }
+    for (const auto& element : streams[mPositionStream].elements)
+    {
+        if (element.encoding == ElementEncoding::Position) mPositionOffset = element.dstOffset;
+    }
+    mNormalStream = ~0u;
+    mCpuVertexStreams = std::move(quantizedStreams);
+
+    logInfo("Geometry pool quantized to " + std::to_string(mVertexDataSize / std::max(1u, mTotalVertexCount)) + " bytes/vertex");
+}
+
+void GeometryPool::readInfluences(uint32_t meshIndex, std::vector<Skinner::Influence>& influences) const
+{
+    const auto& vertexLayout = mSourceMeshes[meshIndex]->getVao()->getVertexLayout();
+    const SourceBones& bones = mSourceBones[meshIndex];
+    const auto& weightLayout = vertexLayout->getBufferLayout(bones.weightStream);
+    const auto& idLayout = vertexLayout->getBufferLayout(bones.idStream);
+    assert(weightLayout->getElementFormat(0) == ResourceFormat::RGBA32Float);
+
+    const uint8_t* pWeights = mSourceVertexData[meshIndex][bones.weightStream] + weightLayout->getElementOffset(0);
+    const uint8_t* pIds = mSourceVertexData[meshIndex][bones.idStream] + idLayout->getElementOffset(0);
+    const ResourceFormat idFormat = idLayout->getElementFormat(0);
+    const uint32_t vertexCount = mMeshRanges[meshIndex].vertexCount;
+
+    influences.resize(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        Skinner::Influence& influence = influences[v];
+        memcpy(&influence.weights, pWeights + (size_t)v * weightLayout->getStride(), sizeof(glm::vec4));
+
+        const uint8_t* pId = pIds + (size_t)v * idLayout->getStride();
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            switch (idFormat)
+            {
+            case ResourceFormat::RGBA8Uint: influence.bones[i] = pId[i]; break;
+            case ResourceFormat::RGBA16Uint: influence.bones[i] = ((const uint16_t*)pId)[i]; break;
+            default: influence.bones[i] = (uint16_t)((const uint32_t*)pId)[i]; break;
+            }
+        }
+    }
+}
+
+GeometryPool::SkinnedElement GeometryPool::getSkinnedElement(uint32_t stream, uint32_t offset)
+{
+    for (auto& skinnedStream : mSkinnedStreams)
+    {
+        if (skinnedStream.first == stream) return { skinnedStream.second.data() + offset, mVertexStrides[stream] };
+    }
+    return { nullptr, 0 };
+}
+
+GeometryPool::SkinnedElement GeometryPool::getSkinnedPositions()
+{
+    return getSkinnedElement(mPositionStream, mPositionOffset);
+}
+
+GeometryPool::SkinnedElement GeometryPool::getSkinnedNormals()
+{
+    return getSkinnedElement(mNormalStream, mNormalOffset);
+}
+
+void GeometryPool::uploadSkinnedVertices()
+{
+    for (const auto& skinnedStream : mSkinnedStreams)
+    {
+        const size_t offset = (size_t)mSkinnedBaseVertex * mVertexStrides[skinnedStream.first];
+        mVao->getVertexBuffer(skinnedStream.first)->updateData(skinnedStream.second.data(), offset, skinnedStream.second.size());
+    }
+}
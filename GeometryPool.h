@@ -0,0 +1,201 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+#include "MeshOptimizer.h"
+#include "Skinner.h"
+
+using namespace Falcor;
+
+// Combined vertex and index buffers holding every unique mesh exactly once.
+// Draws reference a mesh through its range, so geometry memory doesn't grow with the instance count.
+class GeometryPool
+{
+public:
+    using SharedPtr = std::shared_ptr<GeometryPool>;
+
+    enum class Flags : uint32_t
+    {
+        None = 0x0,
+        OptimizeVertexCache = 0x1,  // Reorder each mesh's triangles for the post-transform cache and overdraw, then its vertices for fetch locality
+        ShortIndices = 0x2,         // 16-bit indices, relative to the mesh's base vertex, when every mesh has at most 65536 vertices
+        KeepCpuData = 0x4,          // Keep a CPU copy of the merged vertex and index data, e.g. for writing a draw list pack
+        GenerateLods = 0x8,         // Simplify each mesh into a chain of coarser index ranges over the same vertices
+        KeepOccluders = 0x10,       // Keep CPU triangle lists of the small static meshes, for software occlusion culling
+        QuantizeVertices = 0x20,    // 16-bit positions relative to each mesh's bounds, octahedral normals and bitangents and half texture coordinates
+    };
+
+    // Detail levels per mesh, including the full detail one
+    static const uint32_t kMaxLods = 4;
+
+    struct DataRange
+    {
+        const void* pData;
+        size_t size;
+    };
+
+    struct LodRange
+    {
+        uint32_t startIndex;
+        uint32_t indexCount;
+        float error;            // Largest distance the surface moved from full detail, in object space
+    };
+
+    struct MeshRange
+    {
+        uint32_t baseVertex;
+        uint32_t vertexCount;
+        uint32_t lodCount;
+        LodRange lods[kMaxLods];    // lods[0] is the full detail mesh, each following level has about half the triangles
+        glm::vec3 positionScale;    // Quantized positions decode to unorm * positionScale + positionOffset, the mesh's bounds
+        glm::vec3 positionOffset;
+    };
+
+    // Post-transform cache efficiency summed over all meshes, before and after OptimizeVertexCache (the same without it)
+    struct OptimizeStats
+    {
+        MeshOptimizer::CacheStats before;
+        MeshOptimizer::CacheStats after;
+    };
+
+    struct LodStats
+    {
+        uint32_t levels[kMaxLods] = {};     // Meshes with at least that many levels
+        uint64_t indices[kMaxLods] = {};    // Summed over the meshes, a mesh without the level counts its coarsest one
+    };
+
+    // Bind pose of a mesh with bones, kept on the CPU to be skinned every frame
+    struct SkinnedMesh
+    {
+        uint32_t meshIndex;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;         // Empty without an RGB32Float normal stream
+        std::vector<Skinner::Influence> influences;
+    };
+
+    // Full detail triangles of a static mesh, kept on the CPU to be rasterized as an occluder. Indices are mesh-relative.
+    struct OccluderMesh
+    {
+        uint32_t meshIndex;
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    // Meshes with more triangles than this don't become occluders, they would cost more to rasterize than they save
+    static const uint32_t kMaxOccluderTriangles = 1024;
+
+    // Element of the skinned region's CPU copy, the element of vertex v is at pData + v * stride
+    struct SkinnedElement
+    {
+        uint8_t* pData;
+        uint32_t stride;
+    };
+
+    // All meshes must use 32-bit indices. The pool has the vertex streams of the first mesh without bones, other meshes provide
+    // the same elements, matched by name, and may have more. Meshes with bones go to a region after every static vertex.
+    // Meshes are processed independently, so the output is identical regardless of the thread count.
+    static SharedPtr create(const std::vector<Mesh::SharedPtr>& meshes, ThreadPool* pPool = nullptr, Flags flags = Flags::None);
+
+    // Staged version of create() for building off the render thread. mapSources() and upload() touch GPU buffers and must run on
+    // the render thread, build() only reads the mapped data and can run on any thread. The output is identical to create().
+    static SharedPtr createDeferred(const std::vector<Mesh::SharedPtr>& meshes, Flags flags = Flags::None);
+    bool mapSources(uint32_t maxMeshes);    // Maps up to maxMeshes more meshes for reading, returns true once all are mapped
+    void build(ThreadPool* pPool = nullptr);
+    void upload();                          // Unmaps the sources and creates the combined VAO
+
+    // Uploads previously merged data, e.g. straight from a memory-mapped draw list pack. The vertex layout comes from the prototype VAO.
+    // Of the flags, only KeepOccluders and QuantizeVertices apply, the data is already merged. QuantizeVertices says it was merged quantized.
+    static SharedPtr createFromData(const Vao::SharedPtr& pProtoVao, const std::vector<MeshRange>& meshRanges, const std::vector<DataRange>& vertexStreams, DataRange indices, ResourceFormat indexFormat, const OptimizeStats& optimizeStats, Flags flags = Flags::None);
+
+    const Vao::SharedPtr& getVao() const { return mVao; }
+    uint32_t getMeshCount() const { return (uint32_t)mMeshRanges.size(); }
+    const MeshRange& getMeshRange(uint32_t meshIndex) const { return mMeshRanges[meshIndex]; }
+    size_t getVertexDataSize() const { return mVertexDataSize; }
+    size_t getIndexDataSize() const { return mIndexDataSize; }
+    ResourceFormat getIndexFormat() const { return mIndexFormat; }
+    const OptimizeStats& getOptimizeStats() const { return mOptimizeStats; }
+    const LodStats& getLodStats() const { return mLodStats; }
+    uint64_t getContentHash() const { return mContentHash; }   // Of the vertex and index data, to check that builds are reproducible
+    uint32_t getVertexCount() const { return mTotalVertexCount; }
+
+    // With QuantizeVertices, positions are RGBA16Unorm, normals and bitangents RG16Snorm and texture coordinates RG16Float, other
+    // elements keep their format. Pools with skinned meshes stay fp32, skinning rewrites their positions every frame.
+    // The dequantization buffer holds each mesh's positionScale and positionOffset as two float4s, for BindlessVS.slang.
+    bool isQuantized() const { return mQuantizedLayout != nullptr; }
+    const Buffer::SharedPtr& getPositionDequantBuffer() const { return mPositionDequantBuffer; }
+
+    // Meshes with bones, in mesh order, and their vertex region. Their vertices stay in source order, only the triangles are optimized.
+    const std::vector<SkinnedMesh>& getSkinnedMeshes() const { return mSkinnedMeshes; }
+    uint32_t getSkinnedBaseVertex() const { return mSkinnedBaseVertex; }
+    uint32_t getSkinnedVertexCount() const { return mSkinnedVertexCount; }
+
+    // Write skinned positions and normals of the region relative to getSkinnedBaseVertex(), then upload them with uploadSkinnedVertices()
+    SkinnedElement getSkinnedPositions();
+    SkinnedElement getSkinnedNormals();     // pData is null without normals
+    void uploadSkinnedVertices();
+
+    // Static meshes with at most kMaxOccluderTriangles triangles, in mesh order. Empty unless built with KeepOccluders.
+    const std::vector<OccluderMesh>& getOccluderMeshes() const { return mOccluderMeshes; }
+
+    // Empty unless built with KeepCpuData
+    const std::vector<std::vector<uint8_t>>& getCpuVertexStreams() const { return mCpuVertexStreams; }
+    const std::vector<uint8_t>& getCpuIndices() const { return mCpuIndices; }
+    void releaseCpuData();
+
+private:
+    GeometryPool() = default;
+    void createVao(Vao::Topology topology, const VertexLayout::SharedConstPtr& pLayout, const std::vector<DataRange>& vertexStreams, DataRange indices);
+    void createPositionDequantBuffer();
+    void updateLodStats();
+    void quantizeVertices(ThreadPool* pPool);
+    void extractOccluders(const uint8_t* pPositions, uint32_t positionStride, DataRange indices);
+    const uint8_t* mapSourceStream(uint32_t meshIndex, uint32_t stream);
+    void readInfluences(uint32_t meshIndex, std::vector<Skinner::Influence>& influences) const;
+    SkinnedElement getSkinnedElement(uint32_t stream, uint32_t offset);
+
+    struct SourceBones
+    {
+        uint32_t weightStream = ~0u;
+        uint32_t idStream = ~0u;
+    };
+
+    // Source meshes, mapped between mapSources() and upload()
+    std::vector<Mesh::SharedPtr> mSourceMeshes;
+    Vao::SharedPtr mProtoVao;
+    std::vector<std::vector<const uint8_t*>> mSourceVertexData;     // Per source stream, null where not mapped
+    std::vector<std::vector<uint32_t>> mSourceStreams;              // Source stream of each pool stream
+    std::vector<SourceBones> mSourceBones;                          // Bone streams of skinned meshes
+    std::vector<const uint8_t*> mSourceIndexData;
+    std::vector<std::string> mStreamNames;                          // Name of the first element of each pool stream
+    std::vector<uint32_t> mVertexStrides;
+    uint32_t mPositionStream = ~0u;
+    uint32_t mPositionOffset = 0;
+    uint32_t mNormalStream = ~0u;
+    uint32_t mNormalOffset = 0;
+    uint32_t mMappedMeshCount = 0;
+    uint32_t mTotalVertexCount = 0;
+    uint32_t mTotalIndexCount = 0;
+    Flags mFlags = Flags::None;
+
+    std::vector<SkinnedMesh> mSkinnedMeshes;
+    std::vector<uint32_t> mSkinIndices;                     // Into mSkinnedMeshes per mesh, ~0u for static meshes
+    uint32_t mSkinnedBaseVertex = 0;
+    uint32_t mSkinnedVertexCount = 0;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> mSkinnedStreams;    // Vertex stream and the CPU copy of its skinned region
+
+    Vao::SharedPtr mVao;
+    std::vector<MeshRange> mMeshRanges;
+    size_t mVertexDataSize = 0;
+    size_t mIndexDataSize = 0;
+    ResourceFormat mIndexFormat = ResourceFormat::R32Uint;
+    OptimizeStats mOptimizeStats;
+    LodStats mLodStats;
+    uint64_t mContentHash = 0;
+    std::vector<std::vector<uint8_t>> mCpuVertexStreams;   // Built by build(), kept after upload() only with KeepCpuData
+    std::vector<uint8_t> mCpuIndices;
+    std::vector<OccluderMesh> mOccluderMeshes;
+    VertexLayout::SharedPtr mQuantizedLayout;               // Null unless the vertices are quantized
+    Buffer::SharedPtr mPositionDequantBuffer;
+};
+
+enum_class_operators(GeometryPool::Flags);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+const uint64_t kHashSeed = 0xcbf29ce484222325ull;
+
+// FNV-1a over 64-bit words, with the tail bytes folded in one by one. Stable across runs and platforms of the same endianness.
+inline uint64_t hashBytes(uint64_t hash, const void* pData, size_t size)
+{
+    const uint64_t kPrime = 0x100000001b3ull;
+    const uint8_t* pBytes = (const uint8_t*)pData;
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, pBytes + i, sizeof(word));
+        hash = (hash ^ word) * kPrime;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ pBytes[i]) * kPrime;
+    }
+    return hash;
+}
@@ -1,14 +1,63 @@
 #include "HighPerformanceRendering.h"
-
-#define REPEAT_NEXT_BLOCK for (int i = 0; i < 500; ++i)
+#include "Benchmarks.h"
+#include "AllocationCounter.h"
 
 namespace
 {
     // Relative to working directory. Note: different between running from VS and standalone
     static const char* kDefaultScene = "../../Media/Arcade/Arcade.fscene";
+
+    // Loaded scenes are drawn this many times over to stress the draw paths. Generated scenes have their own instance count.
+    const uint32_t kSceneRepeatCount = 500;
+
+    // Instance counts the N key steps through, generated with the other parameters of the current stress scene. 0 is the loaded scene.
+    const uint32_t kStressInstanceCounts[] = { 0, 1000, 10000, 100000, 1000000 };
     static const glm::vec4 kClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     static const glm::vec4 kSkyColor(0.2f, 0.6f, 0.9f, 1.0f);
 
+    // Prebuilt draw list, written after the first build and restored on later launches. Relative to working directory.
+    static const char* kDrawListPackFile = "DrawList.pack";
+
+    // Render thread time per frame spent on GPU work handed back by the loader, and source meshes read back per loader batch
+    const double kLoadBudgetMs = 4.0;
+    const uint32_t kMeshesPerLoadBatch = 8;
+
+    // Room for kFramesInFlight frames of explicit mode draw constants at the default repeat count. Grows if a frame needs more.
+    const size_t kUploadRingSize = 64 * 1024 * 1024;
+
+    // Multi-draw LOD selection picks the coarsest level whose simplification error covers at most this many pixels
+    const float kLodPixelError = 1.0f;
+
+    // Occluders rasterized per frame by software occlusion culling, picked by screen size
+    const uint32_t kMaxOccluderTriangles = 16 * 1024;
+
+    // Light data slots allocated up front for gClusterLights, it grows when a scene has more
+    const uint32_t kMinClusterLights = 64;
+
+    // Frames recorded by a render stats capture
+    const uint32_t kStatsCaptureFrames = 120;
+
+    // Frames recorded by a command capture, and where it's written. Relative to working directory.
+    const uint32_t kCommandCaptureFrames = 120;
+    static const char* kCommandTraceFile = "Commands.trace";
+
+    // Matches the RenderMode enum
+    static const std::vector<std::string> kRenderModeNames = { "Stock", "Explicit", "BindlessConstants", "BindlessMultiDraw" };
+
+    // Configurations the benchmark runs: every render mode with the default settings, then the per-draw modes submitting serially
+    // in traversal order through the draw queue and through the per-draw callbacks it replaced
+    struct BenchmarkConfig
+    {
+        uint32_t renderMode;
+        bool serial;            // No sorting or parallel recording
+        bool drawCallbacks;
+    };
+    static const std::vector<std::string> kBenchmarkConfigNames = { "Stock", "Explicit", "BindlessConstants", "BindlessMultiDraw",
+        "ExplicitSerialPackets", "ExplicitSerialCallbacks", "BindlessConstantsSerialPackets", "BindlessConstantsSerialCallbacks" };
+    const BenchmarkConfig kBenchmarkConfigs[] = {
+        { 0, false, false }, { 1, false, false }, { 2, false, false }, { 3, false, false },
+        { 1, true, false }, { 1, true, true }, { 2, true, false }, { 2, true, true } };
+
     const char* kPerFrameCbName = "InternalPerFrameCB";
     static size_t sCameraDataOffset = ConstantBuffer::kInvalidOffset;
     static size_t sLightCountOffset = ConstantBuffer::kInvalidOffset;
@@ -21,10 +70,80 @@ namespace
     static size_t sDrawIDOffset = ConstantBuffer::kInvalidOffset;
     static size_t sMeshIdOffset = ConstantBuffer::kInvalidOffset;
     static size_t sWorldMatArraySize = 0;
+
+    // Populate "InternalPerMeshCB" with mesh transforms
+    void setPerMeshInstanceCB(ConstantBuffer* pCB, const Mesh* pMesh, const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance)
+    {
+        assert(!pMesh->hasBones());
+        glm::mat4 worldMat = pModelInstance->getTransformMatrix() * pMeshInstance->getTransformMatrix();
+        glm::mat4 prevWorldMat = pModelInstance->getPrevTransformMatrix() * pMeshInstance->getTransformMatrix();
+        glm::mat3x4 worldInvTransposeMat = transpose(inverse(glm::mat3(worldMat)));
+
+        const int drawInstanceID = 0; // No instancing
+
+        pCB->setBlob(&worldMat, sWorldMatOffset + drawInstanceID * sizeof(glm::mat4), sizeof(glm::mat4));
+        pCB->setBlob(&worldInvTransposeMat, sWorldInvTransposeMatOffset + drawInstanceID * sizeof(glm::mat3x4), sizeof(glm::mat3x4));
+        pCB->setBlob(&prevWorldMat, sPrevWorldMatOffset + drawInstanceID * sizeof(glm::mat4), sizeof(glm::mat4));
+
+        pCB->setVariable(sMeshIdOffset, pMesh->getId());
+    }
+
+    // Per-draw setters of SubmitDrawQueue, one per way the per-draw render modes pass the draw constants. They return the upload
+    // ring slot of the draw's constants for the push constants. The submit loop is instantiated per policy, so it makes no indirect
+    // calls, string lookups, reference count changes or allocations per draw.
+    struct BindlessDrawPolicy
+    {
+        // The constants are in gDrawConstants at the packet's drawID, or were written to the ring when the packet was recorded
+        uint32_t setDrawConstants(const DrawPacket& packet) const { return packet.drawRingSlot; }
+    };
+
+    struct PerMeshCbDrawPolicy
+    {
+        ConstantBuffer* pPerMeshCB;     // Looked up once per frame
+
+        uint32_t setDrawConstants(const DrawPacket& packet) const
+        {
+            setPerMeshInstanceCB(pPerMeshCB, packet.pMesh, packet.pModelInstance, packet.pMeshInstance);
+            return 0;
+        }
+    };
+
+    struct UploadRingDrawPolicy
+    {
+        DrawConstants* pConstants;      // One per packet, allocated for the whole queue
+        uint32_t firstRingSlot;
+        uint32_t drawIndex;
+
+        uint32_t setDrawConstants(const DrawPacket& packet)
+        {
+            DrawRecorder::writeSceneConstants(packet.pMesh, packet.pModelInstance, packet.pMeshInstance, packet.drawID, pConstants + drawIndex);
+            return firstRingSlot + drawIndex++ * DrawRecorder::kRingSlotsPerDraw;
+        }
+    };
+}
+
+void HighPerformanceRendering::SetBenchmarkOptions(const BenchmarkRunner::Options& options)
+{
+    mBenchmarkOptions = options;
+    mBenchmarkEnabled = true;
 }
 
 void HighPerformanceRendering::onLoad(SampleCallbacks* sample, RenderContext* renderContext)
 {
+    mStartupStart = CpuTimer::getCurrentTimePoint();
+    mStartupReported = false;
+    mDrawListMs = 0;
+    mSceneLoadMs = 0;
+    mFirstFrameMs = 0;
+    mMaxLoadFrameMs = 0;
+    mLoadFrameCount = 0;
+    mMaxBuildFrameMs = 0;
+    mBuildFrameCount = 0;
+    mPrecompiledLastFrame = false;
+    mMaxPrecompileFrameMs = 0;
+    mPrecompileFrameCount = 0;
+    mLoadStage = LoadStage::Scene;
+
     uint32_t width = sample->getCurrentFbo()->getWidth();
     uint32_t height = sample->getCurrentFbo()->getHeight();
 
@@ -33,19 +152,233 @@ void HighPerformanceRendering::onLoad(SampleCallbacks* sample, RenderContext* re
     mCamController.attachCamera(mCamera);
     mCamController.setCameraSpeed(5.0f);
 
+    mRepeatCount = 1;
     mDrawCount = 0;
+    mDrawCallCount = 0;
+    mTriangleCount = 0;
+    mBaseTriangleCount = 0;
     mPersistantShaderResourcesBound = false;
+    mEnableCulling = true;
+    mEnableLods = true;
+    mCullHierarchy = true;
+    mEnableOcclusion = true;
+    mSortDraws = true;
+    mCompactDrawConstants = true;
+    mOptimizeGeometry = true;
+    mQuantizeVertices = true;
+    mUseUploadRing = true;
+    mParallelRecording = true;
+    mDrawCallbacks = false;
+    mFrameAllocations = 0;
+    mClusteredLights = true;
     mRenderMode = RenderMode::BindlessMultiDraw;
 
-    SetupScene();
+    mUploadRing = UploadRing::create(kUploadRingSize);
+    mpBoundDrawRing = nullptr;
+    mDrawRingSlot = 0;
+
+    mLightClusters = LightClusters::create();
+    mClusterLightsCapacity = 0;
+    mGlobalLightCount = 0;
+
+    mThreadPool = ThreadPool::create();
+    mLoaderThreadPool = ThreadPool::create(std::max(1u, std::thread::hardware_concurrency() / 2));
+    RegisterRenderStats();
+    mCommandCapture = CommandCapture::create();
+    mDrawQueue = DrawQueue::create();
+    mDrawRecorder = DrawRecorder::create();
+    mLoader = AsyncLoader::create();
+
+    mScenePath = kDefaultScene;
+    if (mBenchmarkEnabled)
+    {
+        if (!mBenchmarkOptions.scenePath.empty()) mScenePath = mBenchmarkOptions.scenePath;
+        mBenchmark = BenchmarkRunner::create(mBenchmarkOptions, kBenchmarkConfigNames);
+        mRenderMode = (RenderMode)kBenchmarkConfigs[mBenchmark->getModeIndex()].renderMode;
+        sample->toggleUI(false);
+    }
+
+    // The scene and draw list load over the following frames, see UpdateLoading()
     SetupRendering(width, height);
 
     ConfigureRenderMode();
 }
 
+bool HighPerformanceRendering::UpdateLoading()
+{
+    // The first frame only clears, so the window shows up before anything is loaded
+    if (mLoadFrameCount == 0) return false;
+
+    if (mLoadStage == LoadStage::Scene)
+    {
+        LoadScene();
+        return true;
+    }
+
+    return mLoader->runBatches(kLoadBudgetMs) > 0;
+}
+
+void HighPerformanceRendering::LoadScene()
+{
+    // Falcor creates the scene's textures and buffers while parsing it, so this part stays on the render thread
+    auto start = CpuTimer::getCurrentTimePoint();
+    SetupScene();
+    mSceneRenderer = SceneRenderer::create(mScene);
+    mSceneLoadMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+
+    // Only the bindless modes use the draw list. The others build it on demand when switched to one.
+    if (mRenderMode != RenderMode::BindlessConstants && mRenderMode != RenderMode::BindlessMultiDraw)
+    {
+        mLoadStage = LoadStage::Done;
+        return;
+    }
+
+    mLoadStage = LoadStage::DrawList;
+    mDrawListStart = CpuTimer::getCurrentTimePoint();
+    const DrawConstantsLayout layout = mCompactDrawConstants ? DrawConstantsLayout::Compact : DrawConstantsLayout::Full;
+    const GeometryPool::Flags geometryFlags = GetGeometryFlags();
+    mLoader->enqueue([this, layout, geometryFlags]() { LoadDrawList(layout, geometryFlags); });
+}
+
+void HighPerformanceRendering::LoadDrawList(DrawConstantsLayout layout, GeometryPool::Flags geometryFlags)
+{
+    // Loader thread: restore or build the draw constants without touching the GPU. The builds run on the loader's own pool,
+    // the render thread's parallelFor calls would otherwise wait for them and frames would stall for the whole build.
+    // Generated scenes are quicker to rebuild than to pack, and their pack would replace the loaded scene's
+    mLoaderBuilding = true;
+    DrawList::SharedPtr pDrawList;
+    if (!mStressScene)
+    {
+        mDrawListPackKey = DrawList::computePackKey(mScenePath, mScene, mRepeatCount, layout, geometryFlags);
+        pDrawList = DrawList::createFromPack(kDrawListPackFile, mDrawListPackKey, mScene, mForwardProgram, mLoaderThreadPool.get(), true);
+    }
+    if (!pDrawList)
+    {
+        pDrawList = DrawList::create(mScene, mForwardProgram, mRepeatCount, mLoaderThreadPool.get(), layout, true);
+    }
+    mLoaderBuilding = false;
+
+    GeometryPool::SharedPtr pGeometryPool;
+    mLoader->publish([this, pDrawList, pGeometryPool, geometryFlags]() mutable
+    {
+        if (!pGeometryPool)
+        {
+            // The constants buffer is created from the reflection of gDrawConstants, which only the bindless variants declare
+            if (mRenderMode != RenderMode::BindlessConstants && mRenderMode != RenderMode::BindlessMultiDraw)
+            {
+                FinishLoading();
+                return true;
+            }
+
+            pDrawList->uploadConstants();
+            mDrawList = pDrawList;
+            mPersistantShaderResourcesBound = false;
+            mLoadStage = LoadStage::Geometry;
+
+            // Packed geometry only needs an upload
+            if (pDrawList->isFromPack())
+            {
+                BuildMultiDrawData();
+                FinishLoading();
+                return true;
+            }
+
+            pGeometryPool = GeometryPool::createDeferred(pDrawList->getGroupMeshes(), geometryFlags | GeometryPool::Flags::KeepCpuData);
+            return false;
+        }
+
+        // Reading back the source meshes stalls on the GPU, so it's spread over several frames
+        if (!pGeometryPool->mapSources(kMeshesPerLoadBatch)) return false;
+
+        mLoader->enqueue([this, pGeometryPool]()
+        {
+            mLoaderBuilding = true;
+            pGeometryPool->build(mLoaderThreadPool.get());
+            mLoaderBuilding = false;
+            mLoader->publish([this, pGeometryPool]()
+            {
+                pGeometryPool->upload();
+                mDrawList->setGeometryPool(pGeometryPool);
+                if (pGeometryPool->isQuantized()) ConfigureRenderMode();
+                WriteDrawListPack();
+                FinishLoading();
+                return true;
+            });
+        });
+        return true;
+    });
+}
+
+void HighPerformanceRendering::LoadNextStressScene()
+{
+    // Keeps the other parameters of the current stress scene, so a scene given on the command line can be stepped through
+    StressScene::Desc desc = mStressScene ? mStressScene->getDesc() : StressScene::Desc();
+    uint32_t step = 0;
+    while (step < arraysize(kStressInstanceCounts) && kStressInstanceCounts[step] != (mStressScene ? desc.instanceCount : 0)) step++;
+    desc.instanceCount = kStressInstanceCounts[(step + 1) % arraysize(kStressInstanceCounts)];
+    mScenePath = desc.instanceCount > 0 ? StressScene::getPath(desc) : kDefaultScene;
+    logInfo("Loading " + mScenePath);
+
+    // The scene loads over the next frames like at startup, the render paths rebuild what they need from it
+    mDrawList = nullptr;
+    mSceneRenderer = nullptr;
+    mScene = nullptr;
+    mStressScene = nullptr;
+    mDrawQueue->clear();
+    mPersistantShaderResourcesBound = false;
+    mLoadStage = LoadStage::Scene;
+}
+
+void HighPerformanceRendering::FinishLoading()
+{
+    mLoadStage = LoadStage::Done;
+    mDrawListMs = CpuTimer::calcDuration(mDrawListStart, CpuTimer::getCurrentTimePoint());
+    mRenderStats->addMs(mStatCounters.drawListBuildMs, mDrawListMs);
+}
+
+bool HighPerformanceRendering::IsRenderModeReady() const
+{
+    // Once loaded, the render paths create whatever is missing themselves
+    if (mLoadStage == LoadStage::Done) return true;
+    if (!mScene) return false;
+
+    if (mRenderMode == RenderMode::BindlessConstants) return mDrawList != nullptr;
+    if (mRenderMode == RenderMode::BindlessMultiDraw) return mDrawList && mDrawList->getGeometryPool();
+    return true;
+}
+
 void HighPerformanceRendering::SetupScene()
 {
-    mScene = Scene::loadFromFile(kDefaultScene, Model::LoadFlags::None, Scene::LoadFlags::None);
+    if (StressScene::isStressScenePath(mScenePath))
+    {
+        // Invalid parameters keep their defaults
+        StressScene::Desc desc;
+        StressScene::parsePath(mScenePath, desc);
+        mStressScene = StressScene::create(desc);
+        mScene = mStressScene->getScene();
+        mRepeatCount = 1;
+    }
+    else
+    {
+        mStressScene = nullptr;
+        mScene = Scene::loadFromFile(mScenePath, Model::LoadFlags::None, Scene::LoadFlags::None);
+        mRepeatCount = kSceneRepeatCount;
+    }
+
+    // SceneRenderer doesn't report what it draws, so the stock path reports every mesh instance
+    mSceneDrawCount = 0;
+    for (uint32_t modelID = 0; modelID < mScene->getModelCount(); ++modelID)
+    {
+        const auto& model = mScene->getModel(modelID);
+        uint32_t meshInstanceCount = 0;
+        for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
+        {
+            meshInstanceCount += model->getMeshInstanceCount(meshID);
+        }
+        mSceneDrawCount += meshInstanceCount * mScene->getModelInstanceCount(modelID);
+    }
+    mSceneDrawCount *= mRepeatCount;
+    mDrawRecorder->setSceneDraws(mScene, mRepeatCount, (uint32_t)RenderMode::Explicit, mDrawQueue.get());
 
     // Set scene specific camera parameters
     float radius = mScene->getRadius();
@@ -59,10 +392,10 @@ void HighPerformanceRendering::SetupScene()
 
 void HighPerformanceRendering::SetupRendering(uint32_t width, uint32_t height)
 {
-    mSceneRenderer = SceneRenderer::create(mScene);
-
+    // The vars are created for the render mode's variant by ConfigureRenderMode()
     mForwardProgram = GraphicsProgram::createFromFile("Forward.slang", "MainVS", "MainPS");
-    mForwardVars = GraphicsVars::create(mForwardProgram->getReflector());
+    mShaderVariants = ShaderVariants::create(mForwardProgram);
+    AddShaderVariants();
     mForwardState = GraphicsState::create();
     mForwardState->setProgram(mForwardProgram);
     mForwardState->setRasterizerState(RasterizerState::create(RasterizerState::Desc().setCullMode(RasterizerState::CullMode::None)));
@@ -70,13 +403,110 @@ void HighPerformanceRendering::SetupRendering(uint32_t width, uint32_t height)
 
 void HighPerformanceRendering::onFrameRender(SampleCallbacks* sample, RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
 {
+    // Frame to frame time while loading, including presentation and GPU work run between frames
+    const CpuTimer::TimePoint frameStart = CpuTimer::getCurrentTimePoint();
+    const uint64_t frameAllocationStart = AllocationCounter::getCount();
+    if (mLoadFrameCount > 0 && !mStartupReported)
+    {
+        const double frameMs = CpuTimer::calcDuration(mLastFrameStart, frameStart);
+        if (mPrecompiledLastFrame)
+        {
+            mMaxPrecompileFrameMs = std::max(mMaxPrecompileFrameMs, frameMs);
+            mPrecompileFrameCount++;
+        }
+        else
+        {
+            mMaxLoadFrameMs = std::max(mMaxLoadFrameMs, frameMs);
+            if (mLoaderBuilding)
+            {
+                mMaxBuildFrameMs = std::max(mMaxBuildFrameMs, frameMs);
+                mBuildFrameCount++;
+            }
+        }
+    }
+    mPrecompiledLastFrame = false;
+    mLastFrameStart = frameStart;
+
+    mUploadStats = mUploadRing->getFrameStats();
+    mUploadRing->beginFrame();
+
+    const CpuTimer::TimePoint loadStart = CpuTimer::getCurrentTimePoint();
+    const bool loadedContent = mLoadStage != LoadStage::Done && UpdateLoading();
+
+    // Shader variants compile between frames next to the loading, so render mode switches find them compiled. They get what the
+    // content left of the frame's budget, and may overrun it only on frames without content work. Content and shaders both count
+    // as loading.
+    if (mLoadFrameCount > 0 && !mShaderVariants->isComplete())
+    {
+        const double budgetMs = kLoadBudgetMs - CpuTimer::calcDuration(loadStart, CpuTimer::getCurrentTimePoint());
+        mPrecompiledLastFrame = mShaderVariants->precompile(budgetMs, !loadedContent) > 0;
+        if (mShaderVariants->isComplete())
+        {
+            const auto& stats = mShaderVariants->getStats();
+            logInfo("Precompiled " + std::to_string(stats.precompiled) + " of " + std::to_string(stats.variants) + " shader variants in " + std::to_string(stats.precompileMs) + " ms");
+        }
+    }
+
+    // The benchmark only measures fully loaded frames
+    const bool loaded = mLoadStage == LoadStage::Done && mShaderVariants->isComplete();
+    if (mBenchmark && loaded)
+    {
+        mBenchmark->beginFrame();
+        // The whole run, warmup frames included, since they're as deterministic as the measured ones
+        if (!mBenchmarkOptions.capturePath.empty() && mBenchmark->getModeIndex() == 0 && mBenchmark->getFrameInMode() == 0)
+        {
+            const uint32_t frameCount = (uint32_t)kBenchmarkConfigNames.size() * (mBenchmarkOptions.warmupFrames + mBenchmarkOptions.measuredFrames);
+            mCommandCapture->beginCapture(frameCount, mBenchmarkOptions.capturePath, kBenchmarkConfigNames);
+        }
+
+        const BenchmarkConfig& config = kBenchmarkConfigs[mBenchmark->getModeIndex()];
+        mSortDraws = !config.serial;
+        mParallelRecording = !config.serial;
+        mDrawCallbacks = config.drawCallbacks;
+
+        const RenderMode mode = (RenderMode)config.renderMode;
+        if (mode != mRenderMode)
+        {
+            mRenderMode = mode;
+            ConfigureRenderMode();
+        }
+    }
+
     mCamera->beginFrame();
-    mCamController.update();
-    mSceneRenderer->update(sample->getCurrentTime());
+    if (mBenchmark && loaded)
+    {
+        mBenchmark->updateCamera(mCamera.get(), mScene->getCenter(), mScene->getRadius());
+    }
+    else
+    {
+        mCamController.update();
+    }
+    // Model instance transforms stay put while the loader thread reads them
+    if (mSceneRenderer && mLoadStage != LoadStage::DrawList)
+    {
+        mSceneRenderer->update(sample->getCurrentTime());
+
+        // Benchmark frames are timed by their index, so every mode sees the same poses
+        if (mStressScene)
+        {
+            const double time = mBenchmark && loaded ? mBenchmark->getFrameInMode() / 60.0 : sample->getCurrentTime();
+            mStressScene->animate(time, mThreadPool.get());
+        }
+    }
 
     renderContext->clearFbo(targetFbo.get(), kSkyColor, 1.0f, 0u, FboAttachmentType::All);
+
+    // Benchmark captures tag the frames with their configuration, interactive ones with the render mode
+    mCommandCapture->beginFrame(mBenchmark && loaded ? mBenchmark->getModeIndex() : (uint32_t)mRenderMode);
  
-    if (mRenderMode == RenderMode::Stock)
+    mTriangleCount = 0;
+    mBaseTriangleCount = 0;
+    if (!IsRenderModeReady())
+    {
+        mDrawCount = 0;
+        mDrawCallCount = 0;
+    }
+    else if (mRenderMode == RenderMode::Stock)
     {
         RenderScene(renderContext, targetFbo);
     }
@@ -92,51 +522,246 @@ void HighPerformanceRendering::onFrameRender(SampleCallbacks* sample, RenderCont
     {
         RenderSceneBindlessMultiDraw(renderContext, targetFbo);
     }
+    mCommandCapture->endFrame();
+
+    if (mLoadFrameCount == 0)
+    {
+        mFirstFrameMs = CpuTimer::calcDuration(mStartupStart, CpuTimer::getCurrentTimePoint());
+    }
+    if (!mStartupReported) mLoadFrameCount++;
+
+    if (loaded && !mStartupReported)
+    {
+        ReportStartupTime();
+    }
+
+    // From every thread while the frame rendered. Loading allocates freely, the benchmark only records loaded frames.
+    mFrameAllocations = AllocationCounter::getCount() - frameAllocationStart;
+    RecordRenderStats();
+
+    if (mBenchmark && loaded)
+    {
+        UpdateBenchmark(sample);
+    }
+}
+
+void HighPerformanceRendering::ReportStartupTime()
+{
+    mStartupReported = true;
+    const double loadedMs = CpuTimer::calcDuration(mStartupStart, CpuTimer::getCurrentTimePoint());
+
+    // Warm means the draw list came from the pack, so a run after deleting the pack or changing the scene measures the cold path
+    const bool warm = mDrawList && mDrawList->isFromPack();
+    const std::string cache = warm ? "warm" : "cold";
+    logInfo("Startup: first frame " + std::to_string(mFirstFrameMs) + " ms, first fully loaded frame " + std::to_string(loadedMs) + " ms (" + cache + "), scene load " + std::to_string(mSceneLoadMs) +
+        " ms, draw list " + std::to_string(mDrawListMs) + " ms, max frame time while loading " + std::to_string(mMaxLoadFrameMs) + " ms over " + std::to_string(mLoadFrameCount) + " frames, " +
+        std::to_string(mMaxBuildFrameMs) + " ms over the " + std::to_string(mBuildFrameCount) + " of them during the loader's builds, " +
+        std::to_string(mMaxPrecompileFrameMs) + " ms over " + std::to_string(mPrecompileFrameCount) + " more frames compiling shader variants");
+
+    Benchmarks::Row row;
+    row.name = cache;
+    row.values.push_back({ "firstFrameMs", mFirstFrameMs });
+    row.values.push_back({ "loadedFrameMs", loadedMs });
+    row.values.push_back({ "sceneLoadMs", mSceneLoadMs });
+    row.values.push_back({ "drawListMs", mDrawListMs });
+    row.values.push_back({ "maxLoadFrameMs", mMaxLoadFrameMs });
+    row.values.push_back({ "loadFrames", (double)mLoadFrameCount });
+    row.values.push_back({ "maxBuildFrameMs", mMaxBuildFrameMs });
+    row.values.push_back({ "buildFrames", (double)mBuildFrameCount });
+    row.values.push_back({ "shaderVariants", (double)mShaderVariants->getStats().variants });
+    row.values.push_back({ "shaderPrecompileMs", mShaderVariants->getStats().precompileMs });
+    row.values.push_back({ "maxPrecompileFrameMs", mMaxPrecompileFrameMs });
+    row.values.push_back({ "precompileFrames", (double)mPrecompileFrameCount });
+    row.values.push_back({ "draws", mDrawList ? (double)mDrawList->getDrawCount() : 0.0 });
+    Benchmarks::writeCsv("StartupTime_" + cache + ".csv", { row });
+}
+
+void HighPerformanceRendering::UpdateBenchmark(SampleCallbacks* sample)
+{
+    BenchmarkRunner::FrameSample frame;
+    for (uint32_t phase = 0; phase < (uint32_t)BenchmarkRunner::Phase::Count; ++phase)
+    {
+        frame.phaseMs[phase] = mPhaseMs[phase];
+    }
+    frame.draws = mDrawCount;
+    frame.drawCalls = mDrawCallCount;
+    frame.triangles = mTriangleCount;
+    frame.baseTriangles = mBaseTriangleCount;
+    frame.heapAllocations = mFrameAllocations;
+    mBenchmark->endFrame(frame);
+
+    if (mBenchmark->isFinished())
+    {
+        if (!mBenchmark->writeResults())
+        {
+            logWarning("Failed to write the render mode benchmark results");
+        }
+        mBenchmark = nullptr;
+        sample->shutdown();
+    }
+}
+
+void HighPerformanceRendering::BeginPhases()
+{
+    for (double& ms : mPhaseMs) ms = 0;
+    mPhaseStart = CpuTimer::getCurrentTimePoint();
+}
+
+void HighPerformanceRendering::EndPhase(BenchmarkRunner::Phase phase)
+{
+    // Phases may be entered several times per frame, the time accumulates
+    const CpuTimer::TimePoint now = CpuTimer::getCurrentTimePoint();
+    mPhaseMs[(uint32_t)phase] += CpuTimer::calcDuration(mPhaseStart, now);
+    mRenderStats->addSpan(mStatCounters.phaseMs[(uint32_t)mRenderMode * (uint32_t)BenchmarkRunner::Phase::Count + (uint32_t)phase], mPhaseStart, now);
+    mPhaseStart = now;
+}
+
+void HighPerformanceRendering::RegisterRenderStats()
+{
+    static const char* kPhaseNames[] = { "prepare", "bind", "submit" };
+
+    mRenderStats = RenderStats::create();
+    mStatCounters.draws = mRenderStats->registerCounter("draws", RenderStats::Unit::Count);
+    mStatCounters.drawCalls = mRenderStats->registerCounter("drawCalls", RenderStats::Unit::Count);
+    mStatCounters.triangles = mRenderStats->registerCounter("triangles", RenderStats::Unit::Count);
+    mStatCounters.visibleDraws = mRenderStats->registerCounter("visibleDraws", RenderStats::Unit::Count);
+    mStatCounters.occludedDraws = mRenderStats->registerCounter("occludedDraws", RenderStats::Unit::Count);
+    mStatCounters.stateChanges = mRenderStats->registerCounter("stateChanges", RenderStats::Unit::Count);
+    mStatCounters.materialChanges = mRenderStats->registerCounter("materialChanges", RenderStats::Unit::Count);
+    mStatCounters.vaoChanges = mRenderStats->registerCounter("vaoChanges", RenderStats::Unit::Count);
+    mStatCounters.descriptorWrites = mRenderStats->registerCounter("descriptorWrites", RenderStats::Unit::Count);
+    mStatCounters.constantUploadBytes = mRenderStats->registerCounter("constantUploadBytes", RenderStats::Unit::Bytes);
+    mStatCounters.constantUploadCalls = mRenderStats->registerCounter("constantUploadCalls", RenderStats::Unit::Count);
+    mStatCounters.ringBytes = mRenderStats->registerCounter("uploadRingBytes", RenderStats::Unit::Bytes);
+    mStatCounters.cullMs = mRenderStats->registerCounter("cull", RenderStats::Unit::Ms);
+    mStatCounters.skinMs = mRenderStats->registerCounter("skin", RenderStats::Unit::Ms);
+    mStatCounters.drawListBuildMs = mRenderStats->registerCounter("drawListBuild", RenderStats::Unit::Ms);
+    mStatCounters.lightClusterMs = mRenderStats->registerCounter("lightClusters", RenderStats::Unit::Ms);
+    mStatCounters.clusterLightAssignments = mRenderStats->registerCounter("clusterLightAssignments", RenderStats::Unit::Count);
+    mStatCounters.heapAllocations = mRenderStats->registerCounter("heapAllocations", RenderStats::Unit::Count);
+
+    mStatCounters.phaseMs.clear();
+    for (const auto& modeName : kRenderModeNames)
+    {
+        for (const char* pPhaseName : kPhaseNames)
+        {
+            mStatCounters.phaseMs.push_back(mRenderStats->registerCounter(modeName + "/" + pPhaseName, RenderStats::Unit::Ms));
+        }
+    }
+}
+
+void HighPerformanceRendering::RecordRenderStats()
+{
+    // Frame totals are taken from the stats the render paths keep anyway, so nothing is counted per draw
+    RenderStats* pStats = mRenderStats.get();
+    pStats->add(mStatCounters.draws, mDrawCount);
+    pStats->add(mStatCounters.drawCalls, mDrawCallCount);
+    pStats->add(mStatCounters.triangles, (int64_t)mTriangleCount);
+    pStats->add(mStatCounters.heapAllocations, (int64_t)mFrameAllocations);
+
+    // The other modes leave these stats from the last frame they rendered
+    const bool ready = IsRenderModeReady();
+    if (ready && (mRenderMode == RenderMode::Explicit || mRenderMode == RenderMode::BindlessConstants))
+    {
+        pStats->add(mStatCounters.stateChanges, mSubmitStats.stateChanges);
+        pStats->add(mStatCounters.materialChanges, mSubmitStats.materialChanges);
+        pStats->add(mStatCounters.vaoChanges, mSubmitStats.vaoChanges);
+    }
+    if (ready && mDrawList && (mRenderMode == RenderMode::BindlessConstants || mRenderMode == RenderMode::BindlessMultiDraw))
+    {
+        pStats->add(mStatCounters.constantUploadBytes, (int64_t)mDrawList->getUploadStats().uploadedBytes);
+        pStats->add(mStatCounters.constantUploadCalls, mDrawList->getUploadStats().uploadCalls);
+    }
+    if (ready && mRenderMode == RenderMode::BindlessMultiDraw)
+    {
+        pStats->add(mStatCounters.visibleDraws, mDrawList->getCullStats().visibleDraws);
+        pStats->add(mStatCounters.occludedDraws, mDrawList->getCullStats().occludedDraws);
+        pStats->addMs(mStatCounters.cullMs, mDrawList->getCullStats().cullMs);
+        if (mDrawList->getSkinner()) pStats->addMs(mStatCounters.skinMs, mDrawList->getSkinner()->getStats().skinMs);
+    }
+
+    if (ready && mRenderMode != RenderMode::Stock && mClusteredLights)
+    {
+        pStats->addMs(mStatCounters.lightClusterMs, mLightClusters->getStats().binMs);
+        pStats->add(mStatCounters.clusterLightAssignments, mLightClusters->getStats().assignments);
+    }
+
+    // The ring's stats are taken at the start of the frame, so this is the previous frame's usage
+    pStats->add(mStatCounters.ringBytes, (int64_t)mUploadStats.allocatedBytes);
+    pStats->endFrame();
 }
 
 void HighPerformanceRendering::RenderScene(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
 {
     PROFILE("RenderScene");
+    BeginPhases();
 
     mForwardState->setFbo(targetFbo);
-    renderContext->setGraphicsState(mForwardState);
-    renderContext->setGraphicsVars(mForwardVars);
+    mCommandCapture->setGraphicsState(renderContext, mForwardState);
+    mCommandCapture->setGraphicsVars(renderContext, mForwardVars);
+    EndPhase(BenchmarkRunner::Phase::Bind);
 
-    REPEAT_NEXT_BLOCK
-    mSceneRenderer->renderScene(renderContext, mCamera.get());
+    for (uint32_t repeat = 0; repeat < mRepeatCount; ++repeat)
+    {
+        mSceneRenderer->renderScene(renderContext, mCamera.get());
+    }
+    EndPhase(BenchmarkRunner::Phase::Submit);
+
+    mDrawCount = mSceneDrawCount;
+    mDrawCallCount = mSceneDrawCount;
 }
 
 void HighPerformanceRendering::RenderSceneExplicit(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
 {
     PROFILE("RenderSceneExplicit");
+    BeginPhases();
 
-    // Populate "InternalPerMeshCB" with mesh transforms
     auto setPerMeshInstanceData = [&](const GraphicsVars::SharedPtr& vars, const Model::MeshInstance::SharedPtr& meshInstance, const Scene::ModelInstance::SharedPtr& modelInstance) 
     {
-        const Mesh* pMesh = meshInstance->getObject().get();
-
-        assert(!pMesh->hasBones());
-        glm::mat4 worldMat = modelInstance->getTransformMatrix() * meshInstance->getTransformMatrix();
-        glm::mat4 prevWorldMat = modelInstance->getPrevTransformMatrix() * meshInstance->getTransformMatrix();
-        glm::mat3x4 worldInvTransposeMat = transpose(inverse(glm::mat3(worldMat)));
-
-        const int drawInstanceID = 0; // No instancing
-
-        ConstantBuffer* pCB = vars->getConstantBuffer(kPerMeshCbName).get();
-        pCB->setBlob(&worldMat, sWorldMatOffset + drawInstanceID * sizeof(glm::mat4), sizeof(glm::mat4));
-        pCB->setBlob(&worldInvTransposeMat, sWorldInvTransposeMatOffset + drawInstanceID * sizeof(glm::mat3x4), sizeof(glm::mat3x4));
-        pCB->setBlob(&prevWorldMat, sPrevWorldMatOffset + drawInstanceID * sizeof(glm::mat4), sizeof(glm::mat4));
-
-        pCB->setVariable(sMeshIdOffset, pMesh->getId());
+        if (mUseUploadRing)
+        {
+            mDrawRingSlot = WriteDrawConstants(meshInstance->getObject().get(), modelInstance.get(), meshInstance.get(), mDrawCount);
+        }
+        else
+        {
+            setPerMeshInstanceCB(vars->getConstantBuffer(kPerMeshCbName).get(), meshInstance->getObject().get(), modelInstance.get(), meshInstance.get());
+        }
     };
 
     mDrawCount = 0;
+    mDrawCallCount = 0;
+    mSubmitStats = {};
     mForwardState->setFbo(targetFbo);
 
     UpdateShaderBindingLocations(mForwardVars);
     SetPerFrameData(mForwardVars, mCamera, mScene);
 
-    REPEAT_NEXT_BLOCK
+    EndPhase(BenchmarkRunner::Phase::Bind);
+
+    mDrawQueue->clear();
+
+    // Recording writes the draw constants from several threads, so it needs them in the upload ring
+    if (mParallelRecording && mUseUploadRing && !mDrawCallbacks)
+    {
+        UploadRing::Allocation allocation;
+        DrawConstants* pConstants = mUploadRing->allocate<DrawConstants>(mDrawRecorder->getSceneDrawCount(), allocation);
+        BindDrawRing(allocation);
+
+        mDrawRecorder->recordScene(mThreadPool.get(), GetRecordView(), pConstants, (uint32_t)(allocation.offset / 16), mDrawQueue.get());
+        if (mSortDraws) mDrawQueue->sort();
+        EndPhase(BenchmarkRunner::Phase::Prepare);
+
+        SubmitDrawQueue(renderContext, BindlessDrawPolicy());
+        EndPhase(BenchmarkRunner::Phase::Submit);
+        return;
+    }
+
+    const Frustum frustum = Frustum::fromViewProj(mCamera->getViewProjMatrix());
+    const glm::vec3 cameraPos = mCamera->getPosition();
+    const float depthScale = 1.0f / mCamera->getFarPlane();
+
+    // Draws submitted through the callbacks are submitted while traversing, so the whole traversal counts as submission
+    for (uint32_t repeat = 0; repeat < mRepeatCount; ++repeat)
     for (uint32_t modelID = 0; modelID < mScene->getModelCount(); ++modelID)
     {
         const auto& model = mScene->getModel(modelID);
@@ -149,304 +774,156 @@ void HighPerformanceRendering::RenderSceneExplicit(RenderContext* renderContext,
                 for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
                 {
                     const auto& meshInstance = model->getMeshInstance(meshID, meshInstanceID);
-                    DrawSingleMesh(renderContext, mForwardVars, mForwardState, mesh, modelInstance, meshInstance, setPerMeshInstanceData);
+                    const BoundingBox box = meshInstance->getBoundingBox().transform(modelInstance->getTransformMatrix());
+                    if (mEnableCulling && !frustum.intersects(box)) continue;
+
+                    if (mDrawCallbacks)
+                    {
+                        DrawSingleMesh(renderContext, mForwardVars, mForwardState, mesh, modelInstance, meshInstance, setPerMeshInstanceData);
+                        continue;
+                    }
+
+                    DrawPacket packet;
+                    packet.sortKey = mSortDraws ? DrawQueue::makeSortKey((uint32_t)mRenderMode, mDrawQueue->getVaoKey(mesh->getVao().get()), mDrawQueue->getMaterialKey(mesh->getMaterial().get()), glm::length(box.center - cameraPos) * depthScale) : 0;
+                    packet.pMesh = mesh.get();
+                    packet.pModelInstance = modelInstance.get();
+                    packet.pMeshInstance = meshInstance.get();
+                    packet.drawID = (uint32_t)mDrawQueue->getPackets().size();
+                    packet.drawRingSlot = 0;
+                    mDrawQueue->push(packet);
                 }
             }
         }
     }
-}
 
-void HighPerformanceRendering::RenderSceneBindlessConstants(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
-{
-    PROFILE("BindlessConstants");
-
-    struct DrawList
+    if (mDrawCallbacks)
     {
-        struct DrawConstants
-        {
-            glm::mat4 worldMat;
-            glm::mat4 prevWorldMat;
-            glm::mat3x4 worldInvTransposeMat;
-            uint32_t drawID;
-            uint32_t meshID;
-            uint32_t pad[2]; // Note the manual padding to ensure 16 byte alignment
-        };
+        EndPhase(BenchmarkRunner::Phase::Submit);
+        return;
+    }
 
-        uint32_t numDrawItems = 0;
-        std::vector<Mesh::SharedPtr> meshes;
-        std::vector<DrawConstants> constants; // CPU copy of constants for debug purpose only
-        StructuredBuffer::SharedPtr drawConstantsBuffer;
-    };
+    if (mSortDraws) mDrawQueue->sort();
+    EndPhase(BenchmarkRunner::Phase::Prepare);
 
-    auto prepareDrawList = [&]() -> DrawList
+    // The constants of all draws go to the ring in one allocation
+    const uint32_t packetCount = (uint32_t)mDrawQueue->getPackets().size();
+    if (mUseUploadRing && packetCount > 0)
     {
-        DrawList drawList;
-
-        REPEAT_NEXT_BLOCK
-        for (uint32_t modelID = 0; modelID < mScene->getModelCount(); ++modelID)
-        {
-            const auto& model = mScene->getModel(modelID);
-            for (uint32_t modelInstanceID = 0; modelInstanceID < mScene->getModelInstanceCount(modelID); ++modelInstanceID)
-            {
-                const auto& modelInstance = mScene->getModelInstance(modelID, modelInstanceID);
-                for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
-                {
-                    const auto& mesh = model->getMesh(meshID);
-                    for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
-                    {
-                        const auto& meshInstance = model->getMeshInstance(meshID, meshInstanceID);
-
-                        assert(!mesh->hasBones()); // Skinning requires different handling of transforms
-
-                        DrawList::DrawConstants drawConstants;
-                        drawConstants.worldMat = modelInstance->getTransformMatrix() * meshInstance->getTransformMatrix();
-                        drawConstants.prevWorldMat = modelInstance->getPrevTransformMatrix() * meshInstance->getTransformMatrix();
-                        drawConstants.worldInvTransposeMat = transpose(inverse(glm::mat3(drawConstants.worldMat)));
-                        drawConstants.meshID = mesh->getId();
-                        drawConstants.drawID = drawList.numDrawItems++;
-
-                        drawList.meshes.push_back(mesh);
-                        drawList.constants.push_back(drawConstants);
-                    }
-                }
-            }
-        }
-
-        if (drawList.constants.size() > 0)
-        {
-            drawList.drawConstantsBuffer = StructuredBuffer::create(mForwardProgram, "gDrawConstants", drawList.constants.size());
-            drawList.drawConstantsBuffer->setBlob(drawList.constants.data(), 0, sizeof(drawList.constants[0]) * drawList.constants.size());
-        }
-
-        return drawList;
-    };
+        UploadRing::Allocation allocation;
+        DrawConstants* pConstants = mUploadRing->allocate<DrawConstants>(packetCount, allocation);
+        BindDrawRing(allocation);
+        SubmitDrawQueue(renderContext, UploadRingDrawPolicy{ pConstants, (uint32_t)(allocation.offset / 16), 0 });
+    }
+    else if (!mUseUploadRing)
+    {
+        SubmitDrawQueue(renderContext, PerMeshCbDrawPolicy{ mForwardVars->getConstantBuffer(kPerMeshCbName).get() });
+    }
+    EndPhase(BenchmarkRunner::Phase::Submit);
+}
 
-    // One-time preparation
-    static DrawList drawList = prepareDrawList();
+void HighPerformanceRendering::RenderSceneBindlessConstants(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
+{
+    PROFILE("BindlessConstants");
+    BeginPhases();
 
-    std::atexit([]
-    { 
-        // Destruct before Vulkan context is destroyed
-        drawList.meshes.clear();
-        drawList.drawConstantsBuffer = nullptr;
-    }); 
+    PrepareDrawList();
+    EndPhase(BenchmarkRunner::Phase::Prepare);
 
     // One-time draw constant bind
     if (!mPersistantShaderResourcesBound)
     {
-        mForwardVars->setStructuredBuffer("gDrawConstants", drawList.drawConstantsBuffer);
+        mForwardVars->setStructuredBuffer("gDrawConstants", mDrawList->getConstantsBuffer());
         mPersistantShaderResourcesBound = true;
     }
+    BindPrevTransforms();
 
     // Per frame draw operation
     mDrawCount = 0;
+    mDrawCallCount = 0;
+    mSubmitStats = {};
     mForwardState->setFbo(targetFbo);
 
     UpdateShaderBindingLocations(mForwardVars);
     SetPerFrameData(mForwardVars, mCamera, mScene);
+    EndPhase(BenchmarkRunner::Phase::Bind);
 
-    for (const auto& mesh : drawList.meshes)
+    if (mParallelRecording && !mDrawCallbacks)
     {
-        DrawSingleMesh(renderContext, mForwardVars, mForwardState, mesh, nullptr, nullptr, nullptr);
+        mDrawQueue->clear();
+        mDrawRecorder->recordDrawList(mThreadPool.get(), GetRecordView(), mDrawList, (uint32_t)mRenderMode, mDrawQueue.get());
+        if (mSortDraws) mDrawQueue->sort();
+        EndPhase(BenchmarkRunner::Phase::Prepare);
+
+        SubmitDrawQueue(renderContext, BindlessDrawPolicy());
+        EndPhase(BenchmarkRunner::Phase::Submit);
+        return;
     }
-}
 
-void HighPerformanceRendering::RenderSceneBindlessMultiDraw(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
-{
-    PROFILE("BindlessMultiDraw");
-
-    struct DrawList
+    if (mDrawCallbacks)
     {
-        struct DrawConstants
-        {
-            glm::mat4 worldMat;
-            glm::mat4 prevWorldMat;
-            glm::mat3x4 worldInvTransposeMat;
-            uint32_t drawID;
-            uint32_t meshID;
-            uint32_t pad[2]; // Note the manual padding to ensure 16 byte alignment
-        };
-
-        uint32_t numDrawItems = 0;
-
-        std::vector<DrawConstants> constants; // CPU copy of constants for debug purpose only
-        StructuredBuffer::SharedPtr drawConstantsBuffer;
-
-        Vao::SharedPtr vao;
-        Buffer::SharedPtr indirectArgBuffer;
-        Material::SharedPtr protoMaterial; // The material instance used to provide material data uniform across the multi draw
-
-        struct MaterialData
-        {
-            Texture::SharedPtr baseColor;
-            Texture::SharedPtr specular;
-            Texture::SharedPtr emissive;
-            Texture::SharedPtr normalMap;
-
-            // TODO: Constants
-        };
-
-        std::vector<MaterialData> materialData; // Bindless textures and data indexed by drawID. TODO: drawID to materialID mapping
-    };
-
-    auto prepareDrawList = [&]() -> DrawList
-    {
-        DrawList drawList;
-
-        const auto& protoVao = mScene->getModel(0)->getMesh(0)->getVao();
-        const uint32_t vertexStreamCount = protoVao->getVertexBuffersCount();
-        auto indexFormat = protoVao->getIndexBufferFormat();
-        assert(indexFormat == ResourceFormat::R32Uint);
-
-        // Combined vertex and index data
-        std::vector<std::vector<uint8_t>> vertexStreams(vertexStreamCount);
-        std::vector<uint8_t> indices;
-
-        // Offsets for building indirect args
-        std::vector<uint32_t> vertexOffsets;
-        std::vector<uint32_t> indexOffsets;
-        std::vector<uint32_t> indexCounts;
-
-        std::vector<Material::SharedPtr> materials;
-
-        REPEAT_NEXT_BLOCK
-        for (uint32_t modelID = 0; modelID < mScene->getModelCount(); ++modelID)
-        {
-            const auto& model = mScene->getModel(modelID);
-            for (uint32_t modelInstanceID = 0; modelInstanceID < mScene->getModelInstanceCount(modelID); ++modelInstanceID)
-            {
-                const auto& modelInstance = mScene->getModelInstance(modelID, modelInstanceID);
-                for (uint32_t meshID = 0; meshID < model->getMeshCount(); ++meshID)
-                {
-                    const auto& mesh = model->getMesh(meshID);
-                    for (uint32_t meshInstanceID = 0; meshInstanceID < model->getMeshInstanceCount(meshID); ++meshInstanceID)
-                    {
-                        const auto& meshInstance = model->getMeshInstance(meshID, meshInstanceID);
-
-                        assert(!mesh->hasBones()); // Skinning requires different handling of transforms
-
-                        DrawList::DrawConstants drawConstants;
-                        drawConstants.worldMat = modelInstance->getTransformMatrix() * meshInstance->getTransformMatrix();
-                        drawConstants.prevWorldMat = modelInstance->getPrevTransformMatrix() * meshInstance->getTransformMatrix();
-                        drawConstants.worldInvTransposeMat = transpose(inverse(glm::mat3(drawConstants.worldMat)));
-                        drawConstants.meshID = mesh->getId();
-                        drawConstants.drawID = drawList.numDrawItems++;
-
-                        drawList.constants.push_back(drawConstants);
-
-                        // Append vertices and indices into combined buffers
-                        const auto& vao = mesh->getVao();
-                        for (uint32_t i = 0; i < vertexStreamCount; ++i)
-                        {
-                            const auto& vb = vao->getVertexBuffer(i);
-                            const void* vbData = vb->map(Buffer::MapType::Read);
-                            const uint32_t vbSize = (uint32_t)vb->getSize();
-                            const uint32_t vertexStride = protoVao->getVertexLayout()->getBufferLayout(i)->getStride();
-                            const uint32_t vertexCount = vbSize / vertexStride;
-
-                            auto& vertices = vertexStreams[i];
-
-                            const size_t currentVBOffset = vertices.size();
-                            vertices.resize(currentVBOffset + vertexCount * vertexStride);
-                            memcpy(vertices.data() + currentVBOffset, vbData, vbSize);
-
-                            if (i == 0)
-                            {
-                                vertexOffsets.push_back((uint32_t)currentVBOffset / vertexStride);
-                            }
-                        }
-
-                        const void* ibData = vao->getIndexBuffer()->map(Buffer::MapType::Read);
-                        const uint32_t ibSize = (uint32_t)vao->getIndexBuffer()->getSize();
-                        const uint32_t indexCount = ibSize / sizeof(uint32_t);
-
-                        const size_t currentIBOffset = indices.size();
-                        indices.resize(currentIBOffset + indexCount * sizeof(uint32_t));
-                        memcpy(indices.data() + currentIBOffset, ibData, ibSize);
-
-                        indexOffsets.push_back((uint32_t)currentIBOffset / sizeof(uint32_t));
-                        indexCounts.push_back(indexCount);
-
-                        // TODO: Identical material check
-                        materials.push_back(mesh->getMaterial());
-                    }
-                }
-            }
-        }
-
-        if (drawList.constants.size() > 0)
+        for (const auto& mesh : mDrawList->getMeshes())
         {
-            // Build bindless draw constants buffer
-            drawList.drawConstantsBuffer = StructuredBuffer::create(mForwardProgram, "gDrawConstants", drawList.constants.size());
-            drawList.drawConstantsBuffer->setBlob(drawList.constants.data(), 0, sizeof(drawList.constants[0]) * drawList.constants.size());
+            DrawSingleMesh(renderContext, mForwardVars, mForwardState, mesh, nullptr, nullptr, nullptr);
+        }
+        EndPhase(BenchmarkRunner::Phase::Submit);
+        return;
+    }
 
-            // Build combined VAO
-            Vao::BufferVec vbs;
-            for (const auto& vertices : vertexStreams)
-            {
-                auto vb = Buffer::create(vertices.size(), Buffer::BindFlags::Vertex, Buffer::CpuAccess::None, vertices.data());;
-                vbs.push_back(vb);
-            }
-            auto ib = Buffer::create(indices.size(), Buffer::BindFlags::Index, Buffer::CpuAccess::None, indices.data());;
-            drawList.vao = Vao::create(protoVao->getPrimitiveTopology(), protoVao->getVertexLayout(), vbs, ib, indexFormat);
+    // The draw's position in gDrawConstants travels with the packet, so any submission order works
+    const glm::vec3 cameraPos = mCamera->getPosition();
+    const float depthScale = 1.0f / mCamera->getFarPlane();
+    const auto& meshes = mDrawList->getMeshes();
+    const auto& constants = mDrawList->getConstants();
 
-            std::vector<DrawIndexedArguments> drawArgs;
-            for (uint32_t i = 0; i < drawList.numDrawItems; ++i)
-            {
-                // Build indirect arguments
-                DrawIndexedArguments args = {};
-                args.indexCountPerInstance = indexCounts[i];
-                args.startIndexLocation = indexOffsets[i];
-                args.baseVertexLocation = vertexOffsets[i];
-                args.instanceCount = 1;
-                args.startInstanceLocation = i; // use gl_InstanceID as drawID
-                     
-                drawArgs.emplace_back(args);
-
-                // Extract material textures
-                const auto& material = materials[i];
-                DrawList::MaterialData materialData = {};
-                materialData.baseColor = material->getBaseColorTexture();
-                materialData.specular = material->getSpecularTexture();
-                materialData.emissive = material->getEmissiveTexture();
-                materialData.normalMap = material->getNormalMap();
-
-                drawList.materialData.push_back(materialData);
-            }
+    mDrawQueue->clear();
+    for (uint32_t drawID = 0; drawID < mDrawList->getDrawCount(); ++drawID)
+    {
+        const Mesh* pMesh = meshes[drawID].get();
 
-            drawList.indirectArgBuffer = Buffer::create(drawArgs.size() * sizeof(DrawIndexedArguments), Resource::BindFlags::IndirectArg, Buffer::CpuAccess::Write, drawArgs.data());
-            drawList.protoMaterial = mScene->getModel(0)->getMesh(0)->getMaterial();
+        DrawPacket packet;
+        packet.sortKey = 0;
+        if (mSortDraws)
+        {
+            const glm::vec3 position = glm::vec3(constants[drawID].worldMat[3]);
+            packet.sortKey = DrawQueue::makeSortKey((uint32_t)mRenderMode, mDrawQueue->getVaoKey(pMesh->getVao().get()), mDrawQueue->getMaterialKey(pMesh->getMaterial().get()), glm::length(position - cameraPos) * depthScale);
         }
+        packet.pMesh = pMesh;
+        packet.pModelInstance = nullptr;
+        packet.pMeshInstance = nullptr;
+        packet.drawID = drawID;
+        packet.drawRingSlot = 0;
+        mDrawQueue->push(packet);
+    }
 
-        return drawList;
-    };
+    if (mSortDraws) mDrawQueue->sort();
+    EndPhase(BenchmarkRunner::Phase::Prepare);
+
+    SubmitDrawQueue(renderContext, BindlessDrawPolicy());
+    EndPhase(BenchmarkRunner::Phase::Submit);
+}
+
+void HighPerformanceRendering::RenderSceneBindlessMultiDraw(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
+{
+    PROFILE("BindlessMultiDraw");
+    BeginPhases();
 
-    // One-time preparation
-    static DrawList drawList = prepareDrawList();
+    PrepareDrawList();
+    BuildMultiDrawData();
 
-    std::atexit([]
-    { 
-        // Destruct before Vulkan context is destroyed
-        drawList.drawConstantsBuffer = nullptr;
-        drawList.vao = nullptr;
-        drawList.indirectArgBuffer = nullptr;
-        drawList.protoMaterial = nullptr;
-        drawList.materialData.clear();
-    }); 
+    // Skinned meshes are posed on the worker threads, their draws stay in the multi-draw with their model instance's transform
+    mDrawList->skin(mThreadPool.get());
+    EndPhase(BenchmarkRunner::Phase::Prepare);
 
     auto bindMaterialResources = [=]() -> bool
     {
-        SetPerMaterialData(mForwardVars, drawList.protoMaterial);
+        SetPerMaterialData(mForwardVars, mDrawList->getProtoMaterial());
 
-        // TODO: Use pre-built parameter block
-        for (uint32_t i = 0; i < drawList.materialData.size(); ++i)
-        {
-            const auto& materialData = drawList.materialData[i];
-            mForwardVars->setTexture("gBindlessMaterialBaseColor[" + std::to_string(i) + "]", materialData.baseColor);
-            mForwardVars->setTexture("gBindlessMaterialSpecular[" + std::to_string(i) + "]", materialData.specular);
-            mForwardVars->setTexture("gBindlessMaterialEmissive[" + std::to_string(i) + "]", materialData.emissive);
-            mForwardVars->setTexture("gBindlessMaterialNormalMap[" + std::to_string(i) + "]", materialData.normalMap);
-        }
+        // Unique textures and material constants, indexed through DrawConstants::materialID
+        const auto& materialTable = mDrawList->getMaterialTable();
+        mForwardVars->setStructuredBuffer("gBindlessMaterials", materialTable->getMaterialBuffer());
+
+        materialTable->getTextureTable()->bind(mForwardVars);
+        mRenderStats->add(mStatCounters.descriptorWrites, materialTable->getTextureTable()->getLastBindStats().slotsWritten);
 
         return true;
     };
@@ -454,23 +931,157 @@ void HighPerformanceRendering::RenderSceneBindlessMultiDraw(RenderContext* rende
     // One-time draw constant and materials bind
     if (!mPersistantShaderResourcesBound)
     {
-        mForwardVars->setStructuredBuffer("gDrawConstants", drawList.drawConstantsBuffer);
+        mForwardVars->setStructuredBuffer("gDrawConstants", mDrawList->getConstantsBuffer());
+        if (mDrawList->getGeometryPool()->isQuantized())
+        {
+            mForwardVars->setRawBuffer("gPositionDequant", mDrawList->getGeometryPool()->getPositionDequantBuffer());
+        }
         bindMaterialResources();
 
         mPersistantShaderResourcesBound = true;
     }
+    BindPrevTransforms();
 
     // Per frame draw operation
     mForwardState->setFbo(targetFbo);
 
     UpdateShaderBindingLocations(mForwardVars);
     SetPerFrameData(mForwardVars, mCamera, mScene);
+    EndPhase(BenchmarkRunner::Phase::Bind);
+
+    // Compact the indirect args down to the visible draws, each at the detail level its screen size needs
+    UploadRing* pUploadRing = mUseUploadRing ? mUploadRing.get() : nullptr;
+    const DrawList::LodSettings lod = DrawList::LodSettings::fromCamera(mCamera.get(), targetFbo->getHeight(), kLodPixelError);
+    if (mEnableCulling)
+    {
+        const Frustum frustum = Frustum::fromViewProj(mCamera->getViewProjMatrix());
+        const DrawList::OcclusionSettings occlusion = DrawList::OcclusionSettings::fromCamera(mCamera.get(), kMaxOccluderTriangles, mThreadPool.get());
+        mDrawList->setCullHierarchy(mCullHierarchy);
+        mDrawList->cull(frustum, FrustumCuller::Kernel::Best, pUploadRing, mEnableLods ? &lod : nullptr, mEnableOcclusion ? &occlusion : nullptr);
+    }
+    else if (mEnableLods)
+    {
+        mDrawList->selectLods(lod, pUploadRing);
+    }
+    else
+    {
+        mDrawList->resetCulling();
+    }
+    const auto& cullStats = mDrawList->getCullStats();
+    mDrawCount = cullStats.visibleDraws;
+    mTriangleCount = cullStats.triangles;
+    mBaseTriangleCount = cullStats.baseTriangles;
+    EndPhase(BenchmarkRunner::Phase::Prepare);
+
+    mDrawCallCount = mDrawList->getIndirectArgCount() > 0 ? 1 : 0;
+    if (mDrawCallCount == 0) return;
+
+    mForwardState->setVao(mDrawList->getVao());
+    mCommandCapture->recordVao(mDrawList->getVao().get());
+
+    mCommandCapture->setGraphicsState(renderContext, mForwardState);
+    mCommandCapture->setGraphicsVars(renderContext, mForwardVars);
+    mCommandCapture->multiDrawIndexedIndirect(renderContext, mDrawList->getIndirectArgBuffer(), mDrawList->getIndirectArgOffset(), mDrawList->getIndirectArgCount(), mDrawList->getIndirectArgData());
+    EndPhase(BenchmarkRunner::Phase::Submit);
+}
+
+void HighPerformanceRendering::PrepareDrawList()
+{
+    // One-time preparation, then incremental updates of the draw constants whose transforms changed
+    if (!mDrawList)
+    {
+        auto start = CpuTimer::getCurrentTimePoint();
+        const DrawConstantsLayout layout = mCompactDrawConstants ? DrawConstantsLayout::Compact : DrawConstantsLayout::Full;
+        if (!mStressScene)
+        {
+            mDrawListPackKey = DrawList::computePackKey(mScenePath, mScene, mRepeatCount, layout, GetGeometryFlags());
+            mDrawList = DrawList::createFromPack(kDrawListPackFile, mDrawListPackKey, mScene, mForwardProgram, mThreadPool.get());
+        }
+        if (!mDrawList)
+        {
+            mDrawList = DrawList::create(mScene, mForwardProgram, mRepeatCount, mThreadPool.get(), layout);
+        }
+        mDrawListMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+        mRenderStats->addMs(mStatCounters.drawListBuildMs, mDrawListMs);
+    }
+    else
+    {
+        mDrawList->update();
+    }
+}
+
+void HighPerformanceRendering::BuildMultiDrawData()
+{
+    if (mDrawList->getGeometryPool()) return;
+    auto start = CpuTimer::getCurrentTimePoint();
+
+    // A draw list restored from the pack ignores the flags and uploads the packed geometry. A fresh build keeps
+    // the merged geometry on the CPU just long enough to write the pack for the next launch.
+    mDrawList->buildMultiDrawData(mThreadPool.get(), GetGeometryFlags() | GeometryPool::Flags::KeepCpuData);
+    WriteDrawListPack();
+
+    // Whether the vertices ended up quantized is only known now, e.g. scenes with skinned meshes stay fp32
+    if (mDrawList->getGeometryPool()->isQuantized()) ConfigureRenderMode();
+    const double buildMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    mDrawListMs += buildMs;
+    mRenderStats->addMs(mStatCounters.drawListBuildMs, buildMs);
+}
+
+void HighPerformanceRendering::WriteDrawListPack()
+{
+    if (mDrawList->isFromPack()) return;
+
+    if (!mStressScene && mDrawList->writePack(kDrawListPackFile, mDrawListPackKey))
+    {
+        logInfo("Wrote draw list pack " + std::string(kDrawListPackFile));
+    }
+    mDrawList->getGeometryPool()->releaseCpuData();
+}
+
+GeometryPool::Flags HighPerformanceRendering::GetGeometryFlags() const
+{
+    // LODs and occluders are always kept so that LOD selection and occlusion culling can be toggled at runtime
+    const GeometryPool::Flags optimizeFlags = mOptimizeGeometry ? GeometryPool::Flags::OptimizeVertexCache | GeometryPool::Flags::ShortIndices : GeometryPool::Flags::None;
+    const GeometryPool::Flags quantizeFlags = mQuantizeVertices ? GeometryPool::Flags::QuantizeVertices : GeometryPool::Flags::None;
+    return optimizeFlags | quantizeFlags | GeometryPool::Flags::GenerateLods | GeometryPool::Flags::KeepOccluders;
+}
+
+void HighPerformanceRendering::BindPrevTransforms()
+{
+    // Not persistent: the buffer is recreated when more draws start moving than it has room for
+    if (mDrawList->getLayout() == DrawConstantsLayout::Compact)
+    {
+        mForwardVars->setStructuredBuffer("gPrevWorldTransforms", mDrawList->getPrevTransformsBuffer());
+    }
+}
+
+uint32_t HighPerformanceRendering::WriteDrawConstants(const Mesh* pMesh, const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, uint32_t drawID)
+{
+    UploadRing::Allocation allocation;
+    DrawConstants* pConstants = mUploadRing->allocate<DrawConstants>(1, allocation);
+    BindDrawRing(allocation);
+    DrawRecorder::writeSceneConstants(pMesh, pModelInstance, pMeshInstance, drawID, pConstants);
+    return (uint32_t)(allocation.offset / 16);
+}
 
-    mForwardState->setVao(drawList.vao);
+void HighPerformanceRendering::BindDrawRing(const UploadRing::Allocation& allocation)
+{
+    // Rebound only when the ring grows into a new buffer
+    if (allocation.pBuffer != mpBoundDrawRing)
+    {
+        mForwardVars->setRawBuffer("gDrawRing", mUploadRing->getBuffer());
+        mpBoundDrawRing = allocation.pBuffer;
+    }
+}
 
-    renderContext->setGraphicsState(mForwardState);
-    renderContext->setGraphicsVars(mForwardVars);
-    renderContext->multiDrawIndexedIndirect(drawList.indirectArgBuffer.get(), 0, drawList.numDrawItems, sizeof(DrawIndexedArguments));
+DrawRecorder::View HighPerformanceRendering::GetRecordView() const
+{
+    DrawRecorder::View view;
+    view.frustum = Frustum::fromViewProj(mCamera->getViewProjMatrix());
+    view.cameraPos = mCamera->getPosition();
+    view.depthScale = 1.0f / mCamera->getFarPlane();
+    view.cull = mEnableCulling;
+    return view;
 }
 
 void HighPerformanceRendering::DrawSingleMesh(
@@ -490,19 +1101,88 @@ void HighPerformanceRendering::DrawSingleMesh(
     }
 
     state->setVao(mesh->getVao());
+    mCommandCapture->recordVao(mesh->getVao().get());
 
 #ifdef FALCOR_VK
-    struct alignas(16) { uint32_t drawID; } push = { mDrawCount };
-    renderContext->pushConstants(vars, sizeof(push), &push);
+    struct alignas(16) { uint32_t drawID; uint32_t drawRingSlot; } push = { mDrawCount, mDrawRingSlot };
+    mCommandCapture->pushConstants(renderContext, vars, sizeof(push), &push);
 #else
     #error This application needs push constants to work
 #endif
 
-    renderContext->setGraphicsState(state);
-    renderContext->setGraphicsVars(vars);
-    renderContext->drawIndexed(mesh->getIndexCount(), 0, 0);
+    mCommandCapture->setGraphicsState(renderContext, state);
+    mCommandCapture->setGraphicsVars(renderContext, vars);
+    mCommandCapture->drawIndexed(renderContext, mesh->getIndexCount(), 0, 0);
 
     mDrawCount++;
+    mDrawCallCount++;
+
+    // Every draw rebinds everything
+    mSubmitStats.draws++;
+    mSubmitStats.materialChanges++;
+    mSubmitStats.vaoChanges++;
+    mSubmitStats.stateChanges++;
+}
+
+template<typename DrawPolicy>
+void HighPerformanceRendering::SubmitDrawQueue(RenderContext* renderContext, DrawPolicy policy)
+{
+    // The render context re-applies the bound state and vars on every draw, so VAO and parameter block changes
+    // are picked up without rebinding. Only the first draw binds them.
+    const Material* pBoundMaterial = nullptr;
+    const Vao* pBoundVao = nullptr;
+    bool stateBound = false;
+
+    for (const DrawPacket& packet : mDrawQueue->getPackets())
+    {
+        const auto& material = packet.pMesh->getMaterial();
+        if (material.get() != pBoundMaterial)
+        {
+            SetPerMaterialData(mForwardVars, material);
+            pBoundMaterial = material.get();
+            mSubmitStats.materialChanges++;
+        }
+        else
+        {
+            mSubmitStats.materialChangesAvoided++;
+        }
+
+        const uint32_t drawRingSlot = policy.setDrawConstants(packet);
+
+        const auto& vao = packet.pMesh->getVao();
+        if (vao.get() != pBoundVao)
+        {
+            mForwardState->setVao(vao);
+            mCommandCapture->recordVao(vao.get());
+            pBoundVao = vao.get();
+            mSubmitStats.vaoChanges++;
+        }
+        else
+        {
+            mSubmitStats.vaoChangesAvoided++;
+        }
+
+        struct alignas(16) { uint32_t drawID; uint32_t drawRingSlot; } push = { packet.drawID, drawRingSlot };
+        mCommandCapture->pushConstants(renderContext, mForwardVars, sizeof(push), &push);
+
+        if (!stateBound)
+        {
+            mCommandCapture->setGraphicsState(renderContext, mForwardState);
+            mCommandCapture->setGraphicsVars(renderContext, mForwardVars);
+            stateBound = true;
+            mSubmitStats.stateChanges++;
+        }
+        else
+        {
+            mSubmitStats.stateChangesAvoided++;
+        }
+
+        mCommandCapture->drawIndexed(renderContext, packet.pMesh->getIndexCount(), 0, 0);
+        mSubmitStats.draws++;
+    }
+
+    mDrawCount += mSubmitStats.draws;
+    mDrawCallCount += mSubmitStats.draws;
 }
 
 void HighPerformanceRendering::UpdateShaderBindingLocations(const GraphicsVars::SharedPtr& vars)
@@ -560,32 +1240,283 @@ void HighPerformanceRendering::SetPerFrameData(const GraphicsVars::SharedPtr& va
     {
         pCB->setVariable(sLightCountOffset, scene->getLightCount());
     }
+
+    if (mClusteredLights)
+    {
+        UpdateLightClusters(vars, camera, scene);
+    }
+}
+
+void HighPerformanceRendering::UpdateLightClusters(const GraphicsVars::SharedPtr& vars, const Camera::SharedPtr& camera, const Scene::SharedPtr& scene)
+{
+    PROFILE("UpdateLightClusters");
+
+    // Lights without a position reach every pixel and go first, the point lights follow in the order the cluster lists index them
+    mClusterLightData.clear();
+    mClusterLights.clear();
+    for (uint32_t i = 0; i < scene->getLightCount(); i++)
+    {
+        const LightData& data = scene->getLight(i)->getData();
+        if (data.type != LightPoint) mClusterLightData.push_back(data);
+    }
+    mGlobalLightCount = (uint32_t)mClusterLightData.size();
+    for (uint32_t i = 0; i < scene->getLightCount(); i++)
+    {
+        const LightData& data = scene->getLight(i)->getData();
+        if (data.type != LightPoint) continue;
+        mClusterLightData.push_back(data);
+        mClusterLights.push_back({ data.posW, LightClusters::getInfluenceRadius(data.intensity) });
+    }
+
+    mLightClusters->build(LightClusters::View::fromCamera(camera.get()), mClusterLights, mThreadPool.get());
+
+    // Grow geometrically, the data is rewritten every frame
+    const uint32_t lightCount = (uint32_t)mClusterLightData.size();
+    if (!mClusterLightsBuffer || lightCount > mClusterLightsCapacity)
+    {
+        mClusterLightsCapacity = std::max(kMinClusterLights, lightCount * 2);
+        mClusterLightsBuffer = StructuredBuffer::create(mForwardProgram, "gClusterLights", mClusterLightsCapacity);
+    }
+    if (lightCount > 0)
+    {
+        mClusterLightsBuffer->setBlob(mClusterLightData.data(), 0, sizeof(LightData) * lightCount);
+    }
+    vars->setStructuredBuffer("gClusterLights", mClusterLightsBuffer);
+
+    // The cluster ranges followed by the index lists, in one allocation
+    const auto& ranges = mLightClusters->getClusterRanges();
+    const auto& indices = mLightClusters->getLightIndices();
+    const size_t rangesSize = sizeof(LightClusters::ClusterRange) * ranges.size();
+    const size_t indicesSize = sizeof(uint32_t) * indices.size();
+    const UploadRing::Allocation allocation = mUploadRing->allocate(rangesSize + indicesSize);
+    memcpy(allocation.pData, ranges.data(), rangesSize);
+    if (indicesSize > 0) memcpy(allocation.pData + rangesSize, indices.data(), indicesSize);
+    vars->setRawBuffer("gClusterData", mUploadRing->getBuffer());
+
+    // The shader finds its tile from the pixel position, its slice from the view depth
+    const Fbo::SharedPtr& pFbo = mForwardState->getFbo();
+    ConstantBuffer* pCB = vars->getConstantBuffer("LightClusterCB").get();
+    pCB->setVariable("gClusterTileScale", glm::vec2((float)LightClusters::kClustersX / pFbo->getWidth(), (float)LightClusters::kClustersY / pFbo->getHeight()));
+    pCB->setVariable("gClusterNearZ", mLightClusters->getNearZ());
+    pCB->setVariable("gClusterSliceScale", mLightClusters->getSliceScale());
+    pCB->setVariable("gClusterRangesOffset", (uint32_t)allocation.offset);
+    pCB->setVariable("gClusterIndicesOffset", (uint32_t)(allocation.offset + rangesSize));
+    pCB->setVariable("gClusterGlobalLightCount", mGlobalLightCount);
 }
 
 void HighPerformanceRendering::SetPerMaterialData(const GraphicsVars::SharedPtr& vars, const Material::SharedPtr& material)
 {
     vars->setParameterBlock("gMaterial", material->getParameterBlock());
+    mCommandCapture->recordMaterial(material.get());
 }
 
-void HighPerformanceRendering::ConfigureRenderMode()
+Program::DefineList HighPerformanceRendering::GetForwardDefines(RenderMode mode, bool useUploadRing, bool compactDrawConstants, bool quantizedVertices, bool clusteredLights)
 {
-    mForwardProgram->setDefines({});
-    if (mRenderMode == RenderMode::BindlessConstants)
+    Program::DefineList defines;
+    if (mode == RenderMode::BindlessConstants)
     {
-        mForwardProgram->addDefine("BINDLESS_CONSTANTS");
+        defines.add("BINDLESS_CONSTANTS");
     }
-    else if (mRenderMode == RenderMode::BindlessMultiDraw)
+    else if (mode == RenderMode::BindlessMultiDraw)
+    {
+        defines.add("MULTI_DRAW");
+        defines.add("BINDLESS_MATERIAL");
+    }
+    else if (mode == RenderMode::Explicit && useUploadRing)
+    {
+        // The bindless vertex shader reads the full draw constants from the upload ring instead of InternalPerMeshCB
+        defines.add("BINDLESS_CONSTANTS");
+        defines.add("RING_DRAW_CONSTANTS");
+    }
+
+    if (compactDrawConstants && (mode == RenderMode::BindlessConstants || mode == RenderMode::BindlessMultiDraw))
+    {
+        defines.add("COMPACT_DRAW_CONSTANTS");
+    }
+
+    // Stock mode shades through SceneRenderer, which sets up the lights itself
+    if (clusteredLights && mode != RenderMode::Stock)
+    {
+        defines.add("CLUSTERED_LIGHTS");
+        defines.add("LIGHT_CLUSTERS_X", std::to_string(LightClusters::kClustersX));
+        defines.add("LIGHT_CLUSTERS_Y", std::to_string(LightClusters::kClustersY));
+        defines.add("LIGHT_CLUSTERS_Z", std::to_string(LightClusters::kClustersZ));
+    }
+
+    // The vertex shader decodes the layout the geometry pool was built with
+    if (quantizedVertices && mode == RenderMode::BindlessMultiDraw)
     {
-        mForwardProgram->addDefine("MULTI_DRAW");
-        mForwardProgram->addDefine("BINDLESS_MATERIAL");
+        defines.add("QUANTIZED_VERTICES");
     }
+    return defines;
+}
+
+void HighPerformanceRendering::AddShaderVariants()
+{
+    // The current settings first, then every combination the keys can switch to. Toggles that don't apply to a mode give
+    // duplicates, which ShaderVariants drops.
+    const bool quantized = mDrawList && mDrawList->getGeometryPool() && mDrawList->getGeometryPool()->isQuantized();
+    mShaderVariants->add(GetForwardDefines(mRenderMode, mUseUploadRing, mCompactDrawConstants, quantized, mClusteredLights));
+    for (uint32_t mode = 0; mode < (uint32_t)kRenderModeNames.size(); ++mode)
+    {
+        for (uint32_t toggles = 0; toggles < 16; ++toggles)
+        {
+            mShaderVariants->add(GetForwardDefines((RenderMode)mode, (toggles & 1) != 0, (toggles & 2) != 0, (toggles & 4) != 0, (toggles & 8) != 0));
+        }
+    }
+}
+
+void HighPerformanceRendering::ConfigureRenderMode()
+{
+    const bool quantized = mDrawList && mDrawList->getGeometryPool() && mDrawList->getGeometryPool()->isQuantized();
+    mShaderVariants->activate(GetForwardDefines(mRenderMode, mUseUploadRing, mCompactDrawConstants, quantized, mClusteredLights));
 
     mForwardVars = GraphicsVars::create(mForwardProgram->getReflector());
     mPersistantShaderResourcesBound = false;
+    mpBoundDrawRing = nullptr;
+    mClusterLightsBuffer = nullptr;
+}
+
+void HighPerformanceRendering::RunBenchmarks()
+{
+    Benchmarks::writeCsv("FrustumCullingBenchmark.csv", Benchmarks::frustumCulling({ 10000, 100000, 1000000 }));
+    Benchmarks::writeCsv("InstanceBvhBenchmark.csv", Benchmarks::instanceBvh({ 10000, 100000, 1000000 }));
+    Benchmarks::writeCsv("OcclusionCullingBenchmark.csv", Benchmarks::occlusionCulling(100000, mThreadPool->getThreadCount()));
+    Benchmarks::writeCsv("LightClusteringBenchmark.csv", Benchmarks::lightClustering({ 100, 1000, 10000 }, mThreadPool->getThreadCount()));
+    Benchmarks::writeCsv("DrawConstantsLayoutBenchmark.csv", Benchmarks::drawConstantsLayout(1000000));
+    Benchmarks::writeCsv("UploadRingBenchmark.csv", Benchmarks::uploadRing({ 1000, 10000, 100000 }));
+    Benchmarks::writeCsv("SkinningBenchmark.csv", Benchmarks::skinning(1000000, mThreadPool->getThreadCount()));
+    Benchmarks::writeCsv("RenderStatsBenchmark.csv", Benchmarks::renderStats(mThreadPool->getThreadCount()));
+    Benchmarks::writeCsv("DrawRecordingBenchmark.csv", Benchmarks::drawRecording(mScene, mRepeatCount, mThreadPool->getThreadCount(), GetRecordView()));
+
+    // The draw constants buffer is created from the reflection of gDrawConstants, which only the bindless variants declare
+    if (mRenderMode == RenderMode::BindlessConstants || mRenderMode == RenderMode::BindlessMultiDraw)
+    {
+        if (mDrawList)
+        {
+            Benchmarks::writeCsv("GeometryOptimizationBenchmark.csv", Benchmarks::geometryOptimization(mDrawList->getGroupMeshes(), mThreadPool->getThreadCount()));
+            Benchmarks::writeCsv("VertexQuantizationBenchmark.csv", Benchmarks::vertexQuantization(mDrawList->getGroupMeshes()));
+        }
+        // Only the multi-draw variant declares gBindlessTextures
+        if (mDrawList && mRenderMode == RenderMode::BindlessMultiDraw)
+        {
+            Benchmarks::writeCsv("DescriptorTableBenchmark.csv", Benchmarks::descriptorTable(mForwardProgram, mDrawList->getMaterialTable()->getTextureTable()));
+        }
+        Benchmarks::writeCsv("DrawListBuildBenchmark.csv", Benchmarks::drawListBuild(mScene, mForwardProgram, mRepeatCount, mThreadPool->getThreadCount(), mCompactDrawConstants ? DrawConstantsLayout::Compact : DrawConstantsLayout::Full));
+    }
+    else
+    {
+        logWarning("Draw list build benchmark requires a bindless render mode");
+    }
 }
 
 void HighPerformanceRendering::onGuiRender(SampleCallbacks* sample, Gui* gui)
 {
+    if (mLoadStage != LoadStage::Done)
+    {
+        static const char* kStageNames[] = { "scene", "draw list", "geometry" };
+        gui->addText((std::string("Loading ") + kStageNames[(uint32_t)mLoadStage] + "...").c_str());
+    }
+
+    if (mStressScene)
+    {
+        const StressScene::Desc& desc = mStressScene->getDesc();
+        std::string text = "Stress scene (N): " + std::to_string(desc.instanceCount) + " instances, " + std::to_string(desc.meshCount) + " meshes, " + std::to_string(desc.materialCount) + " materials, ";
+        text += std::to_string(mStressScene->getAnimatedCount()) + " animated";
+        gui->addText(text.c_str());
+    }
+    else
+    {
+        gui->addText(("Scene (N for a generated one): drawn " + std::to_string(mRepeatCount) + " times").c_str());
+    }
+
+    if (mDrawList && (mRenderMode == RenderMode::BindlessConstants || mRenderMode == RenderMode::BindlessMultiDraw))
+    {
+        const auto& uploadStats = mDrawList->getUploadStats();
+        std::string text = std::string("Draw list: ") + (mDrawList->isFromPack() ? "restored from pack" : "built") + " in " + std::to_string(mDrawListMs) + " ms\n";
+        text += std::string("Draw constants: ") + (mDrawList->getLayout() == DrawConstantsLayout::Compact ? "compact" : "full") + " (P)\n";
+        text += "Bytes/draw: " + std::to_string(mDrawList->getGpuConstantsSize() / std::max(1u, mDrawList->getDrawCount())) + "\n";
+        text += "Uploaded: " + std::to_string(uploadStats.uploadedBytes / 1024) + " KB in " + std::to_string(uploadStats.uploadCalls) + " calls";
+        if (mRenderMode == RenderMode::BindlessMultiDraw)
+        {
+            const auto& textureTable = mDrawList->getMaterialTable()->getTextureTable();
+            text += "\nBindless textures: " + std::to_string(textureTable->getUsedSlotCount()) + ", last bind wrote " + std::to_string(textureTable->getLastBindStats().slotsWritten) + " slots";
+            const uint32_t droppedTextures = mDrawList->getMaterialTable()->getDroppedTextureCount();
+            if (droppedTextures > 0) text += "\n" + std::to_string(droppedTextures) + " textures over the table's " + std::to_string(MaterialTable::kMaxTextures) + " sampled as null";
+        }
+        if (mDrawList->getGeometryPool())
+        {
+            const auto& stats = mDrawList->getGeometryPool()->getOptimizeStats();
+            text += std::string("\nGeometry: ") + (mOptimizeGeometry ? "optimized" : "as loaded") + " (G), ACMR " + std::to_string(stats.after.getACMR()) + ", ATVR " + std::to_string(stats.after.getATVR());
+            const auto& pGeometryPool = mDrawList->getGeometryPool();
+            text += std::string("\nVertices: ") + (pGeometryPool->isQuantized() ? "quantized" : "fp32") + " (Z), " + std::to_string(pGeometryPool->getVertexDataSize() / std::max(1u, pGeometryPool->getVertexCount())) + " bytes/vertex";
+        }
+        if (mRenderMode == RenderMode::BindlessMultiDraw && mDrawList->getGeometryPool())
+        {
+            const auto& cullStats = mDrawList->getCullStats();
+            text += std::string("\nCulling: ") + (mEnableCulling ? (cullStats.hierarchy ? "BVH" : "flat") : "off") + " (C, H), " + std::to_string(cullStats.visibleDraws) + " draws visible in " + std::to_string(cullStats.cullMs) + " ms";
+            if (mDrawList->getOcclusionCuller())
+            {
+                text += std::string("\nOcclusion: ") + (mEnableOcclusion ? "on" : "off") + " (V), " + std::to_string(cullStats.occludedDraws) + " draws hidden by " + std::to_string(cullStats.occluders) +
+                    " occluders, " + std::to_string(cullStats.occluderTriangles) + " triangles, " + std::to_string(cullStats.occlusionMs) + " ms";
+            }
+            text += std::string("\nLOD: ") + (mEnableLods ? "on" : "off") + " (L), triangles " + std::to_string(cullStats.triangles / 1000) + "K of " + std::to_string(cullStats.baseTriangles / 1000) + "K, draws per level";
+            for (uint32_t level = 0; level < GeometryPool::kMaxLods; ++level)
+            {
+                text += " " + std::to_string(cullStats.lodDraws[level]);
+            }
+            if (mDrawList->getSkinner())
+            {
+                const auto& skinStats = mDrawList->getSkinner()->getStats();
+                text += "\nSkinning: " + std::to_string(skinStats.vertices) + " vertices in " + std::to_string(skinStats.skinMs) + " ms on " + std::to_string(mThreadPool->getThreadCount()) + " threads";
+            }
+        }
+        gui->addText(text.c_str());
+    }
+
+    if (mRenderMode == RenderMode::Explicit || mRenderMode == RenderMode::BindlessConstants)
+    {
+        const auto& stats = mSubmitStats;
+        std::string text = std::string("Draw sorting: ") + (mSortDraws ? "on" : "off") + " (O)\n";
+        const bool parallel = mParallelRecording && (mRenderMode == RenderMode::BindlessConstants || mUseUploadRing);
+        text += std::string("Recording: ") + (parallel ? "parallel on " + std::to_string(mThreadPool->getThreadCount()) + " threads" : "serial") + " (J)\n";
+        text += std::string("Submission: ") + (mDrawCallbacks ? "per-draw callbacks, unsorted" : "draw packets") + " (F)\n";
+        text += "Draws: " + std::to_string(stats.draws) + "\n";
+        text += "Material changes: " + std::to_string(stats.materialChanges) + " (avoided " + std::to_string(stats.materialChangesAvoided) + ")\n";
+        text += "VAO changes: " + std::to_string(stats.vaoChanges) + " (avoided " + std::to_string(stats.vaoChangesAvoided) + ")\n";
+        text += "State changes: " + std::to_string(stats.stateChanges) + " (avoided " + std::to_string(stats.stateChangesAvoided) + ")";
+        gui->addText(text.c_str());
+    }
+
+    if (mRenderMode != RenderMode::Stock)
+    {
+        std::string text = std::string("Lights: ") + (mClusteredLights ? "clustered" : "first only") + " (I)";
+        if (mClusteredLights)
+        {
+            const auto& stats = mLightClusters->getStats();
+            text += ", " + std::to_string(stats.lights) + " point lights, " + std::to_string(stats.visibleLights) + " in view, " +
+                std::to_string((double)stats.assignments / std::max(1u, stats.occupiedClusters)) + " per occupied cluster, max " + std::to_string(stats.maxClusterLights) + ", binned in " + std::to_string(stats.binMs) + " ms";
+        }
+        gui->addText(text.c_str());
+    }
+
+    if (mRenderMode == RenderMode::Explicit || mRenderMode == RenderMode::BindlessMultiDraw)
+    {
+        std::string text = std::string("Upload ring: ") + (mUseUploadRing ? "on" : "off") + " (U), " + std::to_string(mUploadRing->getCapacity() / (1024 * 1024)) + " MB\n";
+        text += "Allocations/frame: " + std::to_string(mUploadStats.allocations) + ", " + std::to_string(mUploadStats.allocatedBytes / 1024) + " KB";
+        if (mUploadStats.grows > 0) text += ", grew " + std::to_string(mUploadStats.grows) + "x";
+        gui->addText(text.c_str());
+    }
+
+    {
+        const auto& stats = mShaderVariants->getStats();
+        std::string text = "Shader variants: " + std::to_string(stats.precompiled) + " of " + std::to_string(stats.variants) + " precompiled in " + std::to_string(stats.precompileMs) + " ms\n";
+        text += "Mode switches: " + std::to_string(stats.hits) + " precompiled, saved " + std::to_string(stats.savedMs) + " ms, " + std::to_string(stats.misses) + " compiled on use in " + std::to_string(stats.missMs) + " ms";
+        gui->addText(text.c_str());
+    }
+
+    gui->addText((std::string("Command trace (Y)") + (mCommandCapture->isCapturing() ? " (capturing)" : "")).c_str());
+    gui->addText(("Capture trace (K)\n" + mRenderStats->getReport()).c_str());
 }
 
 bool HighPerformanceRendering::onKeyEvent(SampleCallbacks* sample, const KeyboardEvent& keyEvent)
@@ -593,6 +1524,11 @@ bool HighPerformanceRendering::onKeyEvent(SampleCallbacks* sample, const Keyboar
     if (mCamController.onKeyEvent(keyEvent)) return true;
     if (keyEvent.type == KeyboardEvent::Type::KeyReleased)
     {
+        // The stock and explicit modes read the model and mesh instance transforms, which Falcor updates lazily on read. The loader
+        // thread reads the same instances while it builds the draw list, so the mode stays put until it's done.
+        const bool modeKey = keyEvent.key == KeyboardEvent::Key::R || keyEvent.key == KeyboardEvent::Key::X || keyEvent.key == KeyboardEvent::Key::B || keyEvent.key == KeyboardEvent::Key::M;
+        if (modeKey && mLoadStage == LoadStage::DrawList) return true;
+
         if (keyEvent.key == KeyboardEvent::Key::R)
         {
             mRenderMode = RenderMode::Stock;
@@ -617,6 +1553,107 @@ bool HighPerformanceRendering::onKeyEvent(SampleCallbacks* sample, const Keyboar
             ConfigureRenderMode();
             return true;
         }
+        if (keyEvent.key == KeyboardEvent::Key::C)
+        {
+            mEnableCulling = !mEnableCulling;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::H)
+        {
+            mCullHierarchy = !mCullHierarchy;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::V)
+        {
+            mEnableOcclusion = !mEnableOcclusion;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::L)
+        {
+            mEnableLods = !mEnableLods;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::O)
+        {
+            mSortDraws = !mSortDraws;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::J)
+        {
+            mParallelRecording = !mParallelRecording;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::F)
+        {
+            mDrawCallbacks = !mDrawCallbacks;
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::I)
+        {
+            mClusteredLights = !mClusteredLights;
+            ConfigureRenderMode();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::U)
+        {
+            mUseUploadRing = !mUseUploadRing;
+            ConfigureRenderMode();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::P)
+        {
+            // The loader is building the draw list with the current settings
+            if (mLoadStage != LoadStage::Done) return true;
+
+            // The layout is baked into the draw list
+            mCompactDrawConstants = !mCompactDrawConstants;
+            mDrawList = nullptr;
+            ConfigureRenderMode();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::G)
+        {
+            // The loader is building the draw list with the current settings
+            if (mLoadStage != LoadStage::Done) return true;
+
+            // The geometry pool is built once per draw list
+            mOptimizeGeometry = !mOptimizeGeometry;
+            mDrawList = nullptr;
+            ConfigureRenderMode();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::Z)
+        {
+            if (mLoadStage != LoadStage::Done) return true;
+
+            // Baked into the geometry pool like the optimization
+            mQuantizeVertices = !mQuantizeVertices;
+            mDrawList = nullptr;
+            ConfigureRenderMode();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::T)
+        {
+            if (mLoadStage != LoadStage::Done) return true;
+            RunBenchmarks();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::N)
+        {
+            if (mLoadStage != LoadStage::Done) return true;
+            LoadNextStressScene();
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::K)
+        {
+            mRenderStats->beginCapture(kStatsCaptureFrames, "RenderStats");
+            return true;
+        }
+        if (keyEvent.key == KeyboardEvent::Key::Y)
+        {
+            mCommandCapture->beginCapture(kCommandCaptureFrames, kCommandTraceFile, kRenderModeNames);
+            return true;
+        }
     }
     return false;
 }
@@ -637,16 +1674,65 @@ void HighPerformanceRendering::onResizeSwapChain(SampleCallbacks* sample, uint32
 
 void HighPerformanceRendering::onShutdown(SampleCallbacks* sample)
 {
+    // Destruct before Vulkan context is destroyed. The loader goes first, its jobs reference the draw list and the thread pools.
+    mLoader = nullptr;
+    mLoaderThreadPool = nullptr;
+    mDrawList = nullptr;
+    mThreadPool = nullptr;
+    mUploadRing = nullptr;
 }
 
-int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd)
+namespace
 {
-    Logger::setVerbosity(Logger::Level::Warning);
+    int runSample(int argc, char** argv)
+    {
+        Logger::setVerbosity(Logger::Level::Warning);
+
+        std::unique_ptr<HighPerformanceRendering> pApp = std::make_unique<HighPerformanceRendering>();
+        SampleConfig config;
+        config.windowDesc.title = "HighPerformanceRendering";
+        config.windowDesc.resizableWindow = true;
 
-    HighPerformanceRendering::UniquePtr pRenderer = std::make_unique<HighPerformanceRendering>();
-    SampleConfig config;
-    config.windowDesc.title = "HighPerformanceRendering";
-    config.windowDesc.resizableWindow = true;
-    Sample::run(config, pRenderer);
-    return 0;
+        BenchmarkRunner::Options benchmarkOptions;
+        const bool benchmark = BenchmarkRunner::parseCommandLine(argc, argv, benchmarkOptions);
+
+        // Replaying a command trace needs no window or device, so it also runs on machines without a GPU
+        if (!benchmarkOptions.replayPath.empty())
+        {
+            Logger::setVerbosity(Logger::Level::Info);
+            CommandTrace::SharedPtr pTrace = CommandTrace::readFile(benchmarkOptions.replayPath);
+            if (!pTrace) return 1;
+            return Benchmarks::writeCsv(benchmarkOptions.outputPrefix + "Replay.csv", Benchmarks::commandReplay(pTrace, benchmarkOptions.replayRepeatCount)) ? 0 : 1;
+        }
+
+        if (benchmark)
+        {
+            // Unattended: fixed resolution, no vsync throttling, no blocking error dialogs, and frozen time so the
+            // scene animates identically for every mode
+            Logger::setVerbosity(Logger::Level::Info);
+            config.windowDesc.resizableWindow = false;
+            config.windowDesc.width = 1280;
+            config.windowDesc.height = 720;
+            config.deviceDesc.enableVsync = false;
+            config.showMessageBoxOnError = false;
+            config.freezeTimeOnStartup = true;
+            pApp->SetBenchmarkOptions(benchmarkOptions);
+        }
+
+        HighPerformanceRendering::UniquePtr pRenderer = std::move(pApp);
+        Sample::run(config, pRenderer);
+        return 0;
+    }
 }
+
+#ifdef _WIN32
+int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd)
+{
+    return runSample(__argc, __argv);
+}
+#else
+int main(int argc, char** argv)
+{
+    return runSample(argc, argv);
+}
+#endif
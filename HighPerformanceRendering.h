@@ -1,12 +1,26 @@
 #pragma once
 
 #include "Falcor.h"
+#include "BenchmarkRunner.h"
+#include "AsyncLoader.h"
+#include "DrawList.h"
+#include "DrawQueue.h"
+#include "DrawRecorder.h"
+#include "UploadRing.h"
+#include "LightClusters.h"
+#include "ShaderVariants.h"
+#include "CommandCapture.h"
+#include "RenderStats.h"
+#include "StressScene.h"
 
 using namespace Falcor;
 
 class HighPerformanceRendering : public Renderer
 {
 public:
+    // Call before Sample::run() to render every mode unattended and write the results instead of running interactively
+    void SetBenchmarkOptions(const BenchmarkRunner::Options& options);
+
     void onLoad(SampleCallbacks* sample, RenderContext* renderContext) override;
     void onFrameRender(SampleCallbacks* sample, RenderContext* renderContext, const Fbo::SharedPtr& targetFbo) override;
     void onShutdown(SampleCallbacks* sample) override;
@@ -18,12 +32,31 @@ public:
 
 private:
     void SetupScene();
+    bool UpdateLoading();
+    void LoadScene();
+    void LoadDrawList(DrawConstantsLayout layout, GeometryPool::Flags geometryFlags);
+    void FinishLoading();
+    void LoadNextStressScene();
+    bool IsRenderModeReady() const;
     void SetupRendering(uint32_t width, uint32_t height);
     void RenderScene(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo);
     void RenderSceneExplicit(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo);
     void RenderSceneBindlessConstants(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo);
     void RenderSceneBindlessMultiDraw(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo);
+    void PrepareDrawList();
+    void BuildMultiDrawData();
+    void WriteDrawListPack();
+    GeometryPool::Flags GetGeometryFlags() const;
+    void BindPrevTransforms();
+    uint32_t WriteDrawConstants(const Mesh* pMesh, const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, uint32_t drawID);
+    void BindDrawRing(const UploadRing::Allocation& allocation);
+    DrawRecorder::View GetRecordView() const;
+
+    // Submits the draw queue with the per-draw constants set by the policy, see the draw policies in HighPerformanceRendering.cpp
+    template<typename DrawPolicy>
+    void SubmitDrawQueue(RenderContext* renderContext, DrawPolicy policy);
 
+    // The per-draw submission the draw queue replaced, kept for comparison (F)
     void DrawSingleMesh(
         RenderContext* renderContext,
         const GraphicsVars::SharedPtr& vars,
@@ -33,13 +66,30 @@ private:
         const Model::MeshInstance::SharedPtr& meshInstance,
         std::function<void(const GraphicsVars::SharedPtr&, const Model::MeshInstance::SharedPtr&, const Scene::ModelInstance::SharedPtr&)> setPerDrawData);
 
+
     void UpdateShaderBindingLocations(const GraphicsVars::SharedPtr& vars);
     void SetPerFrameData(const GraphicsVars::SharedPtr& vars, const Camera::SharedPtr& camera, const Scene::SharedPtr& scene);
+    void UpdateLightClusters(const GraphicsVars::SharedPtr& vars, const Camera::SharedPtr& camera, const Scene::SharedPtr& scene);
     void SetPerMaterialData(const GraphicsVars::SharedPtr& vars, const Material::SharedPtr& material);
 
     void ConfigureRenderMode();
+    void AddShaderVariants();
+    void RunBenchmarks();
+    void UpdateBenchmark(SampleCallbacks* sample);
+    void ReportStartupTime();
+
+    // CPU time of the frame phases, see BenchmarkRunner::Phase
+    void BeginPhases();
+    void EndPhase(BenchmarkRunner::Phase phase);
+
+    void RegisterRenderStats();
+    void RecordRenderStats();
     
+    std::string mScenePath;
     Scene::SharedPtr mScene;
+    StressScene::SharedPtr mStressScene;    // Set when the scene is generated, see StressScene::kPathPrefix
+    uint32_t mRepeatCount;                  // Times every draw of the scene is drawn per frame
+    uint32_t mSceneDrawCount;
 
     Camera::SharedPtr mCamera;
     FirstPersonCameraController mCamController;
@@ -49,9 +99,110 @@ private:
     GraphicsProgram::SharedPtr mForwardProgram;
     GraphicsVars::SharedPtr mForwardVars;
     GraphicsState::SharedPtr mForwardState;
+    ShaderVariants::SharedPtr mShaderVariants;     // Every define permutation of mForwardProgram, compiled while loading
+
+    DrawList::SharedPtr mDrawList;
+    uint64_t mDrawListPackKey = 0;
+    ThreadPool::SharedPtr mThreadPool;
+    ThreadPool::SharedPtr mLoaderThreadPool;    // The loader thread's builds, parallelFor on mThreadPool would wait for them
+    DrawQueue::SharedPtr mDrawQueue;
+    DrawQueue::SubmitStats mSubmitStats;
+    DrawRecorder::SharedPtr mDrawRecorder;
+    bool mDrawCallbacks;        // Per-draw modes submit through DrawSingleMesh instead of the draw queue
+    uint64_t mFrameAllocations; // Heap allocations during the last frame
+
+    // Per-draw constants of the explicit mode and the culled indirect args, rewritten every frame
+    UploadRing::SharedPtr mUploadRing;
+    UploadRing::FrameStats mUploadStats;
+    Buffer* mpBoundDrawRing;
+    uint32_t mDrawRingSlot;
+
+    // Point lights binned into view clusters every frame, their lists go to the upload ring and the light data to gClusterLights
+    LightClusters::SharedPtr mLightClusters;
+    std::vector<LightClusters::Light> mClusterLights;
+    std::vector<LightData> mClusterLightData;
+    StructuredBuffer::SharedPtr mClusterLightsBuffer;
+    uint32_t mClusterLightsCapacity;
+    uint32_t mGlobalLightCount;
+
+    BenchmarkRunner::Options mBenchmarkOptions;
+    BenchmarkRunner::SharedPtr mBenchmark;
+    bool mBenchmarkEnabled = false;
+    double mPhaseMs[(uint32_t)BenchmarkRunner::Phase::Count];
+    CpuTimer::TimePoint mPhaseStart;
+
+    // Per-frame counters shown in the GUI and captured to a trace with K
+    RenderStats::SharedPtr mRenderStats;
+
+    // Every RenderContext call of the render paths goes through it, Y captures them to a command trace
+    CommandCapture::SharedPtr mCommandCapture;
+    struct StatCounters
+    {
+        RenderStats::CounterId draws;
+        RenderStats::CounterId drawCalls;
+        RenderStats::CounterId triangles;
+        RenderStats::CounterId visibleDraws;
+        RenderStats::CounterId occludedDraws;
+        RenderStats::CounterId stateChanges;
+        RenderStats::CounterId materialChanges;
+        RenderStats::CounterId vaoChanges;
+        RenderStats::CounterId descriptorWrites;
+        RenderStats::CounterId constantUploadBytes;
+        RenderStats::CounterId constantUploadCalls;
+        RenderStats::CounterId ringBytes;
+        RenderStats::CounterId cullMs;
+        RenderStats::CounterId skinMs;
+        RenderStats::CounterId drawListBuildMs;
+        RenderStats::CounterId lightClusterMs;
+        RenderStats::CounterId clusterLightAssignments;
+        RenderStats::CounterId heapAllocations;
+        std::vector<RenderStats::CounterId> phaseMs;    // Per render mode and phase
+    } mStatCounters;
+
+    // Content loads over several frames: the scene on the render thread, then the draw list on the loader thread
+    enum class LoadStage
+    {
+        Scene,
+        DrawList,
+        Geometry,
+        Done
+    };
+    AsyncLoader::SharedPtr mLoader;
+    LoadStage mLoadStage;
+
+    // Startup to the first frame and to the first fully loaded frame, split into the scene load and the draw list build or pack restore
+    CpuTimer::TimePoint mStartupStart;
+    CpuTimer::TimePoint mDrawListStart;
+    CpuTimer::TimePoint mLastFrameStart;
+    bool mStartupReported;
+    double mFirstFrameMs;
+    double mSceneLoadMs;
+    double mDrawListMs;
+    double mMaxLoadFrameMs;
+    uint32_t mLoadFrameCount;
+    std::atomic<bool> mLoaderBuilding{ false };     // The loader thread is building the draw list or the geometry pool
+    double mMaxBuildFrameMs;                        // Max frame time while it is
+    uint32_t mBuildFrameCount;
+    bool mPrecompiledLastFrame;                     // Frames that compiled shader variants are counted apart from the others
+    double mMaxPrecompileFrameMs;
+    uint32_t mPrecompileFrameCount;
 
     uint32_t mDrawCount;
+    uint32_t mDrawCallCount;
+    uint64_t mTriangleCount;        // Submitted by the multi-draw path, 0 in the other modes
+    uint64_t mBaseTriangleCount;    // The same draws at full detail
     bool mPersistantShaderResourcesBound;
+    bool mEnableCulling;
+    bool mEnableLods;
+    bool mCullHierarchy;
+    bool mEnableOcclusion;
+    bool mSortDraws;
+    bool mCompactDrawConstants;
+    bool mOptimizeGeometry;
+    bool mQuantizeVertices;
+    bool mUseUploadRing;
+    bool mParallelRecording;
+    bool mClusteredLights;
 
     enum class RenderMode : int32_t
     {
@@ -61,4 +212,6 @@ private:
         BindlessMultiDraw
     };
     RenderMode mRenderMode;
+
+    static Program::DefineList GetForwardDefines(RenderMode mode, bool useUploadRing, bool compactDrawConstants, bool quantizedVertices, bool clusteredLights);
 };
@@ -0,0 +1,328 @@
+#include "InstanceBvh.h"
+#include <cfloat>
+
+namespace
+{
+    // Centroid bins per split axis
+    const uint32_t kBinCount = 16;
+
+    // Cost of a node relative to testing one box. Higher than the box test alone, since every node is also a likely cache miss and
+    // refit work, which keeps a few boxes per leaf.
+    const float kTraversalCost = 4.0f;
+
+    // Node bounds grow by this fraction of their largest coordinate, so rounding never makes a node reject or fully accept a box
+    // that the flat test decides the other way
+    const float kBoundsPadding = 1e-5f;
+
+    enum class Overlap
+    {
+        Outside,
+        Intersecting,
+        Inside,
+    };
+
+    float halfArea(const glm::vec3& minPos, const glm::vec3& maxPos)
+    {
+        const glm::vec3 size = maxPos - minPos;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    Overlap classifyBox(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent)
+    {
+        bool inside = true;
+        for (const auto& plane : frustum.planes)
+        {
+            const float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            const float r = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (d + r < 0.0f) return Overlap::Outside;
+            inside = inside && d - r >= 0.0f;
+        }
+        return inside ? Overlap::Inside : Overlap::Intersecting;
+    }
+
+    Overlap classifyBox(const glm::vec3& sphereCenter, float radius, const glm::vec3& center, const glm::vec3& extent)
+    {
+        if (!InstanceBvh::intersectsSphere(center, extent, sphereCenter, radius)) return Overlap::Outside;
+
+        // Inside when the farthest corner is
+        const glm::vec3 farthest = glm::abs(sphereCenter - center) + extent;
+        return glm::dot(farthest, farthest) <= radius * radius ? Overlap::Inside : Overlap::Intersecting;
+    }
+}
+
+InstanceBvh::SharedPtr InstanceBvh::create()
+{
+    return SharedPtr(new InstanceBvh());
+}
+
+bool InstanceBvh::intersectsSphere(const glm::vec3& boxCenter, const glm::vec3& boxExtent, const glm::vec3& center, float radius)
+{
+    const glm::vec3 outside = glm::max(glm::abs(center - boxCenter) - boxExtent, glm::vec3(0.0f));
+    return glm::dot(outside, outside) <= radius * radius;
+}
+
+void InstanceBvh::build(const std::vector<BoundingBox>& bounds)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    const uint32_t count = (uint32_t)bounds.size();
+
+    // Partitioned in place, so every level of the build reads consecutive memory
+    std::vector<BuildPrim> prims(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        prims[i].minPos = bounds[i].center - bounds[i].extent;
+        prims[i].maxPos = bounds[i].center + bounds[i].extent;
+        prims[i].drawIndex = i;
+    }
+
+    mNodes.clear();
+    mNodes.reserve(2 * (size_t)count);
+    mStats = {};
+    if (count > 0) buildNode(prims, 0, count, 1);
+
+    // Primitive data in hierarchy order, so leaves read consecutive memory
+    mPrimBounds.resize(count);
+    mPrimDraws.resize(count);
+    mPrimSlots.resize(count);
+    for (uint32_t slot = 0; slot < count; ++slot)
+    {
+        const uint32_t drawIndex = prims[slot].drawIndex;
+        mPrimBounds[slot] = { bounds[drawIndex].center, bounds[drawIndex].extent };
+        mPrimDraws[slot] = drawIndex;
+        mPrimSlots[drawIndex] = slot;
+    }
+    mDirty = false;
+
+    mStats.nodes = (uint32_t)mNodes.size();
+    mStats.buildMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+}
+
+void InstanceBvh::buildNode(std::vector<BuildPrim>& prims, uint32_t begin, uint32_t end, uint32_t depth)
+{
+    const uint32_t nodeIndex = (uint32_t)mNodes.size();
+    mNodes.push_back({});
+    mStats.depth = std::max(mStats.depth, depth);
+
+    // Centroids are kept doubled, min + max, which bins and orders the same
+    glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const BuildPrim& prim = prims[i];
+        minPos = glm::min(minPos, prim.minPos);
+        maxPos = glm::max(maxPos, prim.maxPos);
+        centroidMin = glm::min(centroidMin, prim.minPos + prim.maxPos);
+        centroidMax = glm::max(centroidMax, prim.minPos + prim.maxPos);
+    }
+    setNodeBounds(mNodes[nodeIndex], minPos, maxPos);
+    mNodes[nodeIndex].firstPrim = begin;
+
+    const uint32_t count = end - begin;
+    auto makeLeaf = [&]()
+    {
+        mNodes[nodeIndex].skip = nodeIndex + 1;
+        mStats.leaves++;
+    };
+    if (count == 1)
+    {
+        makeLeaf();
+        return;
+    }
+
+    // Split along the axis with the widest centroid spread
+    const glm::vec3 centroidExtent = centroidMax - centroidMin;
+    uint32_t axis = 0;
+    if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+    if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+    auto centroid = [axis](const BuildPrim& prim) { return prim.minPos[axis] + prim.maxPos[axis]; };
+
+    uint32_t mid = begin;
+    if (centroidExtent[axis] > 0.0f)
+    {
+        struct Bin
+        {
+            glm::vec3 minPos = glm::vec3(FLT_MAX);
+            glm::vec3 maxPos = glm::vec3(-FLT_MAX);
+            uint32_t count = 0;
+        };
+        Bin bins[kBinCount];
+
+        const float binScale = (float)kBinCount / centroidExtent[axis];
+        auto binIndex = [&](const BuildPrim& prim) { return std::min(kBinCount - 1, (uint32_t)((centroid(prim) - centroidMin[axis]) * binScale)); };
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const BuildPrim& prim = prims[i];
+            Bin& bin = bins[binIndex(prim)];
+            bin.minPos = glm::min(bin.minPos, prim.minPos);
+            bin.maxPos = glm::max(bin.maxPos, prim.maxPos);
+            bin.count++;
+        }
+
+        // Cost of every split between bins, with the right side swept in reverse
+        float rightCost[kBinCount];
+        Bin right;
+        for (uint32_t b = kBinCount - 1; b > 0; --b)
+        {
+            right.minPos = glm::min(right.minPos, bins[b].minPos);
+            right.maxPos = glm::max(right.maxPos, bins[b].maxPos);
+            right.count += bins[b].count;
+            rightCost[b] = right.count > 0 ? halfArea(right.minPos, right.maxPos) * right.count : 0.0f;
+        }
+
+        float bestCost = FLT_MAX;
+        uint32_t bestSplit = 0;
+        Bin left;
+        for (uint32_t b = 0; b + 1 < kBinCount; ++b)
+        {
+            left.minPos = glm::min(left.minPos, bins[b].minPos);
+            left.maxPos = glm::max(left.maxPos, bins[b].maxPos);
+            left.count += bins[b].count;
+            if (left.count == 0 || left.count == count) continue;
+
+            const float cost = halfArea(left.minPos, left.maxPos) * left.count + rightCost[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        const float area = halfArea(minPos, maxPos);
+        const float splitCost = area > 0.0f ? kTraversalCost + bestCost / area : kTraversalCost;
+        if (count <= kMaxLeafSize && splitCost >= (float)count)
+        {
+            makeLeaf();
+            return;
+        }
+
+        if (bestCost < FLT_MAX)
+        {
+            mid = (uint32_t)(std::partition(prims.begin() + begin, prims.begin() + end, [&](const BuildPrim& prim) { return binIndex(prim) <= bestSplit; }) - prims.begin());
+        }
+    }
+    else if (count <= kMaxLeafSize)
+    {
+        makeLeaf();
+        return;
+    }
+
+    // Coincident centroids or a bin that took everything: halve by position along the axis
+    if (mid == begin || mid == end)
+    {
+        mid = begin + count / 2;
+        std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end, [&](const BuildPrim& a, const BuildPrim& b) { return centroid(a) < centroid(b); });
+    }
+
+    buildNode(prims, begin, mid, depth + 1);
+    buildNode(prims, mid, end, depth + 1);
+    mNodes[nodeIndex].skip = (uint32_t)mNodes.size();
+}
+
+void InstanceBvh::setNodeBounds(Node& node, const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+    const glm::vec3 largest = glm::max(glm::abs(minPos), glm::abs(maxPos));
+    const float padding = kBoundsPadding * std::max(largest.x, std::max(largest.y, largest.z));
+    node.center = 0.5f * (minPos + maxPos);
+    node.extent = 0.5f * (maxPos - minPos) + glm::vec3(padding);
+}
+
+void InstanceBvh::setBounds(uint32_t drawIndex, const BoundingBox& box)
+{
+    mPrimBounds[mPrimSlots[drawIndex]] = { box.center, box.extent };
+    mDirty = true;
+}
+
+void InstanceBvh::refit()
+{
+    if (!mDirty) return;
+    auto start = CpuTimer::getCurrentTimePoint();
+
+    // Children follow their parent, so a reverse sweep sees them first
+    for (uint32_t nodeIndex = (uint32_t)mNodes.size(); nodeIndex-- > 0;)
+    {
+        glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+        if (isLeaf(nodeIndex))
+        {
+            for (uint32_t slot = mNodes[nodeIndex].firstPrim; slot < primEnd(nodeIndex); ++slot)
+            {
+                minPos = glm::min(minPos, mPrimBounds[slot].center - mPrimBounds[slot].extent);
+                maxPos = glm::max(maxPos, mPrimBounds[slot].center + mPrimBounds[slot].extent);
+            }
+        }
+        else
+        {
+            const Node& left = mNodes[nodeIndex + 1];
+            const Node& right = mNodes[left.skip];
+            minPos = glm::min(left.center - left.extent, right.center - right.extent);
+            maxPos = glm::max(left.center + left.extent, right.center + right.extent);
+        }
+        setNodeBounds(mNodes[nodeIndex], minPos, maxPos);
+    }
+
+    mDirty = false;
+    mStats.refitMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+}
+
+uint32_t InstanceBvh::queryFrustum(const Frustum& frustum, uint32_t* pDraws) const
+{
+    assert(!mDirty);
+    uint32_t drawCount = 0;
+    uint32_t nodeIndex = 0;
+    while (nodeIndex < (uint32_t)mNodes.size())
+    {
+        const Node& node = mNodes[nodeIndex];
+        const Overlap overlap = classifyBox(frustum, node.center, node.extent);
+        if (overlap == Overlap::Intersecting && !isLeaf(nodeIndex))
+        {
+            nodeIndex++;
+            continue;
+        }
+
+        if (overlap == Overlap::Inside)
+        {
+            for (uint32_t slot = node.firstPrim; slot < primEnd(nodeIndex); ++slot) pDraws[drawCount++] = mPrimDraws[slot];
+        }
+        else if (overlap == Overlap::Intersecting)
+        {
+            for (uint32_t slot = node.firstPrim; slot < primEnd(nodeIndex); ++slot)
+            {
+                BoundingBox box;
+                box.center = mPrimBounds[slot].center;
+                box.extent = mPrimBounds[slot].extent;
+                if (frustum.intersects(box)) pDraws[drawCount++] = mPrimDraws[slot];
+            }
+        }
+        nodeIndex = node.skip;
+    }
+    return drawCount;
+}
+
+uint32_t InstanceBvh::querySphere(const glm::vec3& center, float radius, uint32_t* pDraws) const
+{
+    assert(!mDirty);
+    uint32_t drawCount = 0;
+    uint32_t nodeIndex = 0;
+    while (nodeIndex < (uint32_t)mNodes.size())
+    {
+        const Node& node = mNodes[nodeIndex];
+        const Overlap overlap = classifyBox(center, radius, node.center, node.extent);
+        if (overlap == Overlap::Intersecting && !isLeaf(nodeIndex))
+        {
+            nodeIndex++;
+            continue;
+        }
+
+        if (overlap == Overlap::Inside)
+        {
+            for (uint32_t slot = node.firstPrim; slot < primEnd(nodeIndex); ++slot) pDraws[drawCount++] = mPrimDraws[slot];
+        }
+        else if (overlap == Overlap::Intersecting)
+        {
+            for (uint32_t slot = node.firstPrim; slot < primEnd(nodeIndex); ++slot)
+            {
+                if (intersectsSphere(mPrimBounds[slot].center, mPrimBounds[slot].extent, center, radius)) pDraws[drawCount++] = mPrimDraws[slot];
+            }
+        }
+        nodeIndex = node.skip;
+    }
+    return drawCount;
+}
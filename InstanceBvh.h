@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Falcor.h"
+#include "FrustumCuller.h"
+
+using namespace Falcor;
+
+// Bounding volume hierarchy over the world bounds of many draws, e.g. every mesh instance of the scene.
+// Built top-down with the binned surface area heuristic and stored depth first: a node's first child follows it and every node
+// links to the node after its subtree, so queries walk the array front to back without a stack. The primitives of a subtree are
+// contiguous, so subtrees entirely inside a query are emitted without testing their boxes.
+// Leaves test boxes exactly like FrustumCuller and node bounds are padded to stay conservative, so queries find the same draws as a flat loop.
+class InstanceBvh
+{
+public:
+    using SharedPtr = std::shared_ptr<InstanceBvh>;
+
+    // Leaves hold at most this many primitives, fewer when the heuristic finds a cheaper split
+    static const uint32_t kMaxLeafSize = 8;
+
+    struct Stats
+    {
+        uint32_t nodes = 0;
+        uint32_t leaves = 0;
+        uint32_t depth = 0;
+        double buildMs = 0;
+        double refitMs = 0;         // Of the last refit
+    };
+
+    static SharedPtr create();
+
+    // Builds the hierarchy over bounds[i] for draw index i
+    void build(const std::vector<BoundingBox>& bounds);
+
+    // Updates a draw's bounds. The node bounds are only updated by refit(), queries in between may miss the draw.
+    void setBounds(uint32_t drawIndex, const BoundingBox& box);
+
+    // Recomputes the node bounds bottom up after setBounds(). The topology stays, so quality degrades when draws move far.
+    // No-op if no bounds changed.
+    void refit();
+
+    // Write the indices of the draws whose boxes intersect the query and return how many there are. pDraws must hold getCount()
+    // entries. The draws come out in hierarchy order, not sorted.
+    uint32_t queryFrustum(const Frustum& frustum, uint32_t* pDraws) const;
+    uint32_t querySphere(const glm::vec3& center, float radius, uint32_t* pDraws) const;
+
+    // Reference sphere test used by the leaves, for flat loops that must match querySphere()
+    static bool intersectsSphere(const glm::vec3& boxCenter, const glm::vec3& boxExtent, const glm::vec3& center, float radius);
+
+    uint32_t getCount() const { return (uint32_t)mPrimDraws.size(); }
+    const Stats& getStats() const { return mStats; }
+
+private:
+    InstanceBvh() = default;
+
+    // 32 bytes, two per cache line
+    struct Node
+    {
+        glm::vec3 center;
+        uint32_t firstPrim;     // The subtree's primitives run up to the firstPrim of the skip node
+        glm::vec3 extent;
+        uint32_t skip;          // Next node after this subtree, this node + 1 for leaves
+    };
+
+    struct PrimBounds
+    {
+        glm::vec3 center;
+        glm::vec3 extent;
+    };
+
+    struct BuildPrim
+    {
+        glm::vec3 minPos;
+        uint32_t drawIndex;
+        glm::vec3 maxPos;
+    };
+
+    void buildNode(std::vector<BuildPrim>& prims, uint32_t begin, uint32_t end, uint32_t depth);
+    void setNodeBounds(Node& node, const glm::vec3& minPos, const glm::vec3& maxPos);
+    uint32_t primEnd(uint32_t nodeIndex) const { return mNodes[nodeIndex].skip < mNodes.size() ? mNodes[mNodes[nodeIndex].skip].firstPrim : getCount(); }
+    bool isLeaf(uint32_t nodeIndex) const { return mNodes[nodeIndex].skip == nodeIndex + 1; }
+
+    std::vector<Node> mNodes;
+    std::vector<PrimBounds> mPrimBounds;    // In hierarchy order
+    std::vector<uint32_t> mPrimDraws;       // Draw index per primitive slot
+    std::vector<uint32_t> mPrimSlots;       // Primitive slot per draw index
+    bool mDirty = false;
+    Stats mStats;
+};
@@ -0,0 +1,276 @@
+#include "LightClusters.h"
+#include "Simd.h"
+#include <cfloat>
+
+const float LightClusters::kMinIrradiance = 1.0f / 256.0f;
+
+namespace
+{
+    // Lights per setup task
+    const uint32_t kSetupGrainSize = 256;
+
+    static_assert(LightClusters::kClustersX % 8 == 0, "The AVX kernel tests rows in blocks of 8 clusters");
+    static_assert(LightClusters::kClustersX <= 32 && LightClusters::kClustersY <= 256 && LightClusters::kClustersZ <= 256, "Cluster masks and ranges are too narrow");
+
+    // Bit x is set when the light reaches the view-space box of cluster x of the row. Every kernel evaluates the same expressions.
+    uint32_t testRowScalar(const float* pMinX, const float* pMaxX, float x, float rowDistance2, float radius2, uint32_t x0, uint32_t x1)
+    {
+        uint32_t mask = 0;
+        for (uint32_t i = x0; i <= x1; ++i)
+        {
+            const float dx = std::max(std::max(pMinX[i] - x, x - pMaxX[i]), 0.0f);
+            if (dx * dx + rowDistance2 <= radius2) mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    SIMD_TARGET_AVX uint32_t testRowAVX(const float* pMinX, const float* pMaxX, float x, float rowDistance2, float radius2, uint32_t x0, uint32_t x1)
+    {
+        const __m256 lightX = _mm256_set1_ps(x);
+        const __m256 rowDist = _mm256_set1_ps(rowDistance2);
+        const __m256 r2 = _mm256_set1_ps(radius2);
+        const __m256 zero = _mm256_setzero_ps();
+
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < LightClusters::kClustersX; i += 8)
+        {
+            const __m256 minX = _mm256_loadu_ps(pMinX + i);
+            const __m256 maxX = _mm256_loadu_ps(pMaxX + i);
+            const __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(minX, lightX), _mm256_sub_ps(lightX, maxX)), zero);
+            const __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), rowDist), r2, _CMP_LE_OQ);
+            mask |= (uint32_t)_mm256_movemask_ps(inside) << i;
+        }
+        _mm256_zeroupper();
+
+        // Only the clusters the scalar kernel would visit
+        const uint32_t rangeMask = (x1 - x0 == 31 ? ~0u : ((1u << (x1 - x0 + 1)) - 1)) << x0;
+        return mask & rangeMask;
+    }
+
+    inline float distanceToRange(float value, float minValue, float maxValue)
+    {
+        return std::max(std::max(minValue - value, value - maxValue), 0.0f);
+    }
+
+    inline uint32_t clampCell(float value, uint32_t count)
+    {
+        return (uint32_t)glm::clamp(value, 0.0f, (float)(count - 1));
+    }
+}
+
+LightClusters::View LightClusters::View::fromCamera(const Camera* pCamera)
+{
+    View view;
+    view.viewMat = pCamera->getViewMatrix();
+    view.projMat = pCamera->getProjMatrix();
+    view.nearZ = pCamera->getNearPlane();
+    view.farZ = pCamera->getFarPlane();
+    return view;
+}
+
+LightClusters::SharedPtr LightClusters::create()
+{
+    return SharedPtr(new LightClusters());
+}
+
+float LightClusters::getInfluenceRadius(const glm::vec3& intensity)
+{
+    // Inverse square falloff
+    const float maxIntensity = std::max(std::max(intensity.x, intensity.y), intensity.z);
+    return std::sqrt(std::max(maxIntensity, 0.0f) / kMinIrradiance);
+}
+
+void LightClusters::build(const View& view, const std::vector<Light>& lights, ThreadPool* pPool, Kernel kernel)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    if (kernel == Kernel::Best) kernel = isKernelSupported(Kernel::AVX) ? Kernel::AVX : Kernel::Scalar;
+
+    mViewMat = view.viewMat;
+    mProjMat = view.projMat;
+    mNearZ = view.nearZ;
+    mSliceScale = kClustersZ / std::log(view.farZ / view.nearZ);
+
+    // A view-space point at depth d projects to ndc.x = projMat[0][0] * x / d - projMat[2][0], and likewise for y
+    for (uint32_t z = 0; z <= kClustersZ; ++z)
+    {
+        mSliceDepth[z] = z == kClustersZ ? view.farZ : view.nearZ * std::pow(view.farZ / view.nearZ, (float)z / kClustersZ);
+    }
+    auto tileExtent = [](float ndc0, float ndc1, float d0, float d1, float scale, float offset, float& minValue, float& maxValue)
+    {
+        const float a = d0 * (ndc0 + offset) / scale, b = d0 * (ndc1 + offset) / scale;
+        const float c = d1 * (ndc0 + offset) / scale, d = d1 * (ndc1 + offset) / scale;
+        minValue = std::min(std::min(a, b), std::min(c, d));
+        maxValue = std::max(std::max(a, b), std::max(c, d));
+    };
+    for (uint32_t z = 0; z < kClustersZ; ++z)
+    {
+        for (uint32_t x = 0; x < kClustersX; ++x)
+        {
+            tileExtent(-1.0f + 2.0f * x / kClustersX, -1.0f + 2.0f * (x + 1) / kClustersX, mSliceDepth[z], mSliceDepth[z + 1], mProjMat[0][0], mProjMat[2][0], mTileMinX[z][x], mTileMaxX[z][x]);
+        }
+        for (uint32_t y = 0; y < kClustersY; ++y)
+        {
+            tileExtent(-1.0f + 2.0f * y / kClustersY, -1.0f + 2.0f * (y + 1) / kClustersY, mSliceDepth[z], mSliceDepth[z + 1], mProjMat[1][1], mProjMat[2][1], mTileMinY[z][y], mTileMaxY[z][y]);
+        }
+    }
+
+    const uint32_t lightCount = (uint32_t)lights.size();
+    mBounds.resize(lightCount);
+    parallelFor(pPool, lightCount, kSetupGrainSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i) setupLight(lights[i], mBounds[i]);
+    });
+
+    // Each slice owns its clusters' lists, so slices bin without locks and lists stay in light order
+    parallelFor(pPool, kClustersZ, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t z = begin; z < end; ++z) binSlice(z, kernel);
+    });
+
+    mStats = {};
+    mStats.lights = lightCount;
+    mIndices.clear();
+    for (uint32_t cluster = 0; cluster < kClusterCount; ++cluster)
+    {
+        const auto& clusterLights = mClusterLights[cluster];
+        mRanges[cluster].offset = (uint32_t)mIndices.size();
+        mRanges[cluster].count = (uint32_t)clusterLights.size();
+        mIndices.insert(mIndices.end(), clusterLights.begin(), clusterLights.end());
+
+        mStats.occupiedClusters += clusterLights.empty() ? 0 : 1;
+        mStats.maxClusterLights = std::max(mStats.maxClusterLights, (uint32_t)clusterLights.size());
+    }
+    mStats.assignments = (uint32_t)mIndices.size();
+    for (const auto& bounds : mBounds) mStats.visibleLights += bounds.visible ? 1 : 0;
+    mStats.binMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+}
+
+void LightClusters::setupLight(const Light& light, LightBounds& bounds) const
+{
+    const glm::vec4 center = mViewMat * glm::vec4(light.position, 1.0f);
+    const float radius = light.radius;
+    bounds.x = center.x;
+    bounds.y = center.y;
+    bounds.depth = -center.z;
+    bounds.radius2 = radius * radius;
+    bounds.visible = false;
+
+    const float nearDepth = bounds.depth - radius;
+    const float farDepth = bounds.depth + radius;
+    if (farDepth < mSliceDepth[0] || nearDepth > mSliceDepth[kClustersZ]) return;
+
+    // Ranges are widened by a cluster against rounding, the per-cluster test is exact
+    const uint32_t minZ = clampCell(std::floor(std::log(std::max(nearDepth, mSliceDepth[0]) / mNearZ) * mSliceScale), kClustersZ);
+    const uint32_t maxZ = clampCell(std::floor(std::log(std::min(farDepth, mSliceDepth[kClustersZ]) / mNearZ) * mSliceScale), kClustersZ);
+    bounds.minZ = (uint8_t)(minZ > 0 ? minZ - 1 : 0);
+    bounds.maxZ = (uint8_t)std::min(maxZ + 1, kClustersZ - 1);
+
+    // Screen rectangle of the sphere's view-space box. A box reaching in front of the near plane can cover any tile.
+    bounds.minX = 0;
+    bounds.maxX = kClustersX - 1;
+    bounds.minY = 0;
+    bounds.maxY = kClustersY - 1;
+    if (nearDepth >= mNearZ)
+    {
+        float ndcMin[2] = { FLT_MAX, FLT_MAX }, ndcMax[2] = { -FLT_MAX, -FLT_MAX };
+        const float centers[2] = { bounds.x, bounds.y };
+        const float scales[2] = { mProjMat[0][0], mProjMat[1][1] };
+        const float offsets[2] = { mProjMat[2][0], mProjMat[2][1] };
+        for (uint32_t axis = 0; axis < 2; ++axis)
+        {
+            for (float side : { -radius, radius })
+            for (float depth : { nearDepth, farDepth })
+            {
+                const float ndc = scales[axis] * (centers[axis] + side) / depth - offsets[axis];
+                ndcMin[axis] = std::min(ndcMin[axis], ndc);
+                ndcMax[axis] = std::max(ndcMax[axis], ndc);
+            }
+            if (ndcMax[axis] < -1.0f || ndcMin[axis] > 1.0f) return;
+        }
+
+        const uint32_t minX = clampCell(std::floor((ndcMin[0] + 1.0f) * 0.5f * kClustersX), kClustersX);
+        const uint32_t maxX = clampCell(std::floor((ndcMax[0] + 1.0f) * 0.5f * kClustersX), kClustersX);
+        const uint32_t minY = clampCell(std::floor((ndcMin[1] + 1.0f) * 0.5f * kClustersY), kClustersY);
+        const uint32_t maxY = clampCell(std::floor((ndcMax[1] + 1.0f) * 0.5f * kClustersY), kClustersY);
+        bounds.minX = (uint8_t)(minX > 0 ? minX - 1 : 0);
+        bounds.maxX = (uint8_t)std::min(maxX + 1, kClustersX - 1);
+        bounds.minY = (uint8_t)(minY > 0 ? minY - 1 : 0);
+        bounds.maxY = (uint8_t)std::min(maxY + 1, kClustersY - 1);
+    }
+    bounds.visible = true;
+}
+
+void LightClusters::binSlice(uint32_t z, Kernel kernel)
+{
+    for (uint32_t cluster = getClusterIndex(0, 0, z); cluster < getClusterIndex(0, 0, z + 1); ++cluster)
+    {
+        mClusterLights[cluster].clear();
+    }
+
+    // The distance from the light to a cluster's box splits into the depth, row and column axes. Only the column varies along a row.
+    const uint32_t lightCount = (uint32_t)mBounds.size();
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        const LightBounds& bounds = mBounds[i];
+        if (!bounds.visible || z < bounds.minZ || z > bounds.maxZ) continue;
+
+        const float dz = distanceToRange(bounds.depth, mSliceDepth[z], mSliceDepth[z + 1]);
+        const float sliceDistance2 = dz * dz;
+        if (sliceDistance2 > bounds.radius2) continue;
+
+        for (uint32_t y = bounds.minY; y <= bounds.maxY; ++y)
+        {
+            const float dy = distanceToRange(bounds.y, mTileMinY[z][y], mTileMaxY[z][y]);
+            const float rowDistance2 = sliceDistance2 + dy * dy;
+            if (rowDistance2 > bounds.radius2) continue;
+
+            const uint32_t mask = kernel == Kernel::AVX ?
+                testRowAVX(mTileMinX[z], mTileMaxX[z], bounds.x, rowDistance2, bounds.radius2, bounds.minX, bounds.maxX) :
+                testRowScalar(mTileMinX[z], mTileMaxX[z], bounds.x, rowDistance2, bounds.radius2, bounds.minX, bounds.maxX);
+
+            std::vector<uint32_t>* pRow = &mClusterLights[getClusterIndex(0, y, z)];
+            for (uint32_t x = bounds.minX; x <= bounds.maxX; ++x)
+            {
+                if (mask & (1u << x)) pRow[x].push_back(i);
+            }
+        }
+    }
+}
+
+uint32_t LightClusters::findCluster(const glm::vec3& viewPos) const
+{
+    const float depth = -viewPos.z;
+    const float ndcX = mProjMat[0][0] * viewPos.x / depth - mProjMat[2][0];
+    const float ndcY = mProjMat[1][1] * viewPos.y / depth - mProjMat[2][1];
+    const uint32_t x = clampCell(std::floor((ndcX + 1.0f) * 0.5f * kClustersX), kClustersX);
+    const uint32_t y = clampCell(std::floor((ndcY + 1.0f) * 0.5f * kClustersY), kClustersY);
+    const uint32_t z = clampCell(std::floor(std::log(depth / mNearZ) * mSliceScale), kClustersZ);
+    return getClusterIndex(x, y, z);
+}
+
+BoundingBox LightClusters::getClusterBounds(uint32_t cluster) const
+{
+    const uint32_t x = cluster % kClustersX;
+    const uint32_t y = (cluster / kClustersX) % kClustersY;
+    const uint32_t z = cluster / (kClustersX * kClustersY);
+
+    // View space looks down -z
+    const glm::vec3 minPoint(mTileMinX[z][x], mTileMinY[z][y], -mSliceDepth[z + 1]);
+    const glm::vec3 maxPoint(mTileMaxX[z][x], mTileMaxY[z][y], -mSliceDepth[z]);
+    return BoundingBox::fromMinMax(minPoint, maxPoint);
+}
+
+bool LightClusters::isKernelSupported(Kernel kernel)
+{
+    return kernel == Kernel::AVX ? Simd::hasAVX() : true;
+}
+
+const char* LightClusters::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar: return "Scalar";
+    case Kernel::AVX: return "AVX";
+    default: return "Best";
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+
+using namespace Falcor;
+
+// Clustered light assignment: the view frustum is split into a grid of screen tiles and exponential depth slices, and every
+// cluster gets the list of point lights whose sphere of influence overlaps its view-space bounds. The pixel shader only
+// shades the lights of the cluster it falls into, see Data/LightClusters.slang.
+// Binning is conservative: a light reaching any point of a cluster is in the cluster's list. Lists keep the input order.
+class LightClusters
+{
+public:
+    using SharedPtr = std::shared_ptr<LightClusters>;
+
+    static const uint32_t kClustersX = 16;
+    static const uint32_t kClustersY = 8;
+    static const uint32_t kClustersZ = 24;
+    static const uint32_t kClusterCount = kClustersX * kClustersY * kClustersZ;
+
+    // Lights are cut off where their irradiance drops below this
+    static const float kMinIrradiance;
+
+    enum class Kernel
+    {
+        Scalar,     // Reference implementation
+        AVX,        // 8 clusters of a row per iteration
+        Best,       // Widest kernel supported by the CPU
+    };
+
+    struct Light
+    {
+        glm::vec3 position;     // World space
+        float radius;
+    };
+
+    // Perspective projections only. Depth slices span [nearZ, farZ], nothing is drawn outside of it.
+    struct View
+    {
+        glm::mat4 viewMat;
+        glm::mat4 projMat;
+        float nearZ;
+        float farZ;
+
+        static View fromCamera(const Camera* pCamera);
+    };
+
+    struct Stats
+    {
+        uint32_t lights = 0;
+        uint32_t visibleLights = 0;         // Overlapping at least one cluster
+        uint32_t assignments = 0;           // Entries of all cluster lists
+        uint32_t occupiedClusters = 0;
+        uint32_t maxClusterLights = 0;
+        double binMs = 0;
+    };
+
+    // Offset into the light index list and light count of a cluster
+    struct ClusterRange
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    static SharedPtr create();
+
+    // Distance at which a point light of this intensity falls below kMinIrradiance
+    static float getInfluenceRadius(const glm::vec3& intensity);
+
+    // Bins the lights into the clusters of the view. Lights are split across threads for the setup and depth slices for the
+    // binning, the result is identical for every kernel and thread count.
+    void build(const View& view, const std::vector<Light>& lights, ThreadPool* pPool = nullptr, Kernel kernel = Kernel::Best);
+
+    static uint32_t getClusterIndex(uint32_t x, uint32_t y, uint32_t z) { return (z * kClustersY + y) * kClustersX + x; }
+
+    // Cluster of a view-space point in front of the camera, the same one the shader picks for a pixel at that point
+    uint32_t findCluster(const glm::vec3& viewPos) const;
+
+    // View-space bounds of a cluster
+    BoundingBox getClusterBounds(uint32_t cluster) const;
+
+    // Valid after build(). The lists of all clusters are packed into one index array.
+    const std::vector<ClusterRange>& getClusterRanges() const { return mRanges; }
+    const std::vector<uint32_t>& getLightIndices() const { return mIndices; }
+    const Stats& getStats() const { return mStats; }
+
+    // Depth slicing of the last build(), the shader picks slices with the same constants
+    float getNearZ() const { return mNearZ; }
+    float getSliceScale() const { return mSliceScale; }    // Slices per unit of log(depth / nearZ)
+
+    static bool isKernelSupported(Kernel kernel);
+    static const char* getKernelName(Kernel kernel);
+
+private:
+    LightClusters() = default;
+
+    // View-space sphere and the inclusive cluster range it can touch
+    struct LightBounds
+    {
+        float x, y, depth, radius2;
+        uint8_t minX, maxX, minY, maxY, minZ, maxZ;
+        bool visible;
+    };
+
+    void setupLight(const Light& light, LightBounds& bounds) const;
+    void binSlice(uint32_t z, Kernel kernel);
+
+    glm::mat4 mViewMat;
+    glm::mat4 mProjMat;
+    float mNearZ = 0;
+    float mSliceScale = 0;
+
+    // View-space bounds of the tiles per depth slice, a tile widens with depth so both ends of the slice are covered
+    float mSliceDepth[kClustersZ + 1];
+    float mTileMinX[kClustersZ][kClustersX];
+    float mTileMaxX[kClustersZ][kClustersX];
+    float mTileMinY[kClustersZ][kClustersY];
+    float mTileMaxY[kClustersZ][kClustersY];
+
+    std::vector<LightBounds> mBounds;
+    std::vector<std::vector<uint32_t>> mClusterLights = std::vector<std::vector<uint32_t>>(kClusterCount);
+    std::vector<ClusterRange> mRanges = std::vector<ClusterRange>(kClusterCount);
+    std::vector<uint32_t> mIndices;
+    Stats mStats;
+};
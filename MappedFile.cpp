@@ -0,0 +1,56 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::SharedPtr MappedFile::open(const std::string& path)
+{
+    SharedPtr pFile = SharedPtr(new MappedFile());
+
+#ifdef _WIN32
+    pFile->mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (pFile->mFile == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(pFile->mFile, &size) || size.QuadPart == 0) return nullptr;
+    pFile->mSize = (size_t)size.QuadPart;
+
+    pFile->mMapping = CreateFileMappingA(pFile->mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (pFile->mMapping == nullptr) return nullptr;
+
+    pFile->mpData = (const uint8_t*)MapViewOfFile(pFile->mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (pFile->mpData == nullptr) return nullptr;
+#else
+    pFile->mFile = ::open(path.c_str(), O_RDONLY);
+    if (pFile->mFile < 0) return nullptr;
+
+    struct stat info;
+    if (fstat(pFile->mFile, &info) != 0 || info.st_size == 0) return nullptr;
+    pFile->mSize = (size_t)info.st_size;
+
+    void* pData = mmap(nullptr, pFile->mSize, PROT_READ, MAP_PRIVATE, pFile->mFile, 0);
+    if (pData == MAP_FAILED) return nullptr;
+    pFile->mpData = (const uint8_t*)pData;
+
+    // The data is read front to back once, when it's uploaded
+    madvise(pData, pFile->mSize, MADV_SEQUENTIAL);
+#endif
+
+    return pFile;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (mpData) UnmapViewOfFile(mpData);
+    if (mMapping) CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+#else
+    if (mpData) munmap((void*)mpData, mSize);
+    if (mFile >= 0) close(mFile);
+#endif
+}
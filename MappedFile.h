@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Read-only memory mapping of a whole file. The data stays valid until the object is destroyed.
+class MappedFile
+{
+public:
+    using SharedPtr = std::shared_ptr<MappedFile>;
+
+    // Returns nullptr if the file doesn't exist, is empty or can't be mapped
+    static SharedPtr open(const std::string& path);
+    ~MappedFile();
+
+    const uint8_t* getData() const { return mpData; }
+    size_t getSize() const { return mSize; }
+
+private:
+    MappedFile() = default;
+
+    const uint8_t* mpData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN32
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+#else
+    int mFile = -1;
+#endif
+};
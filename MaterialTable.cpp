@@ -0,0 +1,83 @@
+#include "MaterialTable.h"
+
+MaterialTable::SharedPtr MaterialTable::create()
+{
+    return SharedPtr(new MaterialTable());
+}
+
+MaterialTable::MaterialTable()
+{
+    mpTextureTable = DescriptorTable::create("gBindlessTextures", kMaxTextures);
+    mpTextureTable->add(nullptr); // kNullTexture
+    mTextureLookup[nullptr] = kNullTexture;
+}
+
+uint32_t MaterialTable::addTexture(const Texture::SharedPtr& pTexture)
+{
+    auto it = mTextureLookup.find(pTexture.get());
+    if (it != mTextureLookup.end()) return it->second;
+
+    uint32_t slot = mpTextureTable->add(pTexture);
+    if (slot == DescriptorTable::kInvalidSlot)
+    {
+        // Warned once here, the total is reported with the material buffer
+        if (mDroppedTextureCount++ == 0)
+        {
+            logWarning("Bindless texture table is full at " + std::to_string(kMaxTextures) + " textures, further textures are sampled as null. Raise MAX_BINDLESS_TEXTURES and kMaxTextures.");
+        }
+        slot = kNullTexture;
+    }
+    mTextureLookup[pTexture.get()] = slot;
+    return slot;
+}
+
+uint32_t MaterialTable::addMaterial(const Material::SharedPtr& pMaterial)
+{
+    auto it = mMaterialLookup.find(pMaterial.get());
+    if (it != mMaterialLookup.end()) return it->second;
+
+    BindlessMaterialData data = {};
+    data.baseColor = pMaterial->getBaseColor();
+    data.specular = pMaterial->getSpecularParams();
+    data.emissive = pMaterial->getEmissiveColor();
+    data.alphaThreshold = pMaterial->getAlphaThreshold();
+    data.heightScaleOffset = pMaterial->getHeightScaleOffset();
+    data.IoR = pMaterial->getIndexOfRefraction();
+    data.flags = pMaterial->getFlags();
+    data.baseColorTexture = addTexture(pMaterial->getBaseColorTexture());
+    data.specularTexture = addTexture(pMaterial->getSpecularTexture());
+    data.emissiveTexture = addTexture(pMaterial->getEmissiveTexture());
+    data.normalMapTexture = addTexture(pMaterial->getNormalMap());
+
+    // Different material objects with the same constants and textures are interchangeable in the bindless shader
+    std::string key((const char*)&data, sizeof(data));
+    auto dataIt = mMaterialDataLookup.find(key);
+    uint32_t materialID;
+    if (dataIt != mMaterialDataLookup.end())
+    {
+        materialID = dataIt->second;
+        mDeduplicatedMaterialCount++;
+    }
+    else
+    {
+        materialID = (uint32_t)mMaterialData.size();
+        mMaterialData.push_back(data);
+        mMaterialDataLookup.emplace(std::move(key), materialID);
+    }
+
+    mMaterialLookup[pMaterial.get()] = materialID;
+    return materialID;
+}
+
+void MaterialTable::createMaterialBuffer(const GraphicsProgram::SharedPtr& pProgram)
+{
+    if (mMaterialData.empty()) return;
+
+    if (mDroppedTextureCount > 0)
+    {
+        logWarning("Bindless texture table is full, " + std::to_string(mDroppedTextureCount) + " textures beyond the first " + std::to_string(kMaxTextures) + " are sampled as null");
+    }
+
+    mMaterialBuffer = StructuredBuffer::create(pProgram, "gBindlessMaterials", mMaterialData.size());
+    mMaterialBuffer->setBlob(mMaterialData.data(), 0, sizeof(BindlessMaterialData) * mMaterialData.size());
+}
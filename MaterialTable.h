@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Falcor.h"
+#include "DescriptorTable.h"
+
+using namespace Falcor;
+
+// CPU mirror of BindlessMaterialData in BindlessMaterial.slang
+struct BindlessMaterialData
+{
+    glm::vec4 baseColor;
+    glm::vec4 specular;
+    glm::vec3 emissive;
+    float alphaThreshold;
+    glm::vec2 heightScaleOffset;
+    float IoR;
+    uint32_t flags;
+    uint32_t baseColorTexture;      // Indices into the bindless texture table
+    uint32_t specularTexture;
+    uint32_t emissiveTexture;
+    uint32_t normalMapTexture;
+};
+
+// Compact tables of the unique materials and textures referenced by a draw list.
+// Materials with identical constants and textures share one entry, so the bindless descriptor count scales with unique textures instead of draws.
+class MaterialTable
+{
+public:
+    using SharedPtr = std::shared_ptr<MaterialTable>;
+
+    // Texture slot bound to null, used by materials that don't have a texture in a channel
+    static const uint32_t kNullTexture = 0;
+
+    // Size of gBindlessTextures, must match MAX_BINDLESS_TEXTURES in BindlessMaterial.slang. Falcor binds the whole array every time
+    // the descriptor set is rebuilt, so raising it costs descriptors for every vars object even when few slots are used.
+    static const uint32_t kMaxTextures = 4096;
+
+    static SharedPtr create();
+
+    // Returns the materialID of the unique entry matching the material
+    uint32_t addMaterial(const Material::SharedPtr& pMaterial);
+
+    // Uploads the material constants into the program's gBindlessMaterials. Must be called after all materials were added.
+    void createMaterialBuffer(const GraphicsProgram::SharedPtr& pProgram);
+
+    uint32_t getMaterialCount() const { return (uint32_t)mMaterialData.size(); }
+    uint32_t getTextureCount() const { return mpTextureTable->getUsedSlotCount(); }
+    uint32_t getDeduplicatedMaterialCount() const { return mDeduplicatedMaterialCount; }
+    const std::vector<BindlessMaterialData>& getMaterialData() const { return mMaterialData; }
+    const DescriptorTable::SharedPtr& getTextureTable() const { return mpTextureTable; }
+    uint32_t getDroppedTextureCount() const { return mDroppedTextureCount; }     // Textures that didn't fit, sampled as null
+    const StructuredBuffer::SharedPtr& getMaterialBuffer() const { return mMaterialBuffer; }
+
+private:
+    MaterialTable();
+    uint32_t addTexture(const Texture::SharedPtr& pTexture);
+
+    std::vector<BindlessMaterialData> mMaterialData;            // Indexed by materialID
+    DescriptorTable::SharedPtr mpTextureTable;                  // Bound to gBindlessTextures
+    std::unordered_map<const Material*, uint32_t> mMaterialLookup;
+    std::unordered_map<std::string, uint32_t> mMaterialDataLookup;  // Raw BindlessMaterialData bytes to materialID
+    std::unordered_map<const Texture*, uint32_t> mTextureLookup;
+    uint32_t mDeduplicatedMaterialCount = 0;                    // Distinct Material objects folded into an existing entry
+    uint32_t mDroppedTextureCount = 0;
+
+    StructuredBuffer::SharedPtr mMaterialBuffer;
+};
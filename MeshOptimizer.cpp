@@ -0,0 +1,533 @@
+#include "MeshOptimizer.h"
+
+namespace
+{
+    const uint32_t kInvalidIndex = ~0u;
+
+    // Forsyth's scoring parameters. The scoring cache is larger than the simulated hardware cache on purpose.
+    const uint32_t kScoreCacheSize = 32;
+    const uint32_t kMaxValenceScored = 64;
+    const float kCacheDecayPower = 1.5f;
+    const float kLastTriangleScore = 0.75f;
+    const float kValenceBoostScale = 2.0f;
+    const float kValenceBoostPower = 0.5f;
+
+    // Cache size used to find the overdraw cluster boundaries
+    const uint32_t kOverdrawCacheSize = 16;
+
+    struct ScoreTables
+    {
+        float cache[kScoreCacheSize];
+        float valence[kMaxValenceScored];
+
+        ScoreTables()
+        {
+            for (uint32_t i = 0; i < kScoreCacheSize; ++i)
+            {
+                // The last triangle's vertices get a fixed, lower score so that the next triangle doesn't just reuse its edge
+                cache[i] = i < 3 ? kLastTriangleScore : std::pow(1.0f - (float)(i - 3) / (kScoreCacheSize - 3), kCacheDecayPower);
+            }
+            valence[0] = 0;
+            for (uint32_t i = 1; i < kMaxValenceScored; ++i)
+            {
+                // Boost vertices with few triangles left, so that they get finished off
+                valence[i] = kValenceBoostScale * std::pow((float)i, -kValenceBoostPower);
+            }
+        }
+
+        float score(int32_t cachePosition, uint32_t remainingTriangles) const
+        {
+            if (remainingTriangles == 0) return -1.0f;
+            const float cacheScore = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+            return cacheScore + valence[std::min(remainingTriangles, kMaxValenceScored - 1)];
+        }
+    };
+
+    // FIFO cache hit test using insertion timestamps: a vertex is cached if it was inserted within the last cacheSize misses
+    class FifoCache
+    {
+    public:
+        FifoCache(uint32_t vertexCount, uint32_t cacheSize) : mTimestamps(vertexCount, 0), mTime(cacheSize + 1), mCacheSize(cacheSize) {}
+
+        // Returns true on a miss
+        bool access(uint32_t vertex)
+        {
+            if (mTime - mTimestamps[vertex] <= mCacheSize) return false;
+            mTimestamps[vertex] = mTime++;
+            return true;
+        }
+
+    private:
+        std::vector<uint32_t> mTimestamps;
+        uint32_t mTime;
+        uint32_t mCacheSize;
+    };
+
+    // Weighted sum of squared distances to a set of planes, as the 10 unique coefficients of a symmetric 4x4 matrix
+    struct Quadric
+    {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double weight = 0;
+
+        // Plane n.p + d = 0 with unit normal n
+        static Quadric fromPlane(const glm::vec3& n, float d, float weight)
+        {
+            Quadric q;
+            q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+            q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+            q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+            q.c = weight * d * d;
+            q.weight = weight;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+            return *this;
+        }
+
+        // Weighted mean squared distance, so that the square root is a distance
+        double evaluate(const glm::vec3& p) const
+        {
+            if (weight == 0) return 0;
+            const double x = p.x, y = p.y, z = p.z;
+            const double value = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z) + 2 * (b0 * x + b1 * y + b2 * z) + c;
+            return value > 0 ? value / weight : 0;
+        }
+    };
+
+    // Vertex onto neighbor collapse, ordered by error and then by vertex so that the order is deterministic
+    struct Collapse
+    {
+        double error;
+        uint32_t vertex;
+        uint32_t target;
+
+        bool operator<(const Collapse& other) const
+        {
+            if (error != other.error) return error < other.error;
+            if (vertex != other.vertex) return vertex < other.vertex;
+            return target < other.target;
+        }
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return ((uint64_t)a << 32) | b;
+    }
+}
+
+namespace MeshOptimizer
+{
+    CacheStats analyzeVertexCache(const uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+    {
+        CacheStats stats;
+        stats.triangleCount = indexCount / 3;
+
+        FifoCache cache(vertexCount, cacheSize);
+        std::vector<bool> referenced(vertexCount, false);
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            const uint32_t vertex = pIndices[i];
+            if (cache.access(vertex)) stats.transformCount++;
+            if (!referenced[vertex])
+            {
+                referenced[vertex] = true;
+                stats.vertexCount++;
+            }
+        }
+        return stats;
+    }
+
+    void optimizeVertexCache(uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount)
+    {
+        const uint32_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) return;
+
+        static const ScoreTables kScores;
+
+        // Vertex to triangle adjacency. The first remaining[v] entries of a vertex's list are the triangles not yet emitted.
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; ++i) remaining[pIndices[i]]++;
+
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (uint32_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            for (uint32_t k = 0; k < 3; ++k) adjacency[fill[pIndices[t * 3 + k]]++] = t;
+        }
+
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v) vertexScores[v] = kScores.score(-1, remaining[v]);
+
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        uint32_t bestTriangle = 0;
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            triangleScores[t] = vertexScores[pIndices[t * 3]] + vertexScores[pIndices[t * 3 + 1]] + vertexScores[pIndices[t * 3 + 2]];
+            if (triangleScores[t] > triangleScores[bestTriangle]) bestTriangle = t;
+        }
+
+        // Rescores a vertex and propagates the change to its remaining triangles
+        auto rescore = [&](uint32_t vertex)
+        {
+            const float score = kScores.score(cachePositions[vertex], remaining[vertex]);
+            const float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            for (uint32_t i = 0; i < remaining[vertex]; ++i) triangleScores[adjacency[adjacencyOffsets[vertex] + i]] += delta;
+        };
+
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+        uint32_t cache[kScoreCacheSize + 3];
+        uint32_t newCache[kScoreCacheSize + 3];
+        uint32_t cacheCount = 0;
+        uint32_t scanCursor = 0;
+
+        for (uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            // Nothing in the cache has triangles left: continue with the next triangle in input order
+            if (bestTriangle == kInvalidIndex)
+            {
+                while (emitted[scanCursor]) scanCursor++;
+                bestTriangle = scanCursor;
+            }
+
+            const uint32_t* pTriangle = pIndices + bestTriangle * 3;
+            emitted[bestTriangle] = true;
+            output.insert(output.end(), pTriangle, pTriangle + 3);
+
+            // Triangle's vertices go to the front, followed by the previous entries that aren't part of it
+            uint32_t newCount = 0;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                const uint32_t vertex = pTriangle[k];
+
+                uint32_t* pBegin = &adjacency[adjacencyOffsets[vertex]];
+                uint32_t* pEnd = pBegin + remaining[vertex];
+                uint32_t* pFound = std::find(pBegin, pEnd, bestTriangle);
+                if (pFound != pEnd)
+                {
+                    std::swap(*pFound, *(pEnd - 1));
+                    remaining[vertex]--;
+                }
+
+                if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount) newCache[newCount++] = vertex;
+            }
+            for (uint32_t i = 0; i < cacheCount; ++i)
+            {
+                const uint32_t vertex = cache[i];
+                if (vertex != pTriangle[0] && vertex != pTriangle[1] && vertex != pTriangle[2]) newCache[newCount++] = vertex;
+            }
+
+            // Entries pushed out of the cache
+            for (uint32_t i = kScoreCacheSize; i < newCount; ++i)
+            {
+                cachePositions[newCache[i]] = -1;
+                rescore(newCache[i]);
+            }
+
+            cacheCount = std::min(newCount, kScoreCacheSize);
+            for (uint32_t i = 0; i < cacheCount; ++i)
+            {
+                cache[i] = newCache[i];
+                cachePositions[cache[i]] = (int32_t)i;
+                rescore(cache[i]);
+            }
+
+            // Best remaining triangle touching the cache, first one wins ties
+            bestTriangle = kInvalidIndex;
+            float bestScore = -1.0f;
+            for (uint32_t i = 0; i < cacheCount; ++i)
+            {
+                const uint32_t vertex = cache[i];
+                for (uint32_t j = 0; j < remaining[vertex]; ++j)
+                {
+                    const uint32_t triangle = adjacency[adjacencyOffsets[vertex] + j];
+                    if (triangleScores[triangle] > bestScore)
+                    {
+                        bestScore = triangleScores[triangle];
+                        bestTriangle = triangle;
+                    }
+                }
+            }
+        }
+
+        memcpy(pIndices, output.data(), output.size() * sizeof(uint32_t));
+    }
+
+    void optimizeOverdraw(uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions, uint32_t positionStride, uint32_t vertexCount)
+    {
+        const uint32_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) return;
+
+        auto position = [&](uint32_t vertex)
+        {
+            const float* p = (const float*)(pPositions + (size_t)vertex * positionStride);
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        // A triangle missing the cache with all three vertices starts a new cluster, so moving clusters around costs little
+        std::vector<uint32_t> clusterStarts;
+        FifoCache cache(vertexCount, kOverdrawCacheSize);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t misses = 0;
+            for (uint32_t k = 0; k < 3; ++k) misses += cache.access(pIndices[t * 3 + k]) ? 1 : 0;
+            if (t == 0 || misses == 3) clusterStarts.push_back(t);
+        }
+        if (clusterStarts.size() < 2) return;
+        clusterStarts.push_back(triangleCount);
+
+        struct Cluster
+        {
+            uint32_t firstTriangle;
+            uint32_t triangleCount;
+            glm::vec3 centroid;     // Area weighted
+            glm::vec3 normal;       // Sum of area weighted triangle normals
+            float sortKey;
+        };
+
+        std::vector<Cluster> clusters(clusterStarts.size() - 1);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0;
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            Cluster& cluster = clusters[c];
+            cluster.firstTriangle = clusterStarts[c];
+            cluster.triangleCount = clusterStarts[c + 1] - clusterStarts[c];
+            cluster.centroid = glm::vec3(0.0f);
+            cluster.normal = glm::vec3(0.0f);
+
+            float area = 0;
+            for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+            {
+                const glm::vec3 p0 = position(pIndices[t * 3]);
+                const glm::vec3 p1 = position(pIndices[t * 3 + 1]);
+                const glm::vec3 p2 = position(pIndices[t * 3 + 2]);
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const float triangleArea = glm::length(normal);
+
+                cluster.normal += normal;
+                cluster.centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                area += triangleArea;
+            }
+
+            meshCentroid += cluster.centroid;
+            meshArea += area;
+            if (area > 0) cluster.centroid = cluster.centroid / area;
+        }
+        if (meshArea > 0) meshCentroid = meshCentroid / meshArea;
+
+        // Clusters facing away from the center are likely on the outside and occlude the rest
+        for (auto& cluster : clusters)
+        {
+            const float normalLength = glm::length(cluster.normal);
+            cluster.sortKey = normalLength > 0 ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / normalLength) : 0.0f;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+        for (const auto& cluster : clusters)
+        {
+            output.insert(output.end(), pIndices + cluster.firstTriangle * 3, pIndices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+        }
+        memcpy(pIndices, output.data(), output.size() * sizeof(uint32_t));
+    }
+
+    void optimizeVertexFetch(uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount, std::vector<uint32_t>& remap)
+    {
+        remap.assign(vertexCount, kInvalidIndex);
+
+        uint32_t nextVertex = 0;
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            uint32_t& vertex = pIndices[i];
+            if (remap[vertex] == kInvalidIndex) remap[vertex] = nextVertex++;
+            vertex = remap[vertex];
+        }
+
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            if (remap[v] == kInvalidIndex) remap[v] = nextVertex++;
+        }
+    }
+
+    float simplify(const uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions, uint32_t positionStride, uint32_t vertexCount,
+        uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+    {
+        result.assign(pIndices, pIndices + indexCount);
+        if (indexCount <= targetIndexCount || indexCount < 3) return 0;
+
+        auto position = [&](uint32_t vertex)
+        {
+            const float* p = (const float*)(pPositions + (size_t)vertex * positionStride);
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        // Vertices that only differ in their attributes share a position. The topology is built on the first vertex of each position.
+        std::vector<uint32_t> sorted(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v) sorted[v] = v;
+        std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b)
+        {
+            const int order = memcmp(pPositions + (size_t)a * positionStride, pPositions + (size_t)b * positionStride, sizeof(glm::vec3));
+            return order != 0 ? order < 0 : a < b;
+        });
+
+        std::vector<uint32_t> welded(vertexCount);
+        std::vector<bool> locked(vertexCount, false);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            const bool samePosition = i > 0 && memcmp(pPositions + (size_t)sorted[i] * positionStride, pPositions + (size_t)sorted[i - 1] * positionStride, sizeof(glm::vec3)) == 0;
+            welded[sorted[i]] = samePosition ? welded[sorted[i - 1]] : sorted[i];
+
+            // Moving one side of a seam would tear it open
+            if (samePosition) locked[welded[sorted[i]]] = true;
+        }
+
+        // Welded edges without a twin are on a border
+        std::unordered_map<uint64_t, uint32_t> edges;
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            for (uint32_t k = 0; k < 3; ++k) edges[edgeKey(welded[result[i + k]], welded[result[i + (k + 1) % 3]])]++;
+        }
+        for (const auto& edge : edges)
+        {
+            if (edges.find(edgeKey((uint32_t)edge.first, (uint32_t)(edge.first >> 32))) == edges.end())
+            {
+                locked[(uint32_t)(edge.first >> 32)] = true;
+                locked[(uint32_t)edge.first] = true;
+            }
+        }
+
+        // Area weighted planes of the triangles around each welded vertex
+        std::vector<Quadric> quadrics(vertexCount);
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            const glm::vec3 p0 = position(result[i]), p1 = position(result[i + 1]), p2 = position(result[i + 2]);
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+            if (area == 0) continue;
+
+            const glm::vec3 n = normal / area;
+            const Quadric q = Quadric::fromPlane(n, -glm::dot(n, p0), area);
+            for (uint32_t k = 0; k < 3; ++k) quadrics[welded[result[i + k]]] += q;
+        }
+
+        const double maxErrorSquared = (double)maxError * maxError;
+        double largestError = 0;
+        uint32_t triangleCount = indexCount / 3;
+        const uint32_t targetTriangleCount = targetIndexCount / 3;
+
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+
+        // Each pass collapses the cheapest edges whose neighborhoods don't overlap, then rebuilds the triangles
+        while (triangleCount > targetTriangleCount)
+        {
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (uint32_t index : result) adjacencyOffsets[index + 1]++;
+            for (uint32_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+            adjacency.resize(result.size());
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (uint32_t i = 0; i < (uint32_t)result.size(); ++i) adjacency[fill[result[i]]++] = i / 3;
+
+            collapses.clear();
+            for (uint32_t i = 0; i < (uint32_t)result.size(); i += 3)
+            {
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const uint32_t vertex = result[i + k];
+                    if (locked[welded[vertex]]) continue;
+                    for (uint32_t target : { result[i + (k + 1) % 3], result[i + (k + 2) % 3] })
+                    {
+                        const double error = quadrics[welded[vertex]].evaluate(position(target));
+                        if (error <= maxErrorSquared) collapses.push_back({ error, vertex, target });
+                    }
+                }
+            }
+            if (collapses.empty()) break;
+            std::sort(collapses.begin(), collapses.end());
+
+            for (uint32_t v = 0; v < vertexCount; ++v) remap[v] = v;
+            std::fill(touched.begin(), touched.end(), false);
+
+            uint32_t collapsedTriangles = 0;
+            for (const Collapse& collapse : collapses)
+            {
+                if (triangleCount - collapsedTriangles <= targetTriangleCount) break;
+                if (touched[collapse.vertex] || touched[collapse.target]) continue;
+
+                // Reject collapses that flip or fold one of the triangles that stay, turning its normal by more than ~75 degrees
+                const glm::vec3 newPosition = position(collapse.target);
+                bool flips = false;
+                uint32_t removed = 0;
+                for (uint32_t a = adjacencyOffsets[collapse.vertex]; a < adjacencyOffsets[collapse.vertex + 1] && !flips; ++a)
+                {
+                    const uint32_t* pTriangle = &result[adjacency[a] * 3];
+                    if (pTriangle[0] == collapse.target || pTriangle[1] == collapse.target || pTriangle[2] == collapse.target)
+                    {
+                        removed++;
+                        continue;
+                    }
+
+                    glm::vec3 p[3], q[3];
+                    for (uint32_t k = 0; k < 3; ++k)
+                    {
+                        p[k] = position(pTriangle[k]);
+                        q[k] = pTriangle[k] == collapse.vertex ? newPosition : p[k];
+                    }
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+                }
+                if (flips) continue;
+
+                remap[collapse.vertex] = collapse.target;
+                quadrics[welded[collapse.target]] += quadrics[welded[collapse.vertex]];
+                largestError = std::max(largestError, collapse.error);
+                collapsedTriangles += removed;
+
+                // The neighborhood changed, later collapses in this pass would test against stale triangles
+                for (uint32_t a = adjacencyOffsets[collapse.vertex]; a < adjacencyOffsets[collapse.vertex + 1]; ++a)
+                {
+                    for (uint32_t k = 0; k < 3; ++k) touched[result[adjacency[a] * 3 + k]] = true;
+                }
+            }
+
+            // Drop triangles that collapsed to a line, also across seams where two vertices share a position
+            uint32_t writeIndex = 0;
+            for (uint32_t i = 0; i < (uint32_t)result.size(); i += 3)
+            {
+                const uint32_t v0 = remap[result[i]], v1 = remap[result[i + 1]], v2 = remap[result[i + 2]];
+                if (welded[v0] == welded[v1] || welded[v1] == welded[v2] || welded[v0] == welded[v2]) continue;
+                result[writeIndex++] = v0;
+                result[writeIndex++] = v1;
+                result[writeIndex++] = v2;
+            }
+
+            const uint32_t newTriangleCount = writeIndex / 3;
+            result.resize(writeIndex);
+            if (newTriangleCount == triangleCount) break;
+            triangleCount = newTriangleCount;
+        }
+
+        return (float)std::sqrt(largestError);
+    }
+}
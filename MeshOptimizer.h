@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Index and vertex reordering of triangle lists for the GPU's post-transform cache, overdraw and vertex fetch.
+// All functions are deterministic: the same input always produces bit-identical output.
+namespace MeshOptimizer
+{
+    struct CacheStats
+    {
+        uint32_t triangleCount = 0;
+        uint32_t vertexCount = 0;       // Referenced vertices
+        uint32_t transformCount = 0;    // Cache misses of the simulated FIFO cache
+
+        float getACMR() const { return triangleCount > 0 ? (float)transformCount / triangleCount : 0; }  // Average cache miss ratio, transforms per triangle
+        float getATVR() const { return vertexCount > 0 ? (float)transformCount / vertexCount : 0; }      // Average transform to vertex ratio, 1 is optimal
+
+        CacheStats& operator+=(const CacheStats& other)
+        {
+            triangleCount += other.triangleCount;
+            vertexCount += other.vertexCount;
+            transformCount += other.transformCount;
+            return *this;
+        }
+    };
+
+    // Simulates a FIFO post-transform cache of the given size
+    CacheStats analyzeVertexCache(const uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+    // Reorders triangles for post-transform cache locality (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+    void optimizeVertexCache(uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount);
+
+    // Splits cache-optimized triangles into clusters at points where the cache starts over and orders the clusters
+    // outward-facing first, so that outer surfaces tend to be drawn before the surfaces they occlude. The cache
+    // behavior within clusters is preserved. Positions are float3 at the given byte stride.
+    void optimizeOverdraw(uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions, uint32_t positionStride, uint32_t vertexCount);
+
+    // Builds a vertex remap in order of first use by the indices and rewrites the indices with it.
+    // remap[oldVertex] = newVertex. Unreferenced vertices move to the end, keeping their relative order.
+    void optimizeVertexFetch(uint32_t* pIndices, uint32_t indexCount, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+    // Simplifies a triangle list to at most targetIndexCount indices, or as close as maxError allows, with quadric error metric
+    // edge collapses (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"). Collapses move a vertex onto a
+    // neighbor, so the result indexes the same vertices. Vertices on borders and attribute seams stay put.
+    // Returns the largest error of a collapse, as a distance in the units of the positions.
+    float simplify(const uint32_t* pIndices, uint32_t indexCount, const uint8_t* pPositions, uint32_t positionStride, uint32_t vertexCount,
+        uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+}
@@ -0,0 +1,501 @@
+#include "OcclusionCuller.h"
+#include "Simd.h"
+#include <cfloat>
+#include <map>
+#include <tuple>
+
+namespace
+{
+    // Occluders are clipped at this view depth. Boxes reaching closer than it are always visible.
+    const float kMinW = 1e-3f;
+
+    // Occluders are clipped to |x|, |y| <= kGuardBand * w, beyond that only the bounding rectangle culls
+    const float kGuardBand = 2.0f;
+
+    // Pixel coverage and depth are pulled inward by these to absorb rounding, a slightly thinner occluder only culls less
+    const float kEdgeEpsilon = 1.0f / 16.0f;    // Pixels
+    const float kDepthBias = 1e-4f;             // Relative to the box's 1/w
+    const float kMinArea = 1e-6f;
+
+    const uint32_t kClipPlaneCount = 5;
+    const uint32_t kMaxClipVertices = 3 + kClipPlaneCount;
+
+    // Occluders per binning task and boxes per test task
+    const uint32_t kBinGrainSize = 4;
+    const uint32_t kTestGrainSize = 256;
+
+    // Clip-space vertices are (x, y, w), z isn't needed for 1/w depth
+    inline float clipDistance(uint32_t plane, const glm::vec3& v)
+    {
+        switch (plane)
+        {
+        case 0: return v.z - kMinW;
+        case 1: return kGuardBand * v.z - v.x;
+        case 2: return kGuardBand * v.z + v.x;
+        case 3: return kGuardBand * v.z - v.y;
+        default: return kGuardBand * v.z + v.y;
+        }
+    }
+
+    inline uint32_t computeOutcode(const glm::vec3& v)
+    {
+        uint32_t outcode = 0;
+        for (uint32_t plane = 0; plane < kClipPlaneCount; ++plane)
+        {
+            if (clipDistance(plane, v) < 0) outcode |= 1 << plane;
+        }
+        return outcode;
+    }
+
+    // Both kernels evaluate the edges and depth as a * x + row with row = b * y + c, in the same order and without FMA,
+    // over the same 8 pixel blocks, so they write the same depth buffer bit for bit
+    void rasterizeScalar(const OcclusionCuller::Triangle& tri, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float* pDepth)
+    {
+        for (uint32_t y = y0; y <= y1; ++y)
+        {
+            const float fy = (float)y;
+            const float row0 = tri.edgeB[0] * fy + tri.edgeC[0];
+            const float row1 = tri.edgeB[1] * fy + tri.edgeC[1];
+            const float row2 = tri.edgeB[2] * fy + tri.edgeC[2];
+            const float rowDepth = tri.depthB * fy + tri.depthC;
+            float* pRow = pDepth + y * OcclusionCuller::kWidth;
+            for (uint32_t x = x0; x <= x1; ++x)
+            {
+                const float fx = (float)x;
+                if (tri.edgeA[0] * fx + row0 >= 0 && tri.edgeA[1] * fx + row1 >= 0 && tri.edgeA[2] * fx + row2 >= 0)
+                {
+                    const float depth = tri.depthA * fx + rowDepth;
+                    pRow[x] = pRow[x] > depth ? pRow[x] : depth;
+                }
+            }
+        }
+    }
+
+    SIMD_TARGET_AVX2 void rasterizeAVX2(const OcclusionCuller::Triangle& tri, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float* pDepth)
+    {
+        const __m256 laneOffsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 a0 = _mm256_set1_ps(tri.edgeA[0]);
+        const __m256 a1 = _mm256_set1_ps(tri.edgeA[1]);
+        const __m256 a2 = _mm256_set1_ps(tri.edgeA[2]);
+        const __m256 depthA = _mm256_set1_ps(tri.depthA);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (uint32_t y = y0; y <= y1; ++y)
+        {
+            const float fy = (float)y;
+            const __m256 row0 = _mm256_set1_ps(tri.edgeB[0] * fy + tri.edgeC[0]);
+            const __m256 row1 = _mm256_set1_ps(tri.edgeB[1] * fy + tri.edgeC[1]);
+            const __m256 row2 = _mm256_set1_ps(tri.edgeB[2] * fy + tri.edgeC[2]);
+            const __m256 rowDepth = _mm256_set1_ps(tri.depthB * fy + tri.depthC);
+            float* pRow = pDepth + y * OcclusionCuller::kWidth;
+            for (uint32_t x = x0; x <= x1; x += 8)
+            {
+                const __m256 fx = _mm256_add_ps(_mm256_set1_ps((float)x), laneOffsets);
+                __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, fx), row0), zero, _CMP_GE_OQ);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, fx), row1), zero, _CMP_GE_OQ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, fx), row2), zero, _CMP_GE_OQ));
+                if (_mm256_movemask_ps(inside) == 0) continue;
+
+                const __m256 depth = _mm256_add_ps(_mm256_mul_ps(depthA, fx), rowDepth);
+                const __m256 stored = _mm256_loadu_ps(pRow + x);
+                _mm256_storeu_ps(pRow + x, _mm256_blendv_ps(stored, _mm256_max_ps(stored, depth), inside));
+            }
+        }
+    }
+
+    // True if any pixel of the inclusive rectangle is at or behind depth
+    bool testRectScalar(const float* pDepth, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth)
+    {
+        for (uint32_t y = y0; y <= y1; ++y)
+        {
+            const float* pRow = pDepth + y * OcclusionCuller::kWidth;
+            for (uint32_t x = x0; x <= x1; ++x)
+            {
+                if (pRow[x] <= depth) return true;
+            }
+        }
+        return false;
+    }
+
+    SIMD_TARGET_AVX2 bool testRectAVX2(const float* pDepth, uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth)
+    {
+        // Blocks start 8-aligned, the lanes outside [x0, x1] are masked off. Rows are a multiple of 8 wide, so blocks stay in the row.
+        const __m256 boxDepth = _mm256_set1_ps(depth);
+        const uint32_t blockStart = x0 & ~7u;
+        for (uint32_t y = y0; y <= y1; ++y)
+        {
+            const float* pRow = pDepth + y * OcclusionCuller::kWidth;
+            for (uint32_t x = blockStart; x <= x1; x += 8)
+            {
+                const uint32_t first = x0 > x ? x0 - x : 0;
+                const uint32_t last = x1 - x < 7 ? x1 - x : 7;
+                const int laneMask = (int)(((2u << last) - 1) & ~((1u << first) - 1));
+                if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(pRow + x), boxDepth, _CMP_LE_OQ)) & laneMask) return true;
+            }
+        }
+        return false;
+    }
+}
+
+OcclusionCuller::SharedPtr OcclusionCuller::create()
+{
+    return SharedPtr(new OcclusionCuller());
+}
+
+uint32_t OcclusionCuller::addMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    assert(indices.size() % 3 == 0);
+    Mesh mesh;
+    mesh.positions = positions;
+    mesh.indices = indices;
+
+    // Edges are matched by position, meshes often duplicate vertices along normal and texture seams
+    std::map<std::tuple<float, float, float>, uint32_t> welded;
+    std::vector<uint32_t> weldedIndices(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        const glm::vec3& position = positions[indices[i]];
+        weldedIndices[i] = welded.emplace(std::make_tuple(position.x, position.y, position.z), (uint32_t)welded.size()).first->second;
+    }
+
+    auto edgeKey = [&](size_t triangle, uint32_t edge)
+    {
+        const uint32_t a = weldedIndices[triangle * 3 + (edge + 1) % 3];
+        const uint32_t b = weldedIndices[triangle * 3 + (edge + 2) % 3];
+        return std::make_pair(std::min(a, b), std::max(a, b));
+    };
+
+    const size_t triangleCount = indices.size() / 3;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeUses;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (uint32_t edge = 0; edge < 3; ++edge) edgeUses[edgeKey(t, edge)]++;
+    }
+
+    mesh.sharedEdges.resize(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (uint32_t edge = 0; edge < 3; ++edge)
+        {
+            if (edgeUses[edgeKey(t, edge)] > 1) mesh.sharedEdges[t] |= 1 << edge;
+        }
+    }
+
+    mMeshes.push_back(std::move(mesh));
+    return (uint32_t)mMeshes.size() - 1;
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProj)
+{
+    mViewProj = viewProj;
+    mOccluders.clear();
+    mRasterized = false;
+    mStats = {};
+}
+
+void OcclusionCuller::addOccluder(uint32_t mesh, const glm::mat4& worldMat)
+{
+    mOccluders.push_back({ mesh, mViewProj * worldMat });
+}
+
+void OcclusionCuller::rasterize(ThreadPool* pPool, Kernel kernel)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    if (kernel == Kernel::Best) kernel = isKernelSupported(Kernel::AVX2) ? Kernel::AVX2 : Kernel::Scalar;
+
+    // A task bins into the chunk of its first occluder. Without a pool one task takes everything and the other chunks stay empty.
+    const uint32_t occluderCount = (uint32_t)mOccluders.size();
+    const uint32_t chunkCount = (occluderCount + kBinGrainSize - 1) / kBinGrainSize;
+    if (mChunks.size() < chunkCount) mChunks.resize(chunkCount);
+    for (uint32_t c = 0; c < chunkCount; ++c)
+    {
+        mChunks[c].triangles.clear();
+        for (auto& bin : mChunks[c].bins) bin.clear();
+        mChunks[c].sourceTriangles = 0;
+    }
+
+    parallelFor(pPool, occluderCount, kBinGrainSize, [&](uint32_t begin, uint32_t end)
+    {
+        BinChunk& chunk = mChunks[begin / kBinGrainSize];
+        for (uint32_t o = begin; o < end; ++o) binOccluder(mOccluders[o], chunk);
+    });
+
+    // Each tile takes its triangles chunk by chunk, in occluder order
+    parallelFor(pPool, kTileCount, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t tile = begin; tile < end; ++tile) rasterizeTile(tile, chunkCount, kernel);
+    });
+    mRasterized = true;
+
+    mStats.occluders = occluderCount;
+    for (uint32_t c = 0; c < chunkCount; ++c)
+    {
+        mStats.occluderTriangles += mChunks[c].sourceTriangles;
+        mStats.binnedTriangles += (uint32_t)mChunks[c].triangles.size();
+    }
+    mStats.rasterMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+}
+
+void OcclusionCuller::binOccluder(const Occluder& occluder, BinChunk& chunk) const
+{
+    const Mesh& mesh = mMeshes[occluder.mesh];
+    chunk.clipVertices.resize(mesh.positions.size());
+    for (size_t v = 0; v < mesh.positions.size(); ++v)
+    {
+        const glm::vec4 clip = occluder.worldViewProj * glm::vec4(mesh.positions[v], 1.0f);
+        chunk.clipVertices[v] = glm::vec3(clip.x, clip.y, clip.w);
+    }
+
+    chunk.sourceTriangles += (uint32_t)mesh.indices.size() / 3;
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        clipTriangle(chunk.clipVertices[mesh.indices[i]], chunk.clipVertices[mesh.indices[i + 1]], chunk.clipVertices[mesh.indices[i + 2]], mesh.sharedEdges[i / 3], chunk);
+    }
+}
+
+void OcclusionCuller::clipTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t sharedEdges, BinChunk& chunk) const
+{
+    const uint32_t outcode0 = computeOutcode(v0);
+    const uint32_t outcode1 = computeOutcode(v1);
+    const uint32_t outcode2 = computeOutcode(v2);
+    if (outcode0 & outcode1 & outcode2) return;
+    if ((outcode0 | outcode1 | outcode2) == 0)
+    {
+        addTriangle(v0, v1, v2, sharedEdges, chunk);
+        return;
+    }
+
+    // Sutherland-Hodgman against the planes the triangle crosses, then a fan over the remaining polygon.
+    // Each polygon vertex remembers whether the edge to the next one is shared, the fan's diagonals are shared as well.
+    glm::vec3 polygons[2][kMaxClipVertices] = { { v0, v1, v2 } };
+    bool shared[2][kMaxClipVertices] = { { (sharedEdges & 4) != 0, (sharedEdges & 1) != 0, (sharedEdges & 2) != 0 } };
+    uint32_t count = 3;
+    uint32_t current = 0;
+    for (uint32_t plane = 0; plane < kClipPlaneCount && count >= 3; ++plane)
+    {
+        if (((outcode0 | outcode1 | outcode2) & (1 << plane)) == 0) continue;
+
+        const glm::vec3* pIn = polygons[current];
+        const bool* pInShared = shared[current];
+        glm::vec3* pOut = polygons[current ^ 1];
+        bool* pOutShared = shared[current ^ 1];
+        uint32_t outCount = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const glm::vec3& a = pIn[i];
+            const glm::vec3& b = pIn[(i + 1) % count];
+            const float distanceA = clipDistance(plane, a);
+            const float distanceB = clipDistance(plane, b);
+            if (distanceA >= 0)
+            {
+                pOutShared[outCount] = pInShared[i];
+                pOut[outCount++] = a;
+            }
+            if ((distanceA >= 0) != (distanceB >= 0))
+            {
+                // Leaving, the next edge runs along the plane. Entering, it continues the edge a, b.
+                pOutShared[outCount] = distanceA < 0 && pInShared[i];
+                pOut[outCount++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+            }
+        }
+        count = outCount;
+        current ^= 1;
+    }
+
+    const glm::vec3* pPolygon = polygons[current];
+    const bool* pShared = shared[current];
+    for (uint32_t i = 1; i + 1 < count; ++i)
+    {
+        const bool shared0 = pShared[i];
+        const bool shared1 = i + 2 < count || pShared[count - 1];
+        const bool shared2 = i > 1 || pShared[0];
+        addTriangle(pPolygon[0], pPolygon[i], pPolygon[i + 1], (shared0 ? 1 : 0) | (shared1 ? 2 : 0) | (shared2 ? 4 : 0), chunk);
+    }
+}
+
+void OcclusionCuller::addTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t sharedEdges, BinChunk& chunk) const
+{
+    // Pixel coordinates with y down, pixel x, y spans [x, x + 1] x [y, y + 1]
+    float x[3], y[3], depth[3];
+    const glm::vec3* pVertices[3] = { &v0, &v1, &v2 };
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const float invW = 1.0f / pVertices[i]->z;
+        x[i] = (pVertices[i]->x * invW * 0.5f + 0.5f) * kWidth;
+        y[i] = (0.5f - pVertices[i]->y * invW * 0.5f) * kHeight;
+        depth[i] = invW;
+    }
+
+    const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::abs(area) < kMinArea) return;
+
+    // Pixels with their center in the triangle's bounds, a covered pixel has its center in the triangle either way
+    const int minX = std::max((int)std::ceil(std::min(x[0], std::min(x[1], x[2])) - 0.5f), 0);
+    const int maxX = std::min((int)std::floor(std::max(x[0], std::max(x[1], x[2])) - 0.5f), (int)kWidth - 1);
+    const int minY = std::max((int)std::ceil(std::min(y[0], std::min(y[1], y[2])) - 0.5f), 0);
+    const int maxY = std::min((int)std::floor(std::max(y[0], std::max(y[1], y[2])) - 0.5f), (int)kHeight - 1);
+    if (minX > maxX || minY > maxY) return;
+
+    // Occluders are drawn from both sides, the edges are flipped so that the inside is positive. Edge i is opposite vertex i.
+    Triangle tri;
+    const float sign = area > 0 ? 1.0f : -1.0f;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const uint32_t j = (i + 1) % 3;
+        const uint32_t k = (i + 2) % 3;
+        const float a = sign * (y[j] - y[k]);
+        const float b = sign * (x[k] - x[j]);
+        const float c = sign * (x[j] * y[k] - x[k] * y[j]);
+        tri.edgeA[i] = a;
+        tri.edgeB[i] = b;
+        // Silhouette edges test the pixel's innermost corner. Shared edges test the center and overlap their neighbor slightly,
+        // so that rounding can't open a crack between them.
+        const float slack = (sharedEdges & (1 << i)) ? kEdgeEpsilon : -0.5f - kEdgeEpsilon;
+        tri.edgeC[i] = c + 0.5f * (a + b) + slack * (std::abs(a) + std::abs(b));
+    }
+
+    // 1/w is linear in screen space
+    const float depthA = ((depth[1] - depth[0]) * (y[2] - y[0]) - (depth[2] - depth[0]) * (y[1] - y[0])) / area;
+    const float depthB = ((depth[2] - depth[0]) * (x[1] - x[0]) - (depth[1] - depth[0]) * (x[2] - x[0])) / area;
+    const float depthC = depth[0] - depthA * x[0] - depthB * y[0];
+    tri.depthA = depthA;
+    tri.depthB = depthB;
+    tri.depthC = depthC + 0.5f * (depthA + depthB) - 0.5f * (std::abs(depthA) + std::abs(depthB));
+
+    tri.minX = (uint16_t)minX;
+    tri.maxX = (uint16_t)maxX;
+    tri.minY = (uint16_t)minY;
+    tri.maxY = (uint16_t)maxY;
+
+    const uint32_t index = (uint32_t)chunk.triangles.size();
+    chunk.triangles.push_back(tri);
+    for (uint32_t ty = minY / kTileHeight; ty <= maxY / kTileHeight; ++ty)
+    {
+        for (uint32_t tx = minX / kTileWidth; tx <= maxX / kTileWidth; ++tx)
+        {
+            chunk.bins[ty * kTilesX + tx].push_back(index);
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeTile(uint32_t tile, uint32_t chunkCount, Kernel kernel)
+{
+    const uint32_t tileX = tile % kTilesX * kTileWidth;
+    const uint32_t tileY = tile / kTilesX * kTileHeight;
+    for (uint32_t y = tileY; y < tileY + kTileHeight; ++y)
+    {
+        std::fill_n(mDepth.data() + y * kWidth + tileX, kTileWidth, 0.0f);
+    }
+
+    // Tiles are a multiple of 8 pixels wide, so the 8 pixel blocks starting at an aligned x stay inside the tile
+    for (uint32_t c = 0; c < chunkCount; ++c)
+    {
+        const BinChunk& chunk = mChunks[c];
+        for (uint32_t index : chunk.bins[tile])
+        {
+            const Triangle& tri = chunk.triangles[index];
+            const uint32_t x0 = std::max<uint32_t>(tri.minX, tileX) & ~7u;
+            const uint32_t x1 = std::min<uint32_t>(tri.maxX, tileX + kTileWidth - 1);
+            const uint32_t y0 = std::max<uint32_t>(tri.minY, tileY);
+            const uint32_t y1 = std::min<uint32_t>(tri.maxY, tileY + kTileHeight - 1);
+            if (kernel == Kernel::AVX2) rasterizeAVX2(tri, x0, x1, y0, y1, mDepth.data());
+            else rasterizeScalar(tri, x0, x1 | 7u, y0, y1, mDepth.data());
+        }
+    }
+
+    float tileMin = FLT_MAX;
+    for (uint32_t y = tileY; y < tileY + kTileHeight; ++y)
+    {
+        const float* pRow = mDepth.data() + y * kWidth + tileX;
+        tileMin = std::min(tileMin, *std::min_element(pRow, pRow + kTileWidth));
+    }
+    mTileMin[tile] = tileMin;
+}
+
+bool OcclusionCuller::testBox(const BoundingBox& box, Kernel kernel) const
+{
+    if (!mRasterized || mOccluders.empty()) return true;
+    if (kernel == Kernel::Best) kernel = isKernelSupported(Kernel::AVX2) ? Kernel::AVX2 : Kernel::Scalar;
+
+    // Screen rectangle and nearest depth of the corners
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = 0;
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        const glm::vec3 offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+        const glm::vec4 clip = mViewProj * glm::vec4(box.center + offset * box.extent, 1.0f);
+        if (clip.w < kMinW) return true;
+
+        const float invW = 1.0f / clip.w;
+        const float x = (clip.x * invW * 0.5f + 0.5f) * kWidth;
+        const float y = (0.5f - clip.y * invW * 0.5f) * kHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::max(nearest, invW);
+    }
+
+    // Every pixel the rectangle touches. A rectangle off screen has nothing to show.
+    if (maxX < 0 || maxY < 0 || minX >= (float)kWidth || minY >= (float)kHeight) return false;
+    const uint32_t x0 = (uint32_t)std::max(minX, 0.0f);
+    const uint32_t x1 = (uint32_t)std::min(maxX, (float)(kWidth - 1));
+    const uint32_t y0 = (uint32_t)std::max(minY, 0.0f);
+    const uint32_t y1 = (uint32_t)std::min(maxY, (float)(kHeight - 1));
+    const float depth = nearest * (1.0f + kDepthBias);
+
+    for (uint32_t ty = y0 / kTileHeight; ty <= y1 / kTileHeight; ++ty)
+    {
+        for (uint32_t tx = x0 / kTileWidth; tx <= x1 / kTileWidth; ++tx)
+        {
+            // Every occluder in the tile is nearer than the box
+            if (mTileMin[ty * kTilesX + tx] > depth) continue;
+
+            const uint32_t tileX0 = std::max(x0, tx * kTileWidth);
+            const uint32_t tileX1 = std::min(x1, tx * kTileWidth + kTileWidth - 1);
+            const uint32_t tileY0 = std::max(y0, ty * kTileHeight);
+            const uint32_t tileY1 = std::min(y1, ty * kTileHeight + kTileHeight - 1);
+            const bool visible = kernel == Kernel::AVX2 ?
+                testRectAVX2(mDepth.data(), tileX0, tileX1, tileY0, tileY1, depth) :
+                testRectScalar(mDepth.data(), tileX0, tileX1, tileY0, tileY1, depth);
+            if (visible) return true;
+        }
+    }
+    return false;
+}
+
+uint32_t OcclusionCuller::cull(const FrustumCuller& bounds, uint32_t* pDraws, uint32_t count, ThreadPool* pPool, Kernel kernel)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+
+    mVisible.resize(count);
+    parallelFor(pPool, count, kTestGrainSize, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i) mVisible[i] = testBox(bounds.getBounds(pDraws[i]), kernel) ? 1 : 0;
+    });
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (mVisible[i]) pDraws[visibleCount++] = pDraws[i];
+    }
+
+    mStats.testedBoxes += count;
+    mStats.occludedBoxes += count - visibleCount;
+    mStats.testMs += CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    return visibleCount;
+}
+
+bool OcclusionCuller::isKernelSupported(Kernel kernel)
+{
+    return kernel == Kernel::AVX2 ? Simd::hasAVX2() : true;
+}
+
+const char* OcclusionCuller::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar: return "Scalar";
+    case Kernel::AVX2: return "AVX2";
+    default: return "Best";
+    }
+}
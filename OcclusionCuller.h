@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+#include "FrustumCuller.h"
+
+using namespace Falcor;
+
+// Software occlusion culling: a few large occluders are rasterized on the CPU into a small depth buffer, then the screen
+// rectangles of draw bounds are tested against it. The buffer holds 1/w, so it works with either depth convention.
+// Rasterization is conservative in the direction that keeps draws: an occluder's silhouette only writes pixels it covers
+// completely, at the farthest depth it has within the pixel. Edges shared by two triangles of a mesh sample pixel centers instead,
+// so that the mesh stays watertight. A box is culled only when every pixel under it is nearer than the box.
+class OcclusionCuller
+{
+public:
+    using SharedPtr = std::shared_ptr<OcclusionCuller>;
+
+    static const uint32_t kWidth = 256;
+    static const uint32_t kHeight = 128;
+
+    // Triangles are binned into tiles that are rasterized independently, each tile keeps its farthest depth for a quick reject
+    static const uint32_t kTileWidth = 32;
+    static const uint32_t kTileHeight = 16;
+    static const uint32_t kTilesX = kWidth / kTileWidth;
+    static const uint32_t kTilesY = kHeight / kTileHeight;
+    static const uint32_t kTileCount = kTilesX * kTilesY;
+
+    enum class Kernel
+    {
+        Scalar,     // Reference implementation
+        AVX2,       // 8 pixels per iteration
+        Best,       // Widest kernel supported by the CPU
+    };
+
+    struct Stats
+    {
+        uint32_t occluders = 0;
+        uint32_t occluderTriangles = 0;     // Before clipping
+        uint32_t binnedTriangles = 0;       // After clipping, triangles covering at least one whole pixel
+        uint32_t testedBoxes = 0;
+        uint32_t occludedBoxes = 0;
+        double rasterMs = 0;
+        double testMs = 0;
+    };
+
+    static SharedPtr create();
+
+    // Registers a triangle list in model space and returns its index for addOccluder()
+    uint32_t addMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+    uint32_t getMeshCount() const { return (uint32_t)mMeshes.size(); }
+    uint32_t getMeshTriangleCount(uint32_t mesh) const { return (uint32_t)mMeshes[mesh].indices.size() / 3; }
+
+    // Starts a frame seen through viewProj, dropping the previous frame's occluders
+    void beginFrame(const glm::mat4& viewProj);
+    void addOccluder(uint32_t mesh, const glm::mat4& worldMat);
+
+    // Rasterizes the occluders added since beginFrame(). Occluders are clipped and binned in parallel, then the tiles are
+    // rasterized in parallel. The depth buffer is identical for every kernel and thread count.
+    void rasterize(ThreadPool* pPool = nullptr, Kernel kernel = Kernel::Best);
+
+    // True unless the world-space box is hidden behind the rasterized occluders. Every kernel gives the same answer.
+    bool testBox(const BoundingBox& box, Kernel kernel = Kernel::Best) const;
+
+    // Removes the occluded entries of pDraws, indices into the bounds, keeping the others in order. Returns how many remain.
+    uint32_t cull(const FrustumCuller& bounds, uint32_t* pDraws, uint32_t count, ThreadPool* pPool = nullptr, Kernel kernel = Kernel::Best);
+
+    // Row-major 1/w of the nearest occluder per pixel, 0 where there is none. Valid after rasterize().
+    const std::vector<float>& getDepth() const { return mDepth; }
+    const Stats& getStats() const { return mStats; }
+
+    static bool isKernelSupported(Kernel kernel);
+    static const char* getKernelName(Kernel kernel);
+
+    // Triangle set up for rasterization: silhouette edge functions and the depth plane are offset to the corner of each pixel where
+    // they are smallest, so edge >= 0 means the whole pixel is inside and the depth is the farthest within the pixel
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];     // edge(x, y) = a * x + b * y + c at pixel x, y
+        float depthA, depthB, depthC;
+        uint16_t minX, maxX, minY, maxY;        // Inclusive pixel range of the covered pixels
+    };
+
+private:
+    OcclusionCuller() = default;
+
+    struct Mesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        std::vector<uint8_t> sharedEdges;   // Per triangle, bit i set when the edge opposite vertex i has a neighbor
+    };
+
+    struct Occluder
+    {
+        uint32_t mesh;
+        glm::mat4 worldViewProj;
+    };
+
+    // Triangles of a group of occluders and their bins, filled by one task so binning doesn't need locks
+    struct BinChunk
+    {
+        std::vector<glm::vec3> clipVertices;    // x, y, w of the current occluder
+        std::vector<Triangle> triangles;
+        std::vector<uint32_t> bins[kTileCount];
+        uint32_t sourceTriangles;
+    };
+
+    void binOccluder(const Occluder& occluder, BinChunk& chunk) const;
+    void clipTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t sharedEdges, BinChunk& chunk) const;
+    void addTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t sharedEdges, BinChunk& chunk) const;
+    void rasterizeTile(uint32_t tile, uint32_t chunkCount, Kernel kernel);
+
+    std::vector<Mesh> mMeshes;
+    glm::mat4 mViewProj;
+    std::vector<Occluder> mOccluders;
+    std::vector<BinChunk> mChunks;
+    bool mRasterized = false;
+
+    std::vector<float> mDepth = std::vector<float>(kWidth * kHeight);
+    float mTileMin[kTileCount] = {};        // Farthest depth per tile
+    std::vector<uint8_t> mVisible;          // Per entry of the cull() input
+    Stats mStats;
+};
@@ -0,0 +1,191 @@
+#include "RenderStats.h"
+#include "Benchmarks.h"
+
+namespace
+{
+    const char* kUnitSuffixes[] = { "", " B", " ms" };
+
+    std::string formatValue(double value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), value >= 100 || value == std::floor(value) ? "%.0f" : "%.3f", value);
+        return text;
+    }
+}
+
+RenderStats::SharedPtr RenderStats::create()
+{
+    return SharedPtr(new RenderStats());
+}
+
+RenderStats::CounterId RenderStats::registerCounter(const std::string& name, Unit unit)
+{
+    assert(mCounters.size() < kMaxCounters);
+    mCounters.push_back({ name, unit });
+    return (CounterId)mCounters.size() - 1;
+}
+
+void RenderStats::endFrame()
+{
+#if RENDER_STATS_ENABLED
+    // A count racing with the exchange lands in the next frame, nothing is lost
+    const uint32_t counterCount = (uint32_t)mCounters.size();
+    int64_t* pFrame = &mHistory[(mFrameCount % kHistoryFrames) * kMaxCounters];
+    for (uint32_t id = 0; id < counterCount; ++id)
+    {
+        pFrame[id] = mValues[id].exchange(0, std::memory_order_relaxed);
+    }
+    mFrameCount++;
+
+    if (mCaptureFramesLeft == 0) return;
+
+    mCaptureValues.insert(mCaptureValues.end(), pFrame, pFrame + kMaxCounters);
+    mCaptureFrameEndMs.push_back(CpuTimer::calcDuration(mCaptureStart, CpuTimer::getCurrentTimePoint()));
+    if (--mCaptureFramesLeft == 0)
+    {
+        if (writeCapture()) logInfo("Wrote render stats capture " + mCapturePrefix + "Trace.json and " + mCapturePrefix + ".csv");
+        mSpans = {};
+        mCaptureValues = {};
+        mCaptureFrameEndMs = {};
+    }
+#endif
+}
+
+void RenderStats::beginCapture(uint32_t frameCount, const std::string& prefix)
+{
+#if RENDER_STATS_ENABLED
+    if (mCaptureFramesLeft > 0 || frameCount == 0) return;
+
+    // Reserved up front so that capturing doesn't allocate per span
+    mCapturePrefix = prefix;
+    mCaptureFramesLeft = frameCount;
+    mCaptureStart = CpuTimer::getCurrentTimePoint();
+    mSpans.reserve(frameCount * 16);
+    mCaptureValues.reserve((size_t)frameCount * kMaxCounters);
+    mCaptureFrameEndMs.reserve(frameCount);
+#endif
+}
+
+RenderStats::Summary RenderStats::getSummary(CounterId id) const
+{
+    Summary summary;
+    const uint32_t count = getHistoryCount();
+    if (count == 0) return summary;
+
+    std::vector<double> values(count);
+    for (uint32_t frame = 0; frame < count; ++frame)
+    {
+        values[frame] = toDisplay(id, mHistory[frame * kMaxCounters + id]);
+    }
+    summary.last = values[(mFrameCount - 1) % kHistoryFrames];
+
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (double value : values) sum += value;
+    summary.mean = sum / count;
+    summary.min = values.front();
+    summary.p50 = values[(count - 1) / 2];
+    summary.p95 = values[(size_t)std::ceil(0.95 * count) - 1];
+    summary.max = values.back();
+    return summary;
+}
+
+void RenderStats::getHistogram(CounterId id, uint32_t bins[kHistogramBins]) const
+{
+    std::fill(bins, bins + kHistogramBins, 0u);
+    const uint32_t count = getHistoryCount();
+    if (count == 0) return;
+
+    int64_t minValue = INT64_MAX, maxValue = INT64_MIN;
+    for (uint32_t frame = 0; frame < count; ++frame)
+    {
+        minValue = std::min(minValue, mHistory[frame * kMaxCounters + id]);
+        maxValue = std::max(maxValue, mHistory[frame * kMaxCounters + id]);
+    }
+
+    const double binScale = maxValue > minValue ? kHistogramBins / (double)(maxValue - minValue) : 0.0;
+    for (uint32_t frame = 0; frame < count; ++frame)
+    {
+        const uint32_t bin = (uint32_t)((mHistory[frame * kMaxCounters + id] - minValue) * binScale);
+        bins[std::min(bin, kHistogramBins - 1)]++;
+    }
+}
+
+std::string RenderStats::getReport() const
+{
+#if RENDER_STATS_ENABLED
+    // The histogram is drawn with one character per bin, from empty to the fullest bin
+    static const char kLevels[] = " .:-=+*#";
+    const uint32_t levelCount = (uint32_t)sizeof(kLevels) - 2;
+
+    std::string report = "Render stats over " + std::to_string(getHistoryCount()) + " frames: last, mean, p95, max" + (isCapturing() ? " (capturing)" : "");
+    for (CounterId id = 0; id < getCounterCount(); ++id)
+    {
+        const Summary summary = getSummary(id);
+        if (summary.max == 0) continue;
+
+        uint32_t bins[kHistogramBins];
+        getHistogram(id, bins);
+        const uint32_t fullest = *std::max_element(bins, bins + kHistogramBins);
+        std::string histogram;
+        for (uint32_t bin : bins) histogram += kLevels[(bin * levelCount + fullest - 1) / fullest];
+
+        const char* pUnit = kUnitSuffixes[(uint32_t)mCounters[id].unit];
+        report += "\n" + getName(id) + ": " + formatValue(summary.last) + ", " + formatValue(summary.mean) + ", " + formatValue(summary.p95) + ", " + formatValue(summary.max) + pUnit + " [" + histogram + "]";
+    }
+    return report;
+#else
+    return "Render stats are compiled out";
+#endif
+}
+
+bool RenderStats::writeCapture() const
+{
+    // Chrome trace: frames and spans as complete events, counter totals as counter events at the end of each frame. Times in microseconds.
+    const std::string tracePath = mCapturePrefix + "Trace.json";
+    std::ofstream file(tracePath);
+    if (!file.is_open())
+    {
+        logWarning("Can't open render stats trace file " + tracePath);
+        return false;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto beginEvent = [&]() -> std::ofstream&
+    {
+        file << (first ? "" : ",\n");
+        first = false;
+        return file;
+    };
+
+    const uint32_t frameCount = (uint32_t)mCaptureFrameEndMs.size();
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const double startMs = frame > 0 ? mCaptureFrameEndMs[frame - 1] : 0.0;
+        beginEvent() << "{\"name\":\"Frame " << frame << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << startMs * 1000 << ",\"dur\":" << (mCaptureFrameEndMs[frame] - startMs) * 1000 << "}";
+
+        for (CounterId id = 0; id < getCounterCount(); ++id)
+        {
+            beginEvent() << "{\"name\":\"" << getName(id) << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << mCaptureFrameEndMs[frame] * 1000 << ",\"args\":{\"value\":" << toDisplay(id, mCaptureValues[frame * kMaxCounters + id]) << "}}";
+        }
+    }
+    for (const Span& span : mSpans)
+    {
+        beginEvent() << "{\"name\":\"" << getName(span.id) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":" << span.startMs * 1000 << ",\"dur\":" << span.durationMs * 1000 << "}";
+    }
+    file << "\n]}\n";
+    file.close();
+
+    // CSV: one row per captured frame with every counter
+    std::vector<Benchmarks::Row> rows(frameCount);
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        rows[frame].name = std::to_string(frame);
+        for (CounterId id = 0; id < getCounterCount(); ++id)
+        {
+            rows[frame].values.push_back({ getName(id), toDisplay(id, mCaptureValues[frame * kMaxCounters + id]) });
+        }
+    }
+    return Benchmarks::writeCsv(mCapturePrefix + ".csv", rows);
+}
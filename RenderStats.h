@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Falcor.h"
+#include <atomic>
+
+using namespace Falcor;
+
+// Build with RENDER_STATS_ENABLED=0 to compile the instrumentation out. The counting functions are then empty and inline away.
+#ifndef RENDER_STATS_ENABLED
+#define RENDER_STATS_ENABLED 1
+#endif
+
+// Registry of per-frame render counters: draws, state changes, uploaded bytes, culling survivors, phase times and so on.
+// Counters are registered up front, after which counting is a relaxed atomic add, so worker threads can count without locks.
+// endFrame() moves every counter's frame total into a rolling history that the GUI summarizes with percentiles and a histogram.
+// A capture additionally records the frames' timed spans and totals, written as a Chrome trace (chrome://tracing) and as CSV.
+class RenderStats
+{
+public:
+    using SharedPtr = std::shared_ptr<RenderStats>;
+    using CounterId = uint32_t;
+
+    static const uint32_t kMaxCounters = 64;
+    static const uint32_t kHistoryFrames = 256;
+    static const uint32_t kHistogramBins = 16;
+
+    enum class Unit
+    {
+        Count,
+        Bytes,
+        Ms,         // Stored in nanoseconds so that times add atomically too
+    };
+
+    // Over the frames in the history
+    struct Summary
+    {
+        double last = 0;
+        double mean = 0;
+        double min = 0;
+        double p50 = 0;
+        double p95 = 0;
+        double max = 0;
+    };
+
+    static SharedPtr create();
+
+    // Not thread safe, register every counter before the frames that count it
+    CounterId registerCounter(const std::string& name, Unit unit);
+
+    void add(CounterId id, int64_t value)
+    {
+#if RENDER_STATS_ENABLED
+        mValues[id].fetch_add(value, std::memory_order_relaxed);
+#endif
+    }
+
+    void addMs(CounterId id, double ms)
+    {
+#if RENDER_STATS_ENABLED
+        mValues[id].fetch_add((int64_t)(ms * 1e6), std::memory_order_relaxed);
+#endif
+    }
+
+    // Adds the time between start and end, and records the span while capturing. Spans are only recorded from the render thread.
+    void addSpan(CounterId id, const CpuTimer::TimePoint& start, const CpuTimer::TimePoint& end)
+    {
+#if RENDER_STATS_ENABLED
+        const double ms = CpuTimer::calcDuration(start, end);
+        addMs(id, ms);
+        if (mCaptureFramesLeft > 0) mSpans.push_back({ id, CpuTimer::calcDuration(mCaptureStart, start), ms });
+#endif
+    }
+
+    // Closes the frame: totals go to the history and, while capturing, to the capture. Writes the capture after its last frame.
+    void endFrame();
+
+    // Records the next frameCount frames, then writes <prefix>Trace.json and <prefix>.csv
+    void beginCapture(uint32_t frameCount, const std::string& prefix);
+    bool isCapturing() const { return mCaptureFramesLeft > 0; }
+
+    uint32_t getCounterCount() const { return (uint32_t)mCounters.size(); }
+    const std::string& getName(CounterId id) const { return mCounters[id].name; }
+    Summary getSummary(CounterId id) const;
+
+    // Frames of the history per bin, the bins split [min, max] of the history evenly
+    void getHistogram(CounterId id, uint32_t bins[kHistogramBins]) const;
+
+    // One line per counter that counted anything in the history, for the GUI
+    std::string getReport() const;
+
+private:
+    RenderStats() = default;
+
+    struct Counter
+    {
+        std::string name;
+        Unit unit;
+    };
+
+    struct Span
+    {
+        CounterId id;
+        double startMs;     // Since the capture began
+        double durationMs;
+    };
+
+    double toDisplay(CounterId id, int64_t value) const { return mCounters[id].unit == Unit::Ms ? value * 1e-6 : (double)value; }
+    uint32_t getHistoryCount() const { return mFrameCount < kHistoryFrames ? mFrameCount : kHistoryFrames; }
+    bool writeCapture() const;
+
+    std::atomic<int64_t> mValues[kMaxCounters] = {};
+    std::vector<Counter> mCounters;
+    std::vector<int64_t> mHistory = std::vector<int64_t>(kMaxCounters * kHistoryFrames);    // Ring of frames, kMaxCounters values each
+    uint32_t mFrameCount = 0;
+
+    std::string mCapturePrefix;
+    uint32_t mCaptureFramesLeft = 0;
+    CpuTimer::TimePoint mCaptureStart;
+    std::vector<Span> mSpans;
+    std::vector<double> mCaptureFrameEndMs;
+    std::vector<int64_t> mCaptureValues;        // kMaxCounters per captured frame
+};
@@ -0,0 +1,99 @@
+#include "ShaderVariants.h"
+
+namespace
+{
+    // The define list is ordered by name, so equal lists give equal strings
+    std::string getDefineString(const Program::DefineList& defines)
+    {
+        std::string text;
+        for (const auto& define : defines) text += define.first + "=" + define.second + ";";
+        return text;
+    }
+}
+
+ShaderVariants::SharedPtr ShaderVariants::create(const GraphicsProgram::SharedPtr& pProgram)
+{
+    SharedPtr pVariants = SharedPtr(new ShaderVariants());
+    pVariants->mpProgram = pProgram;
+    pVariants->mActiveDefines = pProgram->getDefines();
+    return pVariants;
+}
+
+void ShaderVariants::add(const Program::DefineList& defines)
+{
+    findOrAdd(defines);
+}
+
+uint32_t ShaderVariants::findOrAdd(const Program::DefineList& defines)
+{
+    const std::string key = getDefineString(defines);
+    auto it = mVariantIndices.find(key);
+    if (it != mVariantIndices.end()) return it->second;
+
+    const uint32_t index = (uint32_t)mVariants.size();
+    Variant variant;
+    variant.defines = defines;
+    mVariants.push_back(variant);
+    mVariantIndices[key] = index;
+    mStats.variants++;
+    return index;
+}
+
+void ShaderVariants::compile(Variant& variant)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    mpProgram->setDefines(variant.defines);
+    mpProgram->getActiveVersion();
+    variant.compileMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    variant.compiled = true;
+}
+
+uint32_t ShaderVariants::precompile(double budgetMs, bool allowOverrun)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    uint32_t compiled = 0;
+    while (mNextPending < mVariants.size())
+    {
+        Variant& variant = mVariants[mNextPending];
+        if (variant.compiled)
+        {
+            mNextPending++;
+            continue;
+        }
+
+        // Left for a later frame rather than overrunning this one
+        const double estimateMs = mStats.precompiled > 0 ? mStats.precompileMs / mStats.precompiled : 0.0;
+        const bool fits = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) + estimateMs <= budgetMs;
+        if (!fits && !(allowOverrun && compiled == 0)) break;
+
+        mNextPending++;
+        compile(variant);
+        variant.precompiled = true;
+        compiled++;
+        mStats.precompiled++;
+        mStats.precompileMs += variant.compileMs;
+    }
+
+    // Back to the variant in use, the program finds its compiled version again
+    if (compiled > 0) mpProgram->setDefines(mActiveDefines);
+    return compiled;
+}
+
+void ShaderVariants::activate(const Program::DefineList& defines)
+{
+    Variant& variant = mVariants[findOrAdd(defines)];
+    mActiveDefines = defines;
+    if (variant.compiled)
+    {
+        mpProgram->setDefines(defines);
+        mStats.hits++;
+        if (variant.precompiled && !variant.used) mStats.savedMs += variant.compileMs;
+    }
+    else
+    {
+        compile(variant);
+        mStats.misses++;
+        mStats.missMs += variant.compileMs;
+    }
+    variant.used = true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Define permutations of a program, compiled ahead of their first use so that switching to one doesn't compile on the frame.
+// Falcor keeps the compiled version of every define list it has linked, so precompiling switches the program's defines, forces
+// the link and switches back. Falcor compiles through one Slang session that only the render thread may use, so variants are
+// compiled between frames when their estimated compile time fits the frame's budget, and a switch to a variant that isn't
+// compiled yet compiles it right away.
+class ShaderVariants
+{
+public:
+    using SharedPtr = std::shared_ptr<ShaderVariants>;
+
+    struct Stats
+    {
+        uint32_t variants = 0;
+        uint32_t precompiled = 0;
+        double precompileMs = 0;    // Spread over the frames precompile() ran on
+        uint32_t hits = 0;          // Switches to a compiled variant
+        uint32_t misses = 0;        // Switches that compiled on the frame
+        double missMs = 0;
+        double savedMs = 0;         // Compile time of precompiled variants at their first use, which no frame paid
+    };
+
+    static SharedPtr create(const GraphicsProgram::SharedPtr& pProgram);
+
+    // Queues a permutation for precompile(), duplicates are ignored. Variants compile in the order they were added.
+    void add(const Program::DefineList& defines);
+
+    // Compiles queued variants while the estimate of the next one, the mean of the ones compiled so far, fits in what's left of
+    // budgetMs. A compile can't be split, so with allowOverrun the first variant compiles even if it doesn't fit, which lets
+    // frames without other work make progress on variants slower than the budget. Leaves the program on the active variant.
+    // Returns the number of variants compiled.
+    uint32_t precompile(double budgetMs, bool allowOverrun);
+    bool isComplete() const { return mNextPending == mVariants.size(); }
+
+    // Sets the program's defines, compiling them first if no frame has done so yet
+    void activate(const Program::DefineList& defines);
+
+    const Stats& getStats() const { return mStats; }
+
+private:
+    ShaderVariants() = default;
+
+    struct Variant
+    {
+        Program::DefineList defines;
+        double compileMs = 0;
+        bool compiled = false;
+        bool precompiled = false;
+        bool used = false;
+    };
+
+    uint32_t findOrAdd(const Program::DefineList& defines);
+    void compile(Variant& variant);
+
+    GraphicsProgram::SharedPtr mpProgram;
+    std::vector<Variant> mVariants;
+    std::unordered_map<std::string, uint32_t> mVariantIndices;     // By define string
+    size_t mNextPending = 0;
+    Program::DefineList mActiveDefines;
+    Stats mStats;
+};
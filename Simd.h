@@ -0,0 +1,73 @@
+#pragma once
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Functions using wider instruction sets than the build baseline are tagged with these and only called after a runtime check.
+// Only SIMD_TARGET_AVX2_FMA enables FMA. GCC and Clang contract a * b + c into FMA by default where it's enabled, which changes the
+// rounding, so kernels that must match their scalar version use SIMD_TARGET_AVX2.
+#ifdef _MSC_VER
+#define SIMD_TARGET_AVX
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX2_FMA
+#else
+#define SIMD_TARGET_AVX __attribute__((target("avx")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#endif
+
+namespace Simd
+{
+    namespace detail
+    {
+        inline void cpuid(int info[4], int leaf, int subleaf)
+        {
+#ifdef _MSC_VER
+            __cpuidex(info, leaf, subleaf);
+#else
+            __asm__ __volatile__("cpuid" : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3]) : "a"(leaf), "c"(subleaf));
+#endif
+        }
+
+        inline bool osSupportsAvxState()
+        {
+            int info[4];
+            cpuid(info, 1, 0);
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx) return false;
+
+#ifdef _MSC_VER
+            const unsigned long long xcr0 = _xgetbv(0);
+#else
+            unsigned int eax, edx;
+            __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            const unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+            return (xcr0 & 0x6) == 0x6; // XMM and YMM state saved by the OS
+        }
+    }
+
+    inline bool hasAVX()
+    {
+        static const bool supported = detail::osSupportsAvxState();
+        return supported;
+    }
+
+    inline bool hasAVX2()
+    {
+        static const bool supported = []
+        {
+            if (!detail::osSupportsAvxState()) return false;
+            int info[4];
+            detail::cpuid(info, 1, 0);
+            const bool fma = (info[2] & (1 << 12)) != 0;
+            detail::cpuid(info, 7, 0);
+            const bool avx2 = (info[1] & (1 << 5)) != 0;
+            return avx2 && fma;
+        }();
+        return supported;
+    }
+}
@@ -0,0 +1,266 @@
+#include "Skinner.h"
+#include "Simd.h"
+#include <cfloat>
+
+namespace
+{
+    // The kernels blend the weighted bone columns, then transform, in the same order. Only AVX2 rounds differently, through FMA.
+
+    inline void storeVec3(uint8_t* pDst, const float* pSrc)
+    {
+        memcpy(pDst, pSrc, sizeof(glm::vec3));
+    }
+
+    void skinScalar(const Skinner::Job& job, uint32_t begin, uint32_t end, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        for (uint32_t v = begin; v < end; ++v)
+        {
+            const Skinner::Influence& influence = job.pInfluences[v];
+
+            glm::vec4 columns[4] = {};
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const glm::mat4& bone = job.pBoneMatrices[influence.bones[i]];
+                for (uint32_t c = 0; c < 4; ++c) columns[c] += influence.weights[i] * bone[c];
+            }
+
+            const glm::vec3& p = job.pPositions[v];
+            const glm::vec4 position = columns[0] * p.x + columns[1] * p.y + columns[2] * p.z + columns[3];
+            storeVec3(job.pOutPositions + (size_t)v * job.outPositionStride, &position.x);
+            boundsMin = glm::min(boundsMin, glm::vec3(position));
+            boundsMax = glm::max(boundsMax, glm::vec3(position));
+
+            if (!job.pNormals) continue;
+
+            glm::vec4 normalColumns[3] = {};
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const glm::mat3x4& bone = job.pBoneNormalMatrices[influence.bones[i]];
+                for (uint32_t c = 0; c < 3; ++c) normalColumns[c] += influence.weights[i] * bone[c];
+            }
+
+            const glm::vec3& n = job.pNormals[v];
+            const glm::vec3 normal = glm::normalize(glm::vec3(normalColumns[0] * n.x + normalColumns[1] * n.y + normalColumns[2] * n.z));
+            storeVec3(job.pOutNormals + (size_t)v * job.outNormalStride, &normal.x);
+        }
+    }
+
+    void skinSSE(const Skinner::Job& job, uint32_t begin, uint32_t end, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        __m128 minPos = _mm_set1_ps(FLT_MAX);
+        __m128 maxPos = _mm_set1_ps(-FLT_MAX);
+        alignas(16) float result[4];
+
+        for (uint32_t v = begin; v < end; ++v)
+        {
+            const Skinner::Influence& influence = job.pInfluences[v];
+
+            __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const float* pBone = glm::value_ptr(job.pBoneMatrices[influence.bones[i]]);
+                const __m128 w = _mm_set1_ps(influence.weights[i]);
+                c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(pBone)));
+                c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(pBone + 4)));
+                c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(pBone + 8)));
+                c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(pBone + 12)));
+            }
+
+            const glm::vec3& p = job.pPositions[v];
+            __m128 position = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))), _mm_mul_ps(c2, _mm_set1_ps(p.z))), c3);
+            minPos = _mm_min_ps(minPos, position);
+            maxPos = _mm_max_ps(maxPos, position);
+            _mm_store_ps(result, position);
+            storeVec3(job.pOutPositions + (size_t)v * job.outPositionStride, result);
+
+            if (!job.pNormals) continue;
+
+            __m128 n0 = _mm_setzero_ps(), n1 = _mm_setzero_ps(), n2 = _mm_setzero_ps();
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const float* pBone = glm::value_ptr(job.pBoneNormalMatrices[influence.bones[i]]);
+                const __m128 w = _mm_set1_ps(influence.weights[i]);
+                n0 = _mm_add_ps(n0, _mm_mul_ps(w, _mm_loadu_ps(pBone)));
+                n1 = _mm_add_ps(n1, _mm_mul_ps(w, _mm_loadu_ps(pBone + 4)));
+                n2 = _mm_add_ps(n2, _mm_mul_ps(w, _mm_loadu_ps(pBone + 8)));
+            }
+
+            const glm::vec3& n = job.pNormals[v];
+            _mm_store_ps(result, _mm_add_ps(_mm_add_ps(_mm_mul_ps(n0, _mm_set1_ps(n.x)), _mm_mul_ps(n1, _mm_set1_ps(n.y))), _mm_mul_ps(n2, _mm_set1_ps(n.z))));
+            const glm::vec3 normal = glm::normalize(glm::vec3(result[0], result[1], result[2]));
+            storeVec3(job.pOutNormals + (size_t)v * job.outNormalStride, &normal.x);
+        }
+
+        _mm_store_ps(result, minPos);
+        boundsMin = glm::min(boundsMin, glm::vec3(result[0], result[1], result[2]));
+        _mm_store_ps(result, maxPos);
+        boundsMax = glm::max(boundsMax, glm::vec3(result[0], result[1], result[2]));
+    }
+
+    // Two 4-wide vertices side by side: the lower lane holds vertex a, the upper lane vertex b
+    SIMD_TARGET_AVX2_FMA inline __m256 pair(__m128 a, __m128 b)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1);
+    }
+
+    SIMD_TARGET_AVX2_FMA inline __m256 pair(float a, float b)
+    {
+        return pair(_mm_set1_ps(a), _mm_set1_ps(b));
+    }
+
+    SIMD_TARGET_AVX2_FMA void skinAVX2(const Skinner::Job& job, uint32_t begin, uint32_t end, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        __m256 minPos = _mm256_set1_ps(FLT_MAX);
+        __m256 maxPos = _mm256_set1_ps(-FLT_MAX);
+        alignas(32) float result[8];
+
+        const uint32_t pairEnd = begin + (end - begin) / 2 * 2;
+        for (uint32_t v = begin; v < pairEnd; v += 2)
+        {
+            const Skinner::Influence& a = job.pInfluences[v];
+            const Skinner::Influence& b = job.pInfluences[v + 1];
+
+            __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps(), c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const float* pBoneA = glm::value_ptr(job.pBoneMatrices[a.bones[i]]);
+                const float* pBoneB = glm::value_ptr(job.pBoneMatrices[b.bones[i]]);
+                const __m256 w = pair(a.weights[i], b.weights[i]);
+                c0 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA), _mm_loadu_ps(pBoneB)), c0);
+                c1 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA + 4), _mm_loadu_ps(pBoneB + 4)), c1);
+                c2 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA + 8), _mm_loadu_ps(pBoneB + 8)), c2);
+                c3 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA + 12), _mm_loadu_ps(pBoneB + 12)), c3);
+            }
+
+            const glm::vec3& pa = job.pPositions[v];
+            const glm::vec3& pb = job.pPositions[v + 1];
+            __m256 position = _mm256_fmadd_ps(c0, pair(pa.x, pb.x), c3);
+            position = _mm256_fmadd_ps(c1, pair(pa.y, pb.y), position);
+            position = _mm256_fmadd_ps(c2, pair(pa.z, pb.z), position);
+            minPos = _mm256_min_ps(minPos, position);
+            maxPos = _mm256_max_ps(maxPos, position);
+            _mm256_store_ps(result, position);
+            storeVec3(job.pOutPositions + (size_t)v * job.outPositionStride, result);
+            storeVec3(job.pOutPositions + (size_t)(v + 1) * job.outPositionStride, result + 4);
+
+            if (!job.pNormals) continue;
+
+            __m256 n0 = _mm256_setzero_ps(), n1 = _mm256_setzero_ps(), n2 = _mm256_setzero_ps();
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const float* pBoneA = glm::value_ptr(job.pBoneNormalMatrices[a.bones[i]]);
+                const float* pBoneB = glm::value_ptr(job.pBoneNormalMatrices[b.bones[i]]);
+                const __m256 w = pair(a.weights[i], b.weights[i]);
+                n0 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA), _mm_loadu_ps(pBoneB)), n0);
+                n1 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA + 4), _mm_loadu_ps(pBoneB + 4)), n1);
+                n2 = _mm256_fmadd_ps(w, pair(_mm_loadu_ps(pBoneA + 8), _mm_loadu_ps(pBoneB + 8)), n2);
+            }
+
+            const glm::vec3& na = job.pNormals[v];
+            const glm::vec3& nb = job.pNormals[v + 1];
+            __m256 normal = _mm256_mul_ps(n0, pair(na.x, nb.x));
+            normal = _mm256_fmadd_ps(n1, pair(na.y, nb.y), normal);
+            normal = _mm256_fmadd_ps(n2, pair(na.z, nb.z), normal);
+            _mm256_store_ps(result, normal);
+            const glm::vec3 normalA = glm::normalize(glm::vec3(result[0], result[1], result[2]));
+            const glm::vec3 normalB = glm::normalize(glm::vec3(result[4], result[5], result[6]));
+            storeVec3(job.pOutNormals + (size_t)v * job.outNormalStride, &normalA.x);
+            storeVec3(job.pOutNormals + (size_t)(v + 1) * job.outNormalStride, &normalB.x);
+        }
+
+        _mm256_store_ps(result, minPos);
+        boundsMin = glm::min(boundsMin, glm::min(glm::vec3(result[0], result[1], result[2]), glm::vec3(result[4], result[5], result[6])));
+        _mm256_store_ps(result, maxPos);
+        boundsMax = glm::max(boundsMax, glm::max(glm::vec3(result[0], result[1], result[2]), glm::vec3(result[4], result[5], result[6])));
+
+        // Odd vertex at the end of the task
+        if (pairEnd < end) skinSSE(job, pairEnd, end, boundsMin, boundsMax);
+    }
+}
+
+Skinner::SharedPtr Skinner::create()
+{
+    return SharedPtr(new Skinner());
+}
+
+uint32_t Skinner::addJob(const Job& job)
+{
+    const uint32_t jobIndex = (uint32_t)mJobs.size();
+    mJobs.push_back(job);
+    mBounds.push_back({});
+    for (uint32_t begin = 0; begin < job.vertexCount; begin += kVerticesPerTask)
+    {
+        mTasks.push_back({ jobIndex, begin, std::min(job.vertexCount, begin + kVerticesPerTask) });
+    }
+    return jobIndex;
+}
+
+void Skinner::clear()
+{
+    mJobs.clear();
+    mTasks.clear();
+    mBounds.clear();
+}
+
+void Skinner::run(ThreadPool* pPool, Kernel kernel)
+{
+    auto start = CpuTimer::getCurrentTimePoint();
+    if (kernel == Kernel::Best) kernel = isKernelSupported(Kernel::AVX2) ? Kernel::AVX2 : Kernel::SSE;
+
+    mTaskMin.assign(mTasks.size(), glm::vec3(FLT_MAX));
+    mTaskMax.assign(mTasks.size(), glm::vec3(-FLT_MAX));
+    parallelFor(pPool, (uint32_t)mTasks.size(), 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t t = begin; t < end; ++t)
+        {
+            const Task& task = mTasks[t];
+            const Job& job = mJobs[task.job];
+            switch (kernel)
+            {
+            case Kernel::Scalar: skinScalar(job, task.begin, task.end, mTaskMin[t], mTaskMax[t]); break;
+            case Kernel::AVX2: skinAVX2(job, task.begin, task.end, mTaskMin[t], mTaskMax[t]); break;
+            default: skinSSE(job, task.begin, task.end, mTaskMin[t], mTaskMax[t]); break;
+            }
+        }
+    });
+
+    // Tasks of a job are consecutive
+    mStats = {};
+    for (uint32_t t = 0; t < (uint32_t)mTasks.size(); ++t)
+    {
+        glm::vec3 minPos = mTaskMin[t], maxPos = mTaskMax[t];
+        const uint32_t job = mTasks[t].job;
+        while (t + 1 < (uint32_t)mTasks.size() && mTasks[t + 1].job == job)
+        {
+            ++t;
+            minPos = glm::min(minPos, mTaskMin[t]);
+            maxPos = glm::max(maxPos, mTaskMax[t]);
+        }
+        mBounds[job] = BoundingBox::fromMinMax(minPos, maxPos);
+        mStats.vertices += mJobs[job].vertexCount;
+    }
+    mStats.tasks = (uint32_t)mTasks.size();
+    mStats.skinMs = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+}
+
+bool Skinner::isKernelSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::AVX2:
+        return Simd::hasAVX2();
+    default:
+        return true; // SSE2 is part of the x64 baseline
+    }
+}
+
+const char* Skinner::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar: return "Scalar";
+    case Kernel::SSE: return "SSE";
+    case Kernel::AVX2: return "AVX2";
+    default: return "Best";
+    }
+}
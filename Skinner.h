@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+
+using namespace Falcor;
+
+// Linear blend skinning on the CPU. Each job skins one mesh's bind pose with up to four bones per vertex into strided outputs,
+// e.g. the skinned region of a geometry pool's vertex streams. Jobs are split into tasks of kVerticesPerTask vertices that run
+// on the thread pool, and the kernels blend the bone matrices in SIMD registers.
+class Skinner
+{
+public:
+    using SharedPtr = std::shared_ptr<Skinner>;
+
+    // Vertices per task, enough to amortize taking a task from the pool
+    static const uint32_t kVerticesPerTask = 1024;
+
+    // Weights sum to one, unused bones have weight zero
+    struct Influence
+    {
+        glm::vec4 weights;
+        uint16_t bones[4];
+    };
+
+    enum class Kernel
+    {
+        Scalar,     // Reference implementation
+        SSE,        // One vertex per iteration, a column of the blended matrix per register
+        AVX2,       // Two vertices per iteration with FMA
+        Best,       // Widest kernel supported by the CPU
+    };
+
+    struct Job
+    {
+        const glm::vec3* pPositions = nullptr;
+        const glm::vec3* pNormals = nullptr;                // Optional, skinned with the inverse transposes and renormalized
+        const Influence* pInfluences = nullptr;
+        uint32_t vertexCount = 0;
+        const glm::mat4* pBoneMatrices = nullptr;           // Read on every run, so they may be animated in place
+        const glm::mat3x4* pBoneNormalMatrices = nullptr;
+        uint8_t* pOutPositions = nullptr;
+        uint8_t* pOutNormals = nullptr;
+        uint32_t outPositionStride = sizeof(glm::vec3);
+        uint32_t outNormalStride = sizeof(glm::vec3);
+    };
+
+    struct Stats
+    {
+        uint32_t vertices = 0;
+        uint32_t tasks = 0;
+        double skinMs = 0;
+    };
+
+    static SharedPtr create();
+
+    // Jobs persist across runs
+    uint32_t addJob(const Job& job);
+    Job& getJob(uint32_t index) { return mJobs[index]; }
+    uint32_t getJobCount() const { return (uint32_t)mJobs.size(); }
+    void clear();
+
+    // Skins every job and computes its bounds. The tasks write disjoint vertices, so the output doesn't depend on the thread count.
+    // Kernels differ only by rounding.
+    void run(ThreadPool* pPool, Kernel kernel = Kernel::Best);
+
+    // Skinned bounds of a job from the last run, in the space of its bone matrices
+    const BoundingBox& getBounds(uint32_t jobIndex) const { return mBounds[jobIndex]; }
+    const Stats& getStats() const { return mStats; }
+
+    static bool isKernelSupported(Kernel kernel);
+    static const char* getKernelName(Kernel kernel);
+
+private:
+    Skinner() = default;
+
+    struct Task
+    {
+        uint32_t job;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    std::vector<Job> mJobs;
+    std::vector<Task> mTasks;
+    std::vector<glm::vec3> mTaskMin;
+    std::vector<glm::vec3> mTaskMax;
+    std::vector<BoundingBox> mBounds;
+    Stats mStats;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// The producer only advances mTail and the consumer only advances mHead, so neither side ever blocks the other.
+template<typename T>
+class SpscQueue
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscQueue(uint32_t capacity)
+    {
+        uint32_t size = 1;
+        while (size < capacity) size <<= 1;
+        mSlots.resize(size);
+        mMask = size - 1;
+    }
+
+    // Producer only. Returns false if the queue is full.
+    bool push(T&& item)
+    {
+        const uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) > mMask) return false;
+
+        mSlots[tail & mMask] = std::move(item);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T& item)
+    {
+        const uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) return false;
+
+        item = std::move(mSlots[head & mMask]);
+        mSlots[head & mMask] = T();     // Release whatever the item holds now rather than when the slot is reused
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire); }
+
+private:
+    std::vector<T> mSlots;
+    uint32_t mMask = 0;
+
+    // On separate cache lines, each is written by one thread only
+    alignas(64) std::atomic<uint32_t> mHead{ 0 };
+    alignas(64) std::atomic<uint32_t> mTail{ 0 };
+};
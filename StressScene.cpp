@@ -0,0 +1,296 @@
+#include "StressScene.h"
+#include "LightClusters.h"
+#include <random>
+
+namespace
+{
+    // Instances are about a unit in size and spaced so that the density is the same at every instance count
+    const float kSpacing = 4.0f;
+    const uint32_t kInstancesPerCluster = 4096;
+    const uint32_t kMaxClusters = 256;
+
+    const float kPi = 3.14159265f;
+
+    const char* kDistributionNames[] = { "grid", "uniform", "clustered" };
+
+    bool parseUint(const std::string& text, uint32_t& value)
+    {
+        char* pEnd = nullptr;
+        const unsigned long parsed = std::strtoul(text.c_str(), &pEnd, 10);
+        if (pEnd == text.c_str() || *pEnd != '\0') return false;
+        value = (uint32_t)parsed;
+        return true;
+    }
+
+    bool parseFloat(const std::string& text, float& value)
+    {
+        char* pEnd = nullptr;
+        const float parsed = std::strtof(text.c_str(), &pEnd);
+        if (pEnd == text.c_str() || *pEnd != '\0') return false;
+        value = parsed;
+        return true;
+    }
+
+    bool parseDistribution(const std::string& text, StressScene::Distribution& distribution)
+    {
+        for (uint32_t i = 0; i < arraysize(kDistributionNames); ++i)
+        {
+            if (text != kDistributionNames[i]) continue;
+            distribution = (StressScene::Distribution)i;
+            return true;
+        }
+        return false;
+    }
+
+    float signedPow(float x, float e)
+    {
+        return std::copysign(std::pow(std::abs(x), e), x);
+    }
+
+    // One buffer per attribute, like meshes loaded by Falcor, so the geometry pool matches the streams the same way
+    VertexLayout::SharedPtr createVertexLayout()
+    {
+        VertexLayout::SharedPtr pLayout = VertexLayout::create();
+        auto addStream = [&](uint32_t index, const std::string& name, ResourceFormat format, uint32_t location)
+        {
+            VertexBufferLayout::SharedPtr pBufferLayout = VertexBufferLayout::create();
+            pBufferLayout->addElement(name, 0, format, 1, location);
+            pLayout->addBufferLayout(index, pBufferLayout);
+        };
+        addStream(0, VERTEX_POSITION_NAME, ResourceFormat::RGB32Float, VERTEX_POSITION_LOC);
+        addStream(1, VERTEX_NORMAL_NAME, ResourceFormat::RGB32Float, VERTEX_NORMAL_LOC);
+        addStream(2, VERTEX_TEXCOORD_NAME, ResourceFormat::RG32Float, VERTEX_TEXCOORD_LOC);
+        return pLayout;
+    }
+
+    struct Geometry
+    {
+        Vao::BufferVec vertexBuffers;
+        Buffer::SharedPtr pIndexBuffer;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        BoundingBox bounds;
+    };
+
+    // Superellipsoid, from rounded box to star-like depending on the exponents, with a mesh-specific stretch and tessellation
+    Geometry createGeometry(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> exponent(0.2f, 2.5f);
+        std::uniform_real_distribution<float> stretch(0.4f, 1.0f);
+        std::uniform_int_distribution<uint32_t> tessellation(3, 8);
+
+        const float e1 = exponent(rng);
+        const float e2 = exponent(rng);
+        const glm::vec3 scale(stretch(rng), stretch(rng), stretch(rng));
+        const uint32_t segments = 2 * tessellation(rng);
+        const uint32_t rings = segments / 2;
+
+        // The seam and the poles repeat vertices so that texture coordinates stay continuous
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texcoords;
+        for (uint32_t ring = 0; ring <= rings; ++ring)
+        {
+            const float v = kPi * ((float)ring / rings - 0.5f);
+            for (uint32_t segment = 0; segment <= segments; ++segment)
+            {
+                const float u = 2.0f * kPi * ((float)segment / segments - 0.5f);
+                const glm::vec3 position(signedPow(std::cos(v), e1) * signedPow(std::cos(u), e2), signedPow(std::sin(v), e1), signedPow(std::cos(v), e1) * signedPow(std::sin(u), e2));
+                const glm::vec3 normal(signedPow(std::cos(v), 2.0f - e1) * signedPow(std::cos(u), 2.0f - e2), signedPow(std::sin(v), 2.0f - e1), signedPow(std::cos(v), 2.0f - e1) * signedPow(std::sin(u), 2.0f - e2));
+
+                // Degenerate at the poles, where the ring collapses
+                const glm::vec3 scaledNormal = normal / scale;
+                positions.push_back(position * scale);
+                normals.push_back(glm::dot(scaledNormal, scaledNormal) > 0.0f ? glm::normalize(scaledNormal) : glm::vec3(0.0f, position.y < 0 ? -1.0f : 1.0f, 0.0f));
+                texcoords.push_back(glm::vec2((float)segment / segments, (float)ring / rings));
+            }
+        }
+
+        std::vector<uint32_t> indices;
+        const uint32_t rowLength = segments + 1;
+        for (uint32_t ring = 0; ring < rings; ++ring)
+        {
+            for (uint32_t segment = 0; segment < segments; ++segment)
+            {
+                const uint32_t i0 = ring * rowLength + segment;
+                const uint32_t i1 = i0 + rowLength;
+                indices.insert(indices.end(), { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 });
+            }
+        }
+
+        Geometry geometry;
+        geometry.vertexCount = (uint32_t)positions.size();
+        geometry.indexCount = (uint32_t)indices.size();
+        geometry.vertexBuffers = {
+            Buffer::create(positions.size() * sizeof(glm::vec3), Resource::BindFlags::Vertex, Buffer::CpuAccess::None, positions.data()),
+            Buffer::create(normals.size() * sizeof(glm::vec3), Resource::BindFlags::Vertex, Buffer::CpuAccess::None, normals.data()),
+            Buffer::create(texcoords.size() * sizeof(glm::vec2), Resource::BindFlags::Vertex, Buffer::CpuAccess::None, texcoords.data()) };
+        geometry.pIndexBuffer = Buffer::create(indices.size() * sizeof(uint32_t), Resource::BindFlags::Index, Buffer::CpuAccess::None, indices.data());
+        geometry.bounds = BoundingBox::fromMinMax(-scale, scale);
+        return geometry;
+    }
+
+    Material::SharedPtr createMaterial(uint32_t index, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        Material::SharedPtr pMaterial = Material::create("Stress" + std::to_string(index));
+        pMaterial->setBaseColor(glm::vec4(0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng), 1.0f));
+        pMaterial->setSpecularParams(glm::vec4(0.0f, 0.2f + 0.8f * unit(rng), unit(rng), 0.0f));
+        return pMaterial;
+    }
+}
+
+const char* StressScene::kPathPrefix = "stress";
+
+bool StressScene::isStressScenePath(const std::string& path)
+{
+    return path.compare(0, strlen(kPathPrefix), kPathPrefix) == 0;
+}
+
+bool StressScene::parsePath(const std::string& path, Desc& desc)
+{
+    if (!isStressScenePath(path)) return false;
+
+    std::string params = path.substr(strlen(kPathPrefix));
+    if (params.empty()) return true;
+    if (params[0] != ':') return false;
+
+    bool valid = true;
+    std::stringstream stream(params.substr(1));
+    std::string param;
+    while (std::getline(stream, param, ','))
+    {
+        const size_t separator = param.find('=');
+        const std::string key = param.substr(0, separator);
+        const std::string value = separator != std::string::npos ? param.substr(separator + 1) : "";
+
+        // Invalid values leave the parameter as it was
+        uint32_t count = 0;
+        float fraction = 0;
+        Distribution distribution;
+        if (key == "instances" && parseUint(value, count) && count > 0) desc.instanceCount = count;
+        else if (key == "meshes" && parseUint(value, count) && count > 0) desc.meshCount = count;
+        else if (key == "materials" && parseUint(value, count) && count > 0) desc.materialCount = count;
+        else if (key == "animated" && parseFloat(value, fraction) && fraction >= 0.0f && fraction <= 1.0f) desc.animatedFraction = fraction;
+        else if (key == "lights" && parseUint(value, count)) desc.lightCount = count;
+        else if (key == "seed" && parseUint(value, count)) desc.seed = count;
+        else if (key == "distribution" && parseDistribution(value, distribution)) desc.distribution = distribution;
+        else
+        {
+            logWarning("Invalid stress scene parameter " + param);
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+std::string StressScene::getPath(const Desc& desc)
+{
+    return std::string(kPathPrefix) + ":instances=" + std::to_string(desc.instanceCount) + ",meshes=" + std::to_string(desc.meshCount) + ",materials=" + std::to_string(desc.materialCount) +
+        ",distribution=" + kDistributionNames[(uint32_t)desc.distribution] + ",animated=" + std::to_string(desc.animatedFraction) + ",lights=" + std::to_string(desc.lightCount) + ",seed=" + std::to_string(desc.seed);
+}
+
+StressScene::SharedPtr StressScene::create(const Desc& desc)
+{
+    SharedPtr pStressScene = SharedPtr(new StressScene());
+    pStressScene->mDesc = desc;
+
+    std::mt19937 rng(desc.seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // A mesh has a single material in Falcor, so every model pairs a geometry with a material. Models share the vertex
+    // and index buffers of their geometry.
+    VertexLayout::SharedPtr pLayout = createVertexLayout();
+    std::vector<Geometry> geometries;
+    for (uint32_t i = 0; i < desc.meshCount; ++i) geometries.push_back(createGeometry(rng));
+    std::vector<Material::SharedPtr> materials;
+    for (uint32_t i = 0; i < desc.materialCount; ++i) materials.push_back(createMaterial(i, rng));
+
+    const uint32_t modelCount = std::min(std::max(desc.meshCount, desc.materialCount), desc.instanceCount);
+    std::vector<Model::SharedPtr> models;
+    for (uint32_t i = 0; i < modelCount; ++i)
+    {
+        const Geometry& geometry = geometries[i % desc.meshCount];
+        Mesh::SharedPtr pMesh = Mesh::create(geometry.vertexBuffers, geometry.vertexCount, geometry.pIndexBuffer, geometry.indexCount, pLayout, Vao::Topology::TriangleList, materials[i % desc.materialCount], geometry.bounds, false);
+        Model::SharedPtr pModel = Model::create();
+        pModel->addMeshInstance(pMesh, glm::mat4(1.0f));
+        models.push_back(pModel);
+    }
+
+    Scene::SharedPtr pScene = Scene::create();
+    DirectionalLight::SharedPtr pLight = DirectionalLight::create();
+    pLight->setWorldDirection(glm::normalize(glm::vec3(-0.5f, -1.0f, -0.3f)));
+    pScene->addLight(pLight);
+
+    const float side = kSpacing * std::cbrt((float)desc.instanceCount);
+    const uint32_t gridSize = (uint32_t)std::ceil(std::cbrt((float)desc.instanceCount));
+    std::vector<glm::vec3> clusterCenters(std::min(1 + desc.instanceCount / kInstancesPerCluster, kMaxClusters));
+    for (auto& center : clusterCenters) center = (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * side;
+    std::normal_distribution<float> clusterOffset(0.0f, side * 0.05f);
+
+    // The first instances add the models in order, so model i is the scene's model i
+    std::vector<uint32_t> modelInstanceCounts(modelCount, 0);
+    std::uniform_int_distribution<uint32_t> randomModel(0, modelCount - 1);
+    for (uint32_t i = 0; i < desc.instanceCount; ++i)
+    {
+        glm::vec3 position;
+        if (desc.distribution == Distribution::Grid)
+        {
+            position = (glm::vec3((float)(i % gridSize), (float)(i / gridSize % gridSize), (float)(i / (gridSize * gridSize))) + 0.5f) * kSpacing - side * 0.5f;
+        }
+        else if (desc.distribution == Distribution::Uniform)
+        {
+            position = (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * side;
+        }
+        else
+        {
+            position = clusterCenters[i % clusterCenters.size()] + glm::vec3(clusterOffset(rng), clusterOffset(rng), clusterOffset(rng));
+        }
+
+        const uint32_t modelID = i < modelCount ? i : randomModel(rng);
+        const glm::vec3 rotation = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f * kPi;
+        const float scale = 0.5f + unit(rng);
+        pScene->addModelInstance(models[modelID], "", position, rotation, glm::vec3(scale));
+
+        Scene::ModelInstance* pInstance = pScene->getModelInstance(modelID, modelInstanceCounts[modelID]++).get();
+        if (unit(rng) < desc.animatedFraction)
+        {
+            pStressScene->mAnimated.push_back({ pInstance, position, kSpacing * (0.1f + 0.4f * unit(rng)), 0.5f + 1.5f * unit(rng), unit(rng) * 2.0f * kPi });
+        }
+    }
+
+    // Point lights in the instances' cube, reaching a few instances in every direction before clustered lighting cuts them off.
+    // Generated after the instances, so the lights don't change the instance layout of a seed.
+    for (uint32_t i = 0; i < desc.lightCount; ++i)
+    {
+        const float radius = kSpacing * (1.0f + 3.0f * unit(rng));
+        const glm::vec3 color = glm::vec3(0.25f) + 0.75f * glm::vec3(unit(rng), unit(rng), unit(rng));
+        PointLight::SharedPtr pPointLight = PointLight::create();
+        pPointLight->setWorldPosition((glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * side);
+        pPointLight->setIntensity(color * radius * radius * LightClusters::kMinIrradiance);
+        pScene->addLight(pPointLight);
+    }
+
+    pStressScene->mpScene = pScene;
+    return pStressScene;
+}
+
+void StressScene::animate(double time, ThreadPool* pPool)
+{
+    auto animateRange = [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const AnimatedInstance& animated = mAnimated[i];
+            const float angle = (float)std::fmod(animated.speed * time + animated.phase, 2.0 * kPi);
+            const glm::vec3 position = animated.center + animated.radius * glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+
+            // Moving the target along keeps the orientation
+            animated.pInstance->setTranslation(position, true);
+        }
+    };
+
+    // Instances are independent, each range only touches its own
+    const uint32_t count = (uint32_t)mAnimated.size();
+    if (pPool) pPool->parallelFor(count, 1024, animateRange);
+    else animateRange(0, count);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Falcor.h"
+#include "ThreadPool.h"
+
+using namespace Falcor;
+
+// Procedurally generated scene for measuring how the render modes scale with draw count, mesh and material diversity and the
+// share of moving objects. Every instance is a model instance of its own, so all render modes draw the scene like a loaded one.
+class StressScene
+{
+public:
+    using SharedPtr = std::shared_ptr<StressScene>;
+
+    enum class Distribution
+    {
+        Grid,       // Regular lattice
+        Uniform,    // Random in a cube
+        Clustered,  // Random around a few dense centers
+    };
+
+    struct Desc
+    {
+        uint32_t instanceCount = 10000;
+        uint32_t meshCount = 16;            // Unique geometry
+        uint32_t materialCount = 16;
+        Distribution distribution = Distribution::Uniform;
+        float animatedFraction = 0.1f;      // Instances that move every frame
+        uint32_t lightCount = 256;          // Point lights, on top of one directional light
+        uint32_t seed = 1;
+    };
+
+    // Scene paths starting with this prefix describe a generated scene, e.g.
+    // "stress:instances=100000,meshes=64,materials=256,distribution=clustered,animated=0.25,lights=1024,seed=7".
+    // Missing parameters keep their defaults.
+    static const char* kPathPrefix;
+    static bool isStressScenePath(const std::string& path);
+    static bool parsePath(const std::string& path, Desc& desc);
+    static std::string getPath(const Desc& desc);
+
+    // The same description always generates the same scene
+    static SharedPtr create(const Desc& desc);
+
+    const Desc& getDesc() const { return mDesc; }
+    const Scene::SharedPtr& getScene() const { return mpScene; }
+    uint32_t getAnimatedCount() const { return (uint32_t)mAnimated.size(); }
+
+    // Moves the animated instances along their orbits. Only depends on time, so replaying the same times gives the same frames.
+    void animate(double time, ThreadPool* pPool = nullptr);
+
+private:
+    StressScene() = default;
+
+    struct AnimatedInstance
+    {
+        Scene::ModelInstance* pInstance;
+        glm::vec3 center;
+        float radius;
+        float speed;
+        float phase;
+    };
+
+    Desc mDesc;
+    Scene::SharedPtr mpScene;
+    std::vector<AnimatedInstance> mAnimated;
+};
@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+ThreadPool::SharedPtr ThreadPool::create(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    SharedPtr pPool = SharedPtr(new ThreadPool());
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        pPool->mWorkers.emplace_back(&ThreadPool::workerLoop, pPool.get());
+    }
+    return pPool;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+    }
+    mWakeCondition.notify_all();
+
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(uint32_t count, uint32_t grainSize, const RangeFunc& func)
+{
+    if (count == 0) return;
+
+    std::lock_guard<std::mutex> dispatchLock(mDispatchMutex);
+
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJob.pFunc = &func;
+        mJob.count = count;
+        mJob.grainSize = std::max(1u, grainSize);
+        mJob.chunkCount = (count + mJob.grainSize - 1) / mJob.grainSize;
+        mJob.generation++;
+        mDoneChunks = 0;
+        mNextChunk = (uint64_t)mJob.generation << 32;
+        job = mJob;
+    }
+    mWakeCondition.notify_all();
+
+    runChunks(job);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [&] { return mDoneChunks == job.chunkCount; });
+}
+
+bool ThreadPool::acquireChunk(uint32_t generation, uint32_t chunkCount, uint32_t& chunk)
+{
+    // Compare-and-swap so that a worker holding a stale job never consumes chunks of a newer one
+    uint64_t current = mNextChunk.load();
+    while (true)
+    {
+        if ((uint32_t)(current >> 32) != generation) return false;
+        chunk = (uint32_t)current;
+        if (chunk >= chunkCount) return false;
+        if (mNextChunk.compare_exchange_weak(current, current + 1)) return true;
+    }
+}
+
+void ThreadPool::runChunks(const Job& job)
+{
+    uint32_t completed = 0;
+    uint32_t chunk;
+    while (acquireChunk(job.generation, job.chunkCount, chunk))
+    {
+        const uint32_t begin = chunk * job.grainSize;
+        const uint32_t end = std::min(begin + job.grainSize, job.count);
+        (*job.pFunc)(begin, end);
+        completed++;
+    }
+
+    if (completed > 0 && (mDoneChunks += completed) == job.chunkCount)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDoneCondition.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    uint32_t seenGeneration = 0;
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeCondition.wait(lock, [&] { return mShutdown || mJob.generation != seenGeneration; });
+            if (mShutdown) return;
+            job = mJob;
+            seenGeneration = job.generation;
+        }
+
+        runChunks(job);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Falcor.h"
+#include <condition_variable>
+
+using namespace Falcor;
+
+// Fixed set of worker threads for data-parallel loops. The calling thread participates in the work.
+class ThreadPool
+{
+public:
+    using SharedPtr = std::shared_ptr<ThreadPool>;
+    using RangeFunc = std::function<void(uint32_t begin, uint32_t end)>;
+
+    // threadCount includes the calling thread. 0 picks the hardware concurrency.
+    static SharedPtr create(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    uint32_t getThreadCount() const { return (uint32_t)mWorkers.size() + 1; }
+
+    // Splits [0, count) into chunks of grainSize items and runs func on each chunk. Blocks until all chunks are done.
+    // Chunk boundaries only depend on count and grainSize, so results written to per-item slots are deterministic.
+    void parallelFor(uint32_t count, uint32_t grainSize, const RangeFunc& func);
+
+private:
+    ThreadPool() = default;
+
+    struct Job
+    {
+        const RangeFunc* pFunc = nullptr;
+        uint32_t count = 0;
+        uint32_t grainSize = 1;
+        uint32_t chunkCount = 0;
+        uint32_t generation = 0;
+    };
+
+    void workerLoop();
+    void runChunks(const Job& job);
+    bool acquireChunk(uint32_t generation, uint32_t chunkCount, uint32_t& chunk);
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mDispatchMutex;      // Serializes parallelFor calls
+    std::mutex mMutex;
+    std::condition_variable mWakeCondition;
+    std::condition_variable mDoneCondition;
+    bool mShutdown = false;
+
+    Job mJob;                                   // Guarded by mMutex
+    std::atomic<uint64_t> mNextChunk{ 0 };      // Job generation in the high 32 bits, next chunk index in the low 32 bits
+    std::atomic<uint32_t> mDoneChunks{ 0 };
+};
+
+// Runs serially when no pool is given
+inline void parallelFor(ThreadPool* pPool, uint32_t count, uint32_t grainSize, const ThreadPool::RangeFunc& func)
+{
+    if (pPool && pPool->getThreadCount() > 1)
+    {
+        pPool->parallelFor(count, grainSize, func);
+    }
+    else if (count > 0)
+    {
+        func(0, count);
+    }
+}
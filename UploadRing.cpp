@@ -0,0 +1,81 @@
+#include "UploadRing.h"
+
+namespace
+{
+    // Capacities stay a multiple of this, so the start of the ring is aligned for any supported alignment
+    const size_t kCapacityGranularity = 256;
+}
+
+UploadRing::SharedPtr UploadRing::create(size_t capacity, Resource::BindFlags bindFlags)
+{
+    SharedPtr pRing = SharedPtr(new UploadRing());
+    pRing->mBindFlags = bindFlags;
+    pRing->createBuffer(capacity);
+    return pRing;
+}
+
+UploadRing::~UploadRing()
+{
+    if (mpBuffer) mpBuffer->unmap();
+}
+
+void UploadRing::createBuffer(size_t capacity)
+{
+    if (mpBuffer)
+    {
+        // Frames in flight may still read the old buffer
+        mpBuffer->unmap();
+        mRetiredBuffers.push_back({ mpBuffer, mFrameIndex + kFramesInFlight });
+    }
+
+    mCapacity = (capacity + kCapacityGranularity - 1) / kCapacityGranularity * kCapacityGranularity;
+    mpBuffer = Buffer::create(mCapacity, mBindFlags, Buffer::CpuAccess::Write, nullptr);
+    mpData = (uint8_t*)mpBuffer->map(Buffer::MapType::Write);
+
+    mHead = 0;
+    mTail = 0;
+    for (auto& start : mFrameStarts) start = 0;
+}
+
+void UploadRing::beginFrame()
+{
+    mFrameIndex++;
+    mFrameStarts[mFrameIndex % kFramesInFlight] = mHead;
+
+    // The oldest frame that may still be in flight started here, everything before it is free
+    mTail = mFrameStarts[(mFrameIndex + 1) % kFramesInFlight];
+
+    mRetiredBuffers.erase(std::remove_if(mRetiredBuffers.begin(), mRetiredBuffers.end(), [this](const RetiredBuffer& retired) { return retired.retireFrame <= mFrameIndex; }), mRetiredBuffers.end());
+    mFrameStats = {};
+}
+
+UploadRing::Allocation UploadRing::allocate(size_t size, size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= kCapacityGranularity);
+
+    uint64_t offset = (mHead + alignment - 1) & ~(uint64_t)(alignment - 1);
+    if (offset % mCapacity + size > mCapacity)
+    {
+        // Doesn't fit before the end, skip to the start of the ring
+        offset += mCapacity - offset % mCapacity;
+    }
+
+    if (offset + size - mTail > mCapacity)
+    {
+        createBuffer(std::max(mCapacity * 2, size * 2));
+        mFrameStats.grows++;
+        logWarning("Upload ring grew to " + std::to_string(mCapacity / 1024) + " KB");
+        return allocate(size, alignment);
+    }
+
+    mFrameStats.allocations++;
+    mFrameStats.allocatedBytes += size;
+    mFrameStats.paddingBytes += offset - mHead;
+    mHead = offset + size;
+
+    Allocation allocation;
+    allocation.offset = offset % mCapacity;
+    allocation.pData = mpData + allocation.offset;
+    allocation.pBuffer = mpBuffer.get();
+    return allocation;
+}
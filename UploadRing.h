@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Upload buffer that stays mapped for its lifetime and hands out aligned sub-allocations for data written once per frame.
+// Frames allocate linearly around the ring. The space a frame used is reused once kFramesInFlight newer frames have begun,
+// by which time the GPU has consumed it, so writing never waits on the GPU and never versions a buffer.
+class UploadRing
+{
+public:
+    using SharedPtr = std::shared_ptr<UploadRing>;
+
+    // Falcor's device blocks in present() once this many frames are queued
+    static const uint32_t kFramesInFlight = 3;
+    static const uint32_t kDefaultAlignment = 16;
+
+    struct Allocation
+    {
+        uint8_t* pData = nullptr;       // Write-combined memory: write sequentially, never read back
+        uint64_t offset = 0;            // In bytes from the start of pBuffer
+        Buffer* pBuffer = nullptr;      // Changes when the ring grows
+    };
+
+    struct FrameStats
+    {
+        uint32_t allocations = 0;
+        uint64_t allocatedBytes = 0;    // Requested sizes
+        uint64_t paddingBytes = 0;      // Alignment and skipped space at the end of the ring
+        uint32_t grows = 0;
+    };
+
+    // The capacity should hold kFramesInFlight frames of data. A frame that doesn't fit grows the ring.
+    static SharedPtr create(size_t capacity, Resource::BindFlags bindFlags = Resource::BindFlags::ShaderResource | Resource::BindFlags::IndirectArg);
+    ~UploadRing();
+
+    // Call once per frame before the first allocation. Releases the space of the frame kFramesInFlight frames ago.
+    void beginFrame();
+
+    // alignment must be a power of two
+    Allocation allocate(size_t size, size_t alignment = kDefaultAlignment);
+
+    template<typename T>
+    T* allocate(uint32_t count, Allocation& allocation)
+    {
+        allocation = allocate(sizeof(T) * count, alignof(T) > kDefaultAlignment ? alignof(T) : kDefaultAlignment);
+        return (T*)allocation.pData;
+    }
+
+    const Buffer::SharedPtr& getBuffer() const { return mpBuffer; }
+    size_t getCapacity() const { return mCapacity; }
+    const FrameStats& getFrameStats() const { return mFrameStats; }    // Of the current frame so far
+
+private:
+    UploadRing() = default;
+    void createBuffer(size_t capacity);
+
+    struct RetiredBuffer
+    {
+        Buffer::SharedPtr pBuffer;
+        uint64_t retireFrame;
+    };
+
+    Resource::BindFlags mBindFlags;
+    Buffer::SharedPtr mpBuffer;
+    uint8_t* mpData = nullptr;
+    size_t mCapacity = 0;
+
+    // Positions count bytes since the buffer was created and wrap modulo the capacity
+    uint64_t mHead = 0;
+    uint64_t mTail = 0;
+    uint64_t mFrameStarts[kFramesInFlight] = {};
+    uint64_t mFrameIndex = 0;
+
+    std::vector<RetiredBuffer> mRetiredBuffers;    // Outgrown buffers, still read by frames in flight
+    FrameStats mFrameStats;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Falcor.h"
+
+using namespace Falcor;
+
+// Vertex encodings of GeometryPool::Flags::QuantizeVertices. The decodes mirror the input assembler's format conversions and
+// BindlessVS.slang with QUANTIZED_VERTICES, so the CPU can check what the GPU will see.
+namespace VertexQuantization
+{
+    inline uint16_t encodeUnorm16(float value)
+    {
+        return (uint16_t)std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f);
+    }
+
+    inline float decodeUnorm16(uint16_t value)
+    {
+        return value / 65535.0f;
+    }
+
+    inline int16_t encodeSnorm16(float value)
+    {
+        return (int16_t)std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+    }
+
+    inline float decodeSnorm16(int16_t value)
+    {
+        return std::max(value / 32767.0f, -1.0f);
+    }
+
+    // Round to nearest even, out of range values become infinity
+    inline uint16_t encodeHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        const uint32_t exponent = (bits >> 23) & 0xff;
+        uint32_t mantissa = bits & 0x7fffff;
+        if (exponent == 0xff) return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+        const int32_t halfExponent = (int32_t)exponent - 127 + 15;
+        if (halfExponent >= 31) return (uint16_t)(sign | 0x7c00);
+
+        // Denormals shift the implicit one into the mantissa
+        uint32_t shift = 13;
+        uint32_t half = sign | ((uint32_t)std::max(halfExponent, 0) << 10);
+        if (halfExponent <= 0)
+        {
+            if (halfExponent < -10) return (uint16_t)sign;
+            mantissa |= 0x800000;
+            shift = 14 - halfExponent;
+        }
+        half |= mantissa >> shift;
+
+        // A carry out of the mantissa correctly rounds up into the exponent
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+        return (uint16_t)half;
+    }
+
+    inline float decodeHalf(uint16_t value)
+    {
+        const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+        const uint32_t exponent = (value >> 10) & 0x1f;
+        const uint32_t mantissa = value & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0)
+        {
+            const float denormal = mantissa * (1.0f / (1 << 24));
+            return sign ? -denormal : denormal;
+        }
+        else if (exponent == 31)
+        {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    // Position relative to its mesh's bounds, decoded as unorm * scale + offset. The fourth component decodes to 1.
+    inline void encodePosition(const glm::vec3& position, const glm::vec3& scale, const glm::vec3& offset, uint16_t* pDst)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            pDst[i] = scale[i] > 0 ? encodeUnorm16((position[i] - offset[i]) / scale[i]) : 0;
+        }
+        pDst[3] = 0xffff;
+    }
+
+    inline glm::vec3 decodePosition(const uint16_t* pSrc, const glm::vec3& scale, const glm::vec3& offset)
+    {
+        return glm::vec3(decodeUnorm16(pSrc[0]), decodeUnorm16(pSrc[1]), decodeUnorm16(pSrc[2])) * scale + offset;
+    }
+
+    // Direction projected onto the octahedron |x| + |y| + |z| = 1, with the lower half folded over the upper one
+    inline void encodeOctahedral(const glm::vec3& direction, int16_t* pDst)
+    {
+        const float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+        float x = length > 0 ? direction.x / length : 0.0f;
+        float y = length > 0 ? direction.y / length : 0.0f;
+        if (direction.z < 0)
+        {
+            const float foldedX = (1.0f - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+            y = (1.0f - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+            x = foldedX;
+        }
+        pDst[0] = encodeSnorm16(x);
+        pDst[1] = encodeSnorm16(y);
+    }
+
+    inline glm::vec3 decodeOctahedral(const int16_t* pSrc)
+    {
+        glm::vec3 direction(decodeSnorm16(pSrc[0]), decodeSnorm16(pSrc[1]), 0.0f);
+        direction.z = 1.0f - std::abs(direction.x) - std::abs(direction.y);
+        if (direction.z < 0)
+        {
+            const float unfoldedX = (1.0f - std::abs(direction.y)) * (direction.x >= 0 ? 1.0f : -1.0f);
+            direction.y = (1.0f - std::abs(direction.x)) * (direction.y >= 0 ? 1.0f : -1.0f);
+            direction.x = unfoldedX;
+        }
+        return glm::normalize(direction);
+    }
+}